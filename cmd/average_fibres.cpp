@@ -32,6 +32,7 @@
 #include "bts/fibre/tractlet/set.h"
 
 #include "bts/fibre/base/writer.h"
+#include "bts/fibre/base/set_pipeline.h"
 
 #include "bts/image/expected/buffer.h"
 
@@ -43,9 +44,75 @@ const double MIN_ACS_DEFAULT = 0.001;
 
 template<typename T> void average_fibres(const std::string& input_location,
                                          const std::string& output_location,
-                                         const std::vector<size_t>& include, double min_acs);
+                                         const std::vector<size_t>& include, double min_acs,
+                                         size_t num_threads);
 
 template<typename T> double acs(const T& fibre);
+
+// Calculates the acs of each element in the worker threads and adds the included sets to the running sums in sample
+// order.
+template<typename T> class AverageStage: public Fibre::Base::SetPipeline<typename T::Set,
+        std::vector<double> >::Stage {
+        
+    protected:
+        
+        const std::vector<size_t>& include;
+        std::vector<size_t>& includes_not_found;
+        typename T::Set& avg_fibres;
+        std::vector<double>& avg_acss;
+
+    public:
+        
+        AverageStage(const std::vector<size_t>& include, std::vector<size_t>& includes_not_found,
+                     typename T::Set& avg_fibres, std::vector<double>& avg_acss)
+                : include(include), includes_not_found(includes_not_found), avg_fibres(avg_fibres), avg_acss(
+                          avg_acss) {
+        }
+        
+        void process(typename T::Set& fibres, std::vector<double>& acss, size_t set_i) {
+            
+            acss.resize(fibres.size());
+            
+            for (size_t elem_i = 0; elem_i < fibres.size(); ++elem_i)
+                acss[elem_i] = acs(fibres[elem_i]);
+            
+        }
+        
+        void write(typename T::Set& fibres, std::vector<double>& acss, size_t set_i) {
+            
+            //Check to see if current set is listed in included list.
+            std::vector<size_t>::iterator include_it = find(includes_not_found.begin(),
+                    includes_not_found.end(), set_i);
+            
+            bool include_set = true;
+            
+            if (include.size()) {
+                if (include_it == includes_not_found.end())
+                    include_set = false;
+                else
+                    //Remove matched include from list.
+                    includes_not_found.erase(include_it);
+            }
+            
+            if (include_set) {
+                
+                if (fibres.size() != avg_fibres.size())
+                    throw Exception(
+                            "Size of set " + str(set_i) + " (" + str(fibres.size())
+                            + ") does not match that of initial set (" + str(avg_fibres.size())
+                            + ").");
+                
+                avg_fibres += fibres;
+                
+                for (size_t elem_i = 0; elem_i < fibres.size(); ++elem_i)
+                    avg_acss[elem_i] += acss[elem_i];
+                
+            }
+            
+        }
+        
+};
+
 SET_VERSION_DEFAULT
 ;
 SET_AUTHOR("Thomas G. Close");
@@ -71,6 +138,9 @@ OPTIONS= {
     Option ("min_acs","Minimum area of tractlet to include")
     + Argument ("include","").type_float (0,LARGE_FLOAT, MIN_ACS_DEFAULT),
 
+    Option ("num_threads", "The number of worker threads the samples are processed in, while another thread reads ahead.")
+    + Argument ("num_threads", "").type_integer (1, 1, LARGE_INT),
+
     Option()};
 
 EXECUTE {
@@ -85,6 +155,12 @@ EXECUTE {
         if (opt.size())
             include = parse_sequence<size_t>(opt[0][0]);
         
+        size_t num_threads = 1;
+        
+        opt = get_options("num_threads");
+        if (opt.size())
+            num_threads = opt[0][0];
+        
         if (File::has_extension<Fibre::Strand::Set>(input_location)) {
             
             if (get_options("min_acs").size())
@@ -106,11 +182,13 @@ EXECUTE {
         
         if (File::has_extension<Fibre::Strand::Set>(input_location)) {
             
-            average_fibres<Fibre::Strand>(input_location, output_location, include, min_acs);
+            average_fibres<Fibre::Strand>(input_location, output_location, include, min_acs,
+                    num_threads);
             
         } else if (File::has_extension<Fibre::Tractlet::Set>(input_location)) {
             
-            average_fibres<Fibre::Tractlet>(input_location, output_location, include, min_acs);
+            average_fibres<Fibre::Tractlet>(input_location, output_location, include, min_acs,
+                    num_threads);
             
         } else
             throw Exception("Unsupported extension of file '" + input_location + "'.");
@@ -119,14 +197,15 @@ EXECUTE {
     
     template<typename T> void average_fibres(const std::string& input_location,
                                              const std::string& output_location,
-                                             const std::vector<size_t>& include, double min_acs) {
+                                             const std::vector<size_t>& include, double min_acs,
+                                             size_t num_threads) {
         
         if (!File::has_extension<T>(output_location))
             throw Exception(
                     "Mismatching extension of output location '" + output_location + "' for input '"
                     + input_location + "'.");
         
-        typename T::Set fibres, avg_fibres;
+        typename T::Set avg_fibres;
         
         typename T::Set::Reader reader(input_location);
         
@@ -141,47 +220,16 @@ EXECUTE {
         
         std::vector<double> avg_acss(avg_fibres.size());
         
-        //Variables to loop through tract sets with.
-        size_t set_i = 0;
         std::vector<size_t> includes_not_found = include;
         
         MR::ProgressBar avg_progress_bar("Generating average set...", set_count);
         
-        while (reader.next(fibres)) {
-            
-            //Check to see if current set is listed in included list.
-            std::vector<size_t>::iterator include_it = find(includes_not_found.begin(),
-                    includes_not_found.end(), set_i);
-            
-            bool include_set = true;
-            
-            if (include.size()) {
-                if (include_it == includes_not_found.end())
-                    include_set = false;
-                else
-                    //Remove matched include from list.
-                    includes_not_found.erase(include_it);
-            }
-            
-            if (include_set) {
-                
-                if (fibres.size() != avg_fibres.size())
-                    throw Exception(
-                            "Size of set " + str(set_i) + " (" + str(fibres.size())
-                            + ") does not match that of initial set (" + str(avg_fibres.size())
-                            + ").");
-                
-                avg_fibres += fibres;
-                
-                for (size_t elem_i = 0; elem_i < fibres.size(); ++elem_i)
-                    avg_acss[elem_i] += acs(fibres[elem_i]);
-                
-            }
-            
-            ++set_i;
-            ++avg_progress_bar;
-            
-        }
+        AverageStage<T> stage(include, includes_not_found, avg_fibres, avg_acss);
+        
+        Fibre::Base::SetPipeline<typename T::Set, std::vector<double> > pipeline(reader, stage,
+                num_threads);
+        
+        size_t set_i = pipeline.run(&avg_progress_bar);
         
         if (includes_not_found.size() != 0)
             throw Exception(
@@ -0,0 +1,704 @@
+/*
+ Copyright 2009 Brain Research Institute, Melbourne, Australia
+
+ Created by Tom Close on 13/03/09.
+
+ This file is part of Fourier Tract Sampling (FouTS).
+
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+extern "C" {
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
+}
+
+#include <algorithm>
+#include <fstream>
+
+#include "bts/cmd.h"
+
+#include "math/matrix.h"
+
+#include "bts/common.h"
+
+#include "bts/fibre/tractlet/set.h"
+#include "bts/fibre/tractlet/set/tensor.h"
+#include "bts/fibre/tractlet/set/walker.h"
+
+#include "bts/diffusion/model.h"
+#include "bts/image/observed/buffer.h"
+#include "bts/image/expected/buffer.h"
+#include "bts/image/noise.h"
+
+#include "bts/prob/prior.h"
+#include "bts/prob/likelihood.h"
+
+#include "bts/mcmc/proposal/distribution.h"
+#include "bts/mcmc/proposal/momentum.h"
+#include "bts/mcmc/hamiltonian.h"
+
+#include "bts/utilities/timer.h"
+
+#include "bts/inline_functions.h"
+
+const char* KERNELS_DEFAULT = "trilinear,gaussian,sinc,quartic,top_hat,reverse_sqrt,realistic";
+const char* LIKELIHOODS_DEFAULT = "gaussian,rician";
+const char* NUM_FIBRES_DEFAULT = "1,4,16";
+const char* DEGREES_DEFAULT = "3,5";
+const char* IMG_SIZES_DEFAULT = "3,6,12";
+const size_t NUM_REPEATS_DEFAULT = 5;
+const double WALK_STEP_SCALE_DEFAULT = 0.001;
+const double MOMEN_STEP_SCALE_DEFAULT = 0.001;
+
+using namespace FTS;
+SET_VERSION_DEFAULT
+;
+SET_AUTHOR("Thomas G. Close");
+SET_COPYRIGHT(NULL);
+
+DESCRIPTION = {
+    "Times the expected image kernels, the likelihoods (and their gradient and Fisher information) and single "
+    "Metropolis and Hamiltonian iterations over synthetic tractlet sets, and saves the timings as JSON.",
+    "Every combination of the kernels, numbers of fibres, degrees, image sizes and numbers of encodings is timed, "
+    "with the likelihood benchmarks repeated for each of the likelihoods. The observed image of each combination is "
+    "generated (with Rician noise at the assumed SNR) from a second synthetic set. Benchmarks that a likelihood doesn't "
+    "support (e.g. the Fisher information of the Rician likelihood) are saved with an 'error' field in place of the "
+    "timings.",
+    NULL
+};
+
+ARGUMENTS= {
+    Argument ("output", "The location the JSON timings will be saved to.").type_file (),
+    Argument()
+};
+
+OPTIONS= {
+
+    Option ("kernels", "A comma-separated list of the expected image kernels to time.")
+    + Argument ("kernels", "").type_text (KERNELS_DEFAULT),
+
+    Option ("likelihoods", "A comma-separated list of the likelihoods to time (overrides '-like_type').")
+    + Argument ("likelihoods", "").type_text (LIKELIHOODS_DEFAULT),
+
+    Option ("num_fibres", "A comma-separated list of the sizes of the synthetic tractlet sets.")
+    + Argument ("num_fibres", "").type_text (NUM_FIBRES_DEFAULT),
+
+    Option ("degrees", "A comma-separated list of the degrees of the synthetic tractlets.")
+    + Argument ("degrees", "").type_text (DEGREES_DEFAULT),
+
+    Option ("img_sizes", "A comma-separated list of the dimensions of the (cubic) synthetic images.")
+    + Argument ("img_sizes", "").type_text (IMG_SIZES_DEFAULT),
+
+    Option ("num_encodings", "A comma-separated list of the number of encodings to use, taken from the start of the "
+            "encoding scheme (defaults to the full scheme).")
+    + Argument ("num_encodings", "").type_text (),
+
+    Option ("num_repeats", "The number of times each benchmark is repeated (after an untimed warm-up).")
+    + Argument ("num_repeats", "").type_integer (1, NUM_REPEATS_DEFAULT, LARGE_INT),
+
+    Option ("num_leapfrog_steps", "The number of leapfrog steps in each timed Hamiltonian iteration.")
+    + Argument ("num_leapfrog_steps", "").type_integer (1, MCMC::Hamiltonian::NUM_LEAPFROG_STEPS_DEFAULT, LARGE_INT),
+
+    Option ("walk_step_scale", "The step size of the Metropolis walker, applied uniformly to every element.")
+    + Argument ("walk_step_scale", "").type_float (SMALL_FLOAT, WALK_STEP_SCALE_DEFAULT, LARGE_FLOAT),
+
+    Option ("momen_step_scale", "The step size of the Hamiltonian momentum, applied uniformly to every element.")
+    + Argument ("momen_step_scale", "").type_float (SMALL_FLOAT, MOMEN_STEP_SCALE_DEFAULT, LARGE_FLOAT),
+
+    Option ("seed", "The random seed that is passed to the random generator")
+    + Argument ("seed", ""),
+
+    DIFFUSION_PARAMETERS,
+
+    EXPECTED_IMAGE_PARAMETERS,
+
+    LIKELIHOOD_PARAMETERS,
+
+    PRIOR_PARAMETERS,
+
+    PROPOSAL_DISTRIBUTION_PARAMETERS,
+
+    COMMON_PARAMETERS,
+
+    Option()};
+
+Fibre::Tractlet::Set synthetic_tractlets(size_t num_fibres, size_t degree, double extent,
+                                         double base_intensity, gsl_rng* rand_gen);
+
+MR::Math::Matrix<double> first_encodings(const MR::Math::Matrix<double>& encodings,
+                                         size_t num_encodings);
+
+void copy_image(Image::Expected::Buffer& image, Image::Observed::Buffer& obs_image);
+
+std::string json_str(const std::string& s);
+
+std::string json_result(const std::string& config, const std::string& benchmark,
+                        std::vector<double> times);
+
+std::string json_error(const std::string& config, const std::string& benchmark, const Exception& e);
+
+EXECUTE {
+    
+        std::string output_location = argument[0];
+        
+        std::vector<std::string> kernels = MR::split(KERNELS_DEFAULT, ",");
+        std::vector<std::string> likelihoods = MR::split(LIKELIHOODS_DEFAULT, ",");
+        std::vector<int> num_fibres = MR::parse_ints(NUM_FIBRES_DEFAULT);
+        std::vector<int> degrees = MR::parse_ints(DEGREES_DEFAULT);
+        std::vector<int> img_sizes = MR::parse_ints(IMG_SIZES_DEFAULT);
+        std::vector<int> num_encodings;
+        size_t num_repeats = NUM_REPEATS_DEFAULT;
+        size_t num_leapfrog_steps = MCMC::Hamiltonian::NUM_LEAPFROG_STEPS_DEFAULT;
+        double walk_step_scale = WALK_STEP_SCALE_DEFAULT;
+        double momen_step_scale = MOMEN_STEP_SCALE_DEFAULT;
+        size_t seed = time(0);
+        
+        Options opt = get_options("kernels");
+        if (opt.size())
+            kernels = MR::split(opt[0][0], ",");
+        
+        opt = get_options("likelihoods");
+        if (opt.size())
+            likelihoods = MR::split(opt[0][0], ",");
+        
+        opt = get_options("num_fibres");
+        if (opt.size())
+            num_fibres = MR::parse_ints(opt[0][0]);
+        
+        opt = get_options("degrees");
+        if (opt.size())
+            degrees = MR::parse_ints(opt[0][0]);
+        
+        opt = get_options("img_sizes");
+        if (opt.size())
+            img_sizes = MR::parse_ints(opt[0][0]);
+        
+        opt = get_options("num_encodings");
+        if (opt.size())
+            num_encodings = MR::parse_ints(opt[0][0]);
+        
+        opt = get_options("num_repeats");
+        if (opt.size())
+            num_repeats = opt[0][0];
+        
+        opt = get_options("num_leapfrog_steps");
+        if (opt.size())
+            num_leapfrog_steps = opt[0][0];
+        
+        opt = get_options("walk_step_scale");
+        if (opt.size())
+            walk_step_scale = opt[0][0];
+        
+        opt = get_options("momen_step_scale");
+        if (opt.size())
+            momen_step_scale = opt[0][0];
+        
+        opt = get_options("seed");
+        if (opt.size()) {
+            std::string seed_str = opt[0][0];
+            seed = to<size_t>(seed_str);
+        }
+        
+        // Loads parameters to construct Diffusion::Model ('diff_' prefix)
+        SET_DIFFUSION_PARAMETERS;
+        
+        // Loads parameters to construct Image::Expected::*::Buffer ('exp_' prefix)
+        SET_EXPECTED_IMAGE_PARAMETERS
+        ;
+        
+        // Loads parameters to construct Prob::Likelihood ('like_' prefix)
+        SET_LIKELIHOOD_PARAMETERS
+        ;
+        
+        // Loads parameters to construct Prob::Prior ('prior_' prefix)
+        SET_PRIOR_PARAMETERS
+        ;
+        
+        // Loads parameters to construct Proposal::Distribution ('prop_' prefix)
+        SET_PROPOSAL_DISTRIBUTION_PARAMETERS;
+        
+        // Loads parameters that are common to all commands.
+        SET_COMMON_PARAMETERS;
+        
+        // The Rician likelihood requires the bounds of the expected image to be enforced and the isotropic components
+        // to be included in the diffusion model.
+        exp_enforce_bounds = true;
+        
+        if (std::find(likelihoods.begin(), likelihoods.end(), "rician") != likelihoods.end())
+            diff_isotropic = true;
+        
+        if (!num_encodings.size())
+            num_encodings.push_back(diff_encodings.rows());
+        
+        if (!exp_base_intensity)
+            exp_base_intensity = 1.0;
+        
+        gsl_rng* rand_gen = gsl_rng_alloc(gsl_rng_taus);
+        gsl_rng_set(rand_gen, seed);
+        
+        MCMC::Proposal::Distribution* proposal_distribution = MCMC::Proposal::Distribution::factory(
+                prop_distr_type, rand_gen);
+        
+        std::map<std::string, std::string> properties;
+        
+        properties["method"] = "bench_fouts";
+        properties["seed"] = str(seed);
+        properties["num_repeats"] = str(num_repeats);
+        properties["num_leapfrog_steps"] = str(num_leapfrog_steps);
+        properties["walk_step_scale"] = str(walk_step_scale);
+        properties["momen_step_scale"] = str(momen_step_scale);
+        properties["img_vox_lengths"] = str(Image::Expected::Buffer::VOX_LENGTHS_DEFAULT);
+        
+        ADD_DIFFUSION_PROPERTIES(properties);
+        
+        ADD_EXPECTED_IMAGE_PROPERTIES(properties);
+        
+        ADD_LIKELIHOOD_PROPERTIES(properties);
+        
+        ADD_PRIOR_PROPERTIES(properties);
+        
+        ADD_PROPOSAL_DISTRIBUTION_PROPERTIES(properties);
+        
+        ADD_COMMON_PROPERTIES(properties);
+        
+        std::vector<std::string> results;
+        
+        size_t num_configs = kernels.size() * num_fibres.size() * degrees.size() * img_sizes.size()
+                             * num_encodings.size();
+        
+        MR::ProgressBar progress_bar("Running benchmarks...", num_configs);
+        
+        for (size_t encodings_i = 0; encodings_i < num_encodings.size(); ++encodings_i) {
+            
+            Diffusion::Model diffusion_model = Diffusion::Model::factory(
+                    first_encodings(diff_encodings, num_encodings[encodings_i]), diff_response_SH,
+                    diff_adc, diff_fa, diff_isotropic, diff_warn_b_mismatch);
+            
+            for (size_t size_i = 0; size_i < img_sizes.size(); ++size_i) {
+                
+                Triple<size_t> img_dims(img_sizes[size_i], img_sizes[size_i], img_sizes[size_i]);
+                Triple<double> img_vox_lengths = Image::Expected::Buffer::VOX_LENGTHS_DEFAULT;
+                Triple<double> img_offsets = Image::Observed::Buffer::default_corner_offset(img_dims,
+                        img_vox_lengths);
+                
+                double extent = img_vox_lengths[X] * img_sizes[size_i];
+                
+                for (size_t fibres_i = 0; fibres_i < num_fibres.size(); ++fibres_i) {
+                    
+                    for (size_t degree_i = 0; degree_i < degrees.size(); ++degree_i) {
+                        
+                        Fibre::Tractlet::Set tractlets = synthetic_tractlets(num_fibres[fibres_i],
+                                degrees[degree_i], extent, exp_base_intensity, rand_gen);
+                        
+                        Fibre::Tractlet::Set truth = synthetic_tractlets(num_fibres[fibres_i],
+                                degrees[degree_i], extent, exp_base_intensity, rand_gen);
+                        
+                        for (size_t kernel_i = 0; kernel_i < kernels.size(); ++kernel_i) {
+                            
+                            std::string config = "\"kernel\": " + json_str(kernels[kernel_i])
+                                                 + ", \"num_fibres\": " + str(num_fibres[fibres_i])
+                                                 + ", \"degree\": " + str(degrees[degree_i])
+                                                 + ", \"img_size\": " + str(img_sizes[size_i])
+                                                 + ", \"num_encodings\": "
+                                                 + str(num_encodings[encodings_i]);
+                            
+                            Image::Expected::Buffer* exp_image = Image::Expected::Buffer::factory(
+                                    kernels[kernel_i], img_dims, img_vox_lengths, diffusion_model,
+                                    exp_num_length_sections, exp_num_width_sections,
+                                    exp_interp_extent, img_offsets, exp_enforce_bounds,
+                                    exp_half_width, exp_num_threads, exp_interp_table);
+                            
+                            //-------------------------//
+                            //  Time expected images   //
+                            //-------------------------//
+                            
+                            std::vector<double> times;
+                            
+                            exp_image->expected_image(tractlets);
+                            
+                            for (size_t repeat_i = 0; repeat_i < num_repeats; ++repeat_i) {
+                                double start = Utilities::monotonic_seconds();
+                                exp_image->expected_image(tractlets);
+                                times.push_back(Utilities::monotonic_seconds() - start);
+                            }
+                            
+                            results.push_back(json_result(config, "expected_image", times));
+                            
+                            //-------------------------------------//
+                            //  Generate the noisy observed image  //
+                            //-------------------------------------//
+                            
+                            exp_image->expected_image(truth);
+                            
+                            Image::Noise* noise = Image::Noise::factory(rand_gen, "rician", like_snr,
+                                    exp_image->max_b0());
+                            noise->noisify(*exp_image);
+                            delete noise;
+                            
+                            Image::Observed::Buffer obs_image(img_dims, img_vox_lengths, img_offsets,
+                                    Diffusion::Encoding::Set(
+                                            first_encodings(diff_encodings,
+                                                    num_encodings[encodings_i])));
+                            
+                            copy_image(*exp_image, obs_image);
+                            
+                            Prob::Prior prior(prior_scale, prior_freq_scale, prior_freq_aux_scale,
+                                    prior_hook_scale, prior_hook_num_points,
+                                    prior_hook_num_width_sections, prior_density_high_scale,
+                                    prior_density_low_scale, prior_density_num_points,
+                                    prior_acs_scale, prior_acs_mean, prior_length_scale,
+                                    prior_length_mean, prior_in_image_scale, prior_in_image_power,
+                                    Prob::PriorComponent::InImage::get_offset(obs_image,
+                                            prior_in_image_border),
+                                    Prob::PriorComponent::InImage::get_extent(obs_image,
+                                            prior_in_image_border),
+                                    prior_in_image_num_length_sections,
+                                    prior_in_image_num_width_sections);
+                            
+                            for (size_t like_i = 0; like_i < likelihoods.size(); ++like_i) {
+                                
+                                std::string like_config = config + ", \"likelihood\": "
+                                                          + json_str(likelihoods[like_i]);
+                                
+                                Prob::Likelihood* likelihood = Prob::Likelihood::factory(
+                                        likelihoods[like_i], obs_image, exp_image, like_snr,
+                                        like_b0_include, like_outside_scale, like_ref_b0,
+                                        like_ref_signal, like_noise_map);
+                                
+                                Fibre::Tractlet::Set gradient(tractlets);
+                                gradient.zero();
+                                
+                                Fibre::Tractlet::Set::Tensor fisher(tractlets);
+                                fisher.zero();
+                                
+                                //-----------------------//
+                                //  Time the likelihood  //
+                                //-----------------------//
+                                
+                                times.clear();
+                                
+                                likelihood->log_prob(tractlets);
+                                
+                                for (size_t repeat_i = 0; repeat_i < num_repeats; ++repeat_i) {
+                                    double start = Utilities::monotonic_seconds();
+                                    likelihood->log_prob(tractlets);
+                                    times.push_back(Utilities::monotonic_seconds() - start);
+                                }
+                                
+                                results.push_back(json_result(like_config, "likelihood", times));
+                                
+                                times.clear();
+                                
+                                likelihood->log_prob(tractlets, gradient);
+                                
+                                for (size_t repeat_i = 0; repeat_i < num_repeats; ++repeat_i) {
+                                    double start = Utilities::monotonic_seconds();
+                                    likelihood->log_prob(tractlets, gradient);
+                                    times.push_back(Utilities::monotonic_seconds() - start);
+                                }
+                                
+                                results.push_back(
+                                        json_result(like_config, "likelihood_gradient", times));
+                                
+                                // Not all likelihoods provide the Fisher information (e.g. Rician), in which case the
+                                // error is recorded in place of the timings.
+                                times.clear();
+                                
+                                try {
+                                    
+                                    likelihood->log_prob_and_fisher(tractlets, gradient, fisher);
+                                    
+                                    for (size_t repeat_i = 0; repeat_i < num_repeats; ++repeat_i) {
+                                        double start = Utilities::monotonic_seconds();
+                                        likelihood->log_prob_and_fisher(tractlets, gradient, fisher);
+                                        times.push_back(Utilities::monotonic_seconds() - start);
+                                    }
+                                    
+                                    results.push_back(
+                                            json_result(like_config, "likelihood_fisher", times));
+                                    
+                                } catch (const Exception& e) {
+                                    results.push_back(json_error(like_config, "likelihood_fisher", e));
+                                }
+                                
+                                //------------------------------------//
+                                //  Time a Metropolis-Hastings step   //
+                                //------------------------------------//
+                                
+                                Fibre::Tractlet::Set::Walker* walker =
+                                        Fibre::Tractlet::Set::Walker::factory(tractlets, "standard",
+                                                walk_step_scale, "", proposal_distribution, 0.0);
+                                
+                                Fibre::Tractlet::Set x(tractlets), prop_x(tractlets);
+                                
+                                double px = prior.log_prob(x) + likelihood->log_prob(x);
+                                
+                                times.clear();
+                                
+                                for (size_t repeat_i = 0; repeat_i <= num_repeats; ++repeat_i) {
+                                    
+                                    double start = Utilities::monotonic_seconds();
+                                    
+                                    walker->step(x, prop_x);
+                                    
+                                    double prop_px = prior.log_prob(prop_x)
+                                                     + likelihood->log_prob(prop_x);
+                                    
+                                    if (prop_px > px
+                                        || log(gsl_rng_uniform(rand_gen)) < prop_px - px) {
+                                        x = prop_x;
+                                        px = prop_px;
+                                    }
+                                    
+                                    // The first iteration is the warm-up.
+                                    if (repeat_i)
+                                        times.push_back(Utilities::monotonic_seconds() - start);
+                                    
+                                }
+                                
+                                results.push_back(
+                                        json_result(like_config, "metropolis_iteration", times));
+                                
+                                delete walker;
+                                
+                                //------------------------------------//
+                                //  Time a Hamiltonian trajectory     //
+                                //------------------------------------//
+                                
+                                MR::Math::Vector<double> momen_step(tractlets.vsize());
+                                momen_step = momen_step_scale;
+                                
+                                MCMC::Proposal::Momentum momentum(proposal_distribution, momen_step);
+                                
+                                Fibre::Tractlet::Set prior_gradient(tractlets),
+                                        likelihood_gradient(tractlets);
+                                
+                                times.clear();
+                                
+                                for (size_t repeat_i = 0; repeat_i <= num_repeats; ++repeat_i) {
+                                    
+                                    double start = Utilities::monotonic_seconds();
+                                    
+                                    prop_x = tractlets;
+                                    
+                                    double prop_px = prior.log_prob(prop_x, prior_gradient);
+                                    prop_px += likelihood->log_prob(prop_x, likelihood_gradient);
+                                    gradient = prior_gradient + likelihood_gradient;
+                                    
+                                    momentum.randomize();
+                                    
+                                    for (size_t leapfrog_i = 0; leapfrog_i < num_leapfrog_steps;
+                                            ++leapfrog_i) {
+                                        
+                                        momentum.half_update_momentum(gradient);
+                                        momentum.update_state(prop_x);
+                                        
+                                        prop_px = prior.log_prob(prop_x, prior_gradient);
+                                        prop_px += likelihood->log_prob(prop_x, likelihood_gradient);
+                                        gradient = prior_gradient + likelihood_gradient;
+                                        
+                                        momentum.half_update_momentum(gradient);
+                                        
+                                    }
+                                    
+                                    // The first iteration is the warm-up.
+                                    if (repeat_i)
+                                        times.push_back(Utilities::monotonic_seconds() - start);
+                                    
+                                }
+                                
+                                results.push_back(
+                                        json_result(like_config, "hamiltonian_iteration", times));
+                                
+                                delete likelihood;
+                                
+                            }
+                            
+                            delete exp_image;
+                            
+                            ++progress_bar;
+                            
+                        }
+                        
+                    }
+                    
+                }
+                
+            }
+            
+        }
+        
+        //--------------------//
+        //  Save the results  //
+        //--------------------//
+        
+        std::ofstream out(output_location.c_str());
+        
+        if (!out)
+            throw Exception("Could not open output file '" + output_location + "'.");
+        
+        out << "{" << std::endl;
+        out << "  \"software_version\": " << json_str(version_number_string()) << "," << std::endl;
+        out << "  \"datetime\": " << json_str(current_datetime()) << "," << std::endl;
+        out << "  \"properties\": {";
+        
+        for (std::map<std::string, std::string>::iterator prop_it = properties.begin();
+                prop_it != properties.end(); ++prop_it) {
+            if (prop_it != properties.begin())
+                out << ",";
+            out << std::endl << "    " << json_str(prop_it->first) << ": "
+                << json_str(prop_it->second);
+        }
+        
+        out << std::endl << "  }," << std::endl;
+        out << "  \"results\": [";
+        
+        for (size_t result_i = 0; result_i < results.size(); ++result_i) {
+            if (result_i)
+                out << ",";
+            out << std::endl << "    " << results[result_i];
+        }
+        
+        out << std::endl << "  ]" << std::endl << "}" << std::endl;
+        
+        delete proposal_distribution;
+        gsl_rng_free(rand_gen);
+        
+    }
+    
+    //Randomly generates a set of tractlets within a cube of side length 'extent' centred on the origin.
+    Fibre::Tractlet::Set synthetic_tractlets(size_t num_fibres, size_t degree, double extent,
+                                             double base_intensity, gsl_rng* rand_gen) {
+        
+        std::vector<const char*> props;
+        props.push_back(Fibre::Tractlet::Set::BASE_INTENSITY_PROP);
+        
+        std::vector<const char*> elem_props;
+        elem_props.push_back(Fibre::Base::Object::ALPHA_PROP);
+        
+        Fibre::Tractlet::Set tractlets(num_fibres, degree, props, elem_props);
+        tractlets.zero();
+        tractlets.set_base_intensity(base_intensity);
+        
+        for (size_t tractlet_i = 0; tractlet_i < tractlets.size(); ++tractlet_i) {
+            
+            Triple<double> centre, orient;
+            
+            for (size_t dim_i = 0; dim_i < 3; ++dim_i) {
+                centre[dim_i] = gsl_ran_flat(rand_gen, -extent / 4.0, extent / 4.0);
+                orient[dim_i] = gsl_ran_gaussian(rand_gen, extent / 4.0);
+            }
+            
+            tractlets[tractlet_i][0][0] = centre;
+            tractlets[tractlet_i][0][1] = orient;
+            
+            if (degree > 2)
+                for (size_t dim_i = 0; dim_i < 3; ++dim_i)
+                    tractlets[tractlet_i][0][2][dim_i] = gsl_ran_gaussian(rand_gen, extent / 20.0);
+            
+            //Get width axes perpendicular to the main orientation and each other.
+            Triple<double> ax1 = orient.cross(orient.min_axis()).normalise();
+            Triple<double> ax2 = orient.cross(ax1).normalise();
+            
+            tractlets[tractlet_i][1][0] = ax1 * (extent / 10.0);
+            tractlets[tractlet_i][2][0] = ax2 * (extent / 10.0);
+            
+            tractlets[tractlet_i].normalise_density();
+            
+        }
+        
+        return tractlets;
+        
+    }
+    
+    MR::Math::Matrix<double> first_encodings(const MR::Math::Matrix<double>& encodings,
+                                             size_t num_encodings) {
+        
+        if (num_encodings > encodings.rows())
+            throw Exception(
+                    "Number of encodings requested (" + str(num_encodings)
+                    + ") is greater than the number in the encoding scheme ("
+                    + str(encodings.rows()) + ").");
+        
+        MR::Math::Matrix<double> first(num_encodings, encodings.columns());
+        
+        for (size_t row_i = 0; row_i < num_encodings; ++row_i)
+            for (size_t col_i = 0; col_i < encodings.columns(); ++col_i)
+                first(row_i, col_i) = encodings(row_i, col_i);
+        
+        return first;
+        
+    }
+    
+    void copy_image(Image::Expected::Buffer& image, Image::Observed::Buffer& obs_image) {
+        
+        for (size_t z = 0; z < image.dim(Z); ++z)
+            for (size_t y = 0; y < image.dim(Y); ++y)
+                for (size_t x = 0; x < image.dim(X); ++x)
+                    for (size_t encode_i = 0; encode_i < image.num_encodings(); ++encode_i)
+                        obs_image(x, y, z)[encode_i] = image(x, y, z)[encode_i];
+        
+    }
+    
+    std::string json_str(const std::string& s) {
+        
+        std::string escaped = "\"";
+        
+        for (size_t char_i = 0; char_i < s.size(); ++char_i) {
+            if (s[char_i] == '"' || s[char_i] == '\\')
+                escaped += '\\';
+            if (s[char_i] == '\n')
+                escaped += "\\n";
+            else if (s[char_i] != '\t' && s[char_i] != '\r')
+                escaped += s[char_i];
+        }
+        
+        return escaped + "\"";
+        
+    }
+    
+    //Formats the timings of a benchmark as a JSON object, where 'config' is the JSON fields of its configuration.
+    std::string json_result(const std::string& config, const std::string& benchmark,
+                            std::vector<double> times) {
+        
+        std::sort(times.begin(), times.end());
+        
+        double total = 0.0;
+        for (size_t time_i = 0; time_i < times.size(); ++time_i)
+            total += times[time_i];
+        
+        double median = times.size() % 2 ? times[times.size() / 2] :
+                                           (times[times.size() / 2 - 1] + times[times.size() / 2])
+                                           / 2.0;
+        
+        return "{\"benchmark\": " + json_str(benchmark) + ", " + config + ", \"num_repeats\": "
+               + str(times.size()) + ", \"min_s\": " + str(times.front()) + ", \"median_s\": "
+               + str(median) + ", \"mean_s\": " + str(total / (double) times.size()) + "}";
+        
+    }
+    
+    //Formats a benchmark that couldn't be run as a JSON object holding the error message(s) instead of timings.
+    std::string json_error(const std::string& config, const std::string& benchmark, const Exception& e) {
+        
+        std::string message;
+        
+        for (size_t desc_i = 0; desc_i < e.num(); ++desc_i)
+            message += (desc_i ? ": " : "") + e[desc_i];
+        
+        return "{\"benchmark\": " + json_str(benchmark) + ", " + config + ", \"error\": "
+               + json_str(message) + "}";
+        
+    }
@@ -196,7 +196,8 @@ EXECUTE {
         Triple<double> offsets(0.0, 0.0, 0.0);
         Image::Expected::Buffer* exp_image = Image::Expected::Buffer::factory(exp_type, dims,
                 vox_lengths, diffusion_model, exp_num_length_sections, exp_num_width_sections,
-                exp_interp_extent, offsets, exp_enforce_bounds, exp_half_width);
+                exp_interp_extent, offsets, exp_enforce_bounds, exp_half_width,
+                exp_num_threads, exp_interp_table);
 
         //------------------------------------------------------------------------------------------
         // Loop through all voxels and calculate the base intensities that would produce the
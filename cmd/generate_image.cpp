@@ -172,7 +172,8 @@ EXECUTE {
         
         Image::Expected::Buffer* image = Image::Expected::Buffer::factory(exp_type, img_dims,
                 img_vox_lengths, diffusion_model, exp_num_length_sections, exp_num_width_sections,
-                exp_interp_extent, img_offsets, exp_enforce_bounds, exp_half_width);
+                exp_interp_extent, img_offsets, exp_enforce_bounds, exp_half_width,
+                exp_num_threads, exp_interp_table);
         
 //-----------------//
 // Generate image //
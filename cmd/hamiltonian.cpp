@@ -63,12 +63,16 @@ extern "C" {
 #include "bts/math/common.h"
 
 #include "bts/mcmc/hamiltonian.h"
+#include "bts/mcmc/nuts.h"
 
 #include "bts/file.h"
 
 #include "bts/inline_functions.h"
 
 using namespace FTS;
+
+const char* HMC_TYPE_DEFAULT = "standard";
+
 SET_VERSION_DEFAULT
 ;
 SET_AUTHOR("Thomas G. Close");
@@ -95,6 +99,9 @@ OPTIONS= {
     Option ("num_samples", "The Number of MCMC iterations to take of the prob distribution over the tractlets")
     + Argument ("num_samples", "").type_integer (1, MCMC::Hamiltonian::NUM_SAMPLES_DEFAULT, LARGE_INT),
 
+    Option ("hmc_type", "The type of Hamiltonian sampler, either 'standard', which takes a fixed number of leapfrog steps per sample, or 'nuts', which extends each trajectory until it doubles back (the No-U-Turn sampler) and adapts the step sizes over the burn-in.")
+    + Argument ("hmc_type", "").type_text (HMC_TYPE_DEFAULT),
+
     Option ("num_leapfrog_steps", "The number of MCMC iterations that will be performed before a sample is saved")
     + Argument ("num_leapfrog_steps", "").type_integer (1, MCMC::Hamiltonian::NUM_LEAPFROG_STEPS_DEFAULT, LARGE_INT),
 
@@ -104,9 +111,15 @@ OPTIONS= {
     Option ("burn_num_leapfrog_steps", "The number of MCMC iterations that will be performed before a sample is saved in the Burn-in.")
     + Argument ("burn_num_leapfrog_steps", "").type_integer (1, MCMC::Hamiltonian::BURN_NUM_LEAPFROG_STEPS_DEFAULT, LARGE_INT),
 
-    Option ("burn_snr", "The Signal-to-noise ratio assumed for the burn-in period.")
+    Option ("burn_snr", "The Signal-to-noise ratio assumed for the burn-in period (by default the '-like_snr' is kept for the 'nuts' sampler, so the step sizes are adapted to the posterior that is sampled).")
     + Argument ("burn_snr", "").type_float (SMALL_FLOAT, MCMC::Hamiltonian::BURN_SNR_DEFAULT, LARGE_FLOAT),
 
+    Option ("max_tree_depth", "The maximum number of trajectory doublings of the 'nuts' sampler (up to 2^max_tree_depth leapfrog steps per sample).")
+    + Argument ("max_tree_depth", "").type_integer (1, MCMC::NUTS::MAX_TREE_DEPTH_DEFAULT, 30),
+
+    Option ("adapt_target", "The mean acceptance probability targeted by the 'nuts' sampler while it adapts its step sizes over the burn-in.")
+    + Argument ("adapt_target", "").type_float (0.0, MCMC::Proposal::Momentum::ADAPT_TARGET_DEFAULT, 1.0),
+
     Option ("seed", "The random seed that is passed to the random generator")
     + Argument ("seed", ""),
 
@@ -156,6 +169,9 @@ EXECUTE {
         size_t burn_num_samples = MCMC::Hamiltonian::BURN_NUM_SAMPLES_DEFAULT;
         size_t burn_num_leapfrog_steps = MCMC::Hamiltonian::BURN_NUM_LEAPFROG_STEPS_DEFAULT;
         double burn_snr = MCMC::Hamiltonian::BURN_SNR_DEFAULT;
+        std::string hmc_type = HMC_TYPE_DEFAULT;
+        size_t max_tree_depth = MCMC::NUTS::MAX_TREE_DEPTH_DEFAULT;
+        double adapt_target = MCMC::Proposal::Momentum::ADAPT_TARGET_DEFAULT;
         size_t seed = time(NULL);
         bool prior_only = false;
         bool save_iterations = true;
@@ -177,9 +193,22 @@ EXECUTE {
             burn_num_leapfrog_steps = opt[0][0];
         
         opt = get_options("burn_snr");
+        bool burn_snr_set = opt.size();
         if (opt.size())
             burn_snr = opt[0][0];
         
+        opt = get_options("hmc_type");
+        if (opt.size())
+            hmc_type = opt[0][0].c_str();
+        
+        opt = get_options("max_tree_depth");
+        if (opt.size())
+            max_tree_depth = opt[0][0];
+        
+        opt = get_options("adapt_target");
+        if (opt.size())
+            adapt_target = opt[0][0];
+        
         opt = get_options("seed");
         if (opt.size()) {
             std::string seed_string = opt[0][0];
@@ -219,6 +248,12 @@ EXECUTE {
         // Loads parameters that are common to all commands.
         SET_COMMON_PARAMETERS;
         
+        if (hmc_type != "standard" && hmc_type != "nuts")
+            throw Exception("Unrecognised Hamiltonian sampler type '" + hmc_type + "'.");
+        
+        if (hmc_type == "nuts" && !burn_snr_set)
+            burn_snr = like_snr;
+        
         //--------------------------------//
         //  Set up reference image buffer //
         //--------------------------------//
@@ -247,7 +282,7 @@ EXECUTE {
         
         Image::Expected::Buffer* exp_image = Image::Expected::Buffer::factory(exp_type, obs_image,
                 diffusion_model, exp_num_length_sections, exp_num_width_sections, exp_interp_extent,
-                exp_enforce_bounds, exp_half_width);
+                exp_enforce_bounds, exp_half_width, exp_num_threads, exp_interp_table);
         
         //-----------------------//
         // Initialize Likelihood //
@@ -273,10 +308,16 @@ EXECUTE {
         std::map<std::string, std::string> run_properties;
         
         run_properties["Method"] = "hamiltonian";
-        run_properties["num_leapfrog_steps"] = str(num_leapfrog_steps);
+        run_properties["hmc_type"] = hmc_type;
+        if (hmc_type == "nuts") {
+            run_properties["max_tree_depth"] = str(max_tree_depth);
+            run_properties["adapt_target"] = str(adapt_target);
+        } else {
+            run_properties["num_leapfrog_steps"] = str(num_leapfrog_steps);
+            run_properties["burn_num_leapfrog_steps"] = str(burn_num_leapfrog_steps);
+        }
         run_properties["seed"] = str(seed);
         run_properties["num_samples"] = str(num_samples);
-        run_properties["burn_num_leapfrog_steps"] = str(burn_num_leapfrog_steps);
         run_properties["burn_num_samples"] = str(burn_num_samples);
         run_properties["burn_snr"] = str(burn_snr);
         run_properties["obs_image"] = obs_image_location;
@@ -344,20 +385,36 @@ EXECUTE {
                 
                 likelihood->set_assumed_snr(burn_snr, like_ref_b0, like_ref_signal);
                 
-                burnt_strands =
-                        MCMC::hamiltonian<Fibre::Strand::Set, Prob::Likelihood, Prob::Prior>(
-                                strands, *likelihood, prior, momentum, burn_samples_location,
-                                run_properties, burn_num_samples, burn_num_leapfrog_steps, rand_gen,
-                                prior_only, save_iterations);
+                if (hmc_type == "nuts") {
+                    
+                    momentum.start_adaptation(adapt_target, burn_num_samples);
+                    
+                    burnt_strands = MCMC::nuts<Fibre::Strand::Set, Prob::Likelihood, Prob::Prior>(
+                            strands, *likelihood, prior, momentum, burn_samples_location,
+                            run_properties, burn_num_samples, max_tree_depth, rand_gen, prior_only);
+                    
+                    momentum.stop_adaptation();
+                    
+                } else
+                    burnt_strands =
+                            MCMC::hamiltonian<Fibre::Strand::Set, Prob::Likelihood, Prob::Prior>(
+                                    strands, *likelihood, prior, momentum, burn_samples_location,
+                                    run_properties, burn_num_samples, burn_num_leapfrog_steps,
+                                    rand_gen, prior_only, save_iterations);
                 
                 likelihood->set_assumed_snr(like_snr, like_ref_b0, like_ref_signal);
                 
             } else
                 burnt_strands = strands;
             
-            MCMC::hamiltonian<Fibre::Strand::Set, Prob::Likelihood, Prob::Prior>(burnt_strands,
-                    *likelihood, prior, momentum, samples_location, run_properties, num_samples,
-                    num_leapfrog_steps, rand_gen, prior_only, save_iterations);
+            if (hmc_type == "nuts")
+                MCMC::nuts<Fibre::Strand::Set, Prob::Likelihood, Prob::Prior>(burnt_strands,
+                        *likelihood, prior, momentum, samples_location, run_properties, num_samples,
+                        max_tree_depth, rand_gen, prior_only);
+            else
+                MCMC::hamiltonian<Fibre::Strand::Set, Prob::Likelihood, Prob::Prior>(burnt_strands,
+                        *likelihood, prior, momentum, samples_location, run_properties, num_samples,
+                        num_leapfrog_steps, rand_gen, prior_only, save_iterations);
             
             //------------------------//
             //  Sampling from Tractlets  //
@@ -392,22 +449,39 @@ EXECUTE {
                 
                 likelihood->set_assumed_snr(burn_snr, like_ref_b0, like_ref_signal);
                 
-                burnt_tractlets = MCMC::hamiltonian<Fibre::Tractlet::Set, Prob::Likelihood,
-                        Prob::Prior>(
-
-                tractlets, *likelihood, prior, momentum, burn_samples_location, run_properties,
-                        burn_num_samples, burn_num_leapfrog_steps, rand_gen, prior_only,
-                        save_iterations);
+                if (hmc_type == "nuts") {
+                    
+                    momentum.start_adaptation(adapt_target, burn_num_samples);
+                    
+                    burnt_tractlets = MCMC::nuts<Fibre::Tractlet::Set, Prob::Likelihood,
+                            Prob::Prior>(tractlets, *likelihood, prior, momentum,
+                            burn_samples_location, run_properties, burn_num_samples, max_tree_depth,
+                            rand_gen, prior_only);
+                    
+                    momentum.stop_adaptation();
+                    
+                } else
+                    burnt_tractlets = MCMC::hamiltonian<Fibre::Tractlet::Set, Prob::Likelihood,
+                            Prob::Prior>(
+
+                    tractlets, *likelihood, prior, momentum, burn_samples_location, run_properties,
+                            burn_num_samples, burn_num_leapfrog_steps, rand_gen, prior_only,
+                            save_iterations);
                 
                 likelihood->set_assumed_snr(like_snr, like_ref_b0, like_ref_signal);
                 
             } else
                 burnt_tractlets = tractlets;
             
-            MCMC::hamiltonian<Fibre::Tractlet::Set, Prob::Likelihood, Prob::Prior>(
-
-            burnt_tractlets, *likelihood, prior, momentum, samples_location, run_properties,
-                    num_samples, num_leapfrog_steps, rand_gen, prior_only, save_iterations);
+            if (hmc_type == "nuts")
+                MCMC::nuts<Fibre::Tractlet::Set, Prob::Likelihood, Prob::Prior>(burnt_tractlets,
+                        *likelihood, prior, momentum, samples_location, run_properties, num_samples,
+                        max_tree_depth, rand_gen, prior_only);
+            else
+                MCMC::hamiltonian<Fibre::Tractlet::Set, Prob::Likelihood, Prob::Prior>(
+
+                burnt_tractlets, *likelihood, prior, momentum, samples_location, run_properties,
+                        num_samples, num_leapfrog_steps, rand_gen, prior_only, save_iterations);
             
         } else
             throw Exception(
@@ -27,10 +27,50 @@
 #include "bts/fibre/tractlet/set.h"
 #include "bts/fibre/strand/set.h"
 #include "bts/fibre/track/set.h"
+#include "bts/fibre/base/set_pipeline.h"
 
 #include "bts/inline_functions.h"
 
 using namespace FTS;
+
+// Sets the mapped bundle indices of each sample in the worker threads and appends them to the output in sample order.
+template<typename S> class MapColoursStage: public Fibre::Base::SetPipeline<S>::Stage {
+        
+    protected:
+        
+        const std::vector<size_t>& bundle_indices;
+        const std::vector<size_t>& reference_match;
+        typename S::Writer& writer;
+
+    public:
+        
+        MapColoursStage(const std::vector<size_t>& bundle_indices,
+                        const std::vector<size_t>& reference_match, typename S::Writer& writer)
+                : bundle_indices(bundle_indices), reference_match(reference_match), writer(writer) {
+        }
+        
+        void process(S& fibres, Fibre::Base::NoResult& result, size_t count) {
+            
+            if (fibres.size() != reference_match.size())
+                throw Exception(
+                        "Size of tractlet set " + str(count) + " (" + str(fibres.size())
+                        + ") does not match that of 'match' set (" + str(reference_match.size())
+                        + ")");
+            
+            fibres.add_extend_elem_prop(Fibre::Track::BUNDLE_INDEX_EPROP, "-1");
+            
+            for (size_t tract_i = 0; tract_i < fibres.size(); ++tract_i)
+                fibres.set_extend_elem_prop(Fibre::Track::BUNDLE_INDEX_EPROP,
+                        str(bundle_indices[reference_match[tract_i]]), tract_i);
+            
+        }
+        
+        void write(S& fibres, Fibre::Base::NoResult& result, size_t count) {
+            writer.append(fibres);
+        }
+        
+};
+
 SET_VERSION_DEFAULT
 ;
 SET_AUTHOR("Thomas G. Close");
@@ -58,6 +98,9 @@ OPTIONS= {
     Option ("degree", "The degree of the Strand coefficients used to describe the strands")
     + Argument ("degree", "").type_integer (1, Fibre::Strand::DEFAULT_DEGREE, LARGE_INT),
 
+    Option ("num_threads", "The number of threads the similarity matrix between the match and reference sets is filled in and the input samples are processed in (while another thread reads ahead).")
+    + Argument ("num_threads", "").type_integer (1, 1, LARGE_INT),
+
     Option()};
 
 EXECUTE {
@@ -82,6 +125,15 @@ EXECUTE {
         if (opt.size())
             degree = opt[0][0];
         
+        size_t num_threads = 1;
+        
+        opt = get_options("num_threads");
+        if (opt.size())
+            num_threads = opt[0][0];
+        
+        Fibre::Strand::Set::set_similarity_num_threads(num_threads);
+        Fibre::Tractlet::Set::set_similarity_num_threads(num_threads);
+        
         //  Options opt = get_options("num_length_sections");
         //  if (opt.size())
         //    num_length_sections = opt[0][0];
@@ -218,28 +270,11 @@ EXECUTE {
                 Fibre::Tractlet::Set::Writer writer(output_location, reader,
                         reader.extend_prop_keys(), elem_header, reader.get_extend_props());
                 
-                Fibre::Tractlet::Set tractlets;
+                MapColoursStage<Fibre::Tractlet::Set> stage(bundle_indices, reference_match, writer);
                 
-                size_t count = 0;
-                while (reader.next(tractlets)) {
-                    
-                    if (tractlets.size() != match.size())
-                        throw Exception(
-                                "Size of tractlet set " + str(count) + " (" + str(tractlets.size())
-                                + ") does not match that of 'match' set (" + str(match.size())
-                                + ")");
-                    
-                    tractlets.add_extend_elem_prop(Fibre::Track::BUNDLE_INDEX_EPROP, "-1");
-                    
-                    for (size_t tract_i = 0; tract_i < tractlets.size(); ++tract_i)
-                        tractlets.set_extend_elem_prop(Fibre::Track::BUNDLE_INDEX_EPROP,
-                                str(bundle_indices[reference_match[tract_i]]), tract_i);
-                    
-                    writer.append(tractlets);
-                    ++count;
-                    ++progress_bar;
-                    
-                }
+                Fibre::Base::SetPipeline<Fibre::Tractlet::Set> pipeline(reader, stage, num_threads);
+                
+                pipeline.run(&progress_bar);
                 
             } else
                 throw Exception(
@@ -375,28 +410,11 @@ EXECUTE {
                 Fibre::Strand::Set::Writer writer(output_location, reader,
                         reader.extend_prop_keys(), elem_header, reader.get_extend_props());
                 
-                Fibre::Strand::Set tractlets;
+                MapColoursStage<Fibre::Strand::Set> stage(bundle_indices, reference_match, writer);
                 
-                size_t count = 0;
-                while (reader.next(tractlets)) {
-                    
-                    if (tractlets.size() != match.size())
-                        throw Exception(
-                                "Size of tractlet set " + str(count) + " (" + str(tractlets.size())
-                                + ") does not match that of 'match' set (" + str(match.size())
-                                + ")");
-                    
-                    tractlets.add_extend_elem_prop(Fibre::Track::BUNDLE_INDEX_EPROP, "-1");
-                    
-                    for (size_t tract_i = 0; tract_i < tractlets.size(); ++tract_i)
-                        tractlets.set_extend_elem_prop(Fibre::Track::BUNDLE_INDEX_EPROP,
-                                str(bundle_indices[reference_match[tract_i]]), tract_i);
-                    
-                    writer.append(tractlets);
-                    ++count;
-                    ++progress_bar;
-                    
-                }
+                Fibre::Base::SetPipeline<Fibre::Strand::Set> pipeline(reader, stage, num_threads);
+                
+                pipeline.run(&progress_bar);
                 
             } else
                 throw Exception(
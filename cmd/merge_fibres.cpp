@@ -20,6 +20,8 @@
 
  */
 
+#include <pthread.h>
+
 #include "bts/cmd.h"
 #include "point.h"
 #include "progressbar.h"
@@ -59,6 +61,82 @@ using namespace FTS;
 
 const double THRESHOLD_DEFAULT = -0.5;
 const size_t NUM_LENGTH_SECTIONS_DEFAULT = 5;
+
+// Scores a share of the candidate pairs against a separate copy of the expected image (see 'score_pairs').
+class PairJob {
+        
+    public:
+        
+        const Fibre::Strand::Set* strands;
+        const std::vector<std::pair<size_t, size_t> >* pairs;
+        const std::vector<double>* strand_priors;
+        std::vector<double>* diff_lprobs;
+        Prob::Likelihood* likelihood;
+        Prob::Prior prior;
+        Image::Expected::Buffer* image;
+        size_t num_length_sections, new_degree;
+        size_t start, stride;
+        MR::ProgressBar* progress_bar;
+        pthread_mutex_t* progress_mutex;
+
+        PairJob(const Prob::Prior& prior)
+                : strands(0), pairs(0), strand_priors(0), diff_lprobs(0), likelihood(0), prior(prior), image(
+                          0), num_length_sections(0), new_degree(0), start(0), stride(1), progress_bar(
+                          0), progress_mutex(0) {
+        }
+        
+};
+
+// The difference in the log posterior when each pair of strands is replaced by their merged strand. Only the voxels
+// touched by either strand or the merged strand are rescored, and the image is restored afterwards.
+void* score_pairs(void* job_ptr) {
+    
+    PairJob& job = *(PairJob*) job_ptr;
+    
+    const Fibre::Strand::Set& strands = *job.strands;
+    
+    double base_intensity = strands.base_intensity();
+    
+    Image::Expected::SignalRecord previous;
+    
+    for (size_t pair_i = job.start; pair_i < job.pairs->size(); pair_i += job.stride) {
+        
+        size_t row_i = (*job.pairs)[pair_i].first;
+        size_t col_i = (*job.pairs)[pair_i].second;
+        
+        Fibre::Strand row_strand = strands[row_i];
+        Fibre::Strand col_strand = strands[col_i];
+        
+        Fibre::Strand merged = row_strand.merge(col_strand, job.num_length_sections,
+                job.new_degree);
+        
+        previous.clear();
+        
+        job.image->part_image(row_strand, -base_intensity, previous);
+        job.image->part_image(col_strand, -base_intensity, previous);
+        job.image->part_image(merged, base_intensity, previous);
+        
+        double merged_like = job.likelihood->log_prob_delta(*job.image, previous);
+        
+        job.image->revert_image(previous);
+        
+        //The distance measure. The original prior is averaged by number of strands, and the merged prior and likelihood
+        //are subtracted from it so that unlikely matches are assigned a large distance.
+        double orig_prior = (*job.strand_priors)[row_i] + (*job.strand_priors)[col_i];
+        double merged_prior = job.prior.log_prob(merged);
+        
+        (*job.diff_lprobs)[pair_i] = (merged_prior - orig_prior) + merged_like;
+        
+        pthread_mutex_lock(job.progress_mutex);
+        ++(*job.progress_bar);
+        pthread_mutex_unlock(job.progress_mutex);
+        
+    }
+    
+    return 0;
+    
+}
+
 SET_VERSION_DEFAULT
 ;
 SET_AUTHOR("Thomas G. Close");
@@ -94,6 +172,9 @@ OPTIONS= {
     Option ("new_degree", "The degree the merged strands will have")
     + Argument ("new_degree", "").type_integer (1, Fibre::Strand::DEFAULT_DEGREE, LARGE_INT),
 
+    Option ("num_threads", "The number of threads the candidate pairs of strands are scored in, each of which keeps its own copy of the expected image (defaults to '-exp_num_threads').")
+    + Argument ("num_threads", "").type_integer (1, 1, LARGE_INT),
+
     DIFFUSION_PARAMETERS,
 
     IMAGE_PARAMETERS,
@@ -122,6 +203,7 @@ EXECUTE {
         size_t num_tractlets = 0;
         size_t num_length_sections = NUM_LENGTH_SECTIONS_DEFAULT;
         size_t new_degree = Fibre::Strand::DEFAULT_DEGREE;
+        size_t num_threads = 0;
         
 //        Options opt = get_options("threshold");
 //        if (opt.size())
@@ -143,6 +225,10 @@ EXECUTE {
         if (opt.size())
             new_degree = opt[0][0];
         
+        opt = get_options("num_threads");
+        if (opt.size())
+            num_threads = opt[0][0];
+        
         // Loads parameters to construct Diffusion::Model ('diff_' prefix)
         SET_DIFFUSION_PARAMETERS;
         
@@ -195,9 +281,7 @@ EXECUTE {
         
         Image::Expected::Buffer& exp_image = *Image::Expected::Buffer::factory(exp_type, obs_image,
                 diffusion_model, exp_num_length_sections, exp_num_width_sections, exp_interp_extent,
-                exp_enforce_bounds, exp_half_width);
-        
-        Image::Expected::Buffer& diff_image = *exp_image.clone();
+                exp_enforce_bounds, exp_half_width, exp_num_threads, exp_interp_table);
         
         //-----------------------//
         // Initialize Likelihood //
@@ -227,80 +311,163 @@ EXECUTE {
         
         if ((num_tractlets == 0) && strands.has_extend_prop(
                     Fibre::Strand::Set::ORIGINAL_NUM_TRACTLETS_PROP))
-            num_tractlets = to<size_t>(
-                    strands.get_extend_prop(Fibre::Strand::Set::ORIGINAL_NUM_TRACTLETS_PROP));
+            num_tractlets = strands.get_extend_prop_integer(
+                    Fibre::Strand::Set::ORIGINAL_NUM_TRACTLETS_PROP);
         
         exp_image.expected_image(strands);
         
 //        obs_image.save("/home/tclose/data/orig_observed.mif");
 //        exp_image.save("/home/tclose/data/orig_expected.mif");
         
-        double orig_like = likelihood->log_prob(strands);
+        // Precalculates the observed signals used by 'log_prob_delta' to rescore the voxels touched by each pair.
+        likelihood->log_prob(strands);
         
-        std::set<Math::Blossom::Edge> edges;
+        //------------------------------------------------------//
+        //  Find the pairs of strands whose footprints overlap  //
+        //------------------------------------------------------//
+        
+        // The voxels touched by each strand are recorded by imaging it into a scratch copy of the expected image, and
+        // only strands that share at least one voxel are considered for merging.
+        Image::Expected::Buffer* scratch_image = exp_image.clone();
+        
+        std::map<Image::Index, std::vector<size_t> > voxel_strands;
+        Image::Expected::SignalRecord footprint;
         
-        MR::ProgressBar progress_bar("Calculating merge weights...", strands.size());
-        
-        for (size_t row_i = 0; row_i < strands.size(); ++row_i) {
-            for (size_t col_i = row_i + 1; col_i < strands.size(); ++col_i) {
-                
-                bool same_bundle = false;
-                
-                if (strands.has_extend_elem_prop(Fibre::Track::BUNDLE_INDEX_EPROP))
-                    if (to<size_t>(
-                                strands.get_extend_elem_prop(Fibre::Track::BUNDLE_INDEX_EPROP,
-                                        row_i))
-                        == to<size_t>(
-                                strands.get_extend_elem_prop(Fibre::Track::BUNDLE_INDEX_EPROP,
-                                        col_i)))
-                        same_bundle = true;
-                
-                if (!same_bundle) {
-                    
-                    Fibre::Strand row_strand = strands[row_i];
-                    Fibre::Strand col_strand = strands[col_i];
-                    
-                    Fibre::Strand merged = row_strand.merge(col_strand, num_length_sections,
-                            new_degree);
-                    
-                    diff_image.zero();
-                    diff_image.part_image(row_strand);
-                    
-                    diff_image.part_image(col_strand);
-                    
-                    diff_image.negate();
-                    
-                    diff_image.part_image(merged);
-                    
-                    exp_image += diff_image;
-                    
-                    //The distance measure. The original prior is averaged by number of strands, and the merged prior and likelihood
-                    //are subtracted from it so that unlikely matches are assigned a large distance.
-                    
-                    double orig_prior = prior.log_prob(row_strand) + prior.log_prob(col_strand);
-                    double merged_prior = prior.log_prob(merged);
-                    double merged_like = likelihood->log_prob(exp_image);
-                    
-//          exp_image.save("/home/tclose/data/merged_expected.mif");
-                    
-                    double diff_lprob = (merged_prior - orig_prior) + (merged_like - orig_like);
-                    
-                    //If difference in log prob is greater than zero. i.e. if merging improves probability add to list of edges to
-                    //find the best fit.
-                    
-//          if (!(row_i == 3 && col_i == 8))
-                    if (diff_lprob > 0)
-                        edges.insert(Math::Blossom::Edge(row_i, col_i, -diff_lprob));
-                    
-                    exp_image -= diff_image;
-                    
-                }
-                
-            }
+        std::vector<double> strand_priors(strands.size());
+        
+        for (size_t strand_i = 0; strand_i < strands.size(); ++strand_i) {
+            
+            footprint.clear();
+            
+            scratch_image->part_image(strands[strand_i], 1.0, footprint);
+            scratch_image->revert_image(footprint);
+            
+            for (size_t record_i = 0; record_i < footprint.size(); ++record_i)
+                voxel_strands[footprint.coord(record_i)].push_back(strand_i);
+            
+            strand_priors[strand_i] = prior.log_prob(strands[strand_i]);
             
-            ++progress_bar;
         }
         
+        delete scratch_image;
+        
+        bool has_bundles = strands.has_extend_elem_prop(Fibre::Track::BUNDLE_INDEX_EPROP);
+        
+        std::vector<size_t> bundle_indices(strands.size());
+        
+        if (has_bundles)
+            for (size_t strand_i = 0; strand_i < strands.size(); ++strand_i)
+                bundle_indices[strand_i] = strands.get_extend_elem_prop<size_t>(
+                        Fibre::Track::BUNDLE_INDEX_EPROP, strand_i);
+        
+        std::set<std::pair<size_t, size_t> > candidate_set;
+        
+        for (std::map<Image::Index, std::vector<size_t> >::iterator vox_it = voxel_strands.begin();
+                vox_it != voxel_strands.end(); ++vox_it) {
+            
+            const std::vector<size_t>& sharing = vox_it->second;
+            
+            for (size_t row_i = 0; row_i < sharing.size(); ++row_i)
+                for (size_t col_i = row_i + 1; col_i < sharing.size(); ++col_i)
+                    if (!has_bundles || bundle_indices[sharing[row_i]] != bundle_indices[sharing[col_i]])
+                        candidate_set.insert(std::pair<size_t, size_t>(sharing[row_i], sharing[col_i]));
+            
+        }
+        
+        std::vector<std::pair<size_t, size_t> > pairs(candidate_set.begin(), candidate_set.end());
+        
+        std::cout << "Scoring " << pairs.size() << " of the "
+                  << strands.size() * (strands.size() - 1) / 2 << " pairs of strands, whose footprints overlap."
+                  << std::endl;
+        
+        //-----------------------------------------//
+        //  Score the candidate pairs in parallel  //
+        //-----------------------------------------//
+        
+        if (!num_threads)
+            num_threads = exp_num_threads;
+        
+        num_threads = std::max((size_t) 1, std::min(num_threads, pairs.size()));
+        
+        std::vector<double> diff_lprobs(pairs.size());
+        
+        MR::ProgressBar progress_bar("Calculating merge weights...", pairs.size());
+        
+        pthread_mutex_t progress_mutex;
+        pthread_mutex_init(&progress_mutex, NULL);
+        
+        std::vector<PairJob> jobs(num_threads, PairJob(prior));
+        std::vector<pthread_t> threads(num_threads);
+        
+        for (size_t thread_i = 0; thread_i < num_threads; ++thread_i) {
+            
+            PairJob& job = jobs[thread_i];
+            
+            job.strands = &strands;
+            job.pairs = &pairs;
+            job.strand_priors = &strand_priors;
+            job.diff_lprobs = &diff_lprobs;
+            job.likelihood = likelihood;
+            job.image = exp_image.clone();
+            job.image->set_num_threads(1);
+            job.num_length_sections = num_length_sections;
+            job.new_degree = new_degree;
+            job.start = thread_i;
+            job.stride = num_threads;
+            job.progress_bar = &progress_bar;
+            job.progress_mutex = &progress_mutex;
+            
+        }
+        
+        if (num_threads == 1)
+            score_pairs(&jobs[0]);
+        else {
+            
+            // The position and tangent matrices of Fibre::Strand are generated lazily into static caches, which aren't
+            // synchronised, so every matrix the threads could request is generated here first. The matrices used to
+            // image the original strands and evaluate their priors were generated by the footprint pass above, which
+            // leaves the tracks the strands are resampled to for merging and the imaging and prior of the merged
+            // strands (which all have 'new_degree').
+            std::set<size_t> degrees;
+            
+            for (size_t strand_i = 0; strand_i < strands.size(); ++strand_i)
+                if (degrees.insert(strands[strand_i].degree()).second)
+                    Fibre::Strand::position_matrix_w_endpoints(num_length_sections, strands[strand_i].degree());
+            
+            Fibre::Strand merged = strands[pairs[0].first].merge(strands[pairs[0].second], num_length_sections,
+                    new_degree);
+            
+            Image::Expected::SignalRecord warm_up;
+            
+            jobs[0].image->part_image(merged, 1.0, warm_up);
+            jobs[0].image->revert_image(warm_up);
+            
+            prior.log_prob(merged);
+            
+            for (size_t thread_i = 0; thread_i < num_threads; ++thread_i)
+                if (pthread_create(&threads[thread_i], NULL, score_pairs, &jobs[thread_i]))
+                    throw Exception("Could not create thread to score pairs of strands.");
+            
+            for (size_t thread_i = 0; thread_i < num_threads; ++thread_i)
+                pthread_join(threads[thread_i], NULL);
+            
+        }
+        
+        for (size_t thread_i = 0; thread_i < num_threads; ++thread_i)
+            delete jobs[thread_i].image;
+        
+        pthread_mutex_destroy(&progress_mutex);
+        
+        std::set<Math::Blossom::Edge> edges;
+        
+        //If difference in log prob is greater than zero. i.e. if merging improves probability add to list of edges to
+        //find the best fit.
+        for (size_t pair_i = 0; pair_i < pairs.size(); ++pair_i)
+            if (diff_lprobs[pair_i] > 0)
+                edges.insert(
+                        Math::Blossom::Edge(pairs[pair_i].first, pairs[pair_i].second,
+                                -diff_lprobs[pair_i]));
+        
         std::vector<Math::Blossom::Edge> merge_list;
         
         for (std::set<Math::Blossom::Edge>::iterator edge_it = edges.begin();
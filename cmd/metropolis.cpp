@@ -58,6 +58,7 @@ extern "C" {
 #include "bts/mcmc/proposal/distribution/gaussian.h"
 
 #include "bts/mcmc/metropolis.h"
+#include "bts/mcmc/multi_chain.h"
 
 #include "bts/fibre/strand/set/walker.h"
 #include "bts/fibre/tractlet/set/walker.h"
@@ -83,7 +84,7 @@ ARGUMENTS= {
 
     Argument ("inital_tractlets", "A starting point for the MCMC algorithm.").type_file (),
 
-    Argument ("samples_location", "The location where the samples will be saved.").type_file (),
+    Argument ("samples_location", "The location where the samples will be saved. Appending '.smp' to the extension (e.g. 'samples.tst.smp') saves them to a binary sample file, which is faster to append to and to read back.").type_file (),
 
     Argument()
 };
@@ -116,6 +117,23 @@ OPTIONS= {
 
     Option ("save_images", "Save both observed and expected images for debugging."),
 
+    Option ("delta_likelihood", "When only a single fibre is altered by a proposal, update the expected image and likelihood incrementally by only rescoring the voxels affected by the changed fibre."),
+
+    Option ("num_chains", "Run this many chains in parallel threads (with consecutive seeds) that share the observed image and diffusion model, saving the samples of each to 'samples_location' with '.chain<i>' inserted before the extension. Sampling stops early once the convergence targets ('-conv_rhat' and '-conv_ess') are met.")
+    + Argument ("num_chains", "").type_integer (1, MCMC::MultiChain::NUM_CHAINS_DEFAULT, LARGE_INT),
+
+    Option ("conv_rhat", "The split R-hat that all of the convergence keys need to be below for the chains to be considered converged (0 to skip the test).")
+    + Argument ("conv_rhat", "").type_float (0.0, MCMC::MultiChain::RHAT_TARGET_DEFAULT, LARGE_FLOAT),
+
+    Option ("conv_ess", "The effective sample size that all of the convergence keys need to be above for the chains to be considered converged (0 to skip the test).")
+    + Argument ("conv_ess", "").type_float (0.0, MCMC::MultiChain::ESS_TARGET_DEFAULT, LARGE_FLOAT),
+
+    Option ("chain_dispersal", "The number of steps of its walker (without accept/reject) that the initial state of each chain after the first is moved by, so that the chains start overdispersed.")
+    + Argument ("chain_dispersal", "").type_integer (0, MCMC::MultiChain::DISPERSAL_STEPS_DEFAULT, LARGE_INT),
+
+    Option ("conv_keys", "A comma-separated list of the per-sample properties whose convergence is assessed, e.g. 'log_px,likelihood,hook'.")
+    + Argument ("conv_keys", "").type_text (MCMC::LOG_PROB_PROP.c_str()),
+
     DIFFUSION_PARAMETERS,
 
     EXPECTED_IMAGE_PARAMETERS,
@@ -163,6 +181,12 @@ EXECUTE {
         bool prior_only = false;
         bool verbose = true;
         bool save_images = false;
+        bool delta_likelihood = false;
+        size_t num_chains = MCMC::MultiChain::NUM_CHAINS_DEFAULT;
+        double conv_rhat = MCMC::MultiChain::RHAT_TARGET_DEFAULT;
+        double conv_ess = MCMC::MultiChain::ESS_TARGET_DEFAULT;
+        std::vector<std::string> conv_keys(1, MCMC::LOG_PROB_PROP);
+        size_t chain_dispersal = MCMC::MultiChain::DISPERSAL_STEPS_DEFAULT;
         
         Options opt = get_options("num_iterations");
         if (opt.size())
@@ -207,6 +231,30 @@ EXECUTE {
         if (opt.size())
             save_images = true;
         
+        opt = get_options("delta_likelihood");
+        if (opt.size())
+            delta_likelihood = true;
+        
+        opt = get_options("num_chains");
+        if (opt.size())
+            num_chains = opt[0][0];
+        
+        opt = get_options("conv_rhat");
+        if (opt.size())
+            conv_rhat = opt[0][0];
+        
+        opt = get_options("conv_ess");
+        if (opt.size())
+            conv_ess = opt[0][0];
+        
+        opt = get_options("conv_keys");
+        if (opt.size())
+            conv_keys = split(opt[0][0], ",");
+        
+        opt = get_options("chain_dispersal");
+        if (opt.size())
+            chain_dispersal = opt[0][0];
+        
         // Loads parameters to construct Diffusion::Model ('diff_' prefix)
         SET_DIFFUSION_PARAMETERS;
         
@@ -231,6 +279,17 @@ EXECUTE {
         // Loads parameters that are common to all commands.
         SET_COMMON_PARAMETERS;
         
+        // The chains are compared against each other in place of a burn-in, discarding the first half of their samples.
+        if (num_chains > 1 && (burn_num_iterations || prior_only))
+            throw Exception(
+                    "'-burn_num_iterations' and '-prior_only' are not supported with multiple chains (" + str(num_chains)
+                    + ").");
+        
+        if (walk_type == "adaptive" && !burn_num_iterations)
+            throw Exception(
+                    "The 'adaptive' walker learns its step sizes over the burn-in, so '-burn_num_iterations' needs to be "
+                    "set.");
+        
         //--------------------------------//
         //  Set up reference image buffer //
         //--------------------------------//
@@ -263,7 +322,7 @@ EXECUTE {
         
         Image::Expected::Buffer* exp_image = Image::Expected::Buffer::factory(exp_type, obs_image,
                 diffusion_model, exp_num_length_sections, exp_num_width_sections, exp_interp_extent,
-                exp_enforce_bounds, exp_half_width);
+                exp_enforce_bounds, exp_half_width, exp_num_threads, exp_interp_table);
         
         //-----------------------//
         // Initialize Likelihood //
@@ -282,6 +341,30 @@ EXECUTE {
         MCMC::Proposal::Distribution *proposal_distribution = MCMC::Proposal::Distribution::factory(
                 prop_distr_type, rand_gen);
         
+        //----------------------------------------------------------------------//
+        //  Initialize Expected Images, Likelihoods and Random Generators of the //
+        //  Additional Chains                                                    //
+        //----------------------------------------------------------------------//
+        
+        // Each chain is stepped in its own thread. The likelihoods of the additional chains are copies of the first,
+        // which have their own expected images but share the observed image and diffusion model. The first chain uses
+        // the objects above.
+        std::vector<Prob::Likelihood*> likelihoods(1, likelihood);
+        std::vector<gsl_rng*> rand_gens(1, rand_gen);
+        std::vector<MCMC::Proposal::Distribution*> proposal_distributions(1, proposal_distribution);
+        
+        for (size_t chain_i = 1; chain_i < num_chains; ++chain_i) {
+            
+            likelihoods.push_back(likelihood->clone());
+            
+            rand_gens.push_back(gsl_rng_alloc(gsl_rng_taus));
+            gsl_rng_set(rand_gens.back(), seed + chain_i);
+            
+            proposal_distributions.push_back(
+                    MCMC::Proposal::Distribution::factory(prop_distr_type, rand_gens.back()));
+            
+        }
+        
 //
 //  Proposal::Intensity* acs_proposer = Proposal::Intensity::factory(walk_intens_type, proposal_distribution, walk_intens_scale);
 //
@@ -305,6 +388,15 @@ EXECUTE {
         run_properties["num_iterations"] = str(num_iterations);
         run_properties["burn_enforce_bounds"] = str(burn_enforce_bounds);
         run_properties["anneal_frac_start"] = str(anneal_frac_start);
+        run_properties["delta_likelihood"] = str(delta_likelihood);
+        
+        if (num_chains > 1) {
+            run_properties["num_chains"] = str(num_chains);
+            run_properties["conv_rhat"] = str(conv_rhat);
+            run_properties["conv_ess"] = str(conv_ess);
+            run_properties["conv_keys"] = str(conv_keys);
+            run_properties["chain_dispersal"] = str(chain_dispersal);
+        }
         
         ADD_DIFFUSION_PROPERTIES(run_properties);
         
@@ -328,6 +420,11 @@ EXECUTE {
                 Prob::PriorComponent::InImage::get_extent(obs_image, prior_in_image_border),
                 prior_in_image_num_length_sections, prior_in_image_num_width_sections);
         
+        std::vector<Prob::Prior*> priors;
+        
+        for (size_t chain_i = 0; chain_i < num_chains; ++chain_i)
+            priors.push_back(new Prob::Prior(prior));
+        
         //-------------------------//
         //  Sampling from Strands  //
         //-------------------------//
@@ -351,32 +448,77 @@ EXECUTE {
                     walk_type, walk_step_scale, walk_step_location, proposal_distribution,
                     walk_base_intens_scale);
             
+            walker->schedule_blocks(strands, walk_block, walk_scan);
+            
             //------------------//
             // Perform sampling //
             //------------------//
             
-            Fibre::Strand::Set burnt_strands;
-            
-            if (burn_num_iterations) {
+            if (num_chains > 1) {
                 
-                if (burn_enforce_bounds != exp_enforce_bounds)
-                    likelihood->set_enforce_bounds(burn_enforce_bounds);
+                // The first chain uses the walker above, the others get their own proposal distributions.
+                std::vector<Fibre::Strand::Set::Walker*> walkers(1, walker);
                 
-                burnt_strands = MCMC::metropolis<Fibre::Strand::Set, Prob::Likelihood, Prob::Prior>(
-                        strands, *likelihood, prior, *walker, burn_samples_location, run_properties,
-                        burn_num_iterations, burn_sample_period, rand_gen, anneal_frac_start,
-                        prior_only, verbose, save_images);
+                for (size_t chain_i = 1; chain_i < num_chains; ++chain_i) {
+                    walkers.push_back(
+                            Fibre::Strand::Set::Walker::factory(strands, walk_type, walk_step_scale,
+                                    walk_step_location, proposal_distributions[chain_i],
+                                    walk_base_intens_scale));
+                    walkers.back()->schedule_blocks(strands, walk_block, walk_scan);
+                }
                 
-                if (burn_enforce_bounds != exp_enforce_bounds)
-                    likelihood->set_enforce_bounds(exp_enforce_bounds);
+                MCMC::multi_chain<Fibre::Strand::Set, Prob::Likelihood, Prob::Prior>(strands,
+                        likelihoods, priors, walkers, rand_gens, samples_location, run_properties,
+                        num_iterations, sample_period, conv_rhat, conv_ess, conv_keys, chain_dispersal,
+                        verbose);
                 
-            } else
-                burnt_strands = strands;
-            
-            MCMC::metropolis<Fibre::Strand::Set, Prob::Likelihood, Prob::Prior>
+                for (size_t chain_i = 1; chain_i < num_chains; ++chain_i)
+                    delete walkers[chain_i];
+                
+            } else {
+                
+                Fibre::Strand::Set burnt_strands;
+                
+                if (burn_num_iterations) {
+                    
+                    if (burn_enforce_bounds != exp_enforce_bounds)
+                        likelihood->set_enforce_bounds(burn_enforce_bounds);
+                    
+                    if (walk_type == "adaptive")
+                        walker->start_adaptation(walk_adapt_target, walk_adapt_rank);
+                    
+                    burnt_strands = MCMC::metropolis<Fibre::Strand::Set, Prob::Likelihood, Prob::Prior>(
+                            strands, *likelihood, prior, *walker, burn_samples_location, run_properties,
+                            burn_num_iterations, burn_sample_period, rand_gen, anneal_frac_start,
+                            prior_only, verbose, save_images, delta_likelihood);
+                    
+                    if (burn_enforce_bounds != exp_enforce_bounds)
+                        likelihood->set_enforce_bounds(exp_enforce_bounds);
+                    
+                    if (walk_type == "adaptive") {
+                        
+                        walker->stop_adaptation();
+                        
+                        // Saved relative to the step scale in the same format as '-walk_step_location'.
+                        if (walk_adapt_save.size()) {
+                            Fibre::Strand::Set learned_step(burnt_strands);
+                            learned_step.MR::Math::Vector<double>::operator=(walker->get_step_sizes());
+                            learned_step /= walk_step_scale;
+                            learned_step.save(walk_adapt_save);
+                        }
+                        
+                    }
+                    
+                } else
+                    burnt_strands = strands;
+                
+                MCMC::metropolis<Fibre::Strand::Set, Prob::Likelihood, Prob::Prior>
 
-            (burnt_strands, *likelihood, prior, *walker, samples_location, run_properties,
-                    num_iterations, sample_period, rand_gen, 1.0, prior_only, verbose, save_images);
+                (burnt_strands, *likelihood, prior, *walker, samples_location, run_properties,
+                        num_iterations, sample_period, rand_gen, 1.0, prior_only, verbose, save_images,
+                        delta_likelihood);
+                
+            }
             
             //------------------------//
             //  Sampling from Tractlets  //
@@ -401,6 +543,8 @@ EXECUTE {
                     walk_type, walk_step_scale, walk_step_location, proposal_distribution,
                     walk_base_intens_scale);
             
+            walker->schedule_blocks(tractlets, walk_block, walk_scan);
+            
             if (walk_type == "manifold") {
                 
                 Fibre::Tractlet::Set dummy(tractlets);
@@ -416,30 +560,73 @@ EXECUTE {
             // Perform sampling //
             //------------------//
             
-            Fibre::Tractlet::Set burnt_tractlets;
-            
-            if (burn_num_iterations) {
+            if (num_chains > 1) {
                 
-                if (burn_enforce_bounds != exp_enforce_bounds)
-                    likelihood->set_enforce_bounds(burn_enforce_bounds);
+                // The first chain uses the walker above, the others get their own proposal distributions.
+                std::vector<Fibre::Tractlet::Set::Walker*> walkers(1, walker);
                 
-                burnt_tractlets = MCMC::metropolis<Fibre::Tractlet::Set, Prob::Likelihood,
-                        Prob::Prior>(
-
-                tractlets, *likelihood, prior, *walker, burn_samples_location, run_properties,
-                        burn_num_iterations, burn_sample_period, rand_gen, anneal_frac_start,
-                        prior_only, verbose, save_images);
+                for (size_t chain_i = 1; chain_i < num_chains; ++chain_i) {
+                    walkers.push_back(
+                            Fibre::Tractlet::Set::Walker::factory(tractlets, walk_type, walk_step_scale,
+                                    walk_step_location, proposal_distributions[chain_i],
+                                    walk_base_intens_scale));
+                    walkers.back()->schedule_blocks(tractlets, walk_block, walk_scan);
+                }
                 
-                if (burn_enforce_bounds != exp_enforce_bounds)
-                    likelihood->set_enforce_bounds(exp_enforce_bounds);
+                MCMC::multi_chain<Fibre::Tractlet::Set, Prob::Likelihood, Prob::Prior>(tractlets,
+                        likelihoods, priors, walkers, rand_gens, samples_location, run_properties,
+                        num_iterations, sample_period, conv_rhat, conv_ess, conv_keys, chain_dispersal,
+                        verbose);
                 
-            } else
-                burnt_tractlets = tractlets;
-            
-            MCMC::metropolis<Fibre::Tractlet::Set, Prob::Likelihood, Prob::Prior>(
+                for (size_t chain_i = 1; chain_i < num_chains; ++chain_i)
+                    delete walkers[chain_i];
+                
+            } else {
+                
+                Fibre::Tractlet::Set burnt_tractlets;
+                
+                if (burn_num_iterations) {
+                    
+                    if (burn_enforce_bounds != exp_enforce_bounds)
+                        likelihood->set_enforce_bounds(burn_enforce_bounds);
+                    
+                    if (walk_type == "adaptive")
+                        walker->start_adaptation(walk_adapt_target, walk_adapt_rank);
+                    
+                    burnt_tractlets = MCMC::metropolis<Fibre::Tractlet::Set, Prob::Likelihood,
+                            Prob::Prior>(
+
+                    tractlets, *likelihood, prior, *walker, burn_samples_location, run_properties,
+                            burn_num_iterations, burn_sample_period, rand_gen, anneal_frac_start,
+                            prior_only, verbose, save_images, delta_likelihood);
+                    
+                    if (burn_enforce_bounds != exp_enforce_bounds)
+                        likelihood->set_enforce_bounds(exp_enforce_bounds);
+                    
+                    if (walk_type == "adaptive") {
+                        
+                        walker->stop_adaptation();
+                        
+                        // Saved relative to the step scale in the same format as '-walk_step_location'.
+                        if (walk_adapt_save.size()) {
+                            Fibre::Tractlet::Set learned_step(burnt_tractlets);
+                            learned_step.MR::Math::Vector<double>::operator=(walker->get_step_sizes());
+                            learned_step /= walk_step_scale;
+                            learned_step.save(walk_adapt_save);
+                        }
+                        
+                    }
+                    
+                } else
+                    burnt_tractlets = tractlets;
+                
+                MCMC::metropolis<Fibre::Tractlet::Set, Prob::Likelihood, Prob::Prior>(
 
-            burnt_tractlets, *likelihood, prior, *walker, samples_location, run_properties,
-                    num_iterations, sample_period, rand_gen, 1.0, prior_only, verbose, save_images);
+                burnt_tractlets, *likelihood, prior, *walker, samples_location, run_properties,
+                        num_iterations, sample_period, rand_gen, 1.0, prior_only, verbose, save_images,
+                        delta_likelihood);
+                
+            }
             
         }
         
@@ -449,5 +636,14 @@ EXECUTE {
         
         gsl_rng_free(rand_gen);
         
+        for (size_t chain_i = 1; chain_i < num_chains; ++chain_i) {
+            delete likelihoods[chain_i];
+            delete proposal_distributions[chain_i];
+            gsl_rng_free(rand_gens[chain_i]);
+        }
+        
+        for (size_t chain_i = 0; chain_i < num_chains; ++chain_i)
+            delete priors[chain_i];
+        
     }
     
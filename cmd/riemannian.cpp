@@ -274,7 +274,7 @@ EXECUTE {
         
         Image::Expected::Buffer* exp_image = Image::Expected::Buffer::factory(exp_type, obs_image,
                 diffusion_model, exp_num_length_sections, exp_num_width_sections, exp_interp_extent,
-                exp_enforce_bounds, exp_half_width);
+                exp_enforce_bounds, exp_half_width, exp_num_threads, exp_interp_table);
         
         //-----------------------//
         // Initialize Likelihood //
@@ -27,10 +27,44 @@
 #include "bts/fibre/tractlet/set.h"
 #include "bts/fibre/strand/set.h"
 #include "bts/fibre/track/set.h"
+#include "bts/fibre/base/set_pipeline.h"
 
 #include "bts/inline_functions.h"
 
 using namespace FTS;
+
+// Matches each sample to the reference set in the worker threads and appends the matches in sample order.
+template<typename S> class ShortestDistanceStage: public Fibre::Base::SetPipeline<S>::Stage {
+        
+    protected:
+        
+        const S& reference;
+        typename S::Writer& writer;
+
+    public:
+        
+        ShortestDistanceStage(const S& reference, typename S::Writer& writer)
+                : reference(reference), writer(writer) {
+        }
+        
+        void process(S& fibres, Fibre::Base::NoResult& result, size_t count) {
+            
+            if (fibres.size() != reference.size())
+                throw Exception(
+                        "Size of tractlet set " + str(count) + " (" + str(fibres.size())
+                        + ") does not match that of 'reference' set (" + str(reference.size())
+                        + ")");
+            
+            fibres = fibres.smallest_distance_set(reference);
+            
+        }
+        
+        void write(S& shortest_dist, Fibre::Base::NoResult& result, size_t count) {
+            writer.append(shortest_dist);
+        }
+        
+};
+
 SET_VERSION_DEFAULT
 ;
 SET_AUTHOR("Thomas G. Close");
@@ -51,6 +85,9 @@ ARGUMENTS= {
 
 OPTIONS= {
 
+    Option ("num_threads", "The number of worker threads the samples are matched to the reference set in, while another thread reads ahead and the matches are written in sample order.")
+    + Argument ("num_threads", "").type_integer (1, 1, LARGE_INT),
+
     Option()};
 
 EXECUTE {
@@ -63,6 +100,12 @@ EXECUTE {
         if (argument.size() == 3)
             output_location = argument[2].c_str();
         
+        size_t num_threads = 1;
+        
+        Options opt = get_options("num_threads");
+        if (opt.size())
+            num_threads = opt[0][0];
+        
         if (File::has_extension<Fibre::Strand>(reference_location)) {
             
             if (!File::has_extension<Fibre::Strand::Set>(samples_location))
@@ -72,30 +115,17 @@ EXECUTE {
             
             Fibre::Strand::Set reference(reference_location);
             
-            Fibre::Strand::Set strands;
-            
             Fibre::Strand::Set::Reader reader(samples_location);
             Fibre::Strand::Set::Writer writer(output_location, reader, reader.get_extend_props());
             
             MR::ProgressBar progress_bar("Calculating shortest distances...",
                     to<size_t>(reader.get_extend_props()["count"]));
             
-            size_t count = 0;
-            while (reader.next(strands)) {
-                
-                if (strands.size() != reference.size())
-                    throw Exception(
-                            "Size of tractlet set " + str(count) + " (" + str(strands.size())
-                            + ") does not match that of 'reference' set (" + str(reference.size())
-                            + ")");
-                
-                Fibre::Strand::Set shortest_dist = strands.smallest_distance_set(reference);
-                writer.append(shortest_dist);
-                
-                ++count;
-                ++progress_bar;
-                
-            }
+            ShortestDistanceStage<Fibre::Strand::Set> stage(reference, writer);
+            
+            Fibre::Base::SetPipeline<Fibre::Strand::Set> pipeline(reader, stage, num_threads);
+            
+            pipeline.run(&progress_bar);
             
         } else if (File::has_extension<Fibre::Tractlet>(reference_location)) {
             
@@ -106,30 +136,17 @@ EXECUTE {
             
             Fibre::Tractlet::Set reference(reference_location);
             
-            Fibre::Tractlet::Set tractlets;
-            
             Fibre::Tractlet::Set::Reader reader(samples_location);
             Fibre::Tractlet::Set::Writer writer(output_location, reader, reader.get_extend_props());
             
             MR::ProgressBar progress_bar("Calculating shortest distances...",
                     to<size_t>(reader.get_extend_props()["count"]));
             
-            size_t count = 0;
-            while (reader.next(tractlets)) {
-                
-                if (tractlets.size() != reference.size())
-                    throw Exception(
-                            "Size of tractlet set " + str(count) + " (" + str(tractlets.size())
-                            + ") does not match that of 'reference' set (" + str(reference.size())
-                            + ")");
-                
-                Fibre::Tractlet::Set shortest_dist = tractlets.smallest_distance_set(reference);
-                writer.append(shortest_dist);
-                
-                ++count;
-                ++progress_bar;
-                
-            }
+            ShortestDistanceStage<Fibre::Tractlet::Set> stage(reference, writer);
+            
+            Fibre::Base::SetPipeline<Fibre::Tractlet::Set> pipeline(reader, stage, num_threads);
+            
+            pipeline.run(&progress_bar);
             
         } else
             throw Exception(
@@ -27,10 +27,103 @@
 #include "bts/fibre/tractlet/set.h"
 #include "bts/fibre/strand/set.h"
 #include "bts/fibre/track/set.h"
+#include "bts/fibre/base/set_pipeline.h"
 
 #include "bts/inline_functions.h"
 
 using namespace FTS;
+
+typedef std::vector<std::string> StatsLines;
+
+template<typename T> void stats_fibres(const std::string& reference_location,
+                                       const std::string& samples_location,
+                                       const std::string& output_location, size_t num_threads);
+
+// The suffixes of the per-sample statistics files, in the order their lines are generated by 'sample_stats'.
+template<typename T> std::vector<std::string> stats_suffixes();
+
+template<typename T> void sample_stats(const typename T::Set& sample,
+                                       const typename T::Set& reference, StatsLines& lines);
+
+// Matches each sample to the reference set and formats its statistics in the worker threads, then adds it to the
+// average and writes the statistics to file in sample order.
+template<typename T> class StatsStage: public Fibre::Base::SetPipeline<typename T::Set, StatsLines>::Stage {
+        
+    protected:
+        
+        const typename T::Set& reference;
+        typename T::Set& average;
+        std::vector<std::ofstream*>& out;
+
+    public:
+        
+        StatsStage(const typename T::Set& reference, typename T::Set& average,
+                   std::vector<std::ofstream*>& out)
+                : reference(reference), average(average), out(out) {
+        }
+        
+        void process(typename T::Set& sample, StatsLines& lines, size_t sample_i) {
+            
+            if (sample.size() != reference.size())
+                throw Exception(
+                        "Size of tractlet set " + str(sample_i) + " (" + str(sample.size())
+                        + ") does not match that of 'reference' set (" + str(reference.size()) + ")");
+            
+            sample = sample.smallest_distance_set(reference);
+            
+            sample_stats<T>(sample, reference, lines);
+            
+        }
+        
+        void write(typename T::Set& sample, StatsLines& lines, size_t sample_i) {
+            
+            average += sample;
+            
+            for (size_t out_i = 0; out_i < out.size(); ++out_i)
+                *out[out_i] << lines[out_i] << std::endl;
+            
+        }
+        
+};
+
+// Matches each sample to the reference set and squares its deviation from the average in the worker threads, then
+// sums the squared deviations in sample order.
+template<typename T> class VarianceStage: public Fibre::Base::SetPipeline<typename T::Set, StatsLines>::Stage {
+        
+    protected:
+        
+        const typename T::Set& reference;
+        const typename T::Set& average;
+        typename T::Set& variance;
+
+    public:
+        
+        VarianceStage(const typename T::Set& reference, const typename T::Set& average,
+                      typename T::Set& variance)
+                : reference(reference), average(average), variance(variance) {
+        }
+        
+        void process(typename T::Set& sample, StatsLines& lines, size_t sample_i) {
+            
+            if (sample.size() != reference.size())
+                throw Exception(
+                        "Size of tractlet set " + str(sample_i) + " (" + str(sample.size())
+                        + ") does not match that of 'reference' set (" + str(reference.size()) + ")");
+            
+            sample = sample.smallest_distance_set(reference);
+            
+            sample -= average;
+            
+            sample *= sample;
+            
+        }
+        
+        void write(typename T::Set& deviation, StatsLines& lines, size_t sample_i) {
+            variance += deviation;
+        }
+        
+};
+
 SET_VERSION_DEFAULT
 ;
 SET_AUTHOR("Thomas G. Close");
@@ -51,6 +144,9 @@ ARGUMENTS= {
 
 OPTIONS= {
 
+    Option ("num_threads", "The number of worker threads the samples are matched to the reference set in, while another thread reads ahead and the results are written in sample order.")
+    + Argument ("num_threads", "").type_integer (1, 1, LARGE_INT),
+
     Option()};
 
 EXECUTE {
@@ -62,6 +158,12 @@ EXECUTE {
         if (argument.size() == 3)
             output_location = argument[2].c_str();
         
+        size_t num_threads = 1;
+        
+        Options opt = get_options("num_threads");
+        if (opt.size())
+            num_threads = opt[0][0];
+        
         if (File::has_extension<Fibre::Strand>(reference_location)) {
             
             if (!File::has_extension<Fibre::Strand::Set>(samples_location))
@@ -69,102 +171,8 @@ EXECUTE {
                         "Samples location ('" + samples_location
                         + "') does not match reference location ('" + reference_location + "').");
             
-            Fibre::Strand::Set reference(reference_location);
-            
-            Fibre::Strand::Set strands;
-            
-            Fibre::Strand::Set::Reader reader(samples_location);
-            
-            size_t count = 0;
-            
-            Fibre::Strand::Set average(reference);
-            
-            average.zero();
-            
-            MR::ProgressBar progress_bar("Calculating average...",
-                    to<size_t>(reader.get_extend_props()["count"]));
-            
-            std::ofstream all_out((File::strip_extension(output_location) + ".dist.txt").c_str());
-            std::ofstream strand_out(
-                    (File::strip_extension(output_location) + ".strdist.txt").c_str());
-            std::ofstream pos_out((File::strip_extension(output_location) + ".pos.txt").c_str());
-            std::ofstream orient_out(
-                    (File::strip_extension(output_location) + ".orient.txt").c_str());
-            std::ofstream len_out((File::strip_extension(output_location) + ".len.txt").c_str());
-            std::ofstream curv_out((File::strip_extension(output_location) + ".curv.txt").c_str());
-            
-            while (reader.next(strands)) {
-                
-                if (strands.size() != reference.size())
-                    throw Exception(
-                            "Size of tractlet set " + str(count) + " (" + str(strands.size())
-                            + ") does not match that of 'reference' set (" + str(reference.size())
-                            + ")");
-                
-                strands = strands.smallest_distance_set(reference);
-                
-                average += strands;
-                
-                all_out << strands.distance(reference) << std::endl;
-                
-                for (size_t strand_i = 0; strand_i < strands.size(); ++strand_i) {
-                    
-                    strand_out << strands[strand_i].distance(reference[strand_i]) << " ";
-                    pos_out << (strands[strand_i][0] - reference[strand_i][0]).norm() << " ";
-                    orient_out << strands[strand_i][1].angle(reference[strand_i][1]) << " ";
-                    len_out << strands[strand_i][1].norm() - reference[strand_i][1].norm() << " ";
-                    curv_out << (strands[strand_i][2] - reference[strand_i][2]).norm() * SQRT_2
-                             << " ";
-                    
-                }
-                
-                strand_out << std::endl;
-                pos_out << std::endl;
-                orient_out << std::endl;
-                len_out << std::endl;
-                curv_out << std::endl;
-                
-                ++count;
-                ++progress_bar;
-                
-            }
-            
-            average /= (double) count;
-            
-            average.save(File::strip_extension(output_location) + ".avg.str");
-            
-            Fibre::Strand::Set variance(reference);
-            
-            variance.zero();
-            
-            count = 0;
-            
-            reader.rewind();
-            
-            while (reader.next(strands)) {
-                
-                if (strands.size() != reference.size())
-                    throw Exception(
-                            "Size of tractlet set " + str(count) + " (" + str(strands.size())
-                            + ") does not match that of 'reference' set (" + str(reference.size())
-                            + ")");
-                
-                Fibre::Strand::Set deviation = strands.smallest_distance_set(reference);
-                
-                deviation -= average;
-                
-                deviation *= deviation;
-                
-                variance += deviation;
-                
-                ++count;
-                ++progress_bar;
-                
-            }
-            
-            variance /= (double) count;
-            
-            variance.save(File::strip_extension(output_location) + ".var.str");
+            stats_fibres<Fibre::Strand>(reference_location, samples_location, output_location,
+                    num_threads);
             
         } else if (File::has_extension<Fibre::Tractlet>(reference_location)) {
             
@@ -173,143 +181,8 @@ EXECUTE {
                         "Samples location ('" + samples_location
                         + "') does not match reference location ('" + reference_location + "').");
             
-            Fibre::Tractlet::Set reference(reference_location);
-            
-            Fibre::Tractlet::Set tractlets;
-            
-            Fibre::Tractlet::Set::Reader reader(samples_location);
-            
-            size_t count = 0;
-            
-            Fibre::Tractlet::Set average(reference);
-            
-            average.zero();
-            
-            MR::ProgressBar progress_bar("Calculating average...",
-                    to<size_t>(reader.get_extend_props()["count"]));
-            
-            std::ofstream all_out((File::strip_extension(output_location) + ".dist.txt").c_str());
-            std::ofstream tractlet_out(
-                    (File::strip_extension(output_location) + ".tctdist.txt").c_str());
-            std::ofstream pos_out((File::strip_extension(output_location) + ".pos.txt").c_str());
-            std::ofstream perp_out((File::strip_extension(output_location) + ".perp.txt").c_str());
-            std::ofstream orient_out(
-                    (File::strip_extension(output_location) + ".orient.txt").c_str());
-            std::ofstream len_out((File::strip_extension(output_location) + ".len.txt").c_str());
-            std::ofstream curv_out((File::strip_extension(output_location) + ".curv.txt").c_str());
-            
-            std::ofstream width1_out(
-                    (File::strip_extension(output_location) + ".width1.txt").c_str());
-            std::ofstream width2_out(
-                    (File::strip_extension(output_location) + ".width2.txt").c_str());
-            
-            std::ofstream acs_out((File::strip_extension(output_location) + ".acs.txt").c_str());
-            
-            std::ofstream rot_out((File::strip_extension(output_location) + ".rot.txt").c_str());
-            
-            while (reader.next(tractlets)) {
-                
-                if (tractlets.size() != reference.size())
-                    throw Exception(
-                            "Size of tractlet set " + str(count) + " (" + str(tractlets.size())
-                            + ") does not match that of 'reference' set (" + str(reference.size())
-                            + ")");
-                
-                tractlets = tractlets.smallest_distance_set(reference);
-                
-                average += tractlets;
-                
-                all_out << tractlets.distance(reference) << std::endl;
-                
-                for (size_t tractlet_i = 0; tractlet_i < tractlets.size(); ++tractlet_i) {
-                    
-                    tractlet_out << tractlets[tractlet_i].distance(reference[tractlet_i]) << " ";
-                    
-                    pos_out << (tractlets[tractlet_i][0][0] - reference[tractlet_i][0][0]).norm()
-                            << " ";
-                    perp_out
-                            << (tractlets[tractlet_i][0][0] - tractlets[tractlet_i][0][0].dot(
-                                                                      tractlets[tractlet_i][0][1])
-                                                              / tractlets[tractlet_i][0][1].norm()
-                                - reference[tractlet_i][0][0]
-                                + reference[tractlet_i][0][0].dot(reference[tractlet_i][0][1]) / reference[tractlet_i][0][1].norm()).norm()
-                            << " ";
-                    orient_out << tractlets[tractlet_i][0][1].angle(reference[tractlet_i][0][1])
-                               << " ";
-                    len_out << tractlets[tractlet_i][0][1].norm()
-                            - reference[tractlet_i][0][1].norm()
-                            << " ";
-                    curv_out
-                            << (tractlets[tractlet_i][0][2] - reference[tractlet_i][0][2]).norm() * SQRT_2
-                            << " ";
-                    
-                    width1_out
-                            << (tractlets[tractlet_i][1][0] - reference[tractlet_i][1][0]).norm() * SQRT_2
-                            << " ";
-                    width2_out
-                            << (tractlets[tractlet_i][2][0] - reference[tractlet_i][2][0]).norm() * SQRT_2
-                            << " ";
-                    
-                    acs_out << tractlets[tractlet_i].acs() - reference[tractlet_i].acs() << " ";
-                    
-                    rot_out << tractlets[tractlet_i].rotation() << " ";
-                    
-                }
-                
-                tractlet_out << std::endl;
-                pos_out << std::endl;
-                perp_out << std::endl;
-                orient_out << std::endl;
-                len_out << std::endl;
-                curv_out << std::endl;
-                
-                width1_out << std::endl;
-                width2_out << std::endl;
-                acs_out << std::endl;
-                
-                rot_out << std::endl;
-                
-                ++count;
-                ++progress_bar;
-                
-            }
-            
-            average /= (double) count;
-            
-            average.save(File::strip_extension(output_location) + ".avg.tct");
-            
-            Fibre::Tractlet::Set variance(reference);
-            
-            variance.zero();
-            
-            count = 0;
-            
-            reader.rewind();
-            
-            while (reader.next(tractlets)) {
-                
-                if (tractlets.size() != reference.size())
-                    throw Exception(
-                            "Size of tractlet set " + str(count) + " (" + str(tractlets.size())
-                            + ") does not match that of 'reference' set (" + str(reference.size())
-                            + ")");
-                
-                Fibre::Tractlet::Set deviation = tractlets.smallest_distance_set(reference);
-                
-                deviation -= average;
-                
-                deviation *= deviation;
-                
-                variance += deviation;
-                
-                ++count;
-                ++progress_bar;
-                
-            }
-            
-            variance /= (double) count;
-            
-            variance.save(File::strip_extension(output_location) + ".var.tct");
+            stats_fibres<Fibre::Tractlet>(reference_location, samples_location, output_location,
+                    num_threads);
             
         } else
             throw Exception(
@@ -317,3 +190,174 @@ EXECUTE {
                     + "') for match of type tractlet.");
         
     }
+    
+    template<typename T> void stats_fibres(const std::string& reference_location,
+                                           const std::string& samples_location,
+                                           const std::string& output_location, size_t num_threads) {
+        
+        typename T::Set reference(reference_location);
+        
+        typename T::Set::Reader reader(samples_location);
+        
+        typename T::Set average(reference);
+        
+        average.zero();
+        
+        MR::ProgressBar progress_bar("Calculating average...",
+                to<size_t>(reader.get_extend_props()["count"]));
+        
+        std::vector<std::string> suffixes = stats_suffixes<T>();
+        std::vector<std::ofstream*> out;
+        
+        for (size_t out_i = 0; out_i < suffixes.size(); ++out_i)
+            out.push_back(
+                    new std::ofstream(
+                            (File::strip_extension(output_location) + suffixes[out_i]).c_str()));
+        
+        StatsStage<T> stats_stage(reference, average, out);
+        
+        size_t count;
+        
+        try {
+            
+            Fibre::Base::SetPipeline<typename T::Set, StatsLines> pipeline(reader, stats_stage,
+                    num_threads);
+            
+            count = pipeline.run(&progress_bar);
+            
+        } catch (Exception& e) {
+            
+            for (size_t out_i = 0; out_i < out.size(); ++out_i)
+                delete out[out_i];
+            
+            throw;
+            
+        }
+        
+        for (size_t out_i = 0; out_i < out.size(); ++out_i)
+            delete out[out_i];
+        
+        average /= (double) count;
+        
+        average.save(File::strip_extension(output_location) + ".avg." + T::FILE_EXTENSION);
+        
+        typename T::Set variance(reference);
+        
+        variance.zero();
+        
+        reader.rewind();
+        
+        VarianceStage<T> variance_stage(reference, average, variance);
+        
+        Fibre::Base::SetPipeline<typename T::Set, StatsLines> pipeline(reader, variance_stage,
+                num_threads);
+        
+        count = pipeline.run(&progress_bar);
+        
+        variance /= (double) count;
+        
+        variance.save(File::strip_extension(output_location) + ".var." + T::FILE_EXTENSION);
+        
+    }
+    
+    template<> std::vector<std::string> stats_suffixes<Fibre::Strand>() {
+        
+        const char* suffixes[] = { ".dist.txt", ".strdist.txt", ".pos.txt", ".orient.txt",
+                                   ".len.txt", ".curv.txt" };
+        
+        return std::vector<std::string>(suffixes, suffixes + 6);
+        
+    }
+    
+    template<> std::vector<std::string> stats_suffixes<Fibre::Tractlet>() {
+        
+        const char* suffixes[] = { ".dist.txt", ".tctdist.txt", ".pos.txt", ".perp.txt",
+                                   ".orient.txt", ".len.txt", ".curv.txt", ".width1.txt",
+                                   ".width2.txt", ".acs.txt", ".rot.txt" };
+        
+        return std::vector<std::string>(suffixes, suffixes + 11);
+        
+    }
+    
+    template<> void sample_stats<Fibre::Strand>(const Fibre::Strand::Set& strands,
+                                                const Fibre::Strand::Set& reference,
+                                                StatsLines& lines) {
+        
+        std::ostringstream all_out, strand_out, pos_out, orient_out, len_out, curv_out;
+        
+        all_out << strands.distance(reference);
+        
+        for (size_t strand_i = 0; strand_i < strands.size(); ++strand_i) {
+            
+            strand_out << strands[strand_i].distance(reference[strand_i]) << " ";
+            pos_out << (strands[strand_i][0] - reference[strand_i][0]).norm() << " ";
+            orient_out << strands[strand_i][1].angle(reference[strand_i][1]) << " ";
+            len_out << strands[strand_i][1].norm() - reference[strand_i][1].norm() << " ";
+            curv_out << (strands[strand_i][2] - reference[strand_i][2]).norm() * SQRT_2 << " ";
+            
+        }
+        
+        lines.resize(6);
+        
+        lines[0] = all_out.str();
+        lines[1] = strand_out.str();
+        lines[2] = pos_out.str();
+        lines[3] = orient_out.str();
+        lines[4] = len_out.str();
+        lines[5] = curv_out.str();
+        
+    }
+    
+    template<> void sample_stats<Fibre::Tractlet>(const Fibre::Tractlet::Set& tractlets,
+                                                  const Fibre::Tractlet::Set& reference,
+                                                  StatsLines& lines) {
+        
+        std::ostringstream all_out, tractlet_out, pos_out, perp_out, orient_out, len_out, curv_out,
+                width1_out, width2_out, acs_out, rot_out;
+        
+        all_out << tractlets.distance(reference);
+        
+        for (size_t tractlet_i = 0; tractlet_i < tractlets.size(); ++tractlet_i) {
+            
+            tractlet_out << tractlets[tractlet_i].distance(reference[tractlet_i]) << " ";
+            
+            pos_out << (tractlets[tractlet_i][0][0] - reference[tractlet_i][0][0]).norm() << " ";
+            perp_out
+                    << (tractlets[tractlet_i][0][0] - tractlets[tractlet_i][0][0].dot(
+                                                              tractlets[tractlet_i][0][1])
+                                                      / tractlets[tractlet_i][0][1].norm()
+                        - reference[tractlet_i][0][0]
+                        + reference[tractlet_i][0][0].dot(reference[tractlet_i][0][1]) / reference[tractlet_i][0][1].norm()).norm()
+                    << " ";
+            orient_out << tractlets[tractlet_i][0][1].angle(reference[tractlet_i][0][1]) << " ";
+            len_out << tractlets[tractlet_i][0][1].norm() - reference[tractlet_i][0][1].norm()
+                    << " ";
+            curv_out << (tractlets[tractlet_i][0][2] - reference[tractlet_i][0][2]).norm() * SQRT_2
+                     << " ";
+            
+            width1_out << (tractlets[tractlet_i][1][0] - reference[tractlet_i][1][0]).norm() * SQRT_2
+                       << " ";
+            width2_out << (tractlets[tractlet_i][2][0] - reference[tractlet_i][2][0]).norm() * SQRT_2
+                       << " ";
+            
+            acs_out << tractlets[tractlet_i].acs() - reference[tractlet_i].acs() << " ";
+            
+            rot_out << tractlets[tractlet_i].rotation() << " ";
+            
+        }
+        
+        lines.resize(11);
+        
+        lines[0] = all_out.str();
+        lines[1] = tractlet_out.str();
+        lines[2] = pos_out.str();
+        lines[3] = perp_out.str();
+        lines[4] = orient_out.str();
+        lines[5] = len_out.str();
+        lines[6] = curv_out.str();
+        lines[7] = width1_out.str();
+        lines[8] = width2_out.str();
+        lines[9] = acs_out.str();
+        lines[10] = rot_out.str();
+        
+    }
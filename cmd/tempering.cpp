@@ -0,0 +1,418 @@
+/*
+ Copyright 2009 Brain Research Institute, Melbourne, Australia
+
+ Created by Tom Close on 13/03/09.
+
+ This file is part of Fourier Tract Sampling (FouTS).
+
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+extern "C" {
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
+}
+
+#include <ctime>
+
+#include "bts/cmd.h"
+
+#include "math/matrix.h"
+#include "progressbar.h"
+
+#include "bts/common.h"
+#include "bts/file.h"
+
+#include "bts/fibre/tractlet/set.h"
+#include "bts/fibre/strand/set.h"
+
+#include "bts/diffusion/model.h"
+#include "bts/image/expected/trilinear/buffer.h"
+#include "bts/image/expected/gaussian/buffer.h"
+#include "bts/image/expected/quartic/buffer.h"
+
+#include "bts/image/observed/buffer.h"
+
+#include "bts/prob/uniform.h"
+#include "bts/prob/prior.h"
+
+#include "bts/prob/likelihood.h"
+#include "bts/prob/likelihood.h"
+#include "bts/prob/likelihood/one_sided_gaussian.h"
+#include "bts/prob/likelihood/gaussian.h"
+
+#include "bts/mcmc/proposal/walker.h"
+#include "bts/mcmc/proposal/distribution.h"
+#include "bts/mcmc/proposal/distribution/gaussian.h"
+
+#include "bts/mcmc/tempering.h"
+
+#include "bts/fibre/strand/set/walker.h"
+#include "bts/fibre/tractlet/set/walker.h"
+
+#include "bts/math/common.h"
+
+#include "bts/inline_functions.h"
+
+using namespace FTS;
+SET_VERSION_DEFAULT
+;
+SET_AUTHOR("Thomas G. Close");
+SET_COPYRIGHT(NULL);
+
+DESCRIPTION = {
+    "Runs replica exchange (parallel tempering) sampling on a given image from a given starting configuration of tractlets or strands. Replicas at progressively flatter annealing factors are run in separate threads and swaps between neighbouring replicas are proposed periodically. Only the samples of the unannealed replica are saved.",
+    "",
+    NULL
+};
+
+ARGUMENTS= {
+    Argument ("input_image", "The image the tractlets will be fit against.").type_image_in(),
+
+    Argument ("inital_tractlets", "A starting point for the MCMC algorithm.").type_file (),
+
+    Argument ("samples_location", "The location where the samples will be saved. Appending '.smp' to the extension (e.g. 'samples.tst.smp') saves them to a binary sample file, which is faster to append to and to read back.").type_file (),
+
+    Argument()
+};
+
+OPTIONS= {
+
+    Option ("num_iterations", "The Number of MCMC iterations to take of the prob distribution over the tractlets")
+    + Argument ("num_iterations", "").type_integer (1, MCMC::Tempering::NUM_ITERATIONS_DEFAULT, LARGE_INT),
+
+    Option ("sample_period", "The number of MCMC iterations that will be performed before a sample is saved. Must be a multiple of the swap period.")
+    + Argument ("sample_period", "").type_integer (1, MCMC::Tempering::SAMPLE_PERIOD_DEFAULT, LARGE_INT),
+
+    Option ("num_replicas", "The number of replicas (and threads) run at different annealing factors.")
+    + Argument ("num_replicas", "").type_integer (1, MCMC::Tempering::NUM_REPLICAS_DEFAULT, LARGE_INT),
+
+    Option ("swap_period", "The number of MCMC iterations performed by each replica between proposed swaps of neighbouring replicas.")
+    + Argument ("swap_period", "").type_integer (1, MCMC::Tempering::SWAP_PERIOD_DEFAULT, LARGE_INT),
+
+    Option ("hottest_factor", "The annealing factor of the hottest replica. The factors of the other replicas are spaced geometrically between it and 1.0.")
+    + Argument ("hottest_factor", "").type_float (0.0, MCMC::Tempering::HOTTEST_FACTOR_DEFAULT, 1.0),
+
+    Option ("seed", "The random seed that is passed to the random generator. Replica 'k' is seeded with 'seed + k'.")
+    + Argument ("seed", ""),
+
+    Option ("unverbose", "Turn off verbose output of sampling."),
+
+    DIFFUSION_PARAMETERS,
+
+    EXPECTED_IMAGE_PARAMETERS,
+
+    LIKELIHOOD_PARAMETERS,
+
+    PRIOR_PARAMETERS,
+
+    PROPOSAL_WALKER_PARAMETERS,
+
+    PROPOSAL_DISTRIBUTION_PARAMETERS,
+
+    COMMON_PARAMETERS,
+
+    Option()};
+
+EXECUTE {
+    
+//-----------------//
+//  Load Arguments //
+//-----------------//
+    
+        std::string obs_image_location = argument[0];
+        std::string initial_location = argument[1];
+        std::string samples_location = argument[2];
+        
+        MR::Image::Header header(obs_image_location);
+        
+        if (header.ndim() != 4)
+            throw Exception("dwi image should contain 4 dimensions");
+        
+//----------------------------------//
+//  Get and Set Optional Parameters //
+//----------------------------------//
+        
+        size_t num_iterations = MCMC::Tempering::NUM_ITERATIONS_DEFAULT;
+        size_t sample_period = MCMC::Tempering::SAMPLE_PERIOD_DEFAULT;
+        size_t num_replicas = MCMC::Tempering::NUM_REPLICAS_DEFAULT;
+        size_t swap_period = MCMC::Tempering::SWAP_PERIOD_DEFAULT;
+        double hottest_factor = MCMC::Tempering::HOTTEST_FACTOR_DEFAULT;
+        size_t seed = time(NULL);
+        bool verbose = true;
+        
+        Options opt = get_options("num_iterations");
+        if (opt.size())
+            num_iterations = opt[0][0];
+        
+        opt = get_options("sample_period");
+        if (opt.size())
+            sample_period = opt[0][0];
+        
+        opt = get_options("num_replicas");
+        if (opt.size())
+            num_replicas = opt[0][0];
+        
+        opt = get_options("swap_period");
+        if (opt.size())
+            swap_period = opt[0][0];
+        
+        opt = get_options("hottest_factor");
+        if (opt.size())
+            hottest_factor = opt[0][0];
+        
+        opt = get_options("seed");
+        if (opt.size()) {
+            std::string seed_string = opt[0][0];
+            seed = to<size_t>(seed_string);
+        } else
+            std::cout << "No random seed supplied. Using timestamp: " << seed << std::endl;
+        
+        opt = get_options("unverbose");
+        if (opt.size())
+            verbose = false;
+        
+        // Loads parameters to construct Diffusion::Model ('diff_' prefix)
+        SET_DIFFUSION_PARAMETERS;
+        
+        // Loads parameters to construct Image::Expected::*::Buffer ('img_' prefix)
+        SET_EXPECTED_IMAGE_PARAMETERS
+        ;
+        
+        // Loads parameters to construct Prob::Likelihood ('like_' prefix)
+        SET_LIKELIHOOD_PARAMETERS
+        ;
+        
+        // Loads parameters to construct Prob::Prior ('prior_' prefix)  
+        SET_PRIOR_PARAMETERS
+        ;
+        
+        // Loads parameters to construct Proposal::Distribution ('walk_' prefix)
+        SET_PROPOSAL_WALKER_PARAMETERS(initial_location);
+        
+        // Loads parameters to construct Proposal::Distribution ('walk_' prefix)
+        SET_PROPOSAL_DISTRIBUTION_PARAMETERS;
+        
+        // Loads parameters that are common to all commands.
+        SET_COMMON_PARAMETERS;
+        
+        if (sample_period % swap_period)
+            throw Exception(
+                    "Sample period (" + str(sample_period)
+                    + ") needs to be a multiple of the swap period (" + str(swap_period) + ").");
+        
+        //--------------------------------//
+        //  Set up reference image buffer //
+        //--------------------------------//
+        
+        Image::Observed::Buffer obs_image(obs_image_location,
+                Diffusion::Encoding::Set(diff_encodings));
+        
+        //If gradient scheme is included in reference image header, use that instead of default (NB: Will override any gradients passed to '-diff_encodings' option).
+        if (header.get_DW_scheme().rows()) {
+            diff_encodings = header.get_DW_scheme();
+            diff_encodings_location = "From observed image";
+        }
+        
+        if ((header.count("diff_response_SH")) && (Math::matlab_str(diff_response_SH)
+                != header["diff_response_SH"]))
+            std::cout << std::endl << "Warning! Diffusion response function harmonics ("
+                      << Math::matlab_str(diff_response_SH) << ") do not match reference image ("
+                      << header["diff_response_SH"] + ")!" << std::endl;
+        
+        Diffusion::Model diffusion_model = Diffusion::Model::factory(diff_encodings,
+                diff_response_SH, diff_adc, diff_fa, diff_isotropic, diff_warn_b_mismatch);
+        
+        Prob::Prior prior(prior_scale, prior_freq_scale, prior_freq_aux_scale, prior_hook_scale,
+                prior_hook_num_points, prior_hook_num_width_sections, prior_density_high_scale,
+                prior_density_low_scale, prior_density_num_points, prior_acs_scale, prior_acs_mean,
+                prior_length_scale, prior_length_mean, prior_in_image_scale, prior_in_image_power,
+                Prob::PriorComponent::InImage::get_offset(obs_image, prior_in_image_border),
+                Prob::PriorComponent::InImage::get_extent(obs_image, prior_in_image_border),
+                prior_in_image_num_length_sections, prior_in_image_num_width_sections);
+        
+        //-----------------------------------------------------------------------//
+        //  Initialize Expected Images, Likelihoods, Priors and Random Generators //
+        //-----------------------------------------------------------------------//
+        
+        // Each replica is stepped in its own thread, so nothing that is written to during sampling can be shared.
+        std::vector<Image::Expected::Buffer*> exp_images;
+        std::vector<Prob::Likelihood*> likelihoods;
+        std::vector<Prob::Prior*> priors;
+        std::vector<gsl_rng*> rand_gens;
+        std::vector<MCMC::Proposal::Distribution*> proposal_distributions;
+        
+        for (size_t replica_i = 0; replica_i < num_replicas; ++replica_i) {
+            
+            Image::Expected::Buffer* exp_image = Image::Expected::Buffer::factory(exp_type,
+                    obs_image, diffusion_model, exp_num_length_sections, exp_num_width_sections,
+                    exp_interp_extent, exp_enforce_bounds, exp_half_width, exp_num_threads,
+                    exp_interp_table);
+            
+            exp_images.push_back(exp_image);
+            
+            likelihoods.push_back(
+                    Prob::Likelihood::factory(like_type, obs_image, exp_image, like_snr,
+                            like_b0_include, like_outside_scale, like_ref_b0, like_ref_signal,
+                            like_noise_map));
+            
+            priors.push_back(new Prob::Prior(prior));
+            
+            gsl_rng* rand_gen = gsl_rng_alloc(gsl_rng_taus);
+            gsl_rng_set(rand_gen, seed + replica_i);
+            
+            rand_gens.push_back(rand_gen);
+            
+            proposal_distributions.push_back(
+                    MCMC::Proposal::Distribution::factory(prop_distr_type, rand_gen));
+            
+        }
+        
+        //-------------------------//
+        //  Set Output Properties  //
+        //-------------------------//
+        
+        std::map<std::string, std::string> run_properties;
+        
+        run_properties["Method"] = "tempering";
+        run_properties["sample_period"] = str(sample_period);
+        run_properties["seed"] = str(seed);
+        run_properties["num_replicas"] = str(num_replicas);
+        run_properties["swap_period"] = str(swap_period);
+        run_properties["hottest_factor"] = str(hottest_factor);
+        run_properties["obs_image"] = obs_image_location;
+        run_properties["initial_state"] = Fibre::Base::Object::load_matlab_str(initial_location);
+        run_properties["initial_state_location"] = initial_location;
+        run_properties["num_iterations"] = str(num_iterations);
+        
+        ADD_DIFFUSION_PROPERTIES(run_properties);
+        
+        ADD_LIKELIHOOD_PROPERTIES(run_properties);
+        
+        ADD_EXPECTED_IMAGE_PROPERTIES(run_properties);
+        
+        ADD_PRIOR_PROPERTIES(run_properties);
+        
+        ADD_PROPOSAL_WALKER_PROPERTIES(run_properties);
+        
+        ADD_PROPOSAL_DISTRIBUTION_PROPERTIES(run_properties);
+        
+        ADD_COMMON_PROPERTIES(run_properties);
+        
+        //-------------------------//
+        //  Sampling from Strands  //
+        //-------------------------//
+        
+        if (File::has_extension<Fibre::Strand>(initial_location)) {
+            
+            //------------------------//
+            //  Load Initial Strands  //
+            //------------------------//
+            
+            Fibre::Strand::Set strands(initial_location);
+            
+            if (exp_base_intensity)
+                strands.set_base_intensity(exp_base_intensity);
+            
+            //----------------------//
+            // Initialize Proposers //
+            //----------------------//
+            
+            std::vector<Fibre::Strand::Set::Walker*> walkers;
+            
+            for (size_t replica_i = 0; replica_i < num_replicas; ++replica_i) {
+                walkers.push_back(
+                        Fibre::Strand::Set::Walker::factory(strands, walk_type, walk_step_scale,
+                                walk_step_location, proposal_distributions[replica_i],
+                                walk_base_intens_scale));
+                walkers.back()->schedule_blocks(strands, walk_block, walk_scan);
+            }
+            
+            //------------------//
+            // Perform sampling //
+            //------------------//
+            
+            MCMC::tempering<Fibre::Strand::Set, Prob::Likelihood, Prob::Prior>(strands,
+                    likelihoods, priors, walkers, rand_gens, samples_location, run_properties,
+                    num_iterations, sample_period, swap_period, hottest_factor, verbose);
+            
+            for (size_t replica_i = 0; replica_i < num_replicas; ++replica_i)
+                delete walkers[replica_i];
+            
+            //---------------------------//
+            //  Sampling from Tractlets  //
+            //---------------------------//
+            
+        } else if (File::has_extension<Fibre::Tractlet>(initial_location)) {
+            
+            //----------------//
+            // Load Tractlets //
+            //----------------//
+            
+            Fibre::Tractlet::Set tractlets(initial_location);
+            
+            if (exp_base_intensity)
+                tractlets.set_base_intensity(exp_base_intensity);
+            
+            //----------------------//
+            // Initialize Proposers //
+            //----------------------//
+            
+            std::vector<Fibre::Tractlet::Set::Walker*> walkers;
+            
+            for (size_t replica_i = 0; replica_i < num_replicas; ++replica_i) {
+                walkers.push_back(
+                        Fibre::Tractlet::Set::Walker::factory(tractlets, walk_type,
+                                walk_step_scale, walk_step_location,
+                                proposal_distributions[replica_i], walk_base_intens_scale));
+                walkers.back()->schedule_blocks(tractlets, walk_block, walk_scan);
+            }
+            
+            if (walk_type == "manifold") {
+                
+                Fibre::Tractlet::Set dummy(tractlets);
+                
+                //Ensures that tractlets lie on the manifold to begin with
+                walkers[0]->step(tractlets, dummy);
+                
+                tractlets = dummy;
+                
+            }
+            
+            //------------------//
+            // Perform sampling //
+            //------------------//
+            
+            MCMC::tempering<Fibre::Tractlet::Set, Prob::Likelihood, Prob::Prior>(tractlets,
+                    likelihoods, priors, walkers, rand_gens, samples_location, run_properties,
+                    num_iterations, sample_period, swap_period, hottest_factor, verbose);
+            
+            for (size_t replica_i = 0; replica_i < num_replicas; ++replica_i)
+                delete walkers[replica_i];
+            
+        }
+        
+        for (size_t replica_i = 0; replica_i < num_replicas; ++replica_i) {
+            
+            delete likelihoods[replica_i];
+            delete exp_images[replica_i];
+            delete priors[replica_i];
+            delete proposal_distributions[replica_i];
+            
+            gsl_rng_free(rand_gens[replica_i]);
+            
+        }
+        
+    }
@@ -46,6 +46,7 @@ extern "C" {
 
 #include "bts/mcmc/metropolis.h"
 #include "bts/mcmc/hamiltonian.h"
+#include "bts/mcmc/nuts.h"
 #include "bts/mcmc/riemannian.h"
 
 #include "bts/triple.h"
@@ -97,7 +98,7 @@ const char* AXIS_SCALES_DEFAULT_LOCATION_DEFAULT =
         "/home/tclose/data/prob/test/gaussian/axis_scales.sta";
 OPTIONS= {
 
-    Option ("algorithm", "Select the algorithm to use (either 'metropolis', 'hamiltonian' at this stage).")
+    Option ("algorithm", "Select the algorithm to use (either 'metropolis', 'hamiltonian', 'nuts' or 'riemannian' at this stage).")
     + Argument ("algorithm", "").type_text(),
 
     Option ("prob_type", "Select the probability object (either 'Prob::Test::Gaussian' or 'Prob::Test::Peaks' at this stage.")
@@ -337,10 +338,17 @@ EXECUTE {
                         num_samples, num_leapfrog_steps, rand_gen, true, save_iterations,
                         suppress_print);
                 
+            } else if (algorithm_type == "nuts") {
+                
+                MCMC::nuts<MCMC::State, Prob::Test::Landscape, Prob::Test::Landscape>(state,
+                        test_peaks, test_peaks, momentum, samples_location, run_properties,
+                        num_samples, MCMC::NUTS::MAX_TREE_DEPTH_DEFAULT, rand_gen, true,
+                        suppress_print);
+                
             } else
                 throw Exception(
                         "Unrecognised value for '-algorithm' option \"" + algorithm_type
-                        + "\", can be either \"metropolis\" or \"hamiltonian\".");
+                        + "\", can be either \"metropolis\", \"hamiltonian\" or \"nuts\".");
             
             if (!lnd_location.size())
                 test_peaks.save(samples_location + ".lnd");
@@ -377,6 +385,13 @@ EXECUTE {
                         num_samples, num_leapfrog_steps, rand_gen, true, save_iterations,
                         suppress_print);
                 
+            } else if (algorithm_type == "nuts") {
+                
+                MCMC::nuts<MCMC::State, Prob::Test::Gaussian, Prob::Test::Gaussian>(state,
+                        test_gaussian, test_gaussian, momentum, samples_location, run_properties,
+                        num_samples, MCMC::NUTS::MAX_TREE_DEPTH_DEFAULT, rand_gen, true,
+                        suppress_print);
+                
             } else if (!strcmp(algorithm_type.c_str(), "riemannian")) {
                 
                 MCMC::Proposal::Momentum::Weighted::NonSeparable nonseparable_momentum =
@@ -394,7 +409,7 @@ EXECUTE {
             } else
                 throw Exception(
                         "Unrecognised value for '-algorithm' option \"" + algorithm_type
-                        + "\", can be either 'metropolis', 'hamiltonian' or 'riemannian'.");
+                        + "\", can be either 'metropolis', 'hamiltonian', 'nuts' or 'riemannian'.");
             
         } else if (prob_type == "Prob::Test::BayesLogRegression") {
             
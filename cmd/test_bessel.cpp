@@ -0,0 +1,177 @@
+/*
+ Copyright 2009 Brain Research Institute, Melbourne, Australia
+ 
+ Written by Thomas G. Close, 04/03/2009.
+ 
+ This file is part of Fourier Tract Sampling (FouTS).
+ 
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+ 
+ */
+
+extern "C" {
+#include <gsl/gsl_rng.h>
+}
+
+#include "math/bessel.h"
+
+#include "bts/cmd.h"
+
+#include "bts/common.h"
+
+#include "bts/math/bessel.h"
+
+#include "bts/inline_functions.h"
+
+using namespace FTS;
+
+SET_VERSION_DEFAULT
+;
+SET_AUTHOR("Thomas G. Close");
+SET_COPYRIGHT(NULL);
+
+DESCRIPTION = {
+    "test_bessel",
+    "Checks the scalar and batched log(I0(x)) and I1(x)/I0(x) used by the Rician likelihood against the scaled Bessel "
+    "functions in lib/math/bessel.h, at random points on both sides of the series limit (x = 3) and at very large x.",
+    NULL
+};
+
+ARGUMENTS= {
+    Argument()
+};
+
+const size_t NUM_SAMPLES_DEFAULT = 10000;
+const double MAX_X_DEFAULT = 1000.0;
+const double TOLERANCE_DEFAULT = 1e-12;
+OPTIONS= {
+    
+    Option ("num_samples", "The number of random points to test on each side of the series limit.")
+    + Argument ("num_samples", "").type_integer (1, NUM_SAMPLES_DEFAULT, LARGE_INT),
+    
+    Option ("max_x", "The maximum value of the random points above the series limit.")
+    + Argument ("max_x", "").type_float (0.0, MAX_X_DEFAULT, LARGE_FLOAT),
+    
+    Option ("tolerance", "The maximum relative difference from the reference functions before the test fails.")
+    + Argument ("tolerance", "").type_float (0.0, TOLERANCE_DEFAULT, LARGE_FLOAT),
+    
+    Option ("seed", "The random seed that is passed to the random generator")
+    + Argument ("seed", ""),
+    
+    Option()};
+
+double relative_difference(double a, double b) {
+    return std::abs(a - b) / std::max(1.0, std::max(std::abs(a), std::abs(b)));
+}
+
+EXECUTE {
+        
+        size_t num_samples = NUM_SAMPLES_DEFAULT;
+        double max_x = MAX_X_DEFAULT;
+        double tolerance = TOLERANCE_DEFAULT;
+        size_t seed = time(NULL);
+        
+        Options opt = get_options("num_samples");
+        if (opt.size())
+            num_samples = opt[0][0];
+        
+        opt = get_options("max_x");
+        if (opt.size())
+            max_x = opt[0][0];
+        
+        opt = get_options("tolerance");
+        if (opt.size())
+            tolerance = opt[0][0];
+        
+        opt = get_options("seed");
+        if (opt.size()) {
+            std::string seed_string = opt[0][0];
+            seed = to<size_t>(seed_string);
+        } else
+            std::cout << "No random seed supplied. Using timestamp: " << seed << std::endl;
+        
+        gsl_rng* rand_gen = gsl_rng_alloc(gsl_rng_taus);
+        gsl_rng_set(rand_gen, seed);
+        
+        double limit = Math::Bessel::SERIES_LIMIT;
+        
+        // Random points below and above the series limit, the limit itself and points large enough to overflow the
+        // unscaled power series.
+        std::vector<double> x;
+        
+        for (size_t sample_i = 0; sample_i < num_samples; ++sample_i)
+            x.push_back(limit * gsl_rng_uniform(rand_gen));
+        
+        for (size_t sample_i = 0; sample_i < num_samples; ++sample_i)
+            x.push_back(limit + (max_x - limit) * gsl_rng_uniform(rand_gen));
+        
+        x.push_back(0.0);
+        x.push_back(limit);
+        x.push_back(1e6);
+        x.push_back(1e300);
+        
+        gsl_rng_free(rand_gen);
+        
+        std::vector<double> batch_log_i0(x.size()), batch_ratio(x.size());
+        
+        Math::Bessel::log_i0_scaled(&x[0], &batch_log_i0[0], x.size());
+        Math::Bessel::i1_i0_ratio(&x[0], &batch_ratio[0], x.size());
+        
+        // Indexed by [below limit, above limit].
+        double max_log_i0_diff[2] = { 0.0, 0.0 }, max_ratio_diff[2] = { 0.0, 0.0 };
+        
+        for (size_t sample_i = 0; sample_i < x.size(); ++sample_i) {
+            
+            size_t side = x[sample_i] > limit;
+            
+            double ref_i0 = MR::Math::Bessel::I0_scaled(x[sample_i]);
+            double ref_log_i0 = log(ref_i0);
+            double ref_ratio = MR::Math::Bessel::I1_scaled(x[sample_i]) / ref_i0;
+            
+            double log_i0 = Math::Bessel::log_i0_scaled(x[sample_i]);
+            double ratio = Math::Bessel::i1_i0_ratio(x[sample_i]);
+            
+            double sum = log_i0 + batch_log_i0[sample_i] + ratio + batch_ratio[sample_i];
+            
+            if (isnan(sum) || isinf(sum))
+                throw Exception("Non-finite Bessel function value at x = " + str(x[sample_i]) + ".");
+            
+            max_log_i0_diff[side] = max2(max_log_i0_diff[side], relative_difference(log_i0, ref_log_i0));
+            max_log_i0_diff[side] = max2(max_log_i0_diff[side],
+                    relative_difference(batch_log_i0[sample_i], ref_log_i0));
+            
+            max_ratio_diff[side] = max2(max_ratio_diff[side], relative_difference(ratio, ref_ratio));
+            max_ratio_diff[side] = max2(max_ratio_diff[side],
+                    relative_difference(batch_ratio[sample_i], ref_ratio));
+            
+        }
+        
+        std::cout << "Maximum relative differences from lib/math/bessel.h over " << x.size() << " points:"
+                  << std::endl;
+        std::cout << "  log(I0), x <= " << limit << ": " << max_log_i0_diff[0] << std::endl;
+        std::cout << "  log(I0), x > " << limit << ":  " << max_log_i0_diff[1] << std::endl;
+        std::cout << "  I1/I0, x <= " << limit << ":   " << max_ratio_diff[0] << std::endl;
+        std::cout << "  I1/I0, x > " << limit << ":    " << max_ratio_diff[1] << std::endl;
+        
+        double max_diff = max2(max2(max_log_i0_diff[0], max_log_i0_diff[1]),
+                max2(max_ratio_diff[0], max_ratio_diff[1]));
+        
+        if (max_diff > tolerance)
+            throw Exception(
+                    "Bessel functions differ from lib/math/bessel.h by " + str(max_diff) + " (tolerance "
+                    + str(tolerance) + ").");
+        
+        std::cout << "Passed." << std::endl;
+        
+    }
@@ -0,0 +1,279 @@
+/*
+ Copyright 2009 Brain Research Institute, Melbourne, Australia
+ 
+ Written by Thomas G. Close, 04/03/2009.
+ 
+ This file is part of Fourier Tract Sampling (FouTS).
+ 
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+ 
+ */
+
+extern "C" {
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
+}
+
+#include "math/cholesky.h"
+
+#include "bts/cmd.h"
+
+#include "bts/common.h"
+
+#include "bts/math/block_sparse.h"
+#include "bts/math/sparse_cholesky.h"
+
+#include "bts/inline_functions.h"
+
+using namespace FTS;
+
+SET_VERSION_DEFAULT
+;
+SET_AUTHOR("Thomas G. Close");
+SET_COPYRIGHT(NULL);
+
+DESCRIPTION = {
+    "test_sparse_cholesky",
+    "Checks the sparse Cholesky decomposition (of both dense and block-sparse matrices) against the dense Cholesky "
+    "decomposition on randomly generated, block-sparse positive definite matrices, comparing the solution of a linear "
+    "system, the inverse and the log determinant.",
+    NULL
+};
+
+ARGUMENTS= {
+    Argument()
+};
+
+const size_t NUM_TRIALS_DEFAULT = 100;
+const size_t MAX_NUM_BLOCKS_DEFAULT = 20;
+const size_t MAX_BLOCK_SIZE_DEFAULT = 12;
+const double COUPLING_DEFAULT = 0.2;
+const double TOLERANCE_DEFAULT = 1e-8;
+OPTIONS= {
+    
+    Option ("num_trials", "The number of random matrices to test.")
+    + Argument ("num_trials", "").type_integer (1, NUM_TRIALS_DEFAULT, LARGE_INT),
+    
+    Option ("max_num_blocks", "The maximum number of blocks (fibres) along each dimension of the matrices.")
+    + Argument ("max_num_blocks", "").type_integer (1, MAX_NUM_BLOCKS_DEFAULT, LARGE_INT),
+    
+    Option ("max_block_size", "The maximum size of each block.")
+    + Argument ("max_block_size", "").type_integer (1, MAX_BLOCK_SIZE_DEFAULT, LARGE_INT),
+    
+    Option ("coupling", "The probability that a pair of blocks is coupled (i.e. has a nonzero off-diagonal block).")
+    + Argument ("coupling", "").type_float (0.0, COUPLING_DEFAULT, 1.0),
+    
+    Option ("tolerance", "The maximum relative difference from the dense decomposition before the test fails.")
+    + Argument ("tolerance", "").type_float (0.0, TOLERANCE_DEFAULT, LARGE_FLOAT),
+    
+    Option ("seed", "The random seed that is passed to the random generator")
+    + Argument ("seed", ""),
+    
+    Option()};
+
+double relative_difference(double a, double b) {
+    return std::abs(a - b) / std::max(1.0, std::max(std::abs(a), std::abs(b)));
+}
+
+EXECUTE {
+        
+        size_t num_trials = NUM_TRIALS_DEFAULT;
+        size_t max_num_blocks = MAX_NUM_BLOCKS_DEFAULT;
+        size_t max_block_size = MAX_BLOCK_SIZE_DEFAULT;
+        double coupling = COUPLING_DEFAULT;
+        double tolerance = TOLERANCE_DEFAULT;
+        size_t seed = time(NULL);
+        
+        Options opt = get_options("num_trials");
+        if (opt.size())
+            num_trials = opt[0][0];
+        
+        opt = get_options("max_num_blocks");
+        if (opt.size())
+            max_num_blocks = opt[0][0];
+        
+        opt = get_options("max_block_size");
+        if (opt.size())
+            max_block_size = opt[0][0];
+        
+        opt = get_options("coupling");
+        if (opt.size())
+            coupling = opt[0][0];
+        
+        opt = get_options("tolerance");
+        if (opt.size())
+            tolerance = opt[0][0];
+        
+        opt = get_options("seed");
+        if (opt.size()) {
+            std::string seed_string = opt[0][0];
+            seed = to<size_t>(seed_string);
+        } else
+            std::cout << "No random seed supplied. Using timestamp: " << seed << std::endl;
+        
+        gsl_rng* rand_gen = gsl_rng_alloc(gsl_rng_taus);
+        gsl_rng_set(rand_gen, seed);
+        
+        double max_solve_diff = 0.0, max_inverse_diff = 0.0, max_log_det_diff = 0.0,
+                max_lower_mult_diff = 0.0, max_block_diff = 0.0;
+        
+        for (size_t trial_i = 0; trial_i < num_trials; ++trial_i) {
+            
+            //------------------------------------------------------//
+            //  Generate a random block-sparse positive definite A  //
+            //------------------------------------------------------//
+            
+            size_t num_blocks = 1 + gsl_rng_uniform_int(rand_gen, max_num_blocks);
+            
+            std::vector<size_t> block_sizes;
+            
+            for (size_t block_i = 0; block_i < num_blocks; ++block_i)
+                block_sizes.push_back(1 + gsl_rng_uniform_int(rand_gen, max_block_size));
+            
+            Math::BlockSparse sparse_A(block_sizes);
+            
+            for (size_t col_block = 0; col_block < num_blocks; ++col_block)
+                for (size_t row_block = col_block; row_block < num_blocks; ++row_block)
+                    if (row_block == col_block || gsl_rng_uniform(rand_gen) < coupling) {
+                        
+                        MR::Math::Matrix<double>& lower = sparse_A.block(row_block, col_block);
+                        MR::Math::Matrix<double>& upper = sparse_A.block(col_block, row_block);
+                        
+                        for (size_t row_i = 0; row_i < lower.rows(); ++row_i)
+                            for (size_t col_i = 0; col_i < lower.columns(); ++col_i)
+                                if (row_block != col_block || row_i >= col_i)
+                                    upper(col_i, row_i) = lower(row_i, col_i) = gsl_ran_gaussian(
+                                            rand_gen, 1.0);
+                        
+                    }
+            
+            // Diagonally dominant, so positive definite.
+            sparse_A.add_diagonal(sparse_A.size());
+            
+            size_t dim = sparse_A.size();
+            
+            MR::Math::Matrix<double> A(dim, dim);
+            sparse_A.copy_to(A);
+            
+            MR::Math::Vector<double> b(dim);
+            
+            for (size_t elem_i = 0; elem_i < dim; ++elem_i)
+                b[elem_i] = gsl_ran_gaussian(rand_gen, 1.0);
+            
+            //---------------------------//
+            //  Reference decomposition  //
+            //---------------------------//
+            
+            MR::Math::Matrix<double> A_chol(A);
+            MR::Math::Cholesky::decomp(A_chol);
+            
+            MR::Math::Vector<double> x(dim);
+            MR::Math::Cholesky::solve(x, A_chol, b);
+            
+            MR::Math::Matrix<double> A_inv(A_chol);
+            MR::Math::Cholesky::inv_from_decomp(A_inv);
+            
+            double log_det = 0.0;
+            
+            for (size_t elem_i = 0; elem_i < dim; ++elem_i)
+                log_det += 2.0 * log(A_chol(elem_i, elem_i));
+            
+            //-------------------------------------------------------------//
+            //  Sparse decompositions of the dense and block-sparse copies //
+            //-------------------------------------------------------------//
+            
+            Math::SparseCholesky dense_chol, sparse_chol;
+            
+            dense_chol.decomp(A);
+            sparse_chol.decomp(sparse_A);
+            
+            // Decompose again with the same pattern to check the reuse of the analysis.
+            sparse_chol.decomp(sparse_A);
+            
+            MR::Math::Vector<double> sparse_x(dim), dense_x(dim);
+            
+            sparse_chol.solve(sparse_x, b);
+            dense_chol.solve(dense_x, b);
+            
+            MR::Math::Matrix<double> sparse_A_inv(dim, dim);
+            
+            sparse_chol.inverse(sparse_A_inv);
+            
+            for (size_t row_i = 0; row_i < dim; ++row_i) {
+                
+                max_solve_diff = max2(max_solve_diff, relative_difference(sparse_x[row_i], x[row_i]));
+                max_solve_diff = max2(max_solve_diff, relative_difference(dense_x[row_i], x[row_i]));
+                
+                for (size_t col_i = 0; col_i <= row_i; ++col_i)
+                    max_inverse_diff = max2(max_inverse_diff,
+                            relative_difference(sparse_A_inv(row_i, col_i), A_inv(row_i, col_i)));
+                
+            }
+            
+            max_log_det_diff = max2(max_log_det_diff, relative_difference(sparse_chol.log_det(), log_det));
+            max_log_det_diff = max2(max_log_det_diff, relative_difference(dense_chol.log_det(), log_det));
+            
+            // y = P' L b has y' A^-1 y = b' b.
+            MR::Math::Vector<double> y(dim), A_inv_y(dim);
+            
+            sparse_chol.lower_mult(y, b);
+            sparse_chol.solve(A_inv_y, y);
+            
+            max_lower_mult_diff = max2(max_lower_mult_diff,
+                    relative_difference(MR::Math::dot(y, A_inv_y), MR::Math::dot(b, b)));
+            
+            // The block-sparse products against their dense equivalents.
+            MR::Math::Vector<double> sparse_Ab(dim), Ab(dim);
+            
+            sparse_A.mult(sparse_Ab, b);
+            MR::Math::mult(Ab, A, b);
+            
+            for (size_t elem_i = 0; elem_i < dim; ++elem_i)
+                max_block_diff = max2(max_block_diff, relative_difference(sparse_Ab[elem_i], Ab[elem_i]));
+            
+            max_block_diff = max2(max_block_diff,
+                    relative_difference(sparse_A.inner(b, b), MR::Math::dot(b, Ab)));
+            
+            double trace = 0.0;
+            
+            for (size_t row_i = 0; row_i < dim; ++row_i)
+                for (size_t col_i = 0; col_i < dim; ++col_i)
+                    trace += A_inv(row_i, col_i) * A(col_i, row_i);
+            
+            max_block_diff = max2(max_block_diff,
+                    relative_difference(sparse_A.trace_product(A_inv), trace));
+            
+        }
+        
+        gsl_rng_free(rand_gen);
+        
+        std::cout << "Maximum relative differences from dense Cholesky over " << num_trials
+                  << " matrices:" << std::endl;
+        std::cout << "  solve:        " << max_solve_diff << std::endl;
+        std::cout << "  inverse:      " << max_inverse_diff << std::endl;
+        std::cout << "  log_det:      " << max_log_det_diff << std::endl;
+        std::cout << "  lower_mult:   " << max_lower_mult_diff << std::endl;
+        std::cout << "  block sparse: " << max_block_diff << std::endl;
+        
+        double max_diff = max2(max2(max2(max_solve_diff, max_inverse_diff), max2(max_log_det_diff,
+                max_lower_mult_diff)), max_block_diff);
+        
+        if (max_diff > tolerance)
+            throw Exception(
+                    "Sparse Cholesky decomposition differs from dense decomposition by " + str(max_diff)
+                    + " (tolerance " + str(tolerance) + ").");
+        
+        std::cout << "Passed." << std::endl;
+        
+    }
@@ -20,6 +20,14 @@
 
  */
 
+// The vectorised weighting sweeps are compiled for AVX and AVX-512 with target attributes and selected when the
+// library is loaded from the instruction sets the processor supports, so that they are used by the default
+// (-march=x86-64) build. Other compilers and architectures only use the scalar sweep.
+#if defined(__GNUC__) && __GNUC__ >= 5 && (defined(__x86_64__) || defined(__i386__))
+#define FTS_WEIGHTING_SWEEP_DISPATCH
+#include <immintrin.h>
+#endif
+
 #include "dwi/gradient.h"
 #include "math/matrix.h"
 
@@ -59,6 +67,147 @@ namespace FTS {
         const double Model::M0_HARMONIC_L6[5] = { -20, 420, -1260, 924, 0 };
         const double Model::M0_HARMONIC_L8[5] = { 70, -2320, 13860, -24024, 12870 };
         
+        namespace {
+            
+            //Sweeps the weightings of encodings 'encode_i' onwards, evaluating the polynomial in cos^2 by Horner's scheme.
+            //Returns the number of encodings.
+            size_t weighting_sweep_scalar(const double* tangent, double inv_tan_dot_tan,
+                                          const double* orients, const double* coeffs,
+                                          size_t num_coeffs, size_t num_encodes, size_t encode_i,
+                                          double* weightings) {
+                
+                const double* orient_x = orients;
+                const double* orient_y = orient_x + num_encodes;
+                const double* orient_z = orient_y + num_encodes;
+                
+                for (; encode_i < num_encodes; ++encode_i) {
+                    
+                    double tan_dot_orient = tangent[X] * orient_x[encode_i] + tangent[Y] * orient_y[encode_i]
+                                            + tangent[Z] * orient_z[encode_i];
+                    
+                    double cos2 = tan_dot_orient * tan_dot_orient * inv_tan_dot_tan;
+                    
+                    double weight = coeffs[(num_coeffs - 1) * num_encodes + encode_i];
+                    
+                    for (size_t p_int = num_coeffs - 1; p_int > 0; --p_int)
+                        weight = weight * cos2 + coeffs[(p_int - 1) * num_encodes + encode_i];
+                    
+                    weightings[encode_i] = weight;
+                    
+                }
+                
+                return encode_i;
+                
+            }
+            
+#ifdef FTS_WEIGHTING_SWEEP_DISPATCH
+            
+            //The vectorised sweeps return the first encoding that doesn't fill a whole vector, which is left to the
+            //scalar sweep. AVX-512 implies FMA, which the AVX-512 sweep uses for Horner's scheme, so its weightings
+            //can differ from those of the other sweeps in the last bit.
+            __attribute__((target("avx")))
+            size_t weighting_sweep_avx(const double* tangent, double inv_tan_dot_tan, const double* orients,
+                                       const double* coeffs, size_t num_coeffs, size_t num_encodes,
+                                       double* weightings) {
+                
+                const double* orient_x = orients;
+                const double* orient_y = orient_x + num_encodes;
+                const double* orient_z = orient_y + num_encodes;
+                
+                __m256d tan_x = _mm256_set1_pd(tangent[X]);
+                __m256d tan_y = _mm256_set1_pd(tangent[Y]);
+                __m256d tan_z = _mm256_set1_pd(tangent[Z]);
+                __m256d inv_norm2 = _mm256_set1_pd(inv_tan_dot_tan);
+                
+                size_t encode_i = 0;
+                
+                for (; encode_i + 4 <= num_encodes; encode_i += 4) {
+                    
+                    __m256d tan_dot_orient = _mm256_add_pd(
+                            _mm256_add_pd(_mm256_mul_pd(tan_x, _mm256_loadu_pd(orient_x + encode_i)),
+                                    _mm256_mul_pd(tan_y, _mm256_loadu_pd(orient_y + encode_i))),
+                            _mm256_mul_pd(tan_z, _mm256_loadu_pd(orient_z + encode_i)));
+                    
+                    __m256d cos2 = _mm256_mul_pd(_mm256_mul_pd(tan_dot_orient, tan_dot_orient),
+                            inv_norm2);
+                    
+                    __m256d weight = _mm256_loadu_pd(coeffs + (num_coeffs - 1) * num_encodes + encode_i);
+                    
+                    for (size_t p_int = num_coeffs - 1; p_int > 0; --p_int)
+                        weight = _mm256_add_pd(_mm256_mul_pd(weight, cos2),
+                                _mm256_loadu_pd(coeffs + (p_int - 1) * num_encodes + encode_i));
+                    
+                    _mm256_storeu_pd(weightings + encode_i, weight);
+                    
+                }
+                
+                return encode_i;
+                
+            }
+            
+            __attribute__((target("avx512f")))
+            size_t weighting_sweep_avx512(const double* tangent, double inv_tan_dot_tan,
+                                          const double* orients, const double* coeffs, size_t num_coeffs,
+                                          size_t num_encodes, double* weightings) {
+                
+                const double* orient_x = orients;
+                const double* orient_y = orient_x + num_encodes;
+                const double* orient_z = orient_y + num_encodes;
+                
+                __m512d tan_x = _mm512_set1_pd(tangent[X]);
+                __m512d tan_y = _mm512_set1_pd(tangent[Y]);
+                __m512d tan_z = _mm512_set1_pd(tangent[Z]);
+                __m512d inv_norm2 = _mm512_set1_pd(inv_tan_dot_tan);
+                
+                size_t encode_i = 0;
+                
+                for (; encode_i + 8 <= num_encodes; encode_i += 8) {
+                    
+                    __m512d tan_dot_orient = _mm512_fmadd_pd(tan_z, _mm512_loadu_pd(orient_z + encode_i),
+                            _mm512_fmadd_pd(tan_y, _mm512_loadu_pd(orient_y + encode_i),
+                                    _mm512_mul_pd(tan_x, _mm512_loadu_pd(orient_x + encode_i))));
+                    
+                    __m512d cos2 = _mm512_mul_pd(_mm512_mul_pd(tan_dot_orient, tan_dot_orient),
+                            inv_norm2);
+                    
+                    __m512d weight = _mm512_loadu_pd(coeffs + (num_coeffs - 1) * num_encodes + encode_i);
+                    
+                    for (size_t p_int = num_coeffs - 1; p_int > 0; --p_int)
+                        weight = _mm512_fmadd_pd(weight, cos2,
+                                _mm512_loadu_pd(coeffs + (p_int - 1) * num_encodes + encode_i));
+                    
+                    _mm512_storeu_pd(weightings + encode_i, weight);
+                    
+                }
+                
+                return encode_i;
+                
+            }
+            
+            enum SweepLevel {
+                SCALAR_SWEEP, AVX_SWEEP, AVX512_SWEEP
+            };
+            
+            SweepLevel supported_sweep_level() {
+                
+                __builtin_cpu_init();
+                
+                if (__builtin_cpu_supports("avx512f"))
+                    return AVX512_SWEEP;
+                else if (__builtin_cpu_supports("avx"))
+                    return AVX_SWEEP;
+                else
+                    return SCALAR_SWEEP;
+                
+            }
+            
+            //Set when the library is loaded, before any threads are started.
+            const SweepLevel SWEEP_LEVEL = supported_sweep_level();
+            
+#endif
+        
+        }
+        
         Model Model::factory(const MR::Math::Matrix<double>& encodings_matrix,
                              const MR::Math::Matrix<double>& response_SHs, double adc, double fa,
                              bool include_isotropic, bool warn_on_b_mismatch) {
@@ -99,13 +248,155 @@ namespace FTS {
             
         }
         
+        void Model::pack() {
+            
+            size_t num_encodes = num_encodings();
+            
+            num_packed_coeffs = 0;
+            
+            for (size_t encode_i = 0; encode_i < num_encodes; ++encode_i)
+                if (responses[encode_i].coefficients().size() > num_packed_coeffs)
+                    num_packed_coeffs = responses[encode_i].coefficients().size();
+            
+            //Responses without coefficients have zero weighting, which is packed as a single zero coefficient so that the
+            //sweeps always have a coefficient to start Horner's scheme from.
+            if (!num_packed_coeffs)
+                num_packed_coeffs = 1;
+            
+            packed_orients.assign(3 * num_encodes, 0.0);
+            packed_coeffs.assign(num_packed_coeffs * num_encodes, 0.0);
+            
+            for (size_t encode_i = 0; encode_i < num_encodes; ++encode_i) {
+                
+                const Response& response = responses[encode_i];
+                
+                for (size_t dim_i = 0; dim_i < 3; ++dim_i)
+                    packed_orients[dim_i * num_encodes + encode_i] = response[dim_i];
+                
+                for (size_t p_int = 0; p_int < response.coefficients().size(); ++p_int)
+                    packed_coeffs[p_int * num_encodes + encode_i] = response.coefficients()[p_int];
+                
+            }
+            
+        }
+        
+        void Model::weighting_sweep(const Coord& tangent, double* weightings) const {
+            
+            size_t num_encodes = num_encodings();
+            
+            if (!num_encodes)
+                return;
+            
+            //If the tangent is zero only the 0th order coefficient contributes (as in Response::weighting), which is
+            //achieved by setting the squared cosine to zero.
+            double tan_dot_tan = tangent.norm2();
+            double inv_tan_dot_tan = tan_dot_tan ? 1.0 / tan_dot_tan : 0.0;
+            
+            const double tan[3] = { tangent[X], tangent[Y], tangent[Z] };
+            const double* orients = &packed_orients[0];
+            const double* coeffs = &packed_coeffs[0];
+            
+            size_t encode_i = 0;
+            
+#ifdef FTS_WEIGHTING_SWEEP_DISPATCH
+            
+            if (SWEEP_LEVEL == AVX512_SWEEP)
+                encode_i = weighting_sweep_avx512(tan, inv_tan_dot_tan, orients, coeffs, num_packed_coeffs,
+                        num_encodes, weightings);
+            else if (SWEEP_LEVEL == AVX_SWEEP)
+                encode_i = weighting_sweep_avx(tan, inv_tan_dot_tan, orients, coeffs, num_packed_coeffs,
+                        num_encodes, weightings);
+            
+#endif
+            
+            //Scalar fallback (and remainder of the vectorised sweeps).
+            weighting_sweep_scalar(tan, inv_tan_dot_tan, orients, coeffs, num_packed_coeffs, num_encodes,
+                    encode_i, weightings);
+            
+        }
+        
+        void Model::weighting_sweep(const Coord& tangent, double* weightings, Coord* gradients,
+                                    Coord::Tensor* hessians) const {
+            
+            size_t num_encodes = num_encodings();
+            
+            double tan_dot_tan = tangent.norm2();
+            double inv_tan_dot_tan = tan_dot_tan ? 1.0 / tan_dot_tan : 0.0;
+            double inv_tan_dot_tan2 = inv_tan_dot_tan * inv_tan_dot_tan;
+            
+            const double* orient_x = &packed_orients[0];
+            const double* orient_y = orient_x + num_encodes;
+            const double* orient_z = orient_y + num_encodes;
+            const double* coeffs = &packed_coeffs[0];
+            
+            for (size_t encode_i = 0; encode_i < num_encodes; ++encode_i) {
+                
+                Coord orient(orient_x[encode_i], orient_y[encode_i], orient_z[encode_i]);
+                
+                double tan_dot_orient = tangent.dot(orient);
+                
+                double cos2 = tan_dot_orient * tan_dot_orient * inv_tan_dot_tan;
+                
+                //Evaluate the polynomial in cos^2 along with its first derivative and half its second derivative using
+                //Horner's scheme.
+                double weight = coeffs[(num_packed_coeffs - 1) * num_encodes + encode_i];
+                double d_weight = 0.0;
+                double half_d2_weight = 0.0;
+                
+                for (size_t p_int = num_packed_coeffs - 1; p_int > 0; --p_int) {
+                    half_d2_weight = half_d2_weight * cos2 + d_weight;
+                    d_weight = d_weight * cos2 + weight;
+                    weight = weight * cos2 + coeffs[(p_int - 1) * num_encodes + encode_i];
+                }
+                
+                weightings[encode_i] = weight;
+                
+                //The gradient of cos^2 with respect to the tangent, 2(o.t)/|t|^2 o - 2(o.t)^2/|t|^4 t, which replaces the
+                //division by (o.t) in Response::weighting.
+                double orient_scale = 2.0 * tan_dot_orient * inv_tan_dot_tan;
+                double tangent_scale = -2.0 * tan_dot_orient * tan_dot_orient * inv_tan_dot_tan2;
+                
+                Coord d_cos2 = orient * orient_scale + tangent * tangent_scale;
+                
+                gradients[encode_i] = d_cos2 * d_weight;
+                
+                if (hessians) {
+                    
+                    //The Hessian of cos^2 is 2/|t|^2 oo' - 4(o.t)/|t|^4 (ot' + to') + 8(o.t)^2/|t|^6 tt' - 2(o.t)^2/|t|^4 I.
+                    double orient2_scale = 2.0 * inv_tan_dot_tan;
+                    double cross_scale = -4.0 * tan_dot_orient * inv_tan_dot_tan2;
+                    double tangent2_scale = -4.0 * tangent_scale * inv_tan_dot_tan;
+                    
+                    Coord::Tensor& hessian = hessians[encode_i];
+                    
+                    for (size_t row_i = 0; row_i < 3; ++row_i)
+                        for (size_t col_i = 0; col_i < 3; ++col_i) {
+                            
+                            double d2_cos2 = orient2_scale * orient[row_i] * orient[col_i]
+                                             + cross_scale * (orient[row_i] * tangent[col_i]
+                                                              + tangent[row_i] * orient[col_i])
+                                             + tangent2_scale * tangent[row_i] * tangent[col_i];
+                            
+                            if (row_i == col_i)
+                                d2_cos2 += tangent_scale;
+                            
+                            hessian(row_i, col_i) = 2.0 * half_d2_weight * d_cos2[row_i] * d_cos2[col_i]
+                                                    + d_weight * d2_cos2;
+                            
+                        }
+                    
+                }
+                
+            }
+            
+        }
+        
         void Model::precalculate_weightings(Fibre::Strand::Section& section) const {
             
             section.precalc_weightings.resize(num_encodings());
             
-            for (size_t response_i = 0; response_i < num_encodings(); ++response_i)
-                section.precalc_weightings[response_i] = operator[](response_i).weighting(
-                        section.tangent());
+            if (num_encodings())
+                weighting_sweep(section.tangent(), &section.precalc_weightings[0]);
             
         }
         
@@ -114,9 +405,9 @@ namespace FTS {
             section.precalc_weightings.resize(num_encodings());
             section.precalc_weight_gradients.resize(num_encodings());
             
-            for (size_t response_i = 0; response_i < num_encodings(); ++response_i)
-                section.precalc_weightings[response_i] = operator[](response_i).weighting(
-                        section.tangent(), section.precalc_weight_gradients[response_i]);
+            if (num_encodings())
+                weighting_sweep(section.tangent(), &section.precalc_weightings[0],
+                        &section.precalc_weight_gradients[0]);
             
         }
         
@@ -127,10 +418,9 @@ namespace FTS {
             section.precalc_weight_gradients.resize(num_encodings());
             section.precalc_weight_hessians.resize(num_encodings());
             
-            for (size_t response_i = 0; response_i < num_encodings(); ++response_i)
-                section.precalc_weightings[response_i] = operator[](response_i).weighting(
-                        section.tangent(), section.precalc_weight_gradients[response_i],
-                        section.precalc_weight_hessians[response_i]);
+            if (num_encodings())
+                weighting_sweep(section.tangent(), &section.precalc_weightings[0],
+                        &section.precalc_weight_gradients[0], &section.precalc_weight_hessians[0]);
             
         }
         
@@ -309,6 +599,8 @@ namespace FTS {
             
             this->includes_iso = include_isotropic;
             
+            pack();
+            
         }
         
         void Model::scale_coeffs(double scalar) {
@@ -316,6 +608,8 @@ namespace FTS {
             for (size_t encode_i = 0; encode_i < this->num_encodings(); encode_i++)
                 this->operator[](encode_i).scale_coeffs(scalar);
             
+            pack();
+            
         }
         
         std::ostream& operator<<(std::ostream& stream, const Diffusion::Model& model) {
@@ -163,6 +163,14 @@ namespace FTS {
                 std::vector<Response> responses;
                 bool includes_iso;
 
+                //Structure-of-arrays copies of the encoding orientations and response coefficients, so that the weightings
+                //of every encoding can be calculated for a section in one contiguous sweep (see 'weighting_sweep').
+                //Orientations are stored as [X block|Y block|Z block] and coefficients as one block per polynomial order,
+                //each block being num_encodings() long. Coefficients of lower order responses are padded with zeros.
+                std::vector<double> packed_orients;
+                std::vector<double> packed_coeffs;
+                size_t num_packed_coeffs;
+
             public:
                 
                 static MR::Math::Vector<double> tensor_m0_SH(double adc, double fa, double b_value);
@@ -177,7 +185,7 @@ namespace FTS {
                 //Public member functions
             public:
                 
-                Model() : includes_iso(false) {
+                Model() : includes_iso(false), num_packed_coeffs(0) {
                 }
                 
                 //TODO: Use b_value from encoding matrix to generate response function per direction.
@@ -193,13 +201,18 @@ namespace FTS {
                       const MR::Math::Matrix<double>& response_SHs, bool include_isotropic);
 
                 Model(const Model& m)
-                        : responses(m.responses), includes_iso(m.includes_iso) {
+                        : responses(m.responses), includes_iso(m.includes_iso), packed_orients(
+                                  m.packed_orients), packed_coeffs(m.packed_coeffs), num_packed_coeffs(
+                                  m.num_packed_coeffs) {
                 }
                 
                 Model& operator=(const Model& m) {
                     
                     this->responses = m.responses;
                     this->includes_iso = m.includes_iso;
+                    this->packed_orients = m.packed_orients;
+                    this->packed_coeffs = m.packed_coeffs;
+                    this->num_packed_coeffs = m.num_packed_coeffs;
                     
                     return *this;
                 }
@@ -224,6 +237,16 @@ namespace FTS {
                     return responses[index];
                 }
                 
+                //Calculates the weightings of all encodings for the given tangent, writing them to the 'weightings' array,
+                //which needs to be at least num_encodings() long.
+                void weighting_sweep(const Coord& tangent, double* weightings) const;
+
+                //As above, also writing the gradients (and Hessians if not null) of the weightings with respect to the
+                //tangent to the 'gradients' (and 'hessians') arrays. The derivatives of the polynomial are evaluated
+                //alongside it with Horner's scheme and the terms that only depend on the tangent are calculated once.
+                void weighting_sweep(const Coord& tangent, double* weightings, Coord* gradients,
+                                     Coord::Tensor* hessians = 0) const;
+
                 void precalculate_weightings(Fibre::Strand::Section& section) const;
 
                 void precalculate_weightings_and_gradients(Fibre::Strand::Section& section) const;
@@ -242,6 +265,8 @@ namespace FTS {
 
             protected:
                 
+                void pack();
+
                 void init(const MR::Math::Matrix<double>& encodings_matrix,
                           const MR::Math::Matrix<double>& response_SHs, bool include_isotropic);
 
@@ -121,6 +121,10 @@ namespace FTS {
                     return index;
                 }
                 
+                const MR::Math::Vector<double>& coefficients() const {
+                    return coeffs;
+                }
+                
 #ifdef OPTIMISED
 //        void        precalculate_weighting(const Triple<double>& tangent)
 //          { this->precalc_weighting = weighting(tangent); }
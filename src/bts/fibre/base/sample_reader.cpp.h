@@ -0,0 +1,403 @@
+/*
+ Copyright 2010 Brain Research Institute, Melbourne, Australia
+
+ Written by Thomas G Close on Jun 3, 2010.
+
+ This file is part of Fourier Tract Sampling (FouTS).
+
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef __bts_fibre_base_samplereader_cpp_h__
+#define __bts_fibre_base_samplereader_cpp_h__
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace FTS {
+    
+    namespace Fibre {
+        
+        namespace Base {
+            
+            template<typename T> const std::string SampleReader<T>::FILE_PREAMBLE = "fouts samples";
+            
+            // "FOTSCHNK" in little-endian byte order.
+            template<typename T> const uint64_t SampleReader<T>::CHUNK_MAGIC = 0x4B4E484353544F46ULL;
+            
+            template<typename T> const char SampleReader<T>::DOUBLE_VALUE = 'd';
+            
+            template<typename T> const char SampleReader<T>::STRING_VALUE = 's';
+            
+            template<typename T> bool SampleReader<T>::is_container(const std::string& location) {
+                
+                std::ifstream in(location.c_str(), std::ios::in | std::ios::binary);
+                
+                std::string first_line;
+                
+                return in && std::getline(in, first_line) && first_line == FILE_PREAMBLE;
+                
+            }
+            
+            template<typename T> inline void SampleReader<T>::put_double(std::vector<char>& buffer,
+                                                                         double value) {
+                
+                value = MR::ByteOrder::LE(value);
+                
+                const char* bytes = (const char*) &value;
+                
+                buffer.insert(buffer.end(), bytes, bytes + sizeof(double));
+                
+            }
+            
+            // Sizes and offsets are stored as 64 bit integers made up of two little-endian 32 bit words (low word first).
+            template<typename T> inline void SampleReader<T>::put_size(std::vector<char>& buffer,
+                                                                       uint64_t value) {
+                
+                uint32_t words[2];
+                
+                words[0] = MR::ByteOrder::LE(uint32_t(value & 0xFFFFFFFFULL));
+                words[1] = MR::ByteOrder::LE(uint32_t(value >> 32));
+                
+                const char* bytes = (const char*) words;
+                
+                buffer.insert(buffer.end(), bytes, bytes + sizeof(words));
+                
+            }
+            
+            template<typename T> inline double SampleReader<T>::get_double(const uint8_t*& ptr) {
+                
+                double value;
+                
+                memcpy(&value, ptr, sizeof(double));
+                
+                ptr += sizeof(double);
+                
+                return MR::ByteOrder::LE(value);
+                
+            }
+            
+            template<typename T> inline uint64_t SampleReader<T>::get_size(const uint8_t*& ptr) {
+                
+                uint32_t words[2];
+                
+                memcpy(words, ptr, sizeof(words));
+                
+                ptr += sizeof(words);
+                
+                return uint64_t(MR::ByteOrder::LE(words[0])) | (uint64_t(MR::ByteOrder::LE(words[1])) << 32);
+                
+            }
+            
+            template<typename T> bool SampleReader<T>::get_column_value(const uint8_t* column,
+                                                                        size_t row, double& number,
+                                                                        std::string& text) {
+                
+                char type = *column++;
+                
+                size_t num_rows = get_size(column);
+                
+                if (type == DOUBLE_VALUE) {
+                
+                    column += row * sizeof(double);
+                    number = get_double(column);
+                
+                    return true;
+                
+                } else if (type != STRING_VALUE)
+                    throw Exception("Unrecognised property column type '" + str((int) type) + "'.");
+                
+                // String columns hold the offset of each value (and of the end of the last one) from the end of the
+                // offsets, followed by the text of the values.
+                const uint8_t* offset = column + row * 2 * sizeof(uint32_t);
+                
+                uint64_t begin = get_size(offset);
+                uint64_t end = get_size(offset);
+                
+                const char* values = (const char*) (column + (num_rows + 1) * 2 * sizeof(uint32_t));
+                
+                text.assign(values + begin, values + end);
+                
+                return false;
+                
+            }
+            
+            template<typename T> template<typename U> std::vector<const char*> SampleReader<T>::intrinsic_keys(
+                    const std::vector<std::string>& header) {
+                
+                std::vector<const char*> keys;
+                
+                for (size_t key_i = 0; key_i < header.size(); ++key_i) {
+                    
+                    std::vector<std::string> key(1, header[key_i]);
+                    
+                    std::vector<const char*> intrinsic = Object::extract_props<U>(key);
+                    
+                    keys.push_back(intrinsic.size() ? intrinsic[0] : 0);
+                    
+                }
+                
+                return keys;
+                
+            }
+            
+            template<typename T> const uint8_t* SampleReader<T>::column(int64_t chunk, size_t column_i) const {
+                
+                const uint8_t* ptr = address(chunk) + 2 * sizeof(uint32_t);
+                
+                size_t num_samples = get_size(ptr);
+                
+                // Skip the chunk size, number of elements and the coordinate offsets and first element rows.
+                ptr += (2 + 2 * num_samples + column_i) * 2 * sizeof(uint32_t);
+                
+                return address(chunk + (int64_t) get_size(ptr));
+                
+            }
+            
+            template<typename T> void SampleReader<T>::open(const std::string& location) {
+                
+                close();
+                
+                file_location = location;
+                
+                if (!is_container(location))
+                    throw Exception("'" + location + "' is not a FouTS sample file.");
+                
+                mmap = new MR::File::MMap(location);
+                
+                read_header();
+                
+                index_chunks();
+                
+            }
+            
+            template<typename T> void SampleReader<T>::read_header() {
+                
+                file_props.clear();
+                prop_hdr.clear();
+                elem_prop_hdr.clear();
+                
+                const char* header = (const char*) address(0);
+                int64_t pos = FILE_PREAMBLE.size() + 1;
+                
+                bool found_end = false;
+                
+                while (pos < mmap->size()) {
+                    
+                    const char* line_end = (const char*) memchr(header + pos, '\n', mmap->size() - pos);
+                    
+                    if (!line_end)
+                        break;
+                    
+                    std::string line(header + pos, line_end);
+                    
+                    pos = line_end - header + 1;
+                    
+                    if (line == "END") {
+                        found_end = true;
+                        break;
+                    }
+                    
+                    size_t colon = line.find(": ");
+                    
+                    if (colon == std::string::npos)
+                        throw Exception(
+                                "Malformed header line '" + line + "' in sample file '" + file_location
+                                + "'.");
+                    
+                    std::string key = line.substr(0, colon);
+                    std::string value = line.substr(colon + 2);
+                    
+                    if (key == "prop")
+                        prop_hdr.push_back(value);
+                    else if (key == "elem_prop")
+                        elem_prop_hdr.push_back(value);
+                    else
+                        file_props[key] = value;
+                    
+                }
+                
+                if (!found_end)
+                    throw Exception("No end of header found in sample file '" + file_location + "'.");
+                
+                // The data starts at the next 8 byte boundary after the header.
+                data_begin = (pos + 7) & ~int64_t(7);
+                
+                ext_prp_keys = prop_hdr;
+                prp_keys = Object::extract_props<T>(ext_prp_keys);
+                
+                ext_elem_prp_keys = elem_prop_hdr;
+                elem_prp_keys = Object::extract_props<typename T::Element>(ext_elem_prp_keys);
+                
+                prop_hdr_keys = intrinsic_keys<T>(prop_hdr);
+                elem_prop_hdr_keys = intrinsic_keys<typename T::Element>(elem_prop_hdr);
+                
+            }
+            
+            template<typename T> void SampleReader<T>::index_chunks() {
+                
+                sample_offsets.clear();
+                sample_chunks.clear();
+                sample_rows.clear();
+                sample_elem_rows.clear();
+                
+                int64_t pos = data_begin;
+                
+                while (pos + 4 * (int64_t) sizeof(uint32_t) * 2 <= mmap->size()) {
+                    
+                    const uint8_t* ptr = address(pos);
+                    
+                    if (get_size(ptr) != CHUNK_MAGIC)
+                        break;
+                    
+                    size_t num_samples = get_size(ptr);
+                    int64_t chunk_size = get_size(ptr);
+                    
+                    // Stop at a partially written chunk.
+                    if (pos + chunk_size > mmap->size())
+                        break;
+                    
+                    // Skip the number of elements.
+                    get_size(ptr);
+                    
+                    for (size_t sample_i = 0; sample_i < num_samples; ++sample_i) {
+                        sample_offsets.push_back(pos + (int64_t) get_size(ptr));
+                        sample_chunks.push_back(pos);
+                        sample_rows.push_back(sample_i);
+                        sample_elem_rows.push_back(get_size(ptr));
+                    }
+                    
+                    pos += chunk_size;
+                    
+                }
+                
+                data_end = pos;
+                
+                sample_index = 0;
+                
+            }
+            
+            template<typename T> bool SampleReader<T>::next(T& set) {
+                
+                if (sample_index >= sample_offsets.size())
+                    return false;
+                
+                read(sample_index++, set);
+                
+                return true;
+                
+            }
+            
+            template<typename T> void SampleReader<T>::read(size_t index, T& set) {
+                
+                if (index >= sample_offsets.size())
+                    throw Exception(
+                            "Sample index " + str(index) + " is out of range (" + str(
+                                    sample_offsets.size()) + ") for '" + file_location + "'.");
+                
+                const uint8_t* ptr = address(sample_offsets[index]);
+                
+                set.reset(prp_keys, elem_prp_keys);
+                
+                read(ptr, set);
+                
+                double number;
+                std::string text;
+                    
+                //Set 'set-wide' properties, handing the values of double columns straight to the set.
+                for (size_t prop_i = 0; prop_i < prop_hdr.size(); ++prop_i) {
+                    
+                    bool is_number = get_column_value(column(sample_chunks[index], prop_i),
+                            sample_rows[index], number, text);
+                    
+                    if (prop_hdr_keys[prop_i])
+                        set.prop(prop_hdr_keys[prop_i]) = is_number ? number : to<double>(text);
+                    else if (is_number)
+                        set.set_extend_prop_number(prop_hdr[prop_i], number);
+                    else
+                        set.set_extend_prop(prop_hdr[prop_i], text);
+                    
+                }
+                
+                //Set element properties, which are stored one column per property.
+                set.clear_extend_elem_props();
+                
+                if (elem_prop_hdr.size()) {
+                    
+                    for (std::vector<std::string>::iterator prop_it = ext_elem_prp_keys.begin();
+                            prop_it != ext_elem_prp_keys.end(); ++prop_it)
+                        set.add_extend_elem_prop(*prop_it, "");
+                    
+                    for (size_t prop_i = 0; prop_i < elem_prop_hdr.size(); ++prop_i) {
+                    
+                        const uint8_t* prop_column = column(sample_chunks[index], prop_hdr.size() + prop_i);
+                    
+                        for (size_t elem_i = 0; elem_i < set.size(); ++elem_i) {
+                        
+                            bool is_number = get_column_value(prop_column, sample_elem_rows[index] + elem_i,
+                                    number, text);
+                        
+                            if (elem_prop_hdr_keys[prop_i])
+                                set[elem_i].prop(elem_prop_hdr_keys[prop_i]) =
+                                        is_number ? number : to<double>(text);
+                            else
+                                set.set_extend_elem_prop(elem_prop_hdr[prop_i], is_number ? str(number) : text,
+                                        elem_i);
+                            
+                        }
+                        
+                    }
+                    
+                }
+                
+            }
+            
+            template<typename T> void SampleReader<T>::read(const uint8_t*& ptr, Coord& coord) {
+                
+                coord[X] = get_double(ptr);
+                coord[Y] = get_double(ptr);
+                coord[Z] = get_double(ptr);
+                
+            }
+            
+            // Mirrors the recursion in Reader<T>::read, except that the number of elements at each level is stored up
+            // front instead of being terminated by a FILE_SEPARATOR.
+            template<typename T> template<typename U> inline void SampleReader<T>::read(
+                    const uint8_t*& ptr, U& fibre_object) {
+                
+                size_t num_elems = get_size(ptr);
+                
+                for (size_t elem_i = 0; elem_i < num_elems; ++elem_i) {
+                    
+                    typename U::Element elem;
+                    
+                    elem.clear();
+                    
+                    read(ptr, elem);
+                    
+                    fibre_object.push_back(elem, false);    // Push back ignoring properties.
+                    
+                }
+                
+            }
+        
+        }
+    
+    }
+
+}
+
+#endif /* __bts_fibre_base_samplereader_cpp_h__ */
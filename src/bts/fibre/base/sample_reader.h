@@ -0,0 +1,252 @@
+/*
+ Copyright 2010 Brain Research Institute/National ICT Australia (NICTA), Melbourne, Australia
+
+ Written by Thomas G Close, 5/05/09.
+
+ This file is part of Fourier Tract Sampling (FouTS).
+
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef __bts_fibre_base_samplereader_forward_h__
+#define __bts_fibre_base_samplereader_forward_h__
+
+namespace FTS {
+    
+    namespace Fibre {
+        
+        namespace Base {
+            
+            template<typename T> class SampleReader;
+        
+        }
+    
+    }
+
+}
+
+#endif
+
+#ifndef __bts_fibre_base_samplereader_h__
+#define __bts_fibre_base_samplereader_h__
+
+#include <vector>
+#include <string>
+#include <map>
+
+#include "get_set.h"
+#include "file/mmap.h"
+
+#include "bts/common.h"
+#include "bts/coord.h"
+#include "bts/file.h"
+
+#include "bts/fibre/base/object.h"
+
+namespace FTS {
+    
+    namespace Fibre {
+        
+        namespace Base {
+            
+            /*! Reads the chunked binary sample containers written by SampleWriter. The file is memory-mapped and the offsets
+             * of every complete sample are indexed on opening, so samples can be read in sequence or jumped to directly.
+             *
+             * The layout of a container is a text header ("fouts samples" followed by "key: value" lines and "END")
+             * padded to an 8 byte boundary, followed by any number of chunks. Each chunk starts with CHUNK_MAGIC, the
+             * number of samples it holds, its total size in bytes, the total number of elements of its samples, then the
+             * offset of the coordinates of each sample (from the start of the chunk) along with the row of its first
+             * element, and the offset of each property column. The coordinates of each sample are stored with each level
+             * prefixed by its number of elements. The properties are stored after the coordinates as one column per set
+             * property (one row per sample) and one column per element property (one row per element of each sample).
+             * Each column is typed: a column holds doubles unless one of its values can't be converted to and from its
+             * text form without change, in which case the column holds strings. Values of double columns are handed to
+             * the set as numbers. A chunk that was only partially written (e.g. by an interrupted sampler) is ignored. */
+            template<typename T> class SampleReader {
+                    
+                public:
+                    
+                    const static std::string FILE_PREAMBLE;
+                    const static uint64_t CHUNK_MAGIC;
+                    const static char DOUBLE_VALUE;
+                    const static char STRING_VALUE;
+
+                public:
+                    
+                    static bool is_container(const std::string& location);
+
+                    static void put_double(std::vector<char>& buffer, double value);
+
+                    static void put_size(std::vector<char>& buffer, uint64_t value);
+
+                    static double get_double(const uint8_t*& ptr);
+
+                    static uint64_t get_size(const uint8_t*& ptr);
+
+                    // Reads the value at 'row' of the column at 'column' into 'number' and returns true if it is a
+                    // double column, or into 'text' and returns false if it is a string column.
+                    static bool get_column_value(const uint8_t* column, size_t row, double& number,
+                                                 std::string& text);
+
+                    // Matches each key of 'header' to the intrinsic property of U it names (or null if it is an extended
+                    // property).
+                    template<typename U> static std::vector<const char*> intrinsic_keys(
+                            const std::vector<std::string>& header);
+
+                protected:
+                    
+                    MR::File::MMap* mmap;
+                    std::string file_location;
+                    int64_t data_begin, data_end;
+
+                    // The position of the coordinates and of the chunk of each sample, its row in the chunk's set
+                    // property columns and the row of its first element in the chunk's element property columns.
+                    std::vector<int64_t> sample_offsets;
+                    std::vector<int64_t> sample_chunks;
+                    std::vector<size_t> sample_rows;
+                    std::vector<size_t> sample_elem_rows;
+                    size_t sample_index;
+
+                    std::map<std::string, std::string> file_props;
+                    std::vector<std::string> prop_hdr;
+                    std::vector<const char*> prp_keys;
+                    std::vector<std::string> ext_prp_keys;
+                    std::vector<std::string> elem_prop_hdr;
+                    std::vector<const char*> elem_prp_keys;
+                    std::vector<std::string> ext_elem_prp_keys;
+                    std::vector<const char*> prop_hdr_keys;
+                    std::vector<const char*> elem_prop_hdr_keys;
+
+                    // Public methods and constructors.
+                public:
+                    
+                    SampleReader()
+                            : mmap(0), data_begin(0), data_end(0), sample_index(0) {
+                    }
+                    
+                    SampleReader(const std::string& location)
+                            : mmap(0), data_begin(0), data_end(0), sample_index(0) {
+                        open(location);
+                    }
+                    
+                    ~SampleReader() {
+                        close();
+                    }
+                    
+                    void open(const std::string& location);
+
+                    void close() {
+                        if (mmap)
+                            delete mmap;
+                        mmap = 0;
+                        sample_offsets.clear();
+                        sample_chunks.clear();
+                        sample_rows.clear();
+                        sample_elem_rows.clear();
+                        sample_index = 0;
+                    }
+                    
+                    void rewind() {
+                        sample_index = 0;
+                    }
+                    
+                    bool next(T& set);
+
+                    bool next(T& set, std::map<std::string, std::string>& properties) {
+                        if (next(set)) {
+                            properties = set.get_extend_props();
+                            return true;
+                        } else
+                            return false;
+                    }
+                    
+                    // Reads sample 'index' without moving the position of the sequential reads.
+                    void read(size_t index, T& set);
+
+                    // Moves the position of the sequential reads to sample 'index'.
+                    void seek(size_t index) {
+                        if (index > sample_offsets.size())
+                            throw Exception(
+                                    "Sample index " + str(index) + " is out of range (" + str(
+                                            sample_offsets.size()) + ") for '" + file_location + "'.");
+                        sample_index = index;
+                    }
+                    
+                    size_t size() const {
+                        return sample_offsets.size();
+                    }
+                    
+                    // The end of the last complete chunk, from which a SampleWriter can continue appending.
+                    int64_t end_of_data() const {
+                        return data_end;
+                    }
+                    
+                    std::map<std::string, std::string> get_extend_props() const {
+                        return file_props;
+                    }
+                    
+                    std::vector<std::string> prop_header() const {
+                        return prop_hdr;
+                    }
+                    
+                    std::vector<const char*> prop_keys() const {
+                        return prp_keys;
+                    }
+                    
+                    std::vector<std::string> extend_prop_keys() const {
+                        return ext_prp_keys;
+                    }
+                    
+                    std::vector<std::string> elem_header() const {
+                        return elem_prop_hdr;
+                    }
+                    
+                    std::vector<const char*> elem_prop_keys() const {
+                        return elem_prp_keys;
+                    }
+                    
+                    std::vector<std::string> extend_elem_prop_keys() const {
+                        return ext_elem_prp_keys;
+                    }
+                    
+                protected:
+                    
+                    void read_header();
+
+                    void index_chunks();
+
+                    const uint8_t* address(int64_t offset) const {
+                        return mmap->address() + offset;
+                    }
+                    
+                    // The position of property column 'column_i' (set properties followed by element properties) of
+                    // the chunk at 'chunk'.
+                    const uint8_t* column(int64_t chunk, size_t column_i) const;
+
+                    void read(const uint8_t*& ptr, Coord& coord);
+
+                    template<typename U> void read(const uint8_t*& ptr, U& fibre_object);
+                    
+            };
+        
+        }
+    
+    }
+
+}
+
+#include "bts/fibre/base/sample_reader.cpp.h"
+
+#endif
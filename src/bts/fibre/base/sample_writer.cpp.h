@@ -0,0 +1,331 @@
+/*
+ Copyright 2008 Brain Research Institute, Melbourne, Australia
+
+ Written by Thomas G Close, Jul 26, 2010.
+
+ This file is part of MRtrix.
+
+ MRtrix is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ MRtrix is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with MRtrix.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef __bts_fibre_base_samplewriter_cpp_h__
+#define __bts_fibre_base_samplewriter_cpp_h__
+
+#include <unistd.h>
+
+#include "bts/version.h"
+
+namespace FTS {
+    
+    namespace Fibre {
+        
+        namespace Base {
+            
+            template<typename T> void SampleWriter<T>::create(
+                    const std::string& location, const std::vector<std::string>& prop_header,
+                    const std::vector<std::string>& elem_prop_header,
+                    const std::map<std::string, std::string>& file_props) {
+                
+                close();
+                
+                file_location = location;
+                prop_hdr = prop_header;
+                elem_prop_hdr = elem_prop_header;
+                
+                std::map<std::string, std::string> header_props = file_props;
+                
+                header_props["software version"] = version_number_string();
+                header_props["datetime"] = current_datetime();
+                header_props["set type"] = T::FILE_EXTENSION;
+                
+                out.open(location.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+                if (!out)
+                    throw Exception(
+                            "error creating sample file \"" + location + "\": " + strerror(errno));
+                
+                out << SampleReader<T>::FILE_PREAMBLE << "\n";
+                
+                for (std::map<std::string, std::string>::const_iterator i = header_props.begin();
+                        i != header_props.end(); ++i)
+                    if (i->first != "prop" && i->first != "elem_prop")
+                        out << i->first << ": " << i->second << "\n";
+                
+                for (size_t prop_i = 0; prop_i < prop_hdr.size(); ++prop_i)
+                    out << "prop: " << prop_hdr[prop_i] << "\n";
+                
+                for (size_t prop_i = 0; prop_i < elem_prop_hdr.size(); ++prop_i)
+                    out << "elem_prop: " << elem_prop_hdr[prop_i] << "\n";
+                
+                out << "END\n";
+                
+                // Pad the header to an 8 byte boundary.
+                while (int64_t(out.tellp()) % 8)
+                    out.put('\0');
+                
+                out.flush();
+                
+                count = 0;
+                
+                init_columns();
+                clear_chunk();
+                
+            }
+            
+            template<typename T> void SampleWriter<T>::open_append(const std::string& location) {
+                
+                close();
+                
+                int64_t end_of_data;
+                
+                {
+                    SampleReader<T> reader(location);
+                    
+                    prop_hdr = reader.prop_header();
+                    elem_prop_hdr = reader.elem_header();
+                    count = reader.size();
+                    end_of_data = reader.end_of_data();
+                }
+                
+                if (truncate(location.c_str(), end_of_data))
+                    throw Exception(
+                            "error truncating sample file \"" + location + "\": " + strerror(errno));
+                
+                file_location = location;
+                
+                out.open(location.c_str(), std::ios::out | std::ios::in | std::ios::binary);
+                if (!out)
+                    throw Exception(
+                            "error opening sample file \"" + location + "\": " + strerror(errno));
+                
+                out.seekp(end_of_data);
+                
+                init_columns();
+                clear_chunk();
+                
+            }
+            
+            template<typename T> void SampleWriter<T>::append(const T& set) {
+                
+                if (!out.is_open())
+                    throw Exception("Sample file has not been created before appending.");
+                
+                chunk_offsets.push_back(chunk.size());
+                chunk_elem_rows.push_back(num_chunk_elems);
+                
+                write(set);
+                
+                num_chunk_elems += set.size();
+                
+                for (size_t prop_i = 0; prop_i < prop_hdr.size(); ++prop_i) {
+                
+                    if (prop_hdr_keys[prop_i] && set.has_prop(prop_hdr_keys[prop_i]))
+                        prop_columns[prop_i].push_back(set.prop(prop_hdr_keys[prop_i]));
+                    else if (set.has_extend_prop(prop_hdr[prop_i])) {
+                        
+                        // Values set as doubles go straight into the column, while integers and text are checked to
+                        // convert back to the same text so that they read back unchanged.
+                        if (set.extend_prop_type(prop_hdr[prop_i]) == Fibre::ExtendProps::NUMBER)
+                            prop_columns[prop_i].push_back(set.get_extend_prop_number(prop_hdr[prop_i]));
+                        else
+                            prop_columns[prop_i].push_back(set.get_extend_prop(prop_hdr[prop_i]));
+                        
+                    } else
+                        throw Exception(
+                                "Did not find value corresponding to property '" + prop_hdr[prop_i] + "'.");
+                
+                }
+                    
+                for (size_t prop_i = 0; prop_i < elem_prop_hdr.size(); ++prop_i) {
+                    
+                    if (elem_prop_hdr_keys[prop_i] && set.has_elem_prop(elem_prop_hdr_keys[prop_i])) {
+                    
+                        for (size_t elem_i = 0; elem_i < set.size(); ++elem_i)
+                            elem_prop_columns[prop_i].push_back(set[elem_i].prop(elem_prop_hdr_keys[prop_i]));
+                            
+                    } else if (set.has_extend_elem_prop(elem_prop_hdr[prop_i])) {
+                            
+                        for (size_t elem_i = 0; elem_i < set.size(); ++elem_i)
+                            elem_prop_columns[prop_i].push_back(
+                                    set.get_extend_elem_prop(elem_prop_hdr[prop_i], elem_i));
+                            
+                    } else
+                        throw Exception(
+                                "Did not find value corresponding to element property '" + elem_prop_hdr[prop_i]
+                                + "'.");
+                    
+                }
+                
+                ++count;
+                
+                if (chunk_offsets.size() >= chunk_size)
+                    flush();
+                
+            }
+            
+            template<typename T> void SampleWriter<T>::flush() {
+                
+                if (!chunk_offsets.size())
+                    return;
+                
+                std::vector<char> columns;
+                std::vector<uint64_t> column_offsets;
+                
+                // Magic, number of samples, chunk size, number of elements, the offsets and first element rows of the
+                // samples and the offsets of the columns.
+                size_t header_size = (4 + 2 * chunk_offsets.size() + prop_columns.size()
+                                      + elem_prop_columns.size()) * 2 * sizeof(uint32_t);
+                
+                for (size_t prop_i = 0; prop_i < prop_columns.size(); ++prop_i) {
+                    column_offsets.push_back(header_size + chunk.size() + columns.size());
+                    prop_columns[prop_i].write(columns);
+                }
+                
+                for (size_t prop_i = 0; prop_i < elem_prop_columns.size(); ++prop_i) {
+                    column_offsets.push_back(header_size + chunk.size() + columns.size());
+                    elem_prop_columns[prop_i].write(columns);
+                }
+                
+                std::vector<char> chunk_header;
+                
+                SampleReader<T>::put_size(chunk_header, SampleReader<T>::CHUNK_MAGIC);
+                SampleReader<T>::put_size(chunk_header, chunk_offsets.size());
+                SampleReader<T>::put_size(chunk_header, header_size + chunk.size() + columns.size());
+                SampleReader<T>::put_size(chunk_header, num_chunk_elems);
+                
+                for (size_t sample_i = 0; sample_i < chunk_offsets.size(); ++sample_i) {
+                    SampleReader<T>::put_size(chunk_header, header_size + chunk_offsets[sample_i]);
+                    SampleReader<T>::put_size(chunk_header, chunk_elem_rows[sample_i]);
+                }
+                
+                for (size_t column_i = 0; column_i < column_offsets.size(); ++column_i)
+                    SampleReader<T>::put_size(chunk_header, column_offsets[column_i]);
+                
+                out.write(&chunk_header[0], chunk_header.size());
+                out.write(&chunk[0], chunk.size());
+                
+                if (columns.size())
+                    out.write(&columns[0], columns.size());
+                
+                out.flush();
+                
+                if (!out)
+                    throw Exception(
+                            "error writing to sample file \"" + file_location + "\": " + strerror(errno));
+                
+                clear_chunk();
+                
+            }
+            
+            template<typename T> void SampleWriter<T>::init_columns() {
+                
+                prop_hdr_keys = SampleReader<T>::template intrinsic_keys<T>(prop_hdr);
+                elem_prop_hdr_keys = SampleReader<T>::template intrinsic_keys<typename T::Element>(
+                        elem_prop_hdr);
+                
+                prop_columns.assign(prop_hdr.size(), Column());
+                elem_prop_columns.assign(elem_prop_hdr.size(), Column());
+                
+            }
+            
+            template<typename T> void SampleWriter<T>::clear_chunk() {
+                
+                chunk.clear();
+                chunk_offsets.clear();
+                chunk_elem_rows.clear();
+                num_chunk_elems = 0;
+                
+                for (size_t prop_i = 0; prop_i < prop_columns.size(); ++prop_i)
+                    prop_columns[prop_i].clear();
+                
+                for (size_t prop_i = 0; prop_i < elem_prop_columns.size(); ++prop_i)
+                    elem_prop_columns[prop_i].clear();
+                
+            }
+            
+            template<typename T> void SampleWriter<T>::Column::push_back(const std::string& value) {
+                
+                if (!is_text) {
+                    
+                    // Only hold the value as a double if it is converted back to exactly the same text, so that reading
+                    // the sample returns the same properties as were written.
+                    char* end;
+                    double number = strtod(value.c_str(), &end);
+                    
+                    if (value.size() && *end == '\0' && str(number) == value) {
+                        numbers.push_back(number);
+                        return;
+                    }
+                    
+                    is_text = true;
+                    
+                    for (size_t row_i = 0; row_i < numbers.size(); ++row_i)
+                        texts.push_back(str(numbers[row_i]));
+                    
+                    numbers.clear();
+                    
+                }
+                
+                texts.push_back(value);
+                
+            }
+            
+            template<typename T> void SampleWriter<T>::Column::write(std::vector<char>& buffer) const {
+                
+                if (!is_text) {
+                    
+                    buffer.push_back(SampleReader<T>::DOUBLE_VALUE);
+                    SampleReader<T>::put_size(buffer, numbers.size());
+                    
+                    for (size_t row_i = 0; row_i < numbers.size(); ++row_i)
+                        SampleReader<T>::put_double(buffer, numbers[row_i]);
+                    
+                } else {
+                    
+                    buffer.push_back(SampleReader<T>::STRING_VALUE);
+                    SampleReader<T>::put_size(buffer, texts.size());
+                    
+                    uint64_t offset = 0;
+                    
+                    for (size_t row_i = 0; row_i < texts.size(); ++row_i) {
+                        SampleReader<T>::put_size(buffer, offset);
+                        offset += texts[row_i].size();
+                    }
+                    
+                    SampleReader<T>::put_size(buffer, offset);
+                    
+                    for (size_t row_i = 0; row_i < texts.size(); ++row_i)
+                        buffer.insert(buffer.end(), texts[row_i].begin(), texts[row_i].end());
+                    
+                }
+                
+            }
+            
+            template<typename T> template<typename U> inline void SampleWriter<T>::write(
+                    const U& fibre_object) {
+                
+                SampleReader<T>::put_size(chunk, fibre_object.size());
+                
+                for (size_t elem_i = 0; elem_i < fibre_object.size(); ++elem_i)
+                    write(fibre_object[elem_i]);
+                
+            }
+            
+        }
+    
+    }
+
+}
+
+#endif /* __bts_fibre_base_samplewriter_cpp_h__ */
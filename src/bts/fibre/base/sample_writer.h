@@ -0,0 +1,185 @@
+/*
+ Copyright 2010 Brain Research Institute/National ICT Australia (NICTA), Melbourne, Australia
+
+ Written by Thomas G Close, 5/05/09.
+
+ This file is part of Fourier Tract Sampling (FouTS).
+
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef __bts_fibre_base_samplewriter_h__
+#define __bts_fibre_base_samplewriter_h__
+
+#include <fstream>
+
+#include "bts/fibre/base/sample_reader.h"
+#include "bts/fibre/properties.h"
+
+namespace FTS {
+    
+    namespace Fibre {
+        
+        namespace Base {
+            
+            /*! Writes sets to the chunked binary sample container described in SampleReader. Samples are buffered in
+             * memory and written a chunk at a time (along with the offsets of the samples within it), so that appending a
+             * sample doesn't require seeking within the file or flushing the stream. The properties of the buffered
+             * samples are collected into one column per property. */
+            template<typename T> class SampleWriter {
+                    
+                public:
+                    
+                    const static size_t DEFAULT_CHUNK_SIZE = 100;
+
+                protected:
+                    
+                    // The values of a property over the samples (or elements) of a chunk. Values are held as doubles until
+                    // one is added that can't be, after which the column holds text.
+                    class Column {
+                            
+                        protected:
+                            
+                            bool is_text;
+                            std::vector<double> numbers;
+                            std::vector<std::string> texts;
+
+                        public:
+                            
+                            Column()
+                                    : is_text(false) {
+                            }
+                            
+                            void push_back(double value) {
+                                if (is_text)
+                                    texts.push_back(str(value));
+                                else
+                                    numbers.push_back(value);
+                            }
+                            
+                            void push_back(const std::string& value);
+
+                            void clear() {
+                                is_text = false;
+                                numbers.clear();
+                                texts.clear();
+                            }
+                            
+                            void write(std::vector<char>& buffer) const;
+                            
+                    };
+
+                public:
+                    
+                    size_t count;
+
+                protected:
+                    
+                    std::ofstream out;
+                    std::string file_location;
+                    size_t chunk_size;
+
+                    std::vector<std::string> prop_hdr;
+                    std::vector<std::string> elem_prop_hdr;
+                    std::vector<const char*> prop_hdr_keys;
+                    std::vector<const char*> elem_prop_hdr_keys;
+
+                    // The coordinates of the buffered samples, the offset of each sample within them and the row of its
+                    // first element in the element property columns.
+                    std::vector<char> chunk;
+                    std::vector<uint64_t> chunk_offsets;
+                    std::vector<uint64_t> chunk_elem_rows;
+                    size_t num_chunk_elems;
+
+                    std::vector<Column> prop_columns;
+                    std::vector<Column> elem_prop_columns;
+
+                    // Public methods and constructors.
+                public:
+                    
+                    SampleWriter()
+                            : count(0), chunk_size(DEFAULT_CHUNK_SIZE), num_chunk_elems(0) {
+                    }
+                    
+                    SampleWriter(const std::string& location, const std::vector<std::string>& prop_header,
+                                 const std::vector<std::string>& elem_prop_header,
+                                 const std::map<std::string, std::string>& file_props = Properties(),
+                                 size_t chunk_size = DEFAULT_CHUNK_SIZE)
+                            : count(0), chunk_size(chunk_size), num_chunk_elems(0) {
+                        create(location, prop_header, elem_prop_header, file_props);
+                    }
+                    
+                    ~SampleWriter() {
+                        close();
+                    }
+                    
+                    void create(const std::string& location, const std::vector<std::string>& prop_header,
+                                const std::vector<std::string>& elem_prop_header,
+                                const std::map<std::string, std::string>& file_props = Properties());
+
+                    // Opens an existing sample file so that further samples are appended to it (dropping any chunk
+                    // that was only partially written).
+                    void open_append(const std::string& location);
+
+                    void append(const T& set);
+
+                    // Writes the buffered samples to the file.
+                    void flush();
+
+                    void close() {
+                        if (out.is_open()) {
+                            flush();
+                            out.close();
+                        }
+                    }
+                    
+                    void set_chunk_size(size_t size) {
+                        chunk_size = size ? size : 1;
+                    }
+                    
+                    std::vector<std::string> prop_header() const {
+                        return prop_hdr;
+                    }
+                    
+                    std::vector<std::string> elem_header() const {
+                        return elem_prop_hdr;
+                    }
+                    
+                protected:
+                    
+                    void write(const Coord& coord) {
+                        SampleReader<T>::put_double(chunk, coord[X]);
+                        SampleReader<T>::put_double(chunk, coord[Y]);
+                        SampleReader<T>::put_double(chunk, coord[Z]);
+                    }
+                    
+                    template<typename U> void write(const U& fibre_object);
+
+                    // Sets up the property columns (and their matching intrinsic keys) from the headers.
+                    void init_columns();
+
+                    void clear_chunk();
+                    
+            };
+        
+        }
+    
+    }
+
+}
+
+#include "bts/fibre/base/sample_writer.cpp.h"
+
+#endif
@@ -31,6 +31,8 @@
 #include "bts/fibre/base/writer.h"
 #include "bts/fibre/base/reader.h"
 
+#include "bts/utilities/threads.h"
+
 namespace FTS {
     
     namespace Fibre {
@@ -46,6 +48,8 @@ namespace FTS {
             template<typename T> const std::string Set<T>::NUM_ELEMS_EXT_PROP = "__num_elems__";
             template<typename T> const std::string Set<T>::ELEM_SIZE_EXT_PROP = "__elem_degree__";
             template<typename T> const std::string Set<T>::ELEM_VSIZE_EXT_PROP = "__elem_row_size__";
+            template<typename T> size_t Set<T>::similarity_num_threads = 1;
+            template<typename T> const size_t Set<T>::SIMILARITY_MIN_PARALLEL_SIZE = 64;
             
             template<typename T> Set<T>::Set(const Set<T>& set)
                     : Object(set), vrows(set.vrows), rsize(set.rsize), elem_dgree(set.elem_dgree), row_ends(
@@ -70,8 +74,7 @@ namespace FTS {
                     
                 }
                 
-                ext_props =
-                        set.ext_props ? new std::map<std::string, std::string>(*set.ext_props) : 0;
+                ext_props = set.ext_props ? new ExtendProps(*set.ext_props) : 0;
                 ext_elem_prop_keys =
                         set.ext_elem_prop_keys ? new std::vector<std::string>(
                                                          *set.ext_elem_prop_keys) :
@@ -89,14 +92,7 @@ namespace FTS {
             
             template<typename T> std::vector<std::string> Set<T>::extend_prop_keys() const {
                 
-                std::vector<std::string> prp_keys;
-                
-                if (ext_props)
-                    for (std::map<std::string, std::string>::iterator prop_it = ext_props->begin();
-                            prop_it != ext_props->end(); ++prop_it)
-                        prp_keys.push_back(prop_it->first);
-                
-                return prp_keys;
+                return ext_props ? ext_props->keys() : std::vector<std::string>();
                 
             }
             
@@ -142,7 +138,7 @@ namespace FTS {
                 if (ext_props)
                     delete ext_props;
                 
-                ext_props = new std::map<std::string, std::string>(extended_props);
+                ext_props = new ExtendProps(extended_props);
                 
             }
             
@@ -150,9 +146,29 @@ namespace FTS {
                                                               const std::string& value) {
                 
                 if (!ext_props)
-                    ext_props = new std::map<std::string, std::string>();
+                    ext_props = new ExtendProps();
+                
+                ext_props->set(prop, value);
+                
+            }
+            
+            template<typename T> void Set<T>::set_extend_prop_number(const std::string& prop,
+                                                                     double value) {
+                
+                if (!ext_props)
+                    ext_props = new ExtendProps();
+                
+                ext_props->set_number(prop, value);
+                
+            }
+            
+            template<typename T> void Set<T>::set_extend_prop_integer(const std::string& prop,
+                                                                      int64_t value) {
+                
+                if (!ext_props)
+                    ext_props = new ExtendProps();
                 
-                (*ext_props)[prop] = value;
+                ext_props->set_integer(prop, value);
                 
             }
             
@@ -255,12 +271,12 @@ namespace FTS {
                     //Copy accross the set-wide properties if present
                     if (set.ext_props) {
                         if (!ext_props)
-                            ext_props = new std::map<std::string, std::string>(*set.ext_props);
+                            ext_props = new ExtendProps(*set.ext_props);
                         else
                             *ext_props = *set.ext_props;
                         
                     } else if (ext_props) {
-                        free(ext_props);
+                        delete ext_props;
                         ext_props = 0;
                     }
                     
@@ -821,7 +837,7 @@ namespace FTS {
                 std::map<std::string, std::string> properties;
                 
                 if (ext_props)
-                    properties = *ext_props;
+                    properties = ext_props->to_map();
 
                 //Insert the properties for the set into the header along with the extended properties
                 insert_props(properties);
@@ -942,12 +958,43 @@ namespace FTS {
                             + str(similarity.columns()) + " do not match Strand::Sets, "
                             + str(size()) + ", " + str(reference.size()) + ".");
                 
-                for (size_t this_i = 0; this_i < size(); this_i++) {
-                    for (size_t reference_i = 0; reference_i < reference.size(); reference_i++)
-                        similarity(this_i, reference_i) = operator[](this_i).distance(
-                                reference[reference_i], strands_per_acs);
+                size_t num_threads = std::min(similarity_num_threads, size());
+                
+                if (size() * reference.size() < SIMILARITY_MIN_PARALLEL_SIZE)
+                    num_threads = 1;
+                
+                std::vector<SimilarityJob> jobs(num_threads);
+                
+                for (size_t job_i = 0; job_i < num_threads; ++job_i) {
+                    jobs[job_i].set = this;
+                    jobs[job_i].reference = &reference;
+                    jobs[job_i].similarity = &similarity;
+                    jobs[job_i].strands_per_acs = strands_per_acs;
+                    jobs[job_i].start = (job_i * size()) / num_threads;
+                    jobs[job_i].end = ((job_i + 1) * size()) / num_threads;
+                }
+                
+                // The first block of rows is filled in the calling thread.
+                Utilities::run_in_threads(jobs, fill_similarity_rows, "fill the similarity matrix");
+                
+            }
+            
+            template<typename T> void* Set<T>::fill_similarity_rows(void* arg) {
+                
+                SimilarityJob& job = *(SimilarityJob*) arg;
+                
+                for (size_t this_i = job.start; this_i < job.end; this_i++) {
+                    
+                    const T elem = job.set->operator[](this_i);
+                    
+                    for (size_t reference_i = 0; reference_i < job.reference->size(); reference_i++)
+                        (*job.similarity)(this_i, reference_i) = elem.distance(
+                                job.reference->operator[](reference_i), job.strands_per_acs);
+                    
                 }
                 
+                return 0;
+                
             }
             
             template<typename T> Set<T>& Set<T>::smallest_distance_set(const Set<T>& reference,
@@ -1185,7 +1232,7 @@ namespace FTS {
                 *elem_props = elem_properties;
                 
                 if (ext_props) {
-                    free(ext_props);
+                    delete ext_props;
                     ext_props = 0;
                 }
                 
@@ -1214,7 +1261,7 @@ namespace FTS {
                 *elem_props = elem_properties;
                 
                 if (ext_props) {
-                    free(ext_props);
+                    delete ext_props;
                     ext_props = 0;
                 }
                 
@@ -75,6 +75,12 @@ namespace FTS {
                     const static std::string ELEM_SIZE_EXT_PROP;
                     const static std::string ELEM_VSIZE_EXT_PROP;
 
+                    //Number of threads used to fill similarity matrices (rows are divided evenly between them).
+                    static size_t similarity_num_threads;
+
+                    //Minimum number of similarity matrix elements before additional threads are spawned.
+                    const static size_t SIMILARITY_MIN_PARALLEL_SIZE;
+
                 protected:
                     
                     size_t initial_vsize(size_t size, size_t* elem_degrees, size_t elem_row_size,
@@ -92,7 +98,7 @@ namespace FTS {
                     
                     std::vector<const char*>* elem_props;
 
-                    std::map<std::string, std::string>* ext_props;
+                    ExtendProps* ext_props;
 
                     std::vector<std::string>* ext_elem_prop_keys;
                     std::vector<std::string>* ext_elem_prop_defaults;
@@ -117,7 +123,7 @@ namespace FTS {
                                       0), ext_elem_prop_defaults(0), ext_elem_prop_values(0) {
                         
                         if (extended_props.size())
-                            ext_props = new std::map<std::string, std::string>(extended_props);
+                            ext_props = new ExtendProps(extended_props);
                         
                     }
                     
@@ -141,7 +147,7 @@ namespace FTS {
                         assert((elem_vsize - elem_props.size()) % 3 == 0);
                         
                         if (extended_props.size())
-                            ext_props = new std::map<std::string, std::string>(extended_props);
+                            ext_props = new ExtendProps(extended_props);
                         
                     }
                     
@@ -383,21 +389,49 @@ namespace FTS {
                                            MR::Math::Matrix<double>& similarity,
                                            double strands_per_acs = 0.0) const;
 
+                    static void set_similarity_num_threads(size_t num_threads) {
+                        similarity_num_threads = num_threads ? num_threads : 1;
+                    }
+                    
+
                     // Methods to get and manipulate element properties.
                     
-                    bool has_extend_prop(const std::string& key) {
-                        return ext_props && ext_props->count(key);
+                    bool has_extend_prop(const std::string& key) const {
+                        return ext_props && ext_props->has(key);
+                    }
+                    
+                    // Whether the extended property is held as text or was set numerically (see Fibre::ExtendProps).
+                    Fibre::ExtendProps::Type extend_prop_type(const std::string& key) const {
+                        return ext_props ? ext_props->type(key) :
+                                           throw Exception(
+                                                   "'" + key
+                                                   + "' key was not found in extended properties.");
+                    }
+                    
+                    std::string get_extend_prop(const std::string& key) const {
+                        return ext_props ? ext_props->get(key) :
+                                           throw Exception(
+                                                   "'" + key
+                                                   + "' key was not found in extended properties.");
                     }
                     
-                    std::string get_extend_prop(const std::string& key) {
-                        return (ext_props && ext_props->count(key)) ? (*ext_props)[key] :
-                                                                      throw Exception(
-                                                                              "'" + key
-                                                                              + "' key was not found in extended properties.");
+                    // Returns a numeric extended property without a round trip through text if it was set numerically.
+                    double get_extend_prop_number(const std::string& key) const {
+                        return ext_props ? ext_props->get_number(key) :
+                                           throw Exception(
+                                                   "'" + key
+                                                   + "' key was not found in extended properties.");
+                    }
+                    
+                    int64_t get_extend_prop_integer(const std::string& key) const {
+                        return ext_props ? ext_props->get_integer(key) :
+                                           throw Exception(
+                                                   "'" + key
+                                                   + "' key was not found in extended properties.");
                     }
                     
                     std::map<std::string, std::string> get_extend_props() const {
-                        return ext_props ? *ext_props : std::map<std::string, std::string>();
+                        return ext_props ? ext_props->to_map() : std::map<std::string, std::string>();
                     }
                     
                     std::vector<std::string> extend_prop_keys() const;
@@ -406,6 +440,11 @@ namespace FTS {
 
                     void set_extend_prop(const std::string& prop, const std::string& value);
 
+                    // Numeric extended properties are stored as numbers and only formatted when they are written.
+                    void set_extend_prop_number(const std::string& prop, double value);
+
+                    void set_extend_prop_integer(const std::string& prop, int64_t value);
+
                     size_t num_extend_elem_props() const {
                         return ext_elem_prop_keys ? ext_elem_prop_keys->size() : 0;
                     }
@@ -433,7 +472,7 @@ namespace FTS {
 
                     template<typename U> U get_extend_elem_prop(std::string key,
                                                                 size_t elem_index) const {
-                        return this->get_extend_elem_prop<U>(key, elem_index);
+                        return to<U>(get_extend_elem_prop(key, elem_index));
                     }
                     
                     bool has_extend_elem_prop(const std::string& key) const;
@@ -615,6 +654,23 @@ namespace FTS {
 
                 protected:
                     
+                    // A contiguous block of rows of a similarity matrix to be filled by a single thread.
+                    class SimilarityJob {
+                            
+                        public:
+                            
+                            const Set* set;
+                            const Set* reference;
+                            MR::Math::Matrix<double>* similarity;
+                            double strands_per_acs;
+                            size_t start;
+                            size_t end;
+                            
+                    };
+                    
+                    // Fills the rows of a SimilarityJob. Has the signature required by pthread_create.
+                    static void* fill_similarity_rows(void* arg);
+                    
                     /*! Returns the row size for the given row index. If the row size is fixed it is simply returned otherwise the
                      * variable row size is looked up.
                      *
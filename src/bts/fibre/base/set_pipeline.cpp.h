@@ -0,0 +1,301 @@
+/*
+ Copyright 2010 Brain Research Institute/National ICT Australia (NICTA), Melbourne, Australia
+
+ Written by Thomas G Close, 5/05/09.
+
+ This file is part of Fourier Tract Sampling (FouTS).
+
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef __bts_fibre_base_setpipeline_cpp_h__
+#define __bts_fibre_base_setpipeline_cpp_h__
+
+#include <algorithm>
+
+namespace FTS {
+    
+    namespace Fibre {
+        
+        namespace Base {
+            
+            template<typename S, typename R> const size_t SetPipeline<S, R>::SLOTS_PER_THREAD_DEFAULT;
+            
+            template<typename S, typename R> SetPipeline<S, R>::SetPipeline(
+                    typename S::Reader& reader, Stage& stage, size_t num_threads, size_t buffer_size)
+                    : reader(reader), stage(stage), num_threads(std::max(num_threads, (size_t) 1)), num_read(
+                              0), num_claimed(0), finished_reading(false), aborted(false) {
+                
+                if (!buffer_size)
+                    buffer_size = this->num_threads * SLOTS_PER_THREAD_DEFAULT;
+                
+                //Each worker needs at least one slot to work on while the writer waits on another.
+                slots.resize(std::max(buffer_size, this->num_threads + 1));
+                
+                pthread_mutex_init(&mutex, NULL);
+                pthread_cond_init(&changed, NULL);
+                
+            }
+            
+            template<typename S, typename R> SetPipeline<S, R>::~SetPipeline() {
+                
+                pthread_cond_destroy(&changed);
+                pthread_mutex_destroy(&mutex);
+                
+            }
+            
+            template<typename S, typename R> size_t SetPipeline<S, R>::run(
+                    MR::ProgressBar* progress_bar) {
+                
+                if (num_threads == 1)
+                    return run_serial(progress_bar);
+                
+                num_read = 0;
+                num_claimed = 0;
+                finished_reading = false;
+                aborted = false;
+                error.clear();
+                
+                for (size_t slot_i = 0; slot_i < slots.size(); ++slot_i)
+                    slots[slot_i].status = EMPTY;
+                
+                pthread_t read_thread;
+                std::vector<pthread_t> process_threads(num_threads);
+                
+                if (pthread_create(&read_thread, NULL, read_samples, this))
+                    throw Exception("Could not create thread to read samples.");
+                
+                size_t num_started = 0;
+                
+                for (; num_started < num_threads; ++num_started)
+                    if (pthread_create(&process_threads[num_started], NULL, process_samples, this)) {
+                        abort("Could not create thread " + str(num_started) + " to process samples.");
+                        break;
+                    }
+                
+                size_t sample_i = 0;
+                
+                // The calling thread writes the processed samples in the order they were read.
+                pthread_mutex_lock(&mutex);
+                
+                while (!aborted) {
+                    
+                    if (finished_reading && sample_i == num_read)
+                        break;
+                    
+                    if (slot(sample_i).status != PROCESSED || sample_i >= num_read) {
+                        pthread_cond_wait(&changed, &mutex);
+                        continue;
+                    }
+                    
+                    pthread_mutex_unlock(&mutex);
+                    
+                    try {
+                        
+                        stage.write(slot(sample_i).sample, slot(sample_i).result, sample_i);
+                        
+                        if (progress_bar)
+                            ++(*progress_bar);
+                        
+                    } catch (Exception& e) {
+                        abort(e.num() ? e[0] : "Unknown error in writing sample " + str(sample_i));
+                    } catch (const std::exception& e) {
+                        abort("Error in writing sample " + str(sample_i) + ": " + e.what());
+                    } catch (...) {
+                        abort("Unknown error in writing sample " + str(sample_i));
+                    }
+                    
+                    pthread_mutex_lock(&mutex);
+                    
+                    slot(sample_i).status = EMPTY;
+                    ++sample_i;
+                    
+                    pthread_cond_broadcast(&changed);
+                    
+                }
+                
+                pthread_mutex_unlock(&mutex);
+                
+                pthread_join(read_thread, NULL);
+                
+                for (size_t thread_i = 0; thread_i < num_started; ++thread_i)
+                    pthread_join(process_threads[thread_i], NULL);
+                
+                if (aborted)
+                    throw Exception(error);
+                
+                return sample_i;
+                
+            }
+            
+            template<typename S, typename R> size_t SetPipeline<S, R>::run_serial(
+                    MR::ProgressBar* progress_bar) {
+                
+                Slot& current = slots[0];
+                
+                size_t sample_i = 0;
+                
+                while (reader.next(current.sample)) {
+                    
+                    stage.process(current.sample, current.result, sample_i);
+                    stage.write(current.sample, current.result, sample_i);
+                    
+                    if (progress_bar)
+                        ++(*progress_bar);
+                    
+                    ++sample_i;
+                    
+                }
+                
+                return sample_i;
+                
+            }
+            
+            template<typename S, typename R> void SetPipeline<S, R>::abort(
+                    const std::string& message) {
+                
+                pthread_mutex_lock(&mutex);
+                
+                if (!aborted) {
+                    aborted = true;
+                    error = message;
+                }
+                
+                pthread_cond_broadcast(&changed);
+                
+                pthread_mutex_unlock(&mutex);
+                
+            }
+            
+            template<typename S, typename R> void* SetPipeline<S, R>::read_samples(
+                    void* pipeline) {
+                
+                SetPipeline<S, R>& pipe = *(SetPipeline<S, R>*) pipeline;
+                
+                pthread_mutex_lock(&pipe.mutex);
+                
+                while (!pipe.aborted) {
+                    
+                    Slot& next = pipe.slot(pipe.num_read);
+                    
+                    //Wait until the previous occupant of the slot has been written.
+                    if (next.status != EMPTY) {
+                        pthread_cond_wait(&pipe.changed, &pipe.mutex);
+                        continue;
+                    }
+                    
+                    pthread_mutex_unlock(&pipe.mutex);
+                    
+                    bool found;
+                    
+                    try {
+                        found = pipe.reader.next(next.sample);
+                    } catch (Exception& e) {
+                        pipe.abort(
+                                e.num() ? e[0] : "Unknown error in reading sample "
+                                                 + str(pipe.num_read));
+                        return NULL;
+                    } catch (const std::exception& e) {
+                        pipe.abort("Error in reading sample " + str(pipe.num_read) + ": " + e.what());
+                        return NULL;
+                    } catch (...) {
+                        pipe.abort("Unknown error in reading sample " + str(pipe.num_read));
+                        return NULL;
+                    }
+                    
+                    pthread_mutex_lock(&pipe.mutex);
+                    
+                    if (found) {
+                        next.status = READ;
+                        ++pipe.num_read;
+                    } else
+                        pipe.finished_reading = true;
+                    
+                    pthread_cond_broadcast(&pipe.changed);
+                    
+                    if (!found)
+                        break;
+                    
+                }
+                
+                pthread_mutex_unlock(&pipe.mutex);
+                
+                return NULL;
+                
+            }
+            
+            template<typename S, typename R> void* SetPipeline<S, R>::process_samples(
+                    void* pipeline) {
+                
+                SetPipeline<S, R>& pipe = *(SetPipeline<S, R>*) pipeline;
+                
+                pthread_mutex_lock(&pipe.mutex);
+                
+                while (!pipe.aborted) {
+                    
+                    if (pipe.num_claimed == pipe.num_read) {
+                        
+                        if (pipe.finished_reading)
+                            break;
+                        
+                        pthread_cond_wait(&pipe.changed, &pipe.mutex);
+                        continue;
+                        
+                    }
+                    
+                    size_t sample_i = pipe.num_claimed++;
+                    
+                    Slot& current = pipe.slot(sample_i);
+                    
+                    current.status = PROCESSING;
+                    
+                    pthread_mutex_unlock(&pipe.mutex);
+                    
+                    try {
+                        pipe.stage.process(current.sample, current.result, sample_i);
+                    } catch (Exception& e) {
+                        pipe.abort(
+                                e.num() ? e[0] : "Unknown error in processing sample "
+                                                 + str(sample_i));
+                        return NULL;
+                    } catch (const std::exception& e) {
+                        pipe.abort("Error in processing sample " + str(sample_i) + ": " + e.what());
+                        return NULL;
+                    } catch (...) {
+                        pipe.abort("Unknown error in processing sample " + str(sample_i));
+                        return NULL;
+                    }
+                    
+                    pthread_mutex_lock(&pipe.mutex);
+                    
+                    current.status = PROCESSED;
+                    
+                    pthread_cond_broadcast(&pipe.changed);
+                    
+                }
+                
+                pthread_mutex_unlock(&pipe.mutex);
+                
+                return NULL;
+                
+            }
+        
+        }
+    
+    }
+
+}
+
+#endif
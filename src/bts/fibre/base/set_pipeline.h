@@ -0,0 +1,159 @@
+/*
+ Copyright 2010 Brain Research Institute/National ICT Australia (NICTA), Melbourne, Australia
+
+ Written by Thomas G Close, 5/05/09.
+
+ This file is part of Fourier Tract Sampling (FouTS).
+
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef __bts_fibre_base_setpipeline_h__
+#define __bts_fibre_base_setpipeline_h__
+
+#include <vector>
+#include <string>
+#include <exception>
+#include <pthread.h>
+
+#include "progressbar.h"
+
+#include "bts/common.h"
+
+namespace FTS {
+    
+    namespace Fibre {
+        
+        namespace Base {
+            
+            //Result type for stages that pass nothing between their 'process' and 'write' steps.
+            class NoResult {
+            };
+            
+            /*! Streams the samples of a set file through a post-processing command. A reader thread prefetches samples
+             *  into a bounded ring of slots, a pool of worker threads processes them in whatever order they become
+             *  free and the calling thread hands the processed samples back to the command in the order they were read,
+             *  so output files are identical to those of a serial loop.
+             *
+             *  'S' is the set type (e.g. Strand::Set) and 'R' is the per-sample result passed from the 'process' to the
+             *  'write' step of the stage (e.g. formatted lines of text).
+             */
+            template<typename S, typename R = NoResult> class SetPipeline {
+                    
+                    //Public nested classes and constants
+                public:
+                    
+                    /*! The per-sample work of a command. 'process' is called concurrently from the worker threads so may
+                     *  only read shared state, whereas 'write' is called from the calling thread in sample order and is
+                     *  where output streams and running sums should be updated.
+                     */
+                    class Stage {
+                            
+                        public:
+                            
+                            virtual ~Stage() {
+                            }
+                            
+                            virtual void process(S& sample, R& result, size_t sample_i) = 0;
+
+                            virtual void write(S& sample, R& result, size_t sample_i) = 0;
+                            
+                    };
+                    
+                    //Number of slots allocated per worker thread when the buffer size is not specified.
+                    const static size_t SLOTS_PER_THREAD_DEFAULT = 4;
+
+                protected:
+                    
+                    enum Status {
+                        EMPTY, READ, PROCESSING, PROCESSED
+                    };
+                    
+                    class Slot {
+                            
+                        public:
+                            
+                            S sample;
+                            R result;
+                            Status status;
+
+                        public:
+                            
+                            Slot()
+                                    : status(EMPTY) {
+                            }
+                            
+                    };
+                    
+                    //Protected member variables
+                protected:
+                    
+                    typename S::Reader& reader;
+                    Stage& stage;
+                    size_t num_threads;
+
+                    std::vector<Slot> slots;
+
+                    pthread_mutex_t mutex;
+                    pthread_cond_t changed;
+
+                    //Number of samples read so far (and the index of the next sample to be read).
+                    size_t num_read;
+                    //Index of the next sample to be claimed by a worker thread.
+                    size_t num_claimed;
+                    bool finished_reading;
+                    bool aborted;
+                    std::string error;
+
+                public:
+                    
+                    SetPipeline(typename S::Reader& reader, Stage& stage, size_t num_threads = 1,
+                                size_t buffer_size = 0);
+
+                    ~SetPipeline();
+
+                    /*! Runs the stage over all remaining samples in the reader, incrementing 'progress_bar' (if
+                     *  provided) as each sample is written. Returns the number of samples processed. Exceptions
+                     *  thrown from any of the threads are rethrown in the calling thread once the others have stopped.
+                     */
+                    size_t run(MR::ProgressBar* progress_bar = 0);
+
+                protected:
+                    
+                    size_t run_serial(MR::ProgressBar* progress_bar);
+
+                    Slot& slot(size_t sample_i) {
+                        return slots[sample_i % slots.size()];
+                    }
+                    
+                    //Stops the other threads, keeping the first error message received.
+                    void abort(const std::string& message);
+
+                    // Thread entry points. Have the signature required by pthread_create.
+                    static void* read_samples(void* pipeline);
+
+                    static void* process_samples(void* pipeline);
+                    
+            };
+        
+        }
+    
+    }
+
+}
+
+#include "bts/fibre/base/set_pipeline.cpp.h"
+
+#endif
@@ -31,6 +31,28 @@ namespace FTS {
             
             template<typename T> void SetReader<T>::open(const std::string& location) {
                 
+                close();
+                
+                if (File::has_sample_extension(location)) {
+                    
+                    samples = new SampleReader<T>(location);
+                    
+                    this->file_location = location;
+                    this->ext_props = samples->get_extend_props();
+                    this->prop_hdr = samples->prop_header();
+                    this->prp_keys = samples->prop_keys();
+                    this->ext_prp_keys = samples->extend_prop_keys();
+                    this->prop_begin = 0;
+                    
+                    elem_prop_hdr = samples->elem_header();
+                    elem_prp_keys = samples->elem_prop_keys();
+                    ext_elem_prp_keys = samples->extend_elem_prop_keys();
+                    elem_begin = 0;
+                    
+                    return;
+                    
+                }
+                
                 Reader<T>::open(location);
                 
                 std::string elem_properties_location = location + "xx";
@@ -59,6 +81,11 @@ namespace FTS {
             
             template<typename T> void SetReader<T>::rewind() {
                 
+                if (samples) {
+                    samples->rewind();
+                    return;
+                }
+                
                 Reader<T>::rewind();
                 
                 if (elem_begin)
@@ -66,8 +93,33 @@ namespace FTS {
                 
             }
             
+            template<typename T> size_t SetReader<T>::size() const {
+                
+                if (!samples)
+                    throw Exception(
+                            "The number of sets is only available for binary sample files ('*."
+                            + File::SAMPLE_FILE_EXTENSION + "').");
+                
+                return samples->size();
+                
+            }
+            
+            template<typename T> void SetReader<T>::seek(size_t index) {
+                
+                if (!samples)
+                    throw Exception(
+                            "Random access is only available for binary sample files ('*."
+                            + File::SAMPLE_FILE_EXTENSION + "').");
+                
+                samples->seek(index);
+                
+            }
+            
             template<typename T> bool SetReader<T>::next(T& set) {
                 
+                if (samples)
+                    return samples->next(set);
+                
                 std::map<std::string, std::string> properties;
                 
                 set.reset(this->prp_keys, elem_prp_keys);
@@ -29,6 +29,7 @@
 
 #include "bts/fibre/base/set.h"
 #include "bts/fibre/base/reader.h"
+#include "bts/fibre/base/sample_reader.h"
 
 namespace FTS {
     
@@ -48,13 +49,18 @@ namespace FTS {
                     std::ifstream elem_in;
                     int64_t elem_begin;
 
+                    // Used in place of the text property files when reading from a binary sample file ('*.smp').
+                    SampleReader<T>* samples;
+
                     // Public methods and constructors.
                 public:
                     
-                    SetReader() {
+                    SetReader()
+                            : samples(0) {
                     }
                     
-                    SetReader(const std::string& location) {
+                    SetReader(const std::string& location)
+                            : samples(0) {
                         open(location);
                     }
                     
@@ -77,11 +83,21 @@ namespace FTS {
                     }
                     
                     void close() {
+                        if (samples)
+                            delete samples;
+                        samples = 0;
                         Base::Reader<T>::close();
                         elem_in.close();
                         elem_prop_hdr.clear();
                     }
                     
+                    // The number of sets in the file (only available for binary sample files).
+                    size_t size() const;
+
+                    // Moves to the set at 'index' so that it is returned by the next call to 'next' (only available
+                    // for binary sample files).
+                    void seek(size_t index);
+                    
                     std::vector<std::string> extend_elem_prop_keys() const {
                         return ext_elem_prp_keys;
                     }
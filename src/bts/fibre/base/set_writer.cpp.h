@@ -48,10 +48,29 @@ namespace FTS {
                 elem_header.insert(elem_header.end(), extend_elem_prop_keys.begin(),
                         extend_elem_prop_keys.end());
                 
-                Writer<T>::create(location, props, extend_prop_keys, file_props);
-                
                 elem_prop_hdr = elem_header;
                 
+                if (File::has_sample_extension(location)) {
+                    
+                    std::vector<std::string> prop_header;
+                    
+                    for (size_t prop_i = 0; prop_i < props.size(); ++prop_i)
+                        prop_header.push_back(props[prop_i]);
+                    
+                    prop_header.insert(prop_header.end(), extend_prop_keys.begin(),
+                            extend_prop_keys.end());
+                    
+                    this->prop_hdr = prop_header;
+                    this->count = this->total_count = 0;
+                    
+                    samples = new SampleWriter<T>(location, prop_header, elem_prop_hdr, file_props);
+                    
+                    return;
+                    
+                }
+                
+                Writer<T>::create(location, props, extend_prop_keys, file_props);
+                
                 std::string set_properties_location = location + "xx";
                 
                 if (elem_prop_hdr.size()) {
@@ -67,6 +86,12 @@ namespace FTS {
             
             template<typename T> void SetWriter<T>::append(const T& set) {
                 
+                if (samples) {
+                    samples->append(set);
+                    this->count = this->total_count = samples->count;
+                    return;
+                }
+                
                 Base::Writer<T>::append(set, set.get_extend_props());
                 
                 for (size_t elem_i = 0; elem_i < set.size(); elem_i++) {
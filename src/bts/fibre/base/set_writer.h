@@ -28,6 +28,7 @@
 #include "bts/fibre/base/set.h"
 #include "bts/fibre/base/writer.h"
 #include "bts/fibre/base/set_reader.h"
+#include "bts/fibre/base/sample_writer.h"
 #include "bts/fibre/properties.h"
 
 namespace FTS {
@@ -48,22 +49,28 @@ namespace FTS {
 
                     std::ofstream ext_elem_out;
 
+                    // Used in place of the text property files when writing to a binary sample file ('*.smp').
+                    SampleWriter<T>* samples;
+
                     // Public methods and constructors.
                 public:
                     
-                    SetWriter() {
+                    SetWriter()
+                            : samples(0) {
                     }
                     
                     template<typename U> SetWriter(
                             const std::string& location, const U& set_or_reader,
-                            const std::map<std::string, std::string>& file_props = Properties()) {
+                            const std::map<std::string, std::string>& file_props = Properties())
+                            : samples(0) {
                         create(location, set_or_reader, file_props);
                     }
                     
                     template<typename U> SetWriter(
                             const std::string& location, const U& set_or_reader,
                             const std::vector<std::string>& extend_prop_keys,
-                            const std::map<std::string, std::string>& file_props = Properties()) {
+                            const std::map<std::string, std::string>& file_props = Properties())
+                            : samples(0) {
                         create(location, set_or_reader, extend_prop_keys, file_props);
                     }
                     
@@ -71,7 +78,8 @@ namespace FTS {
                             const std::string& location, const U& set_or_reader,
                             const std::vector<std::string>& extend_prop_keys,
                             const std::vector<std::string>& extend_elem_prop_keys,
-                            const std::map<std::string, std::string>& file_props = Properties()) {
+                            const std::map<std::string, std::string>& file_props = Properties())
+                            : samples(0) {
                         create(location, set_or_reader, extend_prop_keys, extend_elem_prop_keys,
                                 file_props);
                     }
@@ -117,8 +125,13 @@ namespace FTS {
                     void append(const T& set, std::map<std::string, std::string>& properties);
 
                     void close() {
-                        Fibre::Base::Writer<T>::close();
-                        ext_elem_out.close();
+                        if (samples) {
+                            delete samples;
+                            samples = 0;
+                        } else {
+                            Fibre::Base::Writer<T>::close();
+                            ext_elem_out.close();
+                        }
                     }
                     
                     // Protected methods and constructors
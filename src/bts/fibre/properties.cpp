@@ -0,0 +1,203 @@
+/*
+ Copyright 2010 Brain Research Institute/National ICT Australia (NICTA), Melbourne, Australia
+
+ Written by Thomas G Close, 5/05/09.
+
+ This file is part of Fourier Tract Sampling (FouTS).
+
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <set>
+#include <pthread.h>
+
+#include "bts/common.h"
+
+#include "bts/fibre/properties.h"
+
+namespace FTS {
+    
+    namespace Fibre {
+        
+        ExtendProps::ExtendProps(const std::map<std::string, std::string>& properties) {
+            
+            entries.reserve(properties.size());
+            
+            //The map is already in key order so the entries can be appended directly.
+            for (std::map<std::string, std::string>::const_iterator prop_it = properties.begin();
+                    prop_it != properties.end(); ++prop_it) {
+                entries.push_back(Entry(intern(prop_it->first)));
+                entries.back().text = prop_it->second;
+            }
+            
+        }
+        
+        std::string ExtendProps::Entry::str() const {
+            
+            switch (type) {
+                case NUMBER:
+                    return FTS::str(number);
+                case INTEGER:
+                    return FTS::str(integer);
+                default:
+                    return text;
+            }
+            
+        }
+        
+        void ExtendProps::set(const std::string& key, const std::string& value) {
+            
+            Entry& entry = insert(key);
+            
+            entry.type = TEXT;
+            entry.text = value;
+            
+        }
+        
+        void ExtendProps::set_number(const std::string& key, double value) {
+            
+            Entry& entry = insert(key);
+            
+            entry.type = NUMBER;
+            entry.number = value;
+            entry.text.clear();
+            
+        }
+        
+        void ExtendProps::set_integer(const std::string& key, int64_t value) {
+            
+            Entry& entry = insert(key);
+            
+            entry.type = INTEGER;
+            entry.integer = value;
+            entry.text.clear();
+            
+        }
+        
+        double ExtendProps::get_number(const std::string& key) const {
+            
+            const Entry& entry = lookup(key);
+            
+            switch (entry.type) {
+                case NUMBER:
+                    return entry.number;
+                case INTEGER:
+                    return (double) entry.integer;
+                default:
+                    return to<double>(entry.text);
+            }
+            
+        }
+        
+        int64_t ExtendProps::get_integer(const std::string& key) const {
+            
+            const Entry& entry = lookup(key);
+            
+            switch (entry.type) {
+                case NUMBER:
+                    return (int64_t) entry.number;
+                case INTEGER:
+                    return entry.integer;
+                default:
+                    return to<int64_t>(entry.text);
+            }
+            
+        }
+        
+        std::vector<std::string> ExtendProps::keys() const {
+            
+            std::vector<std::string> keys;
+            
+            keys.reserve(entries.size());
+            
+            for (size_t entry_i = 0; entry_i < entries.size(); ++entry_i)
+                keys.push_back(*entries[entry_i].key);
+            
+            return keys;
+            
+        }
+        
+        std::map<std::string, std::string> ExtendProps::to_map() const {
+            
+            std::map<std::string, std::string> properties;
+            
+            for (size_t entry_i = 0; entry_i < entries.size(); ++entry_i)
+                properties.insert(properties.end(),
+                        std::pair<std::string, std::string>(*entries[entry_i].key,
+                                entries[entry_i].str()));
+            
+            return properties;
+            
+        }
+        
+        const ExtendProps::Entry* ExtendProps::find(const std::string& key) const {
+            
+            //The number of extended properties is small so a linear search is quicker than a binary one.
+            for (size_t entry_i = 0; entry_i < entries.size(); ++entry_i)
+                if (*entries[entry_i].key == key)
+                    return &entries[entry_i];
+            
+            return 0;
+            
+        }
+        
+        const ExtendProps::Entry& ExtendProps::lookup(const std::string& key) const {
+            
+            const Entry* entry = find(key);
+            
+            if (!entry)
+                throw Exception("'" + key + "' key was not found in extended properties.");
+            
+            return *entry;
+            
+        }
+        
+        ExtendProps::Entry& ExtendProps::insert(const std::string& key) {
+            
+            std::vector<Entry>::iterator entry_it = entries.begin();
+            
+            for (; entry_it != entries.end(); ++entry_it) {
+                
+                int comparison = entry_it->key->compare(key);
+                
+                if (!comparison)
+                    return *entry_it;
+                else if (comparison > 0)
+                    break;
+                
+            }
+            
+            return *entries.insert(entry_it, Entry(intern(key)));
+            
+        }
+        
+        const std::string* ExtendProps::intern(const std::string& key) {
+            
+            static std::set<std::string> interned;
+            static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+            
+            pthread_mutex_lock(&mutex);
+            
+            const std::string* shared = &*interned.insert(key).first;
+            
+            pthread_mutex_unlock(&mutex);
+            
+            return shared;
+            
+        }
+    
+    }
+
+}
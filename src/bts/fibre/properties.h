@@ -25,6 +25,8 @@
 
 #include <string>
 #include <map>
+#include <vector>
+#include <stdint.h>
 
 namespace FTS {
     
@@ -51,6 +53,105 @@ namespace FTS {
                 
         };
         
+        /*! Typed store for the extended properties of a fibre set. Numeric values set by the samplers are held as
+         *  doubles or 64-bit integers and only formatted to text (in the same way 'str' would) when they are read as
+         *  strings, e.g. when written to the properties file, while values loaded from file are held as text and parsed
+         *  on numeric access. Entries are kept in key order so that key lists (and hence file headers) match those of
+         *  the std::map they replace, and keys are interned so that copying a store does not copy its key strings.
+         */
+        class ExtendProps {
+                
+            public:
+                
+                enum Type {
+                    TEXT, NUMBER, INTEGER
+                };
+                
+            protected:
+                
+                class Entry {
+                        
+                    public:
+                        
+                        const std::string* key;
+                        Type type;
+                        double number;
+                        int64_t integer;
+                        std::string text;
+
+                    public:
+                        
+                        Entry(const std::string* key)
+                                : key(key), type(TEXT), number(0.0), integer(0) {
+                        }
+                        
+                        std::string str() const;
+                        
+                };
+                
+                std::vector<Entry> entries;
+
+            public:
+                
+                ExtendProps() {
+                }
+                
+                ExtendProps(const std::map<std::string, std::string>& properties);
+
+                ~ExtendProps() {
+                }
+                
+                size_t size() const {
+                    return entries.size();
+                }
+                
+                void clear() {
+                    entries.clear();
+                }
+                
+                bool has(const std::string& key) const {
+                    return find(key);
+                }
+                
+                Type type(const std::string& key) const {
+                    return lookup(key).type;
+                }
+                
+                void set(const std::string& key, const std::string& value);
+
+                void set_number(const std::string& key, double value);
+
+                void set_integer(const std::string& key, int64_t value);
+
+                //Returns the value formatted as text. Throws if the key is not present.
+                std::string get(const std::string& key) const {
+                    return lookup(key).str();
+                }
+                
+                //Returns the value as a double, parsing it if it was stored as text. Throws if the key is not present.
+                double get_number(const std::string& key) const;
+
+                //Returns the value as an integer, parsing it if it was stored as text. Throws if the key is not present.
+                int64_t get_integer(const std::string& key) const;
+
+                std::vector<std::string> keys() const;
+
+                std::map<std::string, std::string> to_map() const;
+
+            protected:
+                
+                const Entry* find(const std::string& key) const;
+
+                const Entry& lookup(const std::string& key) const;
+
+                //Returns the entry for 'key', inserting it (in key order) if it is not already present.
+                Entry& insert(const std::string& key);
+
+                //Returns a pointer to the shared copy of 'key', which remains valid for the life of the program.
+                static const std::string* intern(const std::string& key);
+                
+        };
+        
         class PropertyKeys: public std::vector<std::string> {
                 
             public:
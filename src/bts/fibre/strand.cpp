@@ -373,9 +373,22 @@ namespace FTS {
             const MR::Math::Matrix<double>& tangent_matrix = Strand::tangent_matrix(
                     num_length_sections, this->degree());
             
+            // Copy the coefficients into a contiguous (degree x 3) block so that the positions and tangents of every
+            // section can be calculated with one matrix-matrix product each.
+            std::vector<double> coeffs(this->degree() * 3);
+            
+            for (size_t elem_i = 0; elem_i < coeffs.size(); ++elem_i)
+                coeffs[elem_i] = MR::Math::Vector<double>::operator[](elem_i);
+            
+            std::vector<double> positions, tangents;
+            
+            batch_product(position_matrix, coeffs, 3, positions);
+            batch_product(tangent_matrix, coeffs, 3, tangents);
+            
             for (size_t section_i = 0; section_i < num_length_sections; section_i++) {
                 sections[section_i].set(*this, position_matrix.row(section_i),
-                        tangent_matrix.row(section_i), length_fraction);
+                        tangent_matrix.row(section_i), length_fraction, &positions[section_i * 3],
+                        &tangents[section_i * 3]);
                 sections[section_i].normalize(vox_lengths, offsets);
             }
             
@@ -383,6 +396,32 @@ namespace FTS {
             
         }
         
+        void Strand::batch_product(const MR::Math::Matrix<double>& matrix,
+                                   const std::vector<double>& coeffs, size_t num_columns,
+                                   std::vector<double>& products) {
+            
+            assert(coeffs.size() == matrix.columns() * num_columns);
+            
+            products.assign(matrix.rows() * num_columns, 0.0);
+            
+            for (size_t row_i = 0; row_i < matrix.rows(); ++row_i) {
+                
+                double* product = &products[row_i * num_columns];
+                
+                for (size_t degree_i = 0; degree_i < matrix.columns(); ++degree_i) {
+                    
+                    double weight = matrix(row_i, degree_i);
+                    const double* coeff = &coeffs[degree_i * num_columns];
+                    
+                    for (size_t col_i = 0; col_i < num_columns; ++col_i)
+                        product[col_i] += weight * coeff[col_i];
+                    
+                }
+                
+            }
+            
+        }
+        
         // Used to convert Strand descriptors to a path of points
         MR::Math::Matrix<double> Strand::create_position_matrix(size_t degree, size_t num_sections,
                                                                 bool include_endpoints) {
@@ -608,11 +647,46 @@ namespace FTS {
         
         //Gets the squared distance between this strand and the reference strand.  Due to the Strand descriptor
         //parameterization being orthonormal, by Parseval's theorem it corresponds to the distance between identically-spaced
-        //trains of path points along each strand.
+        //trains of path points along each strand. Both the plain and flipped distances are accumulated in a single pass
+        //without copying the reference, with the shorter strand padded with zeros.
         double Strand::distance(const Strand& reference, bool& flipped) const {
             
-            double dist = MR::Math::sqrt((*this - reference).norm2());
-            double flipped_dist = MR::Math::sqrt((*this - reference.flip()).norm2());
+            assert(props_match(reference));
+            
+            const MR::Math::Vector<double>& this_vec = *this;
+            const MR::Math::Vector<double>& ref_vec = reference;
+            
+            size_t this_degree = degree();
+            size_t ref_degree = reference.degree();
+            
+            double dist2 = 0.0;
+            double flipped_dist2 = 0.0;
+            
+            for (size_t degree_i = 0; degree_i < std::max(this_degree, ref_degree); ++degree_i)
+                for (size_t dim_i = 0; dim_i < 3; ++dim_i) {
+                    
+                    double this_coeff = degree_i < this_degree ? this_vec[degree_i * 3 + dim_i] : 0.0;
+                    double ref_coeff = degree_i < ref_degree ? ref_vec[degree_i * 3 + dim_i] : 0.0;
+                    
+                    double diff = this_coeff - ref_coeff;
+                    double flipped_diff = (degree_i % 2) ? this_coeff + ref_coeff : diff;
+                    
+                    dist2 += diff * diff;
+                    flipped_dist2 += flipped_diff * flipped_diff;
+                    
+                }
+            
+            for (size_t prop_i = 0; prop_i < num_props(); ++prop_i) {
+                
+                double diff = this_vec[this_degree * 3 + prop_i] - ref_vec[ref_degree * 3 + prop_i];
+                
+                dist2 += diff * diff;
+                flipped_dist2 += diff * diff;
+                
+            }
+            
+            double dist = MR::Math::sqrt(dist2);
+            double flipped_dist = MR::Math::sqrt(flipped_dist2);
             
             if (flipped_dist < dist) {
                 dist = flipped_dist;
@@ -76,6 +76,10 @@ namespace FTS {
                 //Public static variables
             public:
                 
+                // Caches of the matrices returned by position_matrix() etc., indexed by the number of sections and then the
+                // degree. They are filled on first use without any locking, so they aren't thread-safe. Code that splits
+                // fibres into sections from several threads must request every matrix it needs from the calling thread
+                // before the threads are started (see Image::Expected::Buffer_tpl::threaded_image).
                 static std::map<size_t, std::map<size_t, MR::Math::Matrix<double> > > position_matrices;
                 static std::map<size_t, std::map<size_t, MR::Math::Matrix<double> > > tangent_matrices;
                 static std::map<size_t, std::map<size_t, MR::Math::Matrix<double> > > inverse_position_matrices;
@@ -124,6 +128,13 @@ namespace FTS {
                 static Strand outer_product(const MR::Math::Vector<double>& column_vector,
                                             const Coord& coord);
 
+                // Multiplies a position or tangent matrix by a (degree x num_columns) block of coefficients, stored row by
+                // row in 'coeffs', to evaluate the coefficients at every section in a single matrix-matrix product. The
+                // products are stored row by row (one row per section) in 'products'.
+                static void batch_product(const MR::Math::Matrix<double>& matrix,
+                                          const std::vector<double>& coeffs, size_t num_columns,
+                                          std::vector<double>& products);
+
             protected:
                 
                 const Base::Set<Strand>* parent;
@@ -113,6 +113,27 @@ namespace FTS {
                     this->parent = &strand;
                 }
                 
+                // Sets the section from its position and tangent, which have already been evaluated from the strand (see
+                // Strand::batch_product).
+                void set(const Strand& strand,
+                         const MR::Math::Vector<double>::View& position_coeffs,
+                         const MR::Math::Vector<double>::View& tangent_coeffs,
+                         double length_fraction, const double* position, const double* tangent) {
+                    
+                    this->intensity() = strand.acs();
+                    
+                    for (size_t dim_i = 0; dim_i < 3; ++dim_i) {
+                        this->position(dim_i) = position[dim_i];
+                        this->tangent(dim_i) = tangent[dim_i] * length_fraction;
+                    }
+                    
+                    this->position_coeffs = position_coeffs;
+                    this->tangent_coeffs = tangent_coeffs;
+                    this->length_fraction = length_fraction;
+                    
+                    this->parent = &strand;
+                }
+                
                 Section(const Section& s)
                         : BasicSection(s), position_coeffs(s.position_coeffs), tangent_coeffs(
                                   s.tangent_coeffs), length_fraction(s.length_fraction), precalc_weightings(
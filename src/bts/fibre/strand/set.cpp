@@ -64,7 +64,7 @@ namespace FTS {
                 : Base::Set<Strand>(tcks.size(), degree,
                         3 * degree + select_props<Strand>(*tcks.elem_props).size(),
                         select_props<Set>(*tcks.props), select_props<Strand>(*tcks.elem_props),
-                        (tcks.ext_props ? *tcks.ext_props : std::map<std::string, std::string>())) {
+                        tcks.get_extend_props()) {
             
             for (size_t tck_i = 0; tck_i < size(); tck_i++) {
                 
@@ -332,7 +332,7 @@ namespace FTS {
             
             Strand::Set include;
             
-            include.set_extend_prop("peel_distance", str(distance));
+            include.set_extend_prop_number("peel_distance", distance);
             
             if (to_cube)
                 include.set_extend_prop("peel_shape", "cube");
@@ -645,7 +645,7 @@ namespace FTS {
                 
                 Tractlet::Set tractlets(location);
                 
-                set_extend_prop(ORIGINAL_NUM_TRACTLETS_PROP, str(tractlets.size()));
+                set_extend_prop_integer(ORIGINAL_NUM_TRACTLETS_PROP, tractlets.size());
                 
                 operator=(tractlets.to_strands(strands_per_acs));
                 
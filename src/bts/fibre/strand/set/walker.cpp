@@ -38,7 +38,9 @@ namespace FTS {
             
             Walker* walker;
             
-            if (type == "standard") {
+            // The 'adaptive' walker starts from the same step sizes as the 'standard' walker, which are then learned over
+            // the burn-in (see MCMC::Proposal::Walker::start_adaptation).
+            if (type == "standard" || type == "adaptive") {
                 Fibre::Strand::Set step;
                 
                 if (step_location.size()) {
@@ -98,6 +100,48 @@ namespace FTS {
             MCMC::Proposal::Walker::step(current, proposed, scalar);
             
         }
+        
+        void Strand::Set::Walker::schedule_blocks(const Strand::Set& state,
+                                                  const std::string& block_type,
+                                                  const std::string& scan) {
+            
+            if (block_type == "none") {
+                clear_blocks();
+                return;
+            }
+            
+            if (block_type != "fibre" && block_type != "axis")
+                throw Exception(
+                        "Unrecognised block type '" + block_type
+                        + "' (can be 'none', 'fibre' or 'axis').");
+            
+            std::vector<size_t> starts, ends;
+            std::vector<int> fibres;
+            
+            size_t offset = 0;
+            
+            for (size_t strand_i = 0; strand_i < state.size(); ++strand_i) {
+                
+                size_t strand_vsize = state[strand_i].vsize();
+                
+                starts.push_back(offset);
+                ends.push_back(offset + strand_vsize);
+                fibres.push_back(strand_i);
+                
+                offset += strand_vsize;
+                
+            }
+            
+            // The set properties (e.g. base intensity), which affect every fibre.
+            if (offset < state.vsize()) {
+                starts.push_back(offset);
+                ends.push_back(state.vsize());
+                fibres.push_back(-1);
+            }
+            
+            set_blocks(starts, ends, fibres, scan);
+            
+        }
     
     }
 
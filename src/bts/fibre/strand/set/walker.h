@@ -67,6 +67,12 @@ namespace FTS {
                 }
                 
                 virtual void step(const Set& current, Set& proposed, double scalar = 1.0);
+
+                //! Restricts the proposals to one block per step (see MCMC::Proposal::Walker::set_blocks), where 'block_type'
+                //! is 'none', 'fibre' or 'axis' (a strand only has the one axis so it is the same as 'fibre') and 'scan' is
+                //! 'random' or 'systematic'.
+                void schedule_blocks(const Set& state, const std::string& block_type,
+                                     const std::string& scan);
                 
         };
     
@@ -279,7 +279,7 @@ namespace FTS {
             
             Track::Set include(get_extend_props());
             
-            include.set_extend_prop("peel_distance", str(distance));
+            include.set_extend_prop_number("peel_distance", distance);
             
             if (to_cube)
                 include.set_extend_prop("peel_shape", "cube");
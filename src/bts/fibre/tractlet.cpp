@@ -58,6 +58,8 @@ namespace FTS {
         const double Tractlet::STRANDS_PER_AREA_DEFAULT = 1; // 1000;
         const double Tractlet::REASONABLE_WIDTH = 0.1;
 
+        std::map<size_t, MR::Math::Matrix<double> > Tractlet::width_section_matrices;
+
 //    Tractlet::Tractlet (std::vector<Strand> axes, double base_width, double acs)
 //
 //      : acs(acs), base_width(base_width), axes(axes) {
@@ -293,7 +295,7 @@ namespace FTS {
          * the hexagon)
          * @return
          */
-        MR::Math::Matrix<double> Tractlet::width_section_matrix(size_t num_width_sections) {
+        MR::Math::Matrix<double> Tractlet::create_width_section_matrix(size_t num_width_sections) {
 
             size_t num_ax2_sections = (size_t)ceil(num_width_sections * 2.0 / SQRT_3);
 
@@ -332,6 +334,17 @@ namespace FTS {
 
         }
 
+        const MR::Math::Matrix<double>& Tractlet::width_section_matrix(size_t num_width_sections) {
+
+            MR::Math::Matrix<double>& width_matrix = Tractlet::width_section_matrices[num_width_sections];
+
+            if (width_matrix.rows())
+                return width_matrix;
+            else
+                return width_matrix = Tractlet::create_width_section_matrix(num_width_sections);
+
+        }
+
         size_t Tractlet::num_width_strands(size_t num_width_sections) {
 
             return width_section_matrix(num_width_sections).rows();
@@ -345,7 +358,7 @@ namespace FTS {
                                                            const Triple<double>& offsets,
                                                            size_t num_encodings) const {
 
-            MR::Math::Matrix<double> width_fractions = width_section_matrix(num_width_sections);
+            const MR::Math::Matrix<double>& width_fractions = width_section_matrix(num_width_sections);
 
             sections.resize(width_fractions.rows() * num_length_sections,
                     Tractlet::Section(num_encodings));
@@ -360,6 +373,23 @@ namespace FTS {
             const MR::Math::Matrix<double>& tangent_matrix = Strand::tangent_matrix(
                     num_length_sections, this->degree());
 
+            // Stack the coefficients of the three axes side by side into a (degree x 9) block so that the positions and
+            // tangents of all three axes at every length section are calculated with one matrix-matrix product each. They
+            // are then shared between all the width sections at that length section.
+            std::vector<double> coeffs(dgree * 9);
+
+            for (size_t axis_i = 0; axis_i < 3; ++axis_i)
+                for (size_t degree_i = 0; degree_i < dgree; ++degree_i)
+                    for (size_t dim_i = 0; dim_i < 3; ++dim_i)
+                        coeffs[degree_i * 9 + axis_i * 3 + dim_i] =
+                                MR::Math::Vector<double>::operator[](
+                                        (axis_i * dgree + degree_i) * 3 + dim_i);
+
+            std::vector<double> axis_positions, axis_tangents;
+
+            Strand::batch_product(position_matrix, coeffs, 9, axis_positions);
+            Strand::batch_product(tangent_matrix, coeffs, 9, axis_tangents);
+
             size_t section_count = 0;
             for (size_t width_i = 0; width_i < width_fractions.rows(); ++width_i) {
                 for (size_t section_i = 0; section_i < num_length_sections; section_i++) {
@@ -367,7 +397,9 @@ namespace FTS {
                                                 tangent_matrix.row(section_i),
                                                 width_fractions(width_i, 0),
                                                 width_fractions(width_i, 1),
-                                                length_fraction, width_fraction, intensity_scale);
+                                                length_fraction, width_fraction, intensity_scale,
+                                                &axis_positions[section_i * 9],
+                                                &axis_tangents[section_i * 9]);
                     sections[section_count].normalize(vox_lengths, offsets);
                     ++section_count;
                 }
@@ -490,14 +522,72 @@ namespace FTS {
         double Tractlet::distance(const Tractlet& reference, bool& flipped, bool& switched,
                                   bool& invert1, bool& invert2) const {
 
-            double min_dist = INFINITY;
-
             //There are four ambiguities in the Tractlet model:
             //  - Flipping the direction of the sections
             //  - Switching the two axes
             //  - Inverting the first axis
             //  - Inverting the second axis
-            // Each combination is checked to see which is the minimal distance.
+            // Each combination is checked to see which is the minimal distance. Instead of constructing a
+            // modified copy of the reference for each combination, the squared distance is expanded into
+            // |this|^2 + |reference|^2 - 2<this, modified> plus the (unaffected) property terms, where the
+            // cross term of every combination is a signed sum of the inner products between pairs of axes,
+            // split into their even and odd degree coefficients (flipping negates the odd ones).
+
+            assert(props_match(reference));
+
+            const MR::Math::Vector<double>& this_vec = *this;
+            const MR::Math::Vector<double>& ref_vec = reference;
+
+            size_t this_degree = degree();
+            size_t ref_degree = reference.degree();
+            size_t common_degree = std::min(this_degree, ref_degree);
+
+            double norms = 0.0;
+
+            for (size_t elem_i = 0; elem_i < 9 * this_degree; ++elem_i)
+                norms += this_vec[elem_i] * this_vec[elem_i];
+
+            for (size_t elem_i = 0; elem_i < 9 * ref_degree; ++elem_i)
+                norms += ref_vec[elem_i] * ref_vec[elem_i];
+
+            for (size_t prop_i = 0; prop_i < num_props(); ++prop_i) {
+                double diff = this_vec[9 * this_degree + prop_i] - ref_vec[9 * ref_degree + prop_i];
+                norms += diff * diff;
+            }
+
+            // The axis pairings (this, reference) that appear in the cross terms.
+            const size_t pairs[5][2] = { { 0, 0 }, { 1, 1 }, { 2, 2 }, { 1, 2 }, { 2, 1 } };
+
+            double unflipped[5];
+            double flipped_inner[5];
+
+            for (size_t pair_i = 0; pair_i < 5; ++pair_i) {
+
+                const double* this_axis = &this_vec[pairs[pair_i][0] * this_degree * 3];
+                const double* ref_axis = &ref_vec[pairs[pair_i][1] * ref_degree * 3];
+
+                double even = 0.0;
+                double odd = 0.0;
+
+                for (size_t degree_i = 0; degree_i < common_degree; ++degree_i) {
+
+                    double inner = this_axis[degree_i * 3 + X] * ref_axis[degree_i * 3 + X]
+                                   + this_axis[degree_i * 3 + Y] * ref_axis[degree_i * 3 + Y]
+                                   + this_axis[degree_i * 3 + Z] * ref_axis[degree_i * 3 + Z];
+
+                    if (degree_i % 2)
+                        odd += inner;
+                    else
+                        even += inner;
+
+                }
+
+                unflipped[pair_i] = even + odd;
+                flipped_inner[pair_i] = even - odd;
+
+            }
+
+            double min_dist = INFINITY;
 
             flipped = false;
             switched = false;
@@ -509,21 +599,20 @@ namespace FTS {
                     for (size_t flip = 0; flip <= 1; ++flip)
                         for (size_t swtch = 0; swtch <= 1; ++swtch) {
 
-                            Tractlet modified(reference);
-
-                            if (invt1)
-                                modified = modified.invert_axis(1);
+                            const double* inner = flip ? flipped_inner : unflipped;
 
-                            if (invt2)
-                                modified = modified.invert_axis(2);
+                            double sign1 = invt1 ? -1.0 : 1.0;
+                            double sign2 = invt2 ? -1.0 : 1.0;
 
-                            if (flip)
-                                modified = modified.flip();
+                            double cross = inner[0];
 
                             if (swtch)
-                                modified = modified.switch_axes();
+                                cross += sign2 * inner[3] + sign1 * inner[4];
+                            else
+                                cross += sign1 * inner[1] + sign2 * inner[2];
 
-                            double dist = (*this - modified).norm2();
+                            // Clamped as rounding can take the expansion of a zero distance slightly negative.
+                            double dist = std::max(norms - 2.0 * cross, 0.0);
 
                             if (dist < min_dist) {
                                 min_dist = dist;
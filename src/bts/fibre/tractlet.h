@@ -34,6 +34,7 @@
 #include "bts/fibre/strand.h"
 #include "bts/fibre/base/reader.h"
 #include "bts/fibre/base/writer.h"
+#include "bts/fibre/base/sample_reader.h"
 #include "bts/fibre/base/set.h"
 
 namespace FTS {
@@ -69,6 +70,7 @@ namespace FTS {
                 friend class Base::Writer<Tractlet>;
                 friend class Base::Reader<Tractlet::Set>;
                 friend class Base::Writer<Tractlet::Set>;
+                friend class Base::SampleReader<Tractlet::Set>;
 
                 //Public const static members,
             public:
@@ -87,6 +89,14 @@ namespace FTS {
 
                 const static char* PROPS_LIST[];
 
+                //Public static variables
+            public:
+                
+                // Cache of width_section_matrix(), indexed by the number of width sections. Like the Strand section matrices
+                // it is filled on first use without locking, so it must be pre-warmed before sections are generated in
+                // parallel.
+                static std::map<size_t, MR::Math::Matrix<double> > width_section_matrices;
+
                 //Public static functions
             public:
                 
@@ -97,7 +107,10 @@ namespace FTS {
                     return num_width_strands(num_width_sections) * num_length_sections;
                 }
                 
-                static MR::Math::Matrix<double> width_section_matrix(size_t num_width_sections);
+                // Generate the fractions of the auxiliary axes the width sections/strands are placed at.
+                static MR::Math::Matrix<double> create_width_section_matrix(size_t num_width_sections);
+                // Returns the width section matrix, generating it and caching it on first use.
+                static const MR::Math::Matrix<double>& width_section_matrix(size_t num_width_sections);
 
                 //Protected member variables.
             protected:
@@ -113,6 +113,45 @@ namespace FTS {
 
                 }
 
+                // Sets the section from the positions and tangents of the three tractlet axes, which have already been
+                // evaluated from the tractlet (see Strand::batch_product). 'axis_positions' and 'axis_tangents' each hold
+                // the three axes one after the other.
+                void set(const Tractlet& tractlet,
+                         const MR::Math::Vector<double>::View& position_coeffs,
+                         const MR::Math::Vector<double>::View& tangent_coeffs, double ax1_fraction,
+                         double ax2_fraction, double length_fraction, double width_fraction,
+                         double intensity_scale, const double* axis_positions,
+                         const double* axis_tangents) {
+
+                    Strand::Section::set(tractlet.acs() * intensity_scale, position_coeffs,
+                            tangent_coeffs, length_fraction);
+
+                    this->ax1_fraction = ax1_fraction;
+                    this->ax2_fraction = ax2_fraction;
+                    this->width_fraction = width_fraction;
+
+                    for (size_t dim_i = 0; dim_i < 3; ++dim_i) {
+
+                        this->position(dim_i) = axis_positions[dim_i]
+                                                + ax1_fraction * axis_positions[3 + dim_i]
+                                                + ax2_fraction * axis_positions[6 + dim_i];
+
+                        this->tangent(dim_i) = (axis_tangents[dim_i]
+                                + ax1_fraction * axis_tangents[3 + dim_i]
+                                + ax2_fraction * axis_tangents[6 + dim_i])
+                                               * length_fraction;
+
+                        MR::Math::Vector<double>::operator[](6 + dim_i) = axis_positions[3 + dim_i]
+                                * width_fraction;
+                        MR::Math::Vector<double>::operator[](9 + dim_i) = axis_positions[6 + dim_i]
+                                * width_fraction;
+
+                    }
+
+                    this->parent = &tractlet;
+
+                }
+
                 Section(const Section& s)
                         : Strand::Section(s), ax1_fraction(s.ax1_fraction), ax2_fraction(
                                   s.ax2_fraction), parent(s.parent) {
@@ -640,7 +640,7 @@ namespace FTS {
             
             Tractlet::Set include(get_extend_props());
             
-            include.set_extend_prop("peel_distance", str(distance));
+            include.set_extend_prop_number("peel_distance", distance);
             
             if (to_cube)
                 include.set_extend_prop("peel_shape", "cube");
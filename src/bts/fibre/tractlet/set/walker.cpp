@@ -38,7 +38,9 @@ namespace FTS {
             
             Walker* walker;
             
-            if (type == "standard") {
+            // The 'adaptive' walker starts from the same step sizes as the 'standard' walker, which are then learned over
+            // the burn-in (see MCMC::Proposal::Walker::start_adaptation).
+            if (type == "standard" || type == "adaptive") {
                 Fibre::Tractlet::Set step;
                 
                 if (step_location.size()) {
@@ -106,6 +108,67 @@ namespace FTS {
             MCMC::Proposal::Walker::step(current, proposed, scalar);
             
         }
+        
+        void Tractlet::Set::Walker::schedule_blocks(const Tractlet::Set& state,
+                                                    const std::string& block_type,
+                                                    const std::string& scan) {
+            
+            if (block_type == "none") {
+                clear_blocks();
+                return;
+            }
+            
+            if (block_type != "fibre" && block_type != "axis")
+                throw Exception(
+                        "Unrecognised block type '" + block_type
+                        + "' (can be 'none', 'fibre' or 'axis').");
+            
+            std::vector<size_t> starts, ends;
+            std::vector<int> fibres;
+            
+            size_t offset = 0;
+            
+            for (size_t tract_i = 0; tract_i < state.size(); ++tract_i) {
+                
+                const Tractlet tractlet = state[tract_i];
+                
+                if (block_type == "axis") {
+                    
+                    size_t axis_size = tractlet.degree() * 3;
+                    
+                    for (size_t ax_i = 0; ax_i < 3; ++ax_i) {
+                        starts.push_back(offset + ax_i * axis_size);
+                        ends.push_back(offset + (ax_i + 1) * axis_size);
+                        fibres.push_back(tract_i);
+                    }
+                    
+                    // The element properties (e.g. ACS) of the tractlet.
+                    if (tractlet.vsize() > 3 * axis_size) {
+                        starts.push_back(offset + 3 * axis_size);
+                        ends.push_back(offset + tractlet.vsize());
+                        fibres.push_back(tract_i);
+                    }
+                    
+                } else {
+                    starts.push_back(offset);
+                    ends.push_back(offset + tractlet.vsize());
+                    fibres.push_back(tract_i);
+                }
+                
+                offset += tractlet.vsize();
+                
+            }
+            
+            // The set properties (e.g. base intensity), which affect every fibre.
+            if (offset < state.vsize()) {
+                starts.push_back(offset);
+                ends.push_back(state.vsize());
+                fibres.push_back(-1);
+            }
+            
+            set_blocks(starts, ends, fibres, scan);
+            
+        }
     
     }
 
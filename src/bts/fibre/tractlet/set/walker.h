@@ -62,6 +62,12 @@ namespace FTS {
                 }
                 
                 void step(const Set& current, Set& proposed, double scalar = 1.0) const;
+
+                //! Restricts the proposals to one block per step (see MCMC::Proposal::Walker::set_blocks), where 'block_type'
+                //! is 'none', 'fibre' or 'axis' (one of the three axes, or the remaining element properties, of a tractlet)
+                //! and 'scan' is 'random' or 'systematic'.
+                void schedule_blocks(const Set& state, const std::string& block_type,
+                                     const std::string& scan);
                 
         };
     
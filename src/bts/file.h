@@ -46,6 +46,8 @@ namespace FTS {
         
         const std::string TXT_FILE_EXTENSTION = "txt";
         
+        const std::string SAMPLE_FILE_EXTENSION = "smp";
+        
         inline bool exists(const std::string& path) {
             return MR::Path::exists(path);
         }
@@ -95,8 +97,24 @@ namespace FTS {
             return has_txt_extension(name, suffix) || has_extension(name, suffix);
         }
         
+        // Binary sample containers (see Fibre::Base::SampleWriter) append '.smp' to the extension of the set type they
+        // hold, e.g. 'samples.tst.smp'.
+        inline bool has_sample_extension(const std::string& name, const std::string& suffix) {
+            return has_extension(name, "." + SAMPLE_FILE_EXTENSION) && has_extension(
+                           strip_extension(name), suffix);
+        }
+        
+        inline bool has_sample_extension(const std::string& name) {
+            return has_extension(name, "." + SAMPLE_FILE_EXTENSION);
+        }
+        
         template<typename T> bool has_extension(const std::string& location) {
-            return MR::Path::has_suffix(location, T::FILE_EXTENSION);
+            return MR::Path::has_suffix(location, T::FILE_EXTENSION) || has_sample_extension(
+                           location, T::FILE_EXTENSION);
+        }
+        
+        template<typename T> bool has_sample_extension(const std::string& name) {
+            return has_sample_extension(name, T::FILE_EXTENSION);
         }
         
         template<typename T> bool has_or_set_extension(const std::string& location) {
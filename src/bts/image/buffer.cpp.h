@@ -46,12 +46,14 @@ namespace FTS {
                         "Coordinate " + str(c) + " is out of image bounds " + str(dimensions)
                         + " (set 'enforce_bounds=false' if this is intentional).");
             
-            iterator it = voxels.find(c);
+            size_t& pos = position_entry(c);
             
-            if (it == voxels.end())
-                return voxels[c] = new_voxel(c);
-            else
-                return it->second;
+            if (pos == EMPTY) {
+                pos = voxels.size();
+                voxels.push_back(std::pair<Index, T>(c, new_voxel(c)));
+            }
+            
+            return voxels[pos].second;
             
         }
         
@@ -62,20 +64,20 @@ namespace FTS {
                         "Coordinate " + str(c) + " is out of image bounds " + str(dimensions)
                         + " (set 'enforce_bounds=false' if this is intentional).");
             
-            const_iterator it = voxels.find(c);
+            size_t pos = position(c);
             
-            if (it == voxels.end())
+            if (pos == EMPTY)
                 throw Exception(
                         "Coordinate " + str(c)
                         + " has not been initialised and can't be since this buffer is const. Suggest using 'is_empty(const Coord&)' to check if it has been initialised first.");
             
-            return it->second;
+            return voxels[pos].second;
             
         }
         
         template<typename T> bool Buffer_tpl<T>::is_empty(const Index& c) const {
             
-            return !voxels.count(c);
+            return position(c) == EMPTY;
             
         }
         
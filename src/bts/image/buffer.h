@@ -34,6 +34,7 @@ namespace FTS {
 }
 
 #include <set>
+#include <deque>
 
 #include "bts/common.h"
 
@@ -58,37 +59,63 @@ namespace FTS {
                 
             public:
                 
-                typedef typename std::map<Index, T>::iterator iterator;
-                typedef typename std::map<Index, T>::const_iterator const_iterator;
+                typedef typename std::deque<std::pair<Index, T> >::iterator iterator;
+                typedef typename std::deque<std::pair<Index, T> >::const_iterator const_iterator;
+
+                //! Marks a voxel that has not been created yet in the lookup tables.
+                const static size_t EMPTY = (size_t) -1;
 
                 //Protected member variables
             protected:
                 
                 Triple<size_t> dimensions;
-                std::map<Index, T> voxels;
+
+                // Voxels are stored in blocks (std::deque) in the order they are created so that references to them remain
+                // valid as new voxels are added. Their positions are looked up from either a flat table spanning the image
+                // dimensions plus a 'halo' on each side (dense storage) or a std::map (sparse storage). The map is also used
+                // for voxels that fall outside the dense region when the bounds are not enforced.
+                std::deque<std::pair<Index, T> > voxels;
+                std::vector<size_t> dense_lookup;
+                std::map<Index, size_t> sparse_lookup;
+                bool dense;
+                size_t halo;
                 bool enforce_bounds;
 
                 //Public member functions
             public:
                 
-                Buffer_tpl(bool enforce_bounds = true)
-                        : dimensions(0, 0, 0), enforce_bounds(enforce_bounds) {
+                Buffer_tpl(bool enforce_bounds = true, bool dense = false, size_t halo = 0)
+                        : dimensions(0, 0, 0), dense(dense), halo(halo), enforce_bounds(
+                                  enforce_bounds) {
                 }
                 
-                Buffer_tpl(const Triple<size_t>& dimensions, bool enforce_bounds = true)
-                        : dimensions(dimensions), enforce_bounds(enforce_bounds) {
+                Buffer_tpl(const Triple<size_t>& dimensions, bool enforce_bounds = true,
+                           bool dense = false, size_t halo = 0)
+                        : dimensions(dimensions), dense(dense), halo(halo), enforce_bounds(
+                                  enforce_bounds) {
+                    reset_lookup();
                 }
                 
                 Buffer_tpl<T>(const Buffer_tpl<T>& B)
-                        : dimensions(B.dims()), voxels(B.voxels), enforce_bounds(B.enforce_bounds) {
+                        : dimensions(B.dims()), voxels(B.voxels), dense_lookup(B.dense_lookup), sparse_lookup(
+                                  B.sparse_lookup), dense(B.dense), halo(B.halo), enforce_bounds(
+                                  B.enforce_bounds) {
                 }
                 
                 virtual ~Buffer_tpl() {
                 }
                 
                 Buffer_tpl<T>& operator=(const Buffer_tpl<T>& B) {
+                    if (this == &B)
+                        return *this;
                     dimensions = B.dimensions;
-                    voxels = B.voxels;
+                    // Copy construct the voxels instead of assigning them element-wise.
+                    voxels.clear();
+                    voxels.insert(voxels.end(), B.voxels.begin(), B.voxels.end());
+                    dense_lookup = B.dense_lookup;
+                    sparse_lookup = B.sparse_lookup;
+                    dense = B.dense;
+                    halo = B.halo;
                     enforce_bounds = B.enforce_bounds;
                     return *this;
                 }
@@ -138,6 +165,7 @@ namespace FTS {
                 
                 virtual Buffer_tpl& clear() {
                     voxels.clear();
+                    reset_lookup();
                     return *this;
                 }
                 
@@ -154,12 +182,13 @@ namespace FTS {
                     return *this;
                 }
                 
-                /*! Resizes the dimensions of the image.  Note that is does not change the underlying voxels which are sparsely
-                 *  implemented in a std::map.  It does set enforce_bounds to false as it does not guarantee that the existing voxels
+                /*! Resizes the dimensions of the image.  Note that is does not change the underlying voxels (only the tables
+                 *  used to look them up).  It does set enforce_bounds to false as it does not guarantee that the existing voxels
                  *  are contained withinness the new bounds. */
                 void resize(const Triple<size_t>& dimensions) {
                     this->dimensions = dimensions;
                     relax_bounds();
+                    reset_lookup();
                 }
                 
                 void reset(const Triple<size_t>& dimensions) {
@@ -170,6 +199,24 @@ namespace FTS {
                     this->dimensions = dimensions;
                     this->enforce_bounds = enforce_bounds;
                     voxels.clear();
+                    reset_lookup();
+                }
+                
+                /*! Switches between dense and sparse lookup of the voxels. The halo is the number of voxels on each side of
+                 *  the image bounds that are also included in the dense lookup table (used when the bounds are not enforced).
+                 *  The existing voxels are retained. */
+                void set_storage(bool dense, size_t halo = 0) {
+                    this->dense = dense;
+                    this->halo = halo;
+                    reset_lookup();
+                }
+                
+                bool is_dense() const {
+                    return dense;
+                }
+                
+                size_t halo_width() const {
+                    return halo;
                 }
                 
                 //!Relaxes the constraint that voxels need to be withinness the given bounds of the image.
@@ -237,6 +284,21 @@ namespace FTS {
                     return voxels.size();
                 }
                 
+                //! The position of the voxel in the storage or EMPTY if it hasn't been created, and the coordinate and value of
+                //! the voxel at a position (voxels are stored in the order they were created). Allows the voxels to be
+                //! traversed by index, e.g. split between threads, without creating any.
+                size_t stored_position(const Index& c) const {
+                    return position(c);
+                }
+                
+                const Index& stored_coord(size_t position) const {
+                    return voxels[position].first;
+                }
+                
+                const T& stored_voxel(size_t position) const {
+                    return voxels[position].second;
+                }
+                
                 bool in_bounds(Index coord) const {
                     return coord.non_negative() && coord.bounded_by(dims());
                 }
@@ -249,10 +311,76 @@ namespace FTS {
                     return T();
                 }
                 
+                //! Gets the offset of the coordinate in the dense lookup table, returning false if it lies outside of it.
+                bool dense_offset(const Index& c, size_t& offset) const {
+                    
+                    if (!dense)
+                        return false;
+                    
+                    size_t width = 2 * halo;
+                    
+                    for (size_t dim_i = 0; dim_i < 3; ++dim_i)
+                        if (c[dim_i] + (int) halo < 0
+                                || c[dim_i] + (int) halo >= (int) (dimensions[dim_i] + width))
+                            return false;
+                    
+                    offset = ((size_t) (c[Z] + halo) * (dimensions[Y] + width) + (size_t) (c[Y] + halo))
+                            * (dimensions[X] + width) + (size_t) (c[X] + halo);
+                    
+                    return true;
+                    
+                }
+                
+                //! Returns the position of the voxel in 'voxels' or EMPTY if it has not been created.
+                size_t position(const Index& c) const {
+                    
+                    size_t offset;
+                    
+                    if (dense_offset(c, offset))
+                        return dense_lookup[offset];
+                    
+                    std::map<Index, size_t>::const_iterator it = sparse_lookup.find(c);
+                    
+                    return it == sparse_lookup.end() ? EMPTY : it->second;
+                    
+                }
+                
+                //! Returns a reference to the lookup table entry for the voxel, adding a sparse entry if required.
+                size_t& position_entry(const Index& c) {
+                    
+                    size_t offset;
+                    
+                    if (dense_offset(c, offset))
+                        return dense_lookup[offset];
+                    
+                    return sparse_lookup.insert(std::pair<Index, size_t>(c, EMPTY)).first->second;
+                    
+                }
+                
+                //! Rebuilds the lookup tables from the existing voxels (e.g. after the dimensions have changed).
+                void reset_lookup() {
+                    
+                    sparse_lookup.clear();
+                    
+                    if (dense)
+                        dense_lookup.assign(
+                                (dimensions[X] + 2 * halo) * (dimensions[Y] + 2 * halo)
+                                * (dimensions[Z] + 2 * halo),
+                                EMPTY);
+                    else
+                        dense_lookup.clear();
+                    
+                    for (size_t vox_i = 0; vox_i < voxels.size(); ++vox_i)
+                        position_entry(voxels[vox_i].first) = vox_i;
+                    
+                }
+                
                 friend std::ostream& operator<<<>(std::ostream& stream, const Buffer_tpl<T>& B);
                 
         };
         
+        template<typename T> const size_t Buffer_tpl<T>::EMPTY;
+        
         template<typename T> Buffer_tpl<T> operator*(double M, Buffer_tpl<T> mult) {
             mult *= M;
             return mult;
@@ -140,9 +140,8 @@ namespace FTS {
                     }
                     
                     bool is_empty(const Index& c) const {
-                        typename Image::Buffer_tpl<Voxel<T> >::const_iterator vox_it =
-                                this->voxels.find(c);
-                        return (vox_it == this->end()) ? true : vox_it->second.is_empty();
+                        size_t pos = this->position(c);
+                        return (pos == this->EMPTY) ? true : this->voxels[pos].second.is_empty();
                     }
                     
                     bool is_empty(size_t x, size_t y, size_t z) const {
@@ -66,13 +66,16 @@ namespace FTS {
             const size_t Buffer::NUM_LENGTH_SECTIONS_DEFAULT = 15;
             const size_t Buffer::NUM_WIDTH_SECTIONS_DEFAULT = 4;
             const bool Buffer::ENFORCE_BOUNDS_DEFAULT = false;
+            const size_t Buffer::NUM_THREADS_DEFAULT = 1;
+            const size_t Buffer::INTERP_TABLE_RESOLUTION_DEFAULT = 0;
             
             Buffer* Buffer::factory(const std::string& type, const Triple<size_t>& dims,
                                     const Triple<double>& vox_lengths,
                                     const Diffusion::Model& diffusion_model,
                                     size_t num_length_sections, size_t num_width_sections,
                                     double interp_extent, const Triple<double>& offsets,
-                                    bool enforce_bounds, double gaussian_half_width) {
+                                    bool enforce_bounds, double gaussian_half_width,
+                                    size_t num_threads, size_t interp_table_resolution) {
                 
                 Buffer* image;
                 
@@ -121,6 +124,9 @@ namespace FTS {
                             "Unrecognised interpolation type '" + type
                             + "' passed to option '-exp_type'.");
                 
+                image->set_num_threads(num_threads);
+                image->set_interp_table_resolution(interp_table_resolution);
+                
                 return image;
                 
             }
@@ -141,11 +147,11 @@ namespace FTS {
                 
             }
         
-            std::map<Index, Voxel>::iterator Buffer::begin() {
+            Buffer::iterator Buffer::begin() {
                 throw Exception("not implemented");
             }
 
-            std::map<Index, Voxel>::iterator Buffer::end() {
+            Buffer::iterator Buffer::end() {
                 throw Exception("not implemented");
             }
         }
@@ -43,6 +43,7 @@ namespace FTS {
 #include "bts/image/index.h"
 #include "bts/image/container/buffer.h"
 #include "bts/image/reference/buffer.h"
+#include "bts/image/expected/signal_record.h"
 
 #include "bts/fibre/strand.h"
 #include "bts/fibre/tractlet.h"
@@ -113,7 +114,13 @@ namespace FTS {
   Option ("exp_base_intensity", "The reference b0 for a \"full\" voxel with unity density. This is used to set the base intensity of the strands. If set to zero (the default) the existing base_intensity of the strands will be used instead.") \
    + Argument ("exp_base_intensity", "").type_float (0.0, 0.0, LARGE_FLOAT), \
 \
-  Option ("exp_untie_width_intensity", "When not set, intensity will be coupled to the average cross-sectional area of the tract.")
+  Option ("exp_untie_width_intensity", "When not set, intensity will be coupled to the average cross-sectional area of the tract."), \
+\
+  Option ("exp_num_threads", "The number of threads used to generate the expected image. The fibres are split between the threads, each of which accumulates its signal in a separate buffer before they are summed together.") \
+   + Argument ("exp_num_threads", "").type_integer (1, Image::Expected::Buffer::NUM_THREADS_DEFAULT, LARGE_INT), \
+\
+  Option ("exp_interp_table", "Look the interpolation kernel up from a table with this many samples per voxel length (linearly interpolated between them) instead of evaluating it directly. Zero (the default) evaluates the kernel directly.") \
+   + Argument ("exp_interp_table", "").type_integer (0, Image::Expected::Buffer::INTERP_TABLE_RESOLUTION_DEFAULT, LARGE_INT)
 
 //Loads the parameters into variables
 #define SET_EXPECTED_IMAGE_PARAMETERS \
@@ -125,6 +132,8 @@ namespace FTS {
   bool          exp_enforce_bounds      = Image::Expected::Buffer::ENFORCE_BOUNDS_DEFAULT; \
   double        exp_half_width          = Image::Expected::Buffer::HALF_WIDTH_DEFAULT; \
   double        exp_base_intensity      = 0.0; \
+  size_t        exp_num_threads         = Image::Expected::Buffer::NUM_THREADS_DEFAULT; \
+  size_t        exp_interp_table        = Image::Expected::Buffer::INTERP_TABLE_RESOLUTION_DEFAULT; \
 \
   Options exp_opt = get_options("exp_num_length_sections"); \
   if (exp_opt.size()) \
@@ -154,6 +163,14 @@ exp_opt = get_options("exp_num_width_sections"); \
   if (exp_opt.size()) \
     exp_base_intensity = exp_opt[0][0]; \
 \
+  exp_opt = get_options("exp_num_threads"); \
+  if (exp_opt.size()) \
+    exp_num_threads = exp_opt[0][0]; \
+\
+  exp_opt = get_options("exp_interp_table"); \
+  if (exp_opt.size()) \
+    exp_interp_table = exp_opt[0][0]; \
+\
 
 //Adds the parameters to the properties to be saved with the data.
 #define ADD_EXPECTED_IMAGE_PROPERTIES(properties) \
@@ -163,6 +180,8 @@ exp_opt = get_options("exp_num_width_sections"); \
   properties["exp_enforce_bounds"]         = str(exp_enforce_bounds); \
   properties["exp_type"]                   = exp_type; \
   properties["exp_base_intensity"]         = str(exp_base_intensity); \
+  properties["exp_num_threads"]            = str(exp_num_threads); \
+  properties["exp_interp_table"]           = str(exp_interp_table); \
   if (exp_type == "gaussian") { \
     properties["exp_half_width"]       = exp_half_width; \
   } \
@@ -223,8 +242,8 @@ namespace FTS {
                     
                 public:
                     
-                    typedef std::map<Index, Voxel>::iterator iterator;
-                    typedef std::map<Index, Voxel>::const_iterator const_iterator;
+                    typedef Image::Buffer_tpl<Voxel>::iterator iterator;
+                    typedef Image::Buffer_tpl<Voxel>::const_iterator const_iterator;
 
                 public:
                     
@@ -238,6 +257,8 @@ namespace FTS {
 
                     const static double INTERP_EXTENT_DEFAULT;
                     const static bool ENFORCE_BOUNDS_DEFAULT;
+                    const static size_t NUM_THREADS_DEFAULT;
+                    const static size_t INTERP_TABLE_RESOLUTION_DEFAULT;
                     const static double HALF_WIDTH_DEFAULT;
                     const static char* TYPE_DEFAULT;
 
@@ -252,20 +273,26 @@ namespace FTS {
                                            const Diffusion::Model& diffusion_model,
                                            size_t num_length_sections, size_t num_width_sections,
                                            double interp_extent, const Triple<double>& offsets,
-                                           bool enforce_bounds, double gaussian_half_width);
+                                           bool enforce_bounds, double gaussian_half_width,
+                                           size_t num_threads = NUM_THREADS_DEFAULT,
+                                           size_t interp_table_resolution =
+                                                   INTERP_TABLE_RESOLUTION_DEFAULT);
 
                     static Buffer* factory(const std::string& type,
                                            const Observed::Buffer& obs_image,
                                            const Diffusion::Model& diffusion_model,
                                            size_t num_length_sections, size_t num_width_sections,
                                            double interp_extent, bool enforce_bounds,
-                                           double gaussian_half_width)
+                                           double gaussian_half_width,
+                                           size_t num_threads = NUM_THREADS_DEFAULT,
+                                           size_t interp_table_resolution =
+                                                   INTERP_TABLE_RESOLUTION_DEFAULT)
 
                                            {
                         return factory(type, obs_image.dims(), obs_image.vox_lengths(),
                                 diffusion_model, num_length_sections, num_width_sections,
                                 interp_extent, obs_image.offsets(), enforce_bounds,
-                                gaussian_half_width);
+                                gaussian_half_width, num_threads, interp_table_resolution);
                     }
                     
                     //Used for pretty printing in gdb. Is set in the constructor of derived classes.
@@ -307,6 +334,20 @@ namespace FTS {
 
                     virtual size_t num_width_sections() const = 0;
 
+                    virtual void set_num_threads(size_t num_threads) = 0;
+
+                    virtual size_t get_num_threads() const = 0;
+
+                    virtual void set_interp_table_resolution(size_t interp_table_resolution) = 0;
+
+                    virtual size_t get_interp_table_resolution() const = 0;
+
+                    //! Running total of the wall time spent generating expected images (see Buffer_tpl::image_seconds).
+                    virtual double get_image_seconds() const = 0;
+
+                    //! The part of get_image_seconds() spent regenerating the sections of changed fibres.
+                    virtual double get_section_seconds() const = 0;
+
                     virtual void save(const std::string& location) const = 0;
 
                     virtual Buffer& expected_image(const Fibre::Strand::Set& strands) = 0;
@@ -316,12 +357,46 @@ namespace FTS {
                     virtual Buffer
                     & expected_image(const Fibre::Tractlet::Set& tractlets) = 0;
 
+                    //! Replaces the contribution of 'old_strand' with that of 'new_strand' in place, recording the signal of
+                    //! each voxel touched by either strand (prior to the update) in 'previous'.
+                    virtual Buffer& update_image(const Fibre::Strand& old_strand,
+                                                 const Fibre::Strand& new_strand,
+                                                 double base_intensity,
+                                                 SignalRecord& previous) = 0;
+
+                    virtual Buffer& update_image(const Fibre::Tractlet& old_tractlet,
+                                                 const Fibre::Tractlet& new_tractlet,
+                                                 double base_intensity,
+                                                 SignalRecord& previous) = 0;
+
+                    //! Adds the contribution of 'strand' scaled by 'scale' in place, recording the signal of each voxel it
+                    //! touches (prior to it first being modified) in 'previous' without clearing it.
+                    virtual Buffer& part_image(const Fibre::Strand& strand, double scale,
+                                               SignalRecord& previous) = 0;
+
+                    virtual Buffer& part_image(const Fibre::Tractlet& tractlet, double scale,
+                                               SignalRecord& previous) = 0;
+
+                    //! Restores the voxel signals recorded by a previous call to 'update_image'.
+                    virtual void revert_image(
+                            const SignalRecord& previous) = 0;
+
                     virtual Reference::Buffer<Fibre::Strand::Section>::Set
                     & expected_image_with_references(const Fibre::Strand::Set& fibres) = 0;
 
                     virtual Reference::Buffer<Fibre::Tractlet::Section>::Set
                     & expected_image_with_references(const Fibre::Tractlet::Set& fibres) = 0;
 
+                    //! Adds the gradient of the sum of 'adjoint' times the signal of each stored voxel and encoding to
+                    //! 'gradient' (see Buffer_tpl::adjoint_gradient).
+                    virtual void adjoint_gradient(const Fibre::Strand::Set& strands,
+                                                  const std::vector<double>& adjoint,
+                                                  Fibre::Strand::Set& gradient) = 0;
+
+                    virtual void adjoint_gradient(const Fibre::Tractlet::Set& tractlets,
+                                                  const std::vector<double>& adjoint,
+                                                  Fibre::Tractlet::Set& gradient) = 0;
+
                     virtual Buffer& expected_image(
                             const Fibre::Strand::Set& strands,
                             Container::Buffer<Fibre::Strand>::Set& gradients) = 0;
@@ -384,6 +459,14 @@ namespace FTS {
 
                     virtual std::set<Index> empty_inbounds() const = 0;
 
+                    virtual size_t num_not_empty_voxels() const = 0;
+
+                    virtual size_t stored_position(const Index& coord) const = 0;
+
+                    virtual const Index& stored_coord(size_t position) const = 0;
+
+                    virtual const Voxel& stored_voxel(size_t position) const = 0;
+
                     virtual bool bounds_are_enforced() const = 0;
 
                     virtual void clear_and_enforce_bounds() = 0;
@@ -415,12 +498,33 @@ namespace FTS {
  \
             Buffer&                     expected_image(const Fibre::Tractlet::Set& tractlets) \
               { this->Buffer_tpl<Voxel>::expected_image<Fibre::Tractlet>(tractlets); return *this; } \
+ \
+            Buffer&                     update_image(const Fibre::Strand& old_strand, const Fibre::Strand& new_strand, double base_intensity, SignalRecord& previous) \
+              { this->Buffer_tpl<Voxel>::update_image<Fibre::Strand>(old_strand, new_strand, base_intensity, previous); return *this; } \
+ \
+            Buffer&                     update_image(const Fibre::Tractlet& old_tractlet, const Fibre::Tractlet& new_tractlet, double base_intensity, SignalRecord& previous) \
+              { this->Buffer_tpl<Voxel>::update_image<Fibre::Tractlet>(old_tractlet, new_tractlet, base_intensity, previous); return *this; } \
+ \
+            Buffer&                     part_image(const Fibre::Strand& strand, double scale, SignalRecord& previous) \
+              { this->Buffer_tpl<Voxel>::part_image<Fibre::Strand>(strand, scale, previous); return *this; } \
+ \
+            Buffer&                     part_image(const Fibre::Tractlet& tractlet, double scale, SignalRecord& previous) \
+              { this->Buffer_tpl<Voxel>::part_image<Fibre::Tractlet>(tractlet, scale, previous); return *this; } \
+ \
+            void                        revert_image(const SignalRecord& previous) \
+              { this->Buffer_tpl<Voxel>::revert_image(previous); } \
  \
             Reference::Buffer<Fibre::Strand::Section>::Set&   expected_image_with_references(const Fibre::Strand::Set& fibres) \
               { return this->Buffer_tpl<Voxel>::expected_image_with_references<Fibre::Strand>(fibres); } \
  \
             Reference::Buffer<Fibre::Tractlet::Section>::Set& expected_image_with_references(const Fibre::Tractlet::Set& fibres) \
               { return this->Buffer_tpl<Voxel>::expected_image_with_references<Fibre::Tractlet>(fibres); } \
+ \
+            void                        adjoint_gradient(const Fibre::Strand::Set& strands, const std::vector<double>& adjoint, Fibre::Strand::Set& gradient) \
+              { this->Buffer_tpl<Voxel>::adjoint_gradient<Fibre::Strand>(strands, adjoint, gradient); } \
+ \
+            void                        adjoint_gradient(const Fibre::Tractlet::Set& tractlets, const std::vector<double>& adjoint, Fibre::Tractlet::Set& gradient) \
+              { this->Buffer_tpl<Voxel>::adjoint_gradient<Fibre::Tractlet>(tractlets, adjoint, gradient); } \
  \
             Buffer&                     expected_image(const Fibre::Strand::Set& strands, Container::Buffer<Fibre::Strand>::Set& gradients) \
               { this->Buffer_tpl<Voxel>::expected_image<Fibre::Strand>(strands, gradients); return *this; } \
@@ -471,6 +575,24 @@ namespace FTS {
  \
             size_t                          num_width_sections() const \
               { return this->Buffer_tpl<Voxel>::num_width_sections(); } \
+ \
+            void                            set_num_threads(size_t num_threads) \
+              { this->Buffer_tpl<Voxel>::set_num_threads(num_threads); } \
+ \
+            size_t                          get_num_threads() const \
+              { return this->Buffer_tpl<Voxel>::get_num_threads(); } \
+ \
+            void                            set_interp_table_resolution(size_t interp_table_resolution) \
+              { this->Buffer_tpl<Voxel>::set_interp_table_resolution(interp_table_resolution); } \
+ \
+            size_t                          get_interp_table_resolution() const \
+              { return this->Buffer_tpl<Voxel>::get_interp_table_resolution(); } \
+ \
+            double                          get_image_seconds() const \
+              { return this->Buffer_tpl<Voxel>::get_image_seconds(); } \
+ \
+            double                          get_section_seconds() const \
+              { return this->Buffer_tpl<Voxel>::get_section_seconds(); } \
  \
             Voxel&                        operator() (Index coord) \
               { return Image::Buffer_tpl<Voxel>::operator()(coord); } \
@@ -567,6 +689,18 @@ namespace FTS {
 \
             std::set<Index>               empty_inbounds() const \
              { return Image::Buffer_tpl<Voxel>::empty_inbounds(); } \
+\
+            size_t                        num_not_empty_voxels() const \
+              { return Image::Buffer_tpl<Voxel>::num_not_empty_voxels(); } \
+\
+            size_t                        stored_position(const Index& coord) const \
+              { return Image::Buffer_tpl<Voxel>::stored_position(coord); } \
+\
+            const Index&                  stored_coord(size_t position) const \
+              { return Image::Buffer_tpl<Voxel>::stored_coord(position); } \
+\
+            const Expected::Voxel&        stored_voxel(size_t position) const \
+              { return Image::Buffer_tpl<Voxel>::stored_voxel(position); } \
 \
             bool                          bounds_are_enforced() const \
               { return Image::Buffer_tpl<Voxel>::bounds_are_enforced(); } \
@@ -23,6 +23,8 @@
 #ifndef __bts_image_expected_buffer_cpp_h__
 #define __bts_image_expected_buffer_cpp_h__
 
+#include <algorithm>
+
 #include "bts/image/expected/buffer_tpl.h"
 #include "bts/image/reference/buffer.h"
 
@@ -61,36 +63,191 @@ namespace FTS {
                 fibre.sections(path, num_len_sections, num_wth_sections, this->voxel_lengths,
                         this->corner_offsets);
                 
-                for (typename std::vector<typename U::Section>::iterator section_it = path.begin();
+#ifdef OPTIMISED
+                for (size_t section_i = 0; section_i < path.size(); ++section_i)
+                    diffusion_model->precalculate_weightings(path[section_i]);
+#endif
+                
+                add_path(path);
+                
+            }
+            
+            template<typename T> template<typename S> void Buffer_tpl<T>::add_path(
+                    std::vector<S>& path) {
+                
+                std::vector<T*> neighbourhood;
+                
+#ifdef OPTIMISED
+                AxisWeights weights;
+#endif
+                
+                for (typename std::vector<S>::iterator section_it = path.begin();
                         section_it != path.end(); ++section_it) {
                     
-                    typename U::Section& section = *section_it;
+                    S& section = *section_it;
+                    
+                    this->get_neighbourhood(section.position(), neighbourhood);
                     
 #ifdef OPTIMISED
-                    diffusion_model.precalculate_weightings(section);
+                    if (neighbourhood.size())
+                        axis_weights(section, *neighbourhood.front(), weights);
 #endif
                     
-                    std::set<T*> neighbourhood = this->get_neighbourhood(section.position());
-                    
-                    for (typename std::set<T*>::iterator vox_it = neighbourhood.begin();
+                    for (typename std::vector<T*>::iterator vox_it = neighbourhood.begin();
                             vox_it != neighbourhood.end(); ++vox_it) {
                         
                         T& voxel = **vox_it;
                         
 #ifdef OPTIMISED
-                        voxel.precalculate_interpolation(section);
+                        section.precalc_interpolation = weights.interpolation(voxel.coord());
 #endif
                         
-                        for (size_t encode_i = 0; encode_i < this->num_encodings(); encode_i++) {
-                            
-                            voxel[encode_i] += voxel.direction(encode_i).signal(section);
-                            
-                        }
+                        add_signal(voxel, section);
+                        
+                    }
+                    
+                }
+                
+            }
+            
+            template<typename T> template<typename S> void Buffer_tpl<T>::axis_weights(
+                    const S& section, T& voxel, AxisWeights& weights) {
+                
+                if (interp_table_resolution && interp_tables[X].empty())
+                    build_interp_tables();
+                
+                const Coord& pos = section.position();
+                
+                Index centre_coord = voxel_centre_coord(pos);
+                
+                weights.corner = Index(centre_coord[X] - neigh_extent, centre_coord[Y] - neigh_extent,
+                        centre_coord[Z] - neigh_extent);
+                
+                weights.tangent_norm = section.tangent().norm();
+                
+                for (size_t dim_i = 0; dim_i < 3; ++dim_i) {
+                    
+                    weights.weights[dim_i].resize(2 * neigh_extent);
+                    
+                    // The displacement of the section from the centre of each voxel along the axis (see Voxel::interpolate).
+                    for (int neigh_i = 0; neigh_i < 2 * neigh_extent; ++neigh_i)
+                        weights.weights[dim_i][neigh_i] = axis_interpolate(voxel,
+                                pos[dim_i] - ((double) (weights.corner[dim_i] + neigh_i) + 0.5), dim_i);
+                    
+                }
+                
+            }
+            
+            template<typename T> double Buffer_tpl<T>::axis_interpolate(T& voxel, double disp,
+                                                                        size_t dim_i) const {
+                
+                const std::vector<double>& table = interp_tables[dim_i];
+                
+                if (table.size()) {
+                    
+                    double position = (disp + (double) (neigh_extent + 1))
+                            * (double) interp_table_resolution;
+                    
+                    double lower = floor(position);
+                    
+                    // Fall back to evaluating the kernel directly outside of the range of the table.
+                    if (lower >= 0.0 && lower + 1.0 < (double) table.size()) {
+                        
+                        size_t index = (size_t) lower;
+                        double frac = position - lower;
+                        
+                        return table[index] * (1.0 - frac) + table[index + 1] * frac;
                         
                     }
                     
                 }
                 
+                return voxel.axis_interpolate(disp, dim_i);
+                
+            }
+            
+            template<typename T> void Buffer_tpl<T>::build_interp_tables() {
+                
+                clear_interp_tables();
+                
+                T voxel = this->new_voxel(Index(0, 0, 0));
+                
+                size_t num_samples = 2 * (neigh_extent + 1) * interp_table_resolution + 1;
+                
+                for (size_t dim_i = 0; dim_i < 3; ++dim_i) {
+                    
+                    interp_tables[dim_i].resize(num_samples);
+                    
+                    for (size_t sample_i = 0; sample_i < num_samples; ++sample_i)
+                        interp_tables[dim_i][sample_i] = voxel.axis_interpolate(
+                                (double) sample_i / (double) interp_table_resolution
+                                - (double) (neigh_extent + 1), dim_i);
+                    
+                }
+                
+            }
+            
+            template<typename T> template<typename S> void Buffer_tpl<T>::add_signal(
+                    T& voxel, const S& section, double* intensities, double scale) {
+                
+#ifdef OPTIMISED
+                
+                //The diffusion weightings of all encodings are stored contiguously in the section (see
+                //Diffusion::Model::weighting_sweep), so they can be added to the voxel intensities in a single sweep
+                //instead of going through each Direction.
+                double section_scale = scale * section.intensity() * section.precalc_interpolation;
+                
+                const double* weightings = &section.precalc_weightings[0];
+                
+                for (size_t encode_i = 0; encode_i < this->num_encodings(); encode_i++)
+                    intensities[encode_i] += section_scale * weightings[encode_i];
+                
+#else
+                
+                for (size_t encode_i = 0; encode_i < this->num_encodings(); encode_i++)
+                    intensities[encode_i] += scale * voxel.direction(encode_i).signal(section);
+                
+#endif
+                
+            }
+            
+            template<typename T> template<typename U> std::vector<typename U::Section>& Buffer_tpl<
+                    T>::cached_path(const U& fibre, size_t fibre_index, double* seconds) {
+                
+                std::vector<typename U::Section>& path = get_paths(U())[fibre_index];
+                std::vector<double>& key = get_path_keys(U())[fibre_index];
+                
+                const MR::Math::Vector<double>& values = fibre;
+                
+                bool changed = key.size() != values.size();
+                
+                for (size_t elem_i = 0; !changed && elem_i < key.size(); ++elem_i)
+                    changed = key[elem_i] != values[elem_i];
+                
+                if (changed) {
+                    
+                    double start_time = seconds ? Utilities::monotonic_seconds() : 0.0;
+                    
+                    fibre.sections(path, num_len_sections, num_wth_sections, this->voxel_lengths,
+                            this->corner_offsets);
+                    
+#ifdef OPTIMISED
+                    for (size_t section_i = 0; section_i < path.size(); ++section_i)
+                        diffusion_model->precalculate_weightings(path[section_i]);
+#endif
+                    
+                    key.resize(values.size());
+                    
+                    for (size_t elem_i = 0; elem_i < key.size(); ++elem_i)
+                        key[elem_i] = values[elem_i];
+                    
+                    if (seconds)
+                        *seconds += Utilities::monotonic_seconds() - start_time;
+                    
+                }
+                
+                return path;
+                
             }
             
             template<typename T> template<typename U> void Buffer_tpl<T>::expected_image(
@@ -100,13 +257,108 @@ namespace FTS {
                             "Base intensity of the provided fibres needs to be positivie (" + str(
                                     fibres.base_intensity())
                             + ")");
+                double start_time = Utilities::monotonic_seconds();
                 this->zero();
-                for (size_t fibre_i = 0; fibre_i < fibres.size(); fibre_i++)
-                    part_image(fibres[fibre_i]);
+                if (num_threads > 1 && fibres.size() > 1)
+                    threaded_image<U>(fibres);
+                else {
+                    resize_paths<U>(fibres.size());
+                    for (size_t fibre_i = 0; fibre_i < fibres.size(); fibre_i++)
+                        add_path(cached_path(fibres[fibre_i], fibre_i, &section_seconds));
+                }
                 for (typename Buffer_tpl<T>::iterator vox_it = this->begin(); vox_it != this->end();
                         ++vox_it)
                     for (size_t encode_i = 0; encode_i < num_encodings(); ++encode_i)
                         vox_it->second[encode_i] *= fibres.base_intensity();
+                image_seconds += Utilities::monotonic_seconds() - start_time;
+            }
+            
+            template<typename T> template<typename U> void Buffer_tpl<T>::part_image(
+                    const U& fibre, double scale, SignalRecord& previous) {
+                
+                std::vector<typename U::Section> path;
+                
+                fibre.sections(path, num_len_sections, num_wth_sections, this->voxel_lengths,
+                        this->corner_offsets);
+                
+                std::vector<T*> neighbourhood;
+                
+#ifdef OPTIMISED
+                AxisWeights weights;
+#endif
+                
+                for (typename std::vector<typename U::Section>::iterator section_it = path.begin();
+                        section_it != path.end(); ++section_it) {
+                    
+                    typename U::Section& section = *section_it;
+                    
+#ifdef OPTIMISED
+                    diffusion_model->precalculate_weightings(section);
+#endif
+                    
+                    this->get_neighbourhood(section.position(), neighbourhood);
+                    
+#ifdef OPTIMISED
+                    if (neighbourhood.size())
+                        axis_weights(section, *neighbourhood.front(), weights);
+#endif
+                    
+                    for (typename std::vector<T*>::iterator vox_it = neighbourhood.begin();
+                            vox_it != neighbourhood.end(); ++vox_it) {
+                        
+                        T& voxel = **vox_it;
+                        
+                        // Record the signal of the voxel before it is first modified so that the update can be scored
+                        // and reverted.
+                        previous.record(this->stored_position(voxel.coord()), voxel.coord(), voxel);
+                        
+#ifdef OPTIMISED
+                        section.precalc_interpolation = weights.interpolation(voxel.coord());
+#endif
+                        
+                        add_signal(voxel, section, scale);
+                        
+                    }
+                    
+                }
+                
+            }
+            
+            template<typename T> template<typename U> void Buffer_tpl<T>::update_image(
+                    const U& old_fibre, const U& new_fibre, double base_intensity,
+                    SignalRecord& previous) {
+                
+                if (base_intensity <= 0.0)
+                    throw Exception(
+                            "Base intensity of the provided fibres needs to be positivie (" + str(
+                                    base_intensity)
+                            + ")");
+                
+                double start_time = Utilities::monotonic_seconds();
+                
+                previous.clear();
+                
+                part_image(old_fibre, -base_intensity, previous);
+                part_image(new_fibre, base_intensity, previous);
+                
+                image_seconds += Utilities::monotonic_seconds() - start_time;
+                
+            }
+            
+            template<typename T> void Buffer_tpl<T>::revert_image(
+                    const SignalRecord& previous) {
+                
+                for (size_t record_i = 0; record_i < previous.size(); ++record_i) {
+                    
+                    T& voxel = this->voxels[previous.position(record_i)].second;
+                    
+                    const double* signal = previous.signal(record_i);
+                    
+                    for (size_t encode_i = 0; encode_i < this->num_encodings(); encode_i++)
+                        voxel[encode_i] = signal[encode_i];
+                    
+                }
+                
             }
             
             template<typename T> template<typename U> void Buffer_tpl<T>::part_image(
@@ -116,18 +368,29 @@ namespace FTS {
                 fibre.sections(path, num_len_sections, num_wth_sections, this->voxel_lengths,
                         this->corner_offsets, this->num_encodings());
                 
+                std::vector<T*> neighbourhood;
+                
+#ifdef OPTIMISED
+                AxisWeights weights;
+#endif
+                
                 for (typename std::vector<typename U::Section>::iterator section_it = path.begin();
                         section_it != path.end(); ++section_it) {
                     
                     typename U::Section& section = *section_it;
                     
 #ifdef OPTIMISED
-                    diffusion_model.precalculate_weightings(section);
+                    diffusion_model->precalculate_weightings(section);
 #endif
                     
-                    std::set<T*> neighbourhood = this->get_neighbourhood(section.position());
+                    this->get_neighbourhood(section.position(), neighbourhood);
+                    
+#ifdef OPTIMISED
+                    if (neighbourhood.size())
+                        axis_weights(section, *neighbourhood.front(), weights);
+#endif
                     
-                    for (typename std::set<T*>::iterator vox_it = neighbourhood.begin();
+                    for (typename std::vector<T*>::iterator vox_it = neighbourhood.begin();
                             vox_it != neighbourhood.end(); ++vox_it) {
                         
                         T& voxel = **vox_it;
@@ -135,14 +398,10 @@ namespace FTS {
                         section_reference(voxel.coord()).push_back(&section);
                         
 #ifdef OPTIMISED
-                        voxel.precalculate_interpolation(section);
+                        section.precalc_interpolation = weights.interpolation(voxel.coord());
 #endif
                         
-                        for (size_t encode_i = 0; encode_i < this->num_encodings(); encode_i++) {
-                            
-                            voxel[encode_i] += voxel.direction(encode_i).signal(section);
-                            
-                        }
+                        add_signal(voxel, section);
                         
                     }
                     
@@ -154,25 +413,33 @@ namespace FTS {
                     typename U::Section>::Set& Buffer_tpl<T>::expected_image_with_references(
                     const typename U::Set& fibres) {
                 
+                double start_time = Utilities::monotonic_seconds();
+                
                 this->zero();
                 
                 std::map<size_t, std::vector<typename U::Section> >& sections = get_sections(U());
                 typename Reference::Buffer<typename U::Section>::Set& section_refs =
                         get_section_references(U());
                 
-                for (size_t fibre_i = 0; fibre_i < fibres.size(); fibre_i++) {
-                    
-                    section_refs[fibre_i].clear_references();
-                    
-                    part_image(fibres[fibre_i], sections[fibre_i], section_refs[fibre_i]);
-                    
-                }
+                if (num_threads > 1 && fibres.size() > 1)
+                    threaded_image<U>(fibres, &sections, &section_refs);
+                
+                else
+                    for (size_t fibre_i = 0; fibre_i < fibres.size(); fibre_i++) {
+                        
+                        section_refs[fibre_i].clear_references();
+                        
+                        part_image(fibres[fibre_i], sections[fibre_i], section_refs[fibre_i]);
+                        
+                    }
                 
                 for (typename Buffer_tpl<T>::iterator vox_it = this->begin(); vox_it != this->end();
                         ++vox_it)
                     for (size_t encode_i = 0; encode_i < num_encodings(); ++encode_i)
                         vox_it->second[encode_i] *= fibres.base_intensity();
                 
+                image_seconds += Utilities::monotonic_seconds() - start_time;
+                
                 return section_refs;
                 
             }
@@ -185,18 +452,20 @@ namespace FTS {
                 fibre.sections(path, num_len_sections, num_wth_sections, this->voxel_lengths,
                         this->corner_offsets);
                 
+                std::vector<T*> neighbourhood;
+                
                 for (typename std::vector<typename U::Section>::iterator section_it = path.begin();
                         section_it != path.end(); ++section_it) {
                     
                     typename U::Section& section = *section_it;
                     
 #ifdef OPTIMISED
-                    diffusion_model.precalculate_weightings_and_gradients(section);
+                    diffusion_model->precalculate_weightings_and_gradients(section);
 #endif
                     
-                    std::set<T*> neighbourhood = this->get_neighbourhood(section.position());
+                    this->get_neighbourhood(section.position(), neighbourhood);
                     
-                    for (typename std::set<T*>::iterator vox_it = neighbourhood.begin();
+                    for (typename std::vector<T*>::iterator vox_it = neighbourhood.begin();
                             vox_it != neighbourhood.end(); ++vox_it) {
                         
                         T& voxel = **vox_it;
@@ -267,13 +536,144 @@ namespace FTS {
                 
             }
             
+            template<typename T> template<typename U> void Buffer_tpl<T>::adjoint_gradient(
+                    const typename U::Set& fibres, const std::vector<double>& adjoint,
+                    typename U::Set& gradient) {
+                
+                if (adjoint.size() != this->num_not_empty_voxels() * num_encodings())
+                    throw Exception(
+                            "Size of adjoint (" + str(adjoint.size())
+                            + ") does not match the number of stored voxels and encodings ("
+                            + str(this->num_not_empty_voxels() * num_encodings()) + ").");
+                
+                if (!stencil_is_current())
+                    reset_stencil();
+                
+                resize_paths<U>(fibres.size());
+                
+                size_t num_jobs = min2(num_threads, fibres.size());
+                
+                if (num_jobs > 1) {
+                    
+                    // The paths should still be cached from generating the image, but in case they aren't, make sure the
+                    // static caches used to regenerate them are set before the threads are started (see threaded_image).
+                    for (size_t fibre_i = 0; fibre_i < fibres.size(); fibre_i++) {
+                        size_t degree = fibres[fibre_i].degree();
+                        Fibre::Strand::position_matrix(num_len_sections, degree);
+                        Fibre::Strand::tangent_matrix(num_len_sections, degree);
+                    }
+                    
+                    Fibre::Tractlet::width_section_matrix(num_wth_sections);
+                    
+                    std::vector<AdjointJob<U> > jobs(num_jobs);
+                    
+                    for (size_t job_i = 0; job_i < num_jobs; ++job_i) {
+                        
+                        AdjointJob<U>& job = jobs[job_i];
+                        
+                        job.image = this;
+                        job.fibres = &fibres;
+                        job.adjoint = &adjoint;
+                        job.gradient = &gradient;
+                        job.start = (fibres.size() * job_i) / num_jobs;
+                        job.end = (fibres.size() * (job_i + 1)) / num_jobs;
+                        
+                    }
+                    
+                    Utilities::run_in_threads(jobs, run_adjoint_job<U>, "calculate the adjoint gradient");
+                    
+                } else
+                    for (size_t fibre_i = 0; fibre_i < fibres.size(); fibre_i++)
+                        part_adjoint(fibres[fibre_i], fibre_i, adjoint, fibres.base_intensity(),
+                                gradient);
+                
+            }
+            
+            template<typename T> template<typename U> void Buffer_tpl<T>::part_adjoint(
+                    const U& fibre, size_t fibre_index, const std::vector<double>& adjoint,
+                    double scale, typename U::Set& gradient) {
+                
+                std::vector<typename U::Section>& path = cached_path(fibre, fibre_index);
+                
+                std::vector<size_t> positions;
+                
+                Fibre::Strand::BasicSection section_gradient, encode_gradient;
+                
+                for (size_t section_i = 0; section_i < path.size(); ++section_i) {
+                    
+                    typename U::Section& section = path[section_i];
+                    
+                    if (!find_neighbourhood(section.position(), positions))
+                        throw Exception(
+                                "Section lies outside of the generated image, the image needs to be generated from the "
+                                "same fibres before the adjoint gradient is calculated.");
+                    
+                    if (!positions.size())
+                        continue;
+                    
+#ifdef OPTIMISED
+                    diffusion_model->precalculate_weightings_and_gradients(section);
+#endif
+                    
+                    section_gradient.zero();
+                    
+                    for (std::vector<size_t>::iterator pos_it = positions.begin();
+                            pos_it != positions.end(); ++pos_it) {
+                        
+                        T& voxel = this->voxels[*pos_it].second;
+                        
+                        const double* voxel_adjoint = &adjoint[*pos_it * num_encodings()];
+                        
+#ifdef OPTIMISED
+                        voxel.precalculate_interpolation_gradient(section);
+#endif
+                        
+                        for (size_t encode_i = 0; encode_i < num_encodings(); encode_i++) {
+                            
+                            // The b=0 encodings are skipped unless they are included in the likelihood.
+                            if (!voxel_adjoint[encode_i])
+                                continue;
+                            
+                            voxel.direction(encode_i).signal(section, encode_gradient);
+                            
+                            encode_gradient *= voxel_adjoint[encode_i];
+                            
+                            section_gradient += encode_gradient;
+                            
+                        }
+                        
+                    }
+                    
+                    section_gradient.unnormalize_gradient(this->vox_lengths());
+                    
+                    section_gradient *= scale;
+                    
+                    gradient[fibre_index].add_section_gradient(fibre, section, section_gradient);
+                    
+                }
+                
+            }
+            
+            template<typename T> template<typename U> void* Buffer_tpl<T>::run_adjoint_job(
+                    void* job_ptr) {
+                
+                AdjointJob<U>& job = *(AdjointJob<U>*) job_ptr;
+                
+                for (size_t fibre_i = job.start; fibre_i < job.end; fibre_i++)
+                    job.image->part_adjoint((*job.fibres)[fibre_i], fibre_i, *job.adjoint,
+                            job.fibres->base_intensity(), *job.gradient);
+                
+                return 0;
+                
+            }
+            
             template<typename T> template<typename U> void Buffer_tpl<T>::precalculate_section_weighting_gradients() {
                 
                 std::map<size_t, std::vector<typename U::Section> >& sections = get_sections(U());
                 
                 for (size_t fibre_i = 0; fibre_i < sections.size(); ++fibre_i)
                     for (size_t section_i = 0; section_i < sections[fibre_i].size(); ++section_i)
-                        diffusion_model.precalculate_weightings_and_gradients(
+                        diffusion_model->precalculate_weightings_and_gradients(
                                 sections[fibre_i][section_i]);
                 
             }
@@ -284,7 +684,7 @@ namespace FTS {
                 
                 for (size_t fibre_i = 0; fibre_i < sections.size(); ++fibre_i)
                     for (size_t section_i = 0; section_i < sections[fibre_i].size(); ++section_i)
-                        diffusion_model.precalculate_weightings_gradients_and_hessians(
+                        diffusion_model->precalculate_weightings_gradients_and_hessians(
                                 sections[fibre_i][section_i]);
                 
             }
@@ -302,18 +702,20 @@ namespace FTS {
                 fibre.sections(path, num_len_sections, num_wth_sections, this->voxel_lengths,
                         this->corner_offsets);
                 
+                std::vector<T*> neighbourhood;
+                
                 for (typename std::vector<typename U::Section>::iterator section_it = path.begin();
                         section_it != path.end(); ++section_it) {
                     
                     typename U::Section& section = *section_it;
                     
 #ifdef OPTIMISED
-                    diffusion_model.precalculate_weightings_gradients_and_hessians(section);
+                    diffusion_model->precalculate_weightings_gradients_and_hessians(section);
 #endif
                     
-                    std::set<T*> neighbourhood = this->get_neighbourhood(section.position());
+                    this->get_neighbourhood(section.position(), neighbourhood);
                     
-                    for (typename std::set<T*>::iterator vox_it = neighbourhood.begin();
+                    for (typename std::vector<T*>::iterator vox_it = neighbourhood.begin();
                             vox_it != neighbourhood.end(); ++vox_it) {
                         
                         T& voxel = **vox_it;
@@ -468,61 +870,472 @@ namespace FTS {
                 
             }
             
-            template<typename T> std::set<T*>& Buffer_tpl<T>::get_neighbourhood(
-                    const Coord& point) {
+            template<typename T> template<typename U> void Buffer_tpl<T>::threaded_image(
+                    const typename U::Set& fibres,
+                    std::map<size_t, std::vector<typename U::Section> >* sections,
+                    typename Reference::Buffer<typename U::Section>::Set* section_refs) {
                 
-                Index centre_coord = voxel_centre_coord(point);
+                size_t num_jobs = min2(num_threads, fibres.size());
+                
+                // Voxels and the stencil are only modified by the calling thread, so make sure the stencil is current before
+                // the threads are started (see find_neighbourhood).
+                if (!stencil_is_current())
+                    reset_stencil();
+                
+                // The matrices used to split the fibres into sections are generated on first use and cached in static maps,
+                // which also isn't safe to do from multiple threads.
+                for (size_t fibre_i = 0; fibre_i < fibres.size(); fibre_i++) {
+                    size_t degree = fibres[fibre_i].degree();
+                    Fibre::Strand::position_matrix(num_len_sections, degree);
+                    Fibre::Strand::tangent_matrix(num_len_sections, degree);
+                }
+                
+                Fibre::Tractlet::width_section_matrix(num_wth_sections);
+                
+                // Likewise for the interpolation tables (see axis_weights).
+                if (interp_table_resolution && interp_tables[X].empty())
+                    build_interp_tables();
+                
+                if (!section_refs)
+                    resize_paths<U>(fibres.size());
+                
+                std::vector<std::vector<typename U::Section>*> paths;
+                std::vector<Reference::Buffer<typename U::Section>*> refs;
+                
+                // Map entries are created here as std::map isn't safe to insert into from multiple threads.
+                if (section_refs) {
+                    
+                    for (size_t fibre_i = 0; fibre_i < fibres.size(); fibre_i++) {
+                        
+                        (*section_refs)[fibre_i].clear_references();
+                        
+                        paths.push_back(&(*sections)[fibre_i]);
+                        refs.push_back(&(*section_refs)[fibre_i]);
+                        
+                    }
+                    
+                }
+                
+                thread_tiles.resize(num_jobs);
+                
+                std::vector<Job<U> > jobs(num_jobs);
+                
+                for (size_t job_i = 0; job_i < num_jobs; ++job_i) {
+                    
+                    thread_tiles[job_i].assign(this->num_not_empty_voxels() * num_encodings(), 0.0);
+                    
+                    Job<U>& job = jobs[job_i];
+                    
+                    job.image = this;
+                    job.fibres = &fibres;
+                    job.start = (fibres.size() * job_i) / num_jobs;
+                    job.end = (fibres.size() * (job_i + 1)) / num_jobs;
+                    job.tile = &thread_tiles[job_i];
+                    
+                    if (section_refs) {
+                        job.paths = &paths;
+                        job.section_refs = &refs;
+                    }
+                    
+                }
+                
+                Utilities::run_in_threads(jobs, run_job<U>, "generate the expected image");
+                
+                double job_section_seconds = 0.0;
+                
+                for (size_t job_i = 0; job_i < num_jobs; ++job_i)
+                    job_section_seconds += jobs[job_i].section_seconds;
                 
-                std::set<T*>& neighbourhood = neighbourhoods[centre_coord];
+                section_seconds += job_section_seconds / (double) num_jobs;
                 
-                if (!neighbourhood.size())
-                    neighbourhoods[centre_coord] = create_neighbourhood(centre_coord);
+                std::vector<Reduction> reductions(num_jobs);
                 
-                return neighbourhood;
+                for (size_t job_i = 0; job_i < num_jobs; ++job_i) {
+                    reductions[job_i].image = this;
+                    reductions[job_i].start = (this->num_not_empty_voxels() * job_i) / num_jobs;
+                    reductions[job_i].end = (this->num_not_empty_voxels() * (job_i + 1)) / num_jobs;
+                }
+                
+                Utilities::run_in_threads(reductions, run_reduction, "generate the expected image");
+                
+                // Add the sections that touched voxels that didn't exist yet (in a fixed order).
+                std::vector<T*> neighbourhood;
+                
+#ifdef OPTIMISED
+                AxisWeights weights;
+#endif
+                
+                for (size_t job_i = 0; job_i < num_jobs; ++job_i) {
+                    
+                    Job<U>& job = jobs[job_i];
+                    
+                    for (size_t defer_i = 0; defer_i < job.deferred.size(); ++defer_i) {
+                        
+                        typename U::Section& section = job.deferred[defer_i];
+                        
+                        get_neighbourhood(section.position(), neighbourhood);
+                        
+#ifdef OPTIMISED
+                        if (neighbourhood.size())
+                            axis_weights(section, *neighbourhood.front(), weights);
+#endif
+                        
+                        for (typename std::vector<T*>::iterator vox_it = neighbourhood.begin();
+                                vox_it != neighbourhood.end(); ++vox_it) {
+                            
+                            T& voxel = **vox_it;
+                            
+#ifdef OPTIMISED
+                            section.precalc_interpolation = weights.interpolation(voxel.coord());
+#endif
+                            
+                            add_signal(voxel, section);
+                            
+                        }
+                        
+                    }
+                    
+                    for (size_t defer_i = 0; defer_i < job.deferred_refs.size(); ++defer_i) {
+                        
+                        size_t fibre_i = job.deferred_refs[defer_i].first;
+                        
+                        typename U::Section& section = (*paths[fibre_i])[job.deferred_refs[defer_i].second];
+                        
+                        get_neighbourhood(section.position(), neighbourhood);
+                        
+#ifdef OPTIMISED
+                        if (neighbourhood.size())
+                            axis_weights(section, *neighbourhood.front(), weights);
+#endif
+                        
+                        for (typename std::vector<T*>::iterator vox_it = neighbourhood.begin();
+                                vox_it != neighbourhood.end(); ++vox_it) {
+                            
+                            T& voxel = **vox_it;
+                            
+                            (*refs[fibre_i])(voxel.coord()).push_back(&section);
+                            
+#ifdef OPTIMISED
+                            section.precalc_interpolation = weights.interpolation(voxel.coord());
+#endif
+                            
+                            add_signal(voxel, section);
+                            
+                        }
+                        
+                    }
+                    
+                }
                 
             }
             
-            template<typename T> template<typename U> std::set<T*> Buffer_tpl<T>::get_neighbourhood(
-                    const typename U::Section& section) {
+            template<typename T> template<typename U> void Buffer_tpl<T>::part_tile(
+                    const U& fibre, size_t fibre_index, std::vector<typename U::Section>& path,
+                    Job<U>& job) {
                 
-                std::set<T*> whole_neighbourhood;
+                Reference::Buffer<typename U::Section>* section_reference = 0;
                 
-                std::vector<Coord> extreme_points = T::extreme_points(section);
+                if (job.section_refs) {
+                    
+                    section_reference = (*job.section_refs)[fibre_index];
+                    
+                    fibre.sections(path, num_len_sections, num_wth_sections, this->voxel_lengths,
+                            this->corner_offsets, this->num_encodings());
+                    
+#ifdef OPTIMISED
+                    for (size_t section_i = 0; section_i < path.size(); ++section_i)
+                        diffusion_model->precalculate_weightings(path[section_i]);
+#endif
+                    
+                }
                 
-                for (std::vector<Coord>::iterator point_it = extreme_points.begin();
-                        point_it != extreme_points.end(); ++point_it) {
-                    std::set<T*> point_neighbourhood = get_neighbourhood(
-                            voxel_centre_coord(*point_it));
-                    whole_neighbourhood.insert(point_neighbourhood.begin(),
-                            point_neighbourhood.end());
+                std::vector<typename U::Section>& fibre_path =
+                        section_reference ? path : cached_path(fibre, fibre_index, &job.section_seconds);
+                
+                std::vector<size_t> positions;
+                
+#ifdef OPTIMISED
+                AxisWeights weights;
+#endif
+                
+                for (size_t section_i = 0; section_i < fibre_path.size(); ++section_i) {
+                    
+                    typename U::Section& section = fibre_path[section_i];
+                    
+                    if (!find_neighbourhood(section.position(), positions)) {
+                        
+                        if (section_reference)
+                            job.deferred_refs.push_back(
+                                    std::pair<size_t, size_t>(fibre_index, section_i));
+                        else
+                            job.deferred.push_back(section);
+                        
+                        continue;
+                        
+                    }
+                    
+#ifdef OPTIMISED
+                    if (positions.size())
+                        axis_weights(section, this->voxels[positions.front()].second, weights);
+#endif
+                    
+                    for (std::vector<size_t>::iterator pos_it = positions.begin();
+                            pos_it != positions.end(); ++pos_it) {
+                        
+                        T& voxel = this->voxels[*pos_it].second;
+                        
+                        if (section_reference)
+                            (*section_reference)(voxel.coord()).push_back(&section);
+                        
+#ifdef OPTIMISED
+                        section.precalc_interpolation = weights.interpolation(voxel.coord());
+#endif
+                        
+                        add_signal(voxel, section, &(*job.tile)[*pos_it * num_encodings()]);
+                        
+                    }
+                    
+                }
+                
+            }
+            
+            template<typename T> template<typename U> void* Buffer_tpl<T>::run_job(void* job_ptr) {
+                
+                Job<U>& job = *(Job<U>*) job_ptr;
+                
+                std::vector<typename U::Section> path;
+                
+                for (size_t fibre_i = job.start; fibre_i < job.end; fibre_i++)
+                    job.image->part_tile((*job.fibres)[fibre_i], fibre_i,
+                            job.paths ? *(*job.paths)[fibre_i] : path, job);
+                
+                return 0;
+                
+            }
+            
+            template<typename T> void* Buffer_tpl<T>::run_reduction(void* reduction_ptr) {
+                
+                Reduction& reduction = *(Reduction*) reduction_ptr;
+                
+                Buffer_tpl<T>& image = *reduction.image;
+                
+                size_t num_encodes = image.num_encodings();
+                
+                for (size_t pos_i = reduction.start; pos_i < reduction.end; ++pos_i) {
+                    
+                    T& voxel = image.voxels[pos_i].second;
+                    
+                    for (size_t encode_i = 0; encode_i < num_encodes; ++encode_i) {
+                        
+                        double sum = 0.0;
+                        
+                        for (size_t tile_i = 0; tile_i < image.thread_tiles.size(); ++tile_i)
+                            sum += image.thread_tiles[tile_i][pos_i * num_encodes + encode_i];
+                        
+                        voxel[encode_i] += sum;
+                        
+                    }
+                    
                 }
                 
-                return whole_neighbourhood;
+                return 0;
                 
             }
             
-            template<typename T> std::set<T*> Buffer_tpl<T>::create_neighbourhood(
-                    const Index& coord) {
+            template<typename T> void Buffer_tpl<T>::reset_stencil() {
+                
+                stencil_offsets.clear();
+                stencil_coords.clear();
                 
-                std::set<T*> neighbourhood;
+                // The layout of the dense lookup table (image dimensions plus the halo on either side).
+                stencil_layout.set(this->dim(X) + 2 * this->halo_width(),
+                        this->dim(Y) + 2 * this->halo_width(), this->dim(Z) + 2 * this->halo_width());
                 
-                // Loop through all voxels withinness the interpolation extent of the given voxel and add their address to the
-                // neighbourhood vector.
-                for (int z_neigh = coord[Z] - neigh_extent; z_neigh < coord[Z] + neigh_extent;
-                        z_neigh++)
-                    for (int y_neigh = coord[Y] - neigh_extent; y_neigh < coord[Y] + neigh_extent;
-                            y_neigh++)
-                        for (int x_neigh = coord[X] - neigh_extent;
-                                x_neigh < coord[X] + neigh_extent; x_neigh++) {
+                int width = 2 * neigh_extent;
+                
+                for (int z_neigh = 0; z_neigh < width; z_neigh++)
+                    for (int y_neigh = 0; y_neigh < width; y_neigh++)
+                        for (int x_neigh = 0; x_neigh < width; x_neigh++) {
                             
-                            Index coord(x_neigh, y_neigh, z_neigh);
+                            stencil_offsets.push_back(
+                                    ((size_t) z_neigh * stencil_layout[Y] + (size_t) y_neigh)
+                                    * stencil_layout[X]
+                                    + (size_t) x_neigh);
                             
-                            if (!this->enforce_bounds || this->in_bounds(coord))
-                                neighbourhood.insert(&(this->operator()(coord)));
+                            stencil_coords.push_back(Index(x_neigh, y_neigh, z_neigh));
                             
                         }
                 
-                return neighbourhood;
+            }
+            
+            template<typename T> bool Buffer_tpl<T>::stencil_is_current() const {
+                
+                return stencil_layout[X] == this->dim(X) + 2 * this->halo_width()
+                        && stencil_layout[Y] == this->dim(Y) + 2 * this->halo_width()
+                        && stencil_layout[Z] == this->dim(Z) + 2 * this->halo_width()
+                        && stencil_offsets.size() == (size_t) MR::Math::pow3(2 * neigh_extent);
+                
+            }
+            
+            template<typename T> bool Buffer_tpl<T>::neighbourhood_range(const Coord& point,
+                                                                         Index& corner,
+                                                                         Index& lower,
+                                                                         Index& upper,
+                                                                         bool& clipped) const {
+                
+                Index centre_coord = voxel_centre_coord(point);
+                
+                // The neighbourhood spans [centre - neigh_extent, centre + neigh_extent) along each dimension.
+                corner = Index(centre_coord[X] - neigh_extent, centre_coord[Y] - neigh_extent,
+                        centre_coord[Z] - neigh_extent);
+                upper = Index(centre_coord[X] + neigh_extent, centre_coord[Y] + neigh_extent,
+                        centre_coord[Z] + neigh_extent);
+                
+                lower = corner;
+                
+                clipped = false;
+                
+                // Clip the neighbourhood to the image bounds if they are enforced.
+                if (this->enforce_bounds)
+                    for (size_t dim_i = 0; dim_i < 3; ++dim_i) {
+                        
+                        if (lower[dim_i] < 0) {
+                            lower[dim_i] = 0;
+                            clipped = true;
+                        }
+                        
+                        if (upper[dim_i] > (int) this->dim(dim_i)) {
+                            upper[dim_i] = (int) this->dim(dim_i);
+                            clipped = true;
+                        }
+                        
+                        if (lower[dim_i] >= upper[dim_i])
+                            return false;
+                        
+                    }
+                
+                return true;
+                
+            }
+            
+            template<typename T> void Buffer_tpl<T>::get_neighbourhood(
+                    const Coord& point, std::vector<T*>& neighbourhood) {
+                
+                neighbourhood.clear();
+                
+                Index corner, lower, upper;
+                bool clipped;
+                
+                if (!neighbourhood_range(point, corner, lower, upper, clipped))
+                    return;
+                
+                size_t corner_offset, last_offset;
+                
+                // If the whole neighbourhood lies within the dense lookup table, step through it using the precomputed
+                // stencil offsets.
+                if (!clipped && this->dense_offset(corner, corner_offset)
+                        && this->dense_offset(Index(upper[X] - 1, upper[Y] - 1, upper[Z] - 1),
+                                last_offset)) {
+                    
+                    if (!stencil_is_current())
+                        reset_stencil();
+                    
+                    for (size_t stencil_i = 0; stencil_i < stencil_offsets.size(); ++stencil_i) {
+                        
+                        size_t position = this->dense_lookup[corner_offset
+                                + stencil_offsets[stencil_i]];
+                        
+                        if (position == this->EMPTY)
+                            neighbourhood.push_back(
+                                    &(this->operator()(corner + stencil_coords[stencil_i])));
+                        else
+                            neighbourhood.push_back(&(this->voxels[position].second));
+                        
+                    }
+                    
+                } else {
+                    
+                    for (int z_neigh = lower[Z]; z_neigh < upper[Z]; z_neigh++)
+                        for (int y_neigh = lower[Y]; y_neigh < upper[Y]; y_neigh++)
+                            for (int x_neigh = lower[X]; x_neigh < upper[X]; x_neigh++)
+                                neighbourhood.push_back(
+                                        &(this->operator()(Index(x_neigh, y_neigh, z_neigh))));
+                    
+                }
+                
+            }
+            
+            template<typename T> bool Buffer_tpl<T>::find_neighbourhood(
+                    const Coord& point, std::vector<size_t>& positions) const {
+                
+                positions.clear();
+                
+                Index corner, lower, upper;
+                bool clipped;
+                
+                if (!neighbourhood_range(point, corner, lower, upper, clipped))
+                    return true;
+                
+                size_t corner_offset, last_offset;
+                
+                if (!clipped && stencil_is_current() && this->dense_offset(corner, corner_offset)
+                        && this->dense_offset(Index(upper[X] - 1, upper[Y] - 1, upper[Z] - 1),
+                                last_offset)) {
+                    
+                    for (size_t stencil_i = 0; stencil_i < stencil_offsets.size(); ++stencil_i) {
+                        
+                        size_t position = this->dense_lookup[corner_offset
+                                + stencil_offsets[stencil_i]];
+                        
+                        if (position == this->EMPTY)
+                            return false;
+                        
+                        positions.push_back(position);
+                        
+                    }
+                    
+                } else {
+                    
+                    for (int z_neigh = lower[Z]; z_neigh < upper[Z]; z_neigh++)
+                        for (int y_neigh = lower[Y]; y_neigh < upper[Y]; y_neigh++)
+                            for (int x_neigh = lower[X]; x_neigh < upper[X]; x_neigh++) {
+                                
+                                size_t position = this->position(
+                                        Index(x_neigh, y_neigh, z_neigh));
+                                
+                                if (position == this->EMPTY)
+                                    return false;
+                                
+                                positions.push_back(position);
+                                
+                            }
+                    
+                }
+                
+                return true;
+                
+            }
+            
+            template<typename T> template<typename U> void Buffer_tpl<T>::get_neighbourhood(
+                    const typename U::Section& section, std::vector<T*>& neighbourhood) {
+                
+                neighbourhood.clear();
+                
+                std::vector<T*> point_neighbourhood;
+                
+                std::vector<Coord> extreme_points = T::extreme_points(section);
+                
+                for (std::vector<Coord>::iterator point_it = extreme_points.begin();
+                        point_it != extreme_points.end(); ++point_it) {
+                    get_neighbourhood(*point_it, point_neighbourhood);
+                    neighbourhood.insert(neighbourhood.end(), point_neighbourhood.begin(),
+                            point_neighbourhood.end());
+                }
+                
+                // Remove voxels that are shared between the neighbourhoods of the extreme points.
+                std::sort(neighbourhood.begin(), neighbourhood.end());
+                neighbourhood.erase(std::unique(neighbourhood.begin(), neighbourhood.end()),
+                        neighbourhood.end());
                 
             }
             
@@ -531,24 +1344,13 @@ namespace FTS {
                 
                 this->Observed::Buffer_tpl<T>::to_stream(stream);
                 
-                stream << "Diffusion model: " << diffusion_model << std::endl;
+                stream << "Diffusion model: " << *diffusion_model << std::endl;
                 stream << "Num sections: " << num_len_sections << std::endl;
                 stream << "Num strands: " << num_wth_sections << std::endl;
                 stream << "Interpolation extent: " << interp_extent << std::endl;
                 stream << "Neighbourhood extent: " << neigh_extent << std::endl;
                 
-                stream << "Neighbourhoods: " << std::endl;
-                
-                for (typename std::map<Index, std::set<T*> >::const_iterator neigh_it =
-                        neighbourhoods.begin(); neigh_it != neighbourhoods.end(); ++neigh_it) {
-                    
-                    stream << neigh_it->first << std::endl;
-                    
-                    for (typename std::set<T*>::const_iterator vox_it = neigh_it->second.begin();
-                            vox_it != neigh_it->second.end(); ++vox_it)
-                        stream << "  " << (*vox_it)->centre() << std::endl;
-                    
-                }
+                stream << "Neighbourhood stencil size: " << MR::Math::pow3(2 * neigh_extent) << std::endl;
                 
                 stream << std::endl << std::endl;
                 
@@ -37,12 +37,17 @@ namespace FTS {
 
 }
 
+#include <pthread.h>
+
 #include "bts/common.h"
+#include "bts/utilities/timer.h"
+#include "bts/utilities/threads.h"
 
 #include "bts/image/observed/buffer.h"
 #include "bts/image/index.h"
 #include "bts/image/container/buffer.h"
 #include "bts/image/reference/buffer.h"
+#include "bts/image/expected/signal_record.h"
 
 #include "bts/fibre/strand.h"
 #include "bts/fibre/tractlet.h"
@@ -50,6 +55,7 @@ namespace FTS {
 #include "bts/diffusion/model.h"
 
 #include "math/matrix.h"
+#include "ptr.h"
 
 #include "bts/common.h"
 
@@ -83,7 +89,9 @@ namespace FTS {
                     
                 protected:
                     
-                    Diffusion::Model diffusion_model;
+                    // Shared between copies of the buffer (e.g. the expected images of the chains in a multi-chain run), as it
+                    // isn't modified after construction.
+                    MR::RefPtr<Diffusion::Model> diffusion_model;
 
                     size_t num_len_sections;
                     size_t num_wth_sections;
@@ -91,7 +99,41 @@ namespace FTS {
                     double interp_extent;
                     int neigh_extent;
 
-                    std::map<Index, std::set<T*> > neighbourhoods;
+                    // Offsets into the dense lookup table (relative to the lowest corner) and relative coordinates of the voxels
+                    // within the neighbourhood extent of a voxel centre. Rebuilt whenever the layout of the lookup table
+                    // changes (see get_neighbourhood).
+                    std::vector<size_t> stencil_offsets;
+                    std::vector<Index> stencil_coords;
+                    Triple<size_t> stencil_layout;
+
+                    // Number of threads used to generate the expected image and the private buffers they accumulate the
+                    // signal into (indexed by the position of the voxel and then the encoding).
+                    size_t num_threads;
+                    std::vector<std::vector<double> > thread_tiles;
+
+                    // Number of samples per unit displacement of the tables the 1-D interpolation kernels are looked up from
+                    // (see axis_weights), or 0 to evaluate the kernels directly. The tables are built on first use and span
+                    // displacements of [-(neigh_extent + 1), neigh_extent + 1] along each dimension.
+                    size_t interp_table_resolution;
+                    std::vector<double> interp_tables[3];
+
+                    // Sections (with their diffusion weightings precalculated) of each fibre in the last set passed to
+                    // expected_image(), along with the values of the fibre they were generated from, so that the sections only
+                    // need to be regenerated for the fibres that have changed since (see cached_path). Indexed by fibre. The
+                    // keys only hold the fibre values, so the caches are cleared (see clear_paths) whenever the buffer is
+                    // copied or reconfigured. The diffusion model, voxel geometry and numbers of sections they also depend on
+                    // are only set on construction.
+                    std::vector<std::vector<Fibre::Strand::Section> > strand_paths;
+                    std::vector<std::vector<Fibre::Tractlet::Section> > tractlet_paths;
+                    std::vector<std::vector<double> > strand_path_keys;
+                    std::vector<std::vector<double> > tractlet_path_keys;
+
+                    // Running totals of the wall time spent in expected_image(), expected_image_with_references() and
+                    // update_image(), and of the part of it spent regenerating the cached sections of changed fibres
+                    // (averaged over the threads when the image is generated in parallel), which the samplers use to break
+                    // down the time of each iteration.
+                    double image_seconds;
+                    double section_seconds;
 
                 public:
                     //Holds all strand or tractlet sections used to generate the image. Storage here allows data structures to be
@@ -118,6 +160,16 @@ namespace FTS {
 
                     template<typename U> void part_image(const U& fibre);
 
+                    template<typename U> void part_image(
+                            const U& fibre, double scale,
+                            SignalRecord& previous);
+
+                    template<typename U> void update_image(
+                            const U& old_fibre, const U& new_fibre, double base_intensity,
+                            SignalRecord& previous);
+
+                    void revert_image(const SignalRecord& previous);
+
                     template<typename U> typename Image::Reference::Buffer<typename U::Section>::Set& expected_image_with_references(
                             const typename U::Set& fibres);
 
@@ -125,6 +177,20 @@ namespace FTS {
                             const U& fibre, std::vector<typename U::Section>& path,
                             Image::Reference::Buffer<typename U::Section>& section_reference);
 
+                    /*! Adds the gradient of the sum of 'adjoint' times the signal of each stored voxel and encoding (indexed by
+                     *  position * num_encodings() + encoding) w.r.t. the fibres to 'gradient'. The image must have just been
+                     *  generated from the same fibres by 'expected_image' as the cached paths are reused. Each section is
+                     *  visited once and the contributions from all of the voxels and encodings it touches are summed before
+                     *  being added to the fibre, so unlike 'expected_image_with_references' no per-voxel lists are built.
+                     */
+                    template<typename U> void adjoint_gradient(const typename U::Set& fibres,
+                                                               const std::vector<double>& adjoint,
+                                                               typename U::Set& gradient);
+
+                    template<typename U> void part_adjoint(const U& fibre, size_t fibre_index,
+                                                           const std::vector<double>& adjoint,
+                                                           double scale, typename U::Set& gradient);
+
                     template<typename U> void expected_image(
                             const typename U::Set& fibres,
                             typename Container::Buffer<U>::Set& gradients);
@@ -149,7 +215,7 @@ namespace FTS {
                     precalculate_section_weighting_gradients_and_hessians();
 
                     const Diffusion::Model& get_diffusion_model() const {
-                        return diffusion_model;
+                        return *diffusion_model;
                     }
                     
                     double get_extent() {
@@ -159,28 +225,61 @@ namespace FTS {
                     void set_extent(double interp_extent) {
                         this->interp_extent = interp_extent;
                         neigh_extent = (size_t) std::ceil(interp_extent);
-                        neighbourhoods.clear();
+                        stencil_layout.set(0, 0, 0);
+                        clear_interp_tables();
+                        clear_paths();
+                        // Signal can spill up to the neighbourhood extent outside the image when bounds aren't enforced.
+                        this->set_storage(true, neigh_extent);
                     }
                     
                     Buffer_tpl& clear() {
                         Image::Buffer_tpl<T>::clear();
-                        neighbourhoods.clear();
                         return *this;
                     }
                     
                     size_t num_encodings() const {
-                        return diffusion_model.num_encodings();
+                        return diffusion_model->num_encodings();
                     }
                     
                     const Diffusion::Encoding& encoding(size_t index) const {
-                        return diffusion_model[index];
+                        return (*diffusion_model)[index];
+                    }
+                    
+                    void set_num_threads(size_t num_threads) {
+                        if (!num_threads)
+                            throw Exception("Number of threads used to generate the expected image must be at least one.");
+                        this->num_threads = num_threads;
+                    }
+                    
+                    size_t get_num_threads() const {
+                        return num_threads;
+                    }
+                    
+                    void set_interp_table_resolution(size_t interp_table_resolution) {
+                        this->interp_table_resolution = interp_table_resolution;
+                        clear_interp_tables();
+                        clear_paths();
+                    }
+                    
+                    size_t get_interp_table_resolution() const {
+                        return interp_table_resolution;
+                    }
+                    
+                    double get_image_seconds() const {
+                        return image_seconds;
+                    }
+                    
+                    double get_section_seconds() const {
+                        return section_seconds;
                     }
                     
                 protected:
                     
                     Buffer_tpl(bool enforce_bounds = true)
-                            : Observed::Buffer_tpl<T>(enforce_bounds), num_len_sections(0), num_wth_sections(
-                                      0), interp_extent(0.0), neigh_extent(0) {
+                            : Observed::Buffer_tpl<T>(enforce_bounds), diffusion_model(new Diffusion::Model()),
+                              num_len_sections(0), num_wth_sections(0), interp_extent(0.0), neigh_extent(0),
+                              stencil_layout(0, 0, 0), num_threads(1), interp_table_resolution(0), image_seconds(0.0),
+                              section_seconds(0.0) {
                     }
                     
                     Buffer_tpl(const Triple<size_t>& dimensions, const Triple<double>& voxel_sizes,
@@ -189,9 +288,10 @@ namespace FTS {
                                double interp_extent, const Triple<double>& corner_offsets,
                                bool enforce_bounds)
                             : Observed::Buffer_tpl<T>(dimensions, voxel_sizes, corner_offsets,
-                                      enforce_bounds), diffusion_model(diffusion_model), num_len_sections(
-                                      number_length_sections), num_wth_sections(
-                                      number_width_sections)
+                                      enforce_bounds), diffusion_model(new Diffusion::Model(diffusion_model)),
+                              num_len_sections(number_length_sections), num_wth_sections(
+                                      number_width_sections), num_threads(1), interp_table_resolution(0), image_seconds(
+                                      0.0), section_seconds(0.0)
 
                     {
                         
@@ -207,9 +307,13 @@ namespace FTS {
                     
                     Buffer_tpl(const Buffer_tpl& bt)
                             : Observed::Buffer_tpl<T>(bt), diffusion_model(bt.diffusion_model), num_len_sections(
-                                      bt.num_len_sections), num_wth_sections(bt.num_wth_sections)
+                                      bt.num_len_sections), num_wth_sections(bt.num_wth_sections), num_threads(
+                                      bt.num_threads), interp_table_resolution(bt.interp_table_resolution), image_seconds(
+                                      0.0), section_seconds(0.0)
 
                     {
+                        // The cached paths aren't copied (set_extent clears them anyway), as copies are typically
+                        // reconfigured after they are made.
                         set_extent(bt.interp_extent);
                     }
                     
@@ -219,19 +323,184 @@ namespace FTS {
                     // Returns the 'neighbourhood' coordinate that the point lies in.  The 'neighbourhood' coordinate is the coordinate
                     // that the point + [0.5,0.5,0.5] lies in. This is used to map the neighbourhood of voxels that lie
                     // withinness the interpolation extent about the given point (see set and get neighbourhoods).
-                    Index voxel_centre_coord(const Coord& point) {
+                    Index voxel_centre_coord(const Coord& point) const {
                         Coord offset_point = point + Coord::Halves;
                         Index coord((int) floor(offset_point[X]), (int) floor(offset_point[Y]),
                                 (int) floor(offset_point[Z]));
                         return coord;
                     }
                     
-                    std::set<T*> create_neighbourhood(const Index& coord);
+                    // The interpolation kernels are separable, i.e. the interpolation of a point by a voxel is the product of a
+                    // 1-D kernel (T::axis_interpolate) of its displacement from the voxel centre along each axis. So the
+                    // interpolations of a section by every voxel in its neighbourhood can be formed from 3 x (2 * neigh_extent)
+                    // axis weights, which only need to be calculated once per section.
+                    class AxisWeights {
+                            
+                        public:
+                            
+                            Index corner;
+                            double tangent_norm;
+                            std::vector<double> weights[3];
+
+                        public:
+                            
+                            // Equivalent to T::interpolate(section) for the voxel at 'coord', which must lie in the
+                            // neighbourhood of the section.
+                            double interpolation(const Index& coord) const {
+                                return weights[X][coord[X] - corner[X]] * weights[Y][coord[Y] - corner[Y]]
+                                       * weights[Z][coord[Z] - corner[Z]] * tangent_norm;
+                            }
+                            
+                    };
+                    
+                    // Calculates the axis weights of the section's neighbourhood, where 'voxel' is any voxel of the image,
+                    // which is only used to evaluate the 1-D kernel.
+                    template<typename S> void axis_weights(const S& section, T& voxel,
+                                                           AxisWeights& weights);
+
+                    double axis_interpolate(T& voxel, double disp, size_t dim_i) const;
+
+                    void build_interp_tables();
+
+                    void clear_interp_tables() {
+                        for (size_t dim_i = 0; dim_i < 3; ++dim_i)
+                            interp_tables[dim_i].clear();
+                    }
+                    
+                    void clear_paths() {
+                        strand_paths.clear();
+                        tractlet_paths.clear();
+                        strand_path_keys.clear();
+                        tractlet_path_keys.clear();
+                    }
+                    
+                    //Adds the (scaled) signal of the section to every encoding of the voxel.
+                    template<typename S> void add_signal(T& voxel, const S& section,
+                                                         double scale = 1.0) {
+                        add_signal(voxel, section, &voxel[0], scale);
+                    }
+                    
+                    //Adds the (scaled) signal of the section at the voxel to the 'intensities' array (one per encoding).
+                    template<typename S> void add_signal(T& voxel, const S& section, double* intensities,
+                                                         double scale = 1.0);
+
+                    //Adds the signal of every section in the path, which should have their weightings precalculated already.
+                    template<typename S> void add_path(std::vector<S>& path);
+
+                    // Returns the sections of the fibre at 'fibre_index' of the set, only regenerating them if the fibre differs
+                    // from the one they were last generated from. The cache needs to be sized to the number of fibres first (see
+                    // resize_paths). As each fibre only touches its own entry it is safe to call from multiple threads as long
+                    // as no two threads are given the same fibre index. The time spent regenerating the sections is added to
+                    // 'seconds' if provided.
+                    template<typename U> std::vector<typename U::Section>& cached_path(const U& fibre,
+                                                                                       size_t fibre_index,
+                                                                                       double* seconds = 0);
+
+                    template<typename U> void resize_paths(size_t num_fibres) {
+                        get_paths(U()).resize(num_fibres);
+                        get_path_keys(U()).resize(num_fibres);
+                    }
 
-                    std::set<T*>& get_neighbourhood(const Coord& point);
+                    void reset_stencil();
+
+                    bool stencil_is_current() const;
+
+                    // Gets the corner of the neighbourhood about the point and its range after it has been clipped to the
+                    // image bounds (if enforced). Returns false if the clipped neighbourhood is empty.
+                    bool neighbourhood_range(const Coord& point, Index& corner, Index& lower,
+                                             Index& upper, bool& clipped) const;
+
+                    // Fills 'neighbourhood' with the voxels that lie within the interpolation extent of the given point,
+                    // creating them if required. The vector is cleared first but retains its capacity so it can be reused
+                    // between sections without reallocating.
+                    void get_neighbourhood(const Coord& point, std::vector<T*>& neighbourhood);
+
+                    template<typename U> void get_neighbourhood(const typename U::Section& section,
+                                                                std::vector<T*>& neighbourhood);
+
+                    // Fills 'positions' with the positions (in the voxel storage) of the neighbourhood about the given point
+                    // without creating any voxels, so it is safe to call from multiple threads. Returns false if any of the
+                    // voxels haven't been created yet.
+                    bool find_neighbourhood(const Coord& point, std::vector<size_t>& positions) const;
+
+                    // The fibres (and the voxels) that each thread is responsible for when generating the image in parallel.
+                    template<typename U> class Job {
+                            
+                        public:
+                            
+                            Buffer_tpl<T>* image;
+                            const typename U::Set* fibres;
+                            size_t start, end;
+                            std::vector<double>* tile;
+
+                            // Only set when section references are required, indexed by fibre.
+                            std::vector<std::vector<typename U::Section>*>* paths;
+                            std::vector<Reference::Buffer<typename U::Section>*>* section_refs;
+
+                            // Sections that touch voxels that hadn't been created when the threads were started, which are
+                            // added afterwards by the calling thread. When references are required they are stored as
+                            // (fibre, section) indices into 'paths' instead.
+                            std::vector<typename U::Section> deferred;
+                            std::vector<std::pair<size_t, size_t> > deferred_refs;
+
+                            // Time the thread spent regenerating cached sections.
+                            double section_seconds;
+
+                            Job()
+                                    : image(0), fibres(0), start(0), end(0), tile(0), paths(0), section_refs(
+                                              0), section_seconds(0.0) {
+                            }
+                            
+                    };
+                    
+                    template<typename U> static void* run_job(void* job);
+
+                    // The range of voxels that each thread sums the thread buffers over.
+                    class Reduction {
+                            
+                        public:
+                            
+                            Buffer_tpl<T>* image;
+                            size_t start, end;
+
+                            Reduction()
+                                    : image(0), start(0), end(0) {
+                            }
+                            
+                    };
+                    
+                    static void* run_reduction(void* reduction);
 
-                    template<typename U> std::set<T*> get_neighbourhood(
-                            const typename U::Section& section);
+                    // Generates the image from the fibres using 'num_threads' threads, each of which accumulates the signal
+                    // of a contiguous block of fibres in its own buffer. The buffers are then summed in a fixed order so the
+                    // result doesn't depend on the thread scheduling.
+                    template<typename U> void threaded_image(
+                            const typename U::Set& fibres,
+                            std::map<size_t, std::vector<typename U::Section> >* sections = 0,
+                            typename Reference::Buffer<typename U::Section>::Set* section_refs = 0);
+
+                    template<typename U> void part_tile(
+                            const U& fibre, size_t fibre_index, std::vector<typename U::Section>& path,
+                            Job<U>& job);
+
+                    // The fibres that each thread pulls the adjoint back through (see adjoint_gradient).
+                    template<typename U> class AdjointJob {
+                            
+                        public:
+                            
+                            Buffer_tpl<T>* image;
+                            const typename U::Set* fibres;
+                            const std::vector<double>* adjoint;
+                            typename U::Set* gradient;
+                            size_t start, end;
+
+                            AdjointJob()
+                                    : image(0), fibres(0), adjoint(0), gradient(0), start(0), end(0) {
+                            }
+                            
+                    };
+                    
+                    template<typename U> static void* run_adjoint_job(void* job);
 
                     std::ostream& to_stream(std::ostream& stream) const;
 
@@ -248,6 +517,24 @@ namespace FTS {
                         return tractlet_sections;
                     }
                     
+                    std::vector<std::vector<Fibre::Strand::Section> >& get_paths(
+                            const Fibre::Strand& dummy) {
+                        return strand_paths;
+                    }
+                    
+                    std::vector<std::vector<Fibre::Tractlet::Section> >& get_paths(
+                            const Fibre::Tractlet& dummy) {
+                        return tractlet_paths;
+                    }
+                    
+                    std::vector<std::vector<double> >& get_path_keys(const Fibre::Strand& dummy) {
+                        return strand_path_keys;
+                    }
+                    
+                    std::vector<std::vector<double> >& get_path_keys(const Fibre::Tractlet& dummy) {
+                        return tractlet_path_keys;
+                    }
+                    
                     Reference::Buffer<Fibre::Strand::Section>::Set& get_section_references(
                             const Fibre::Strand& dummy) {
                         return strand_section_references;
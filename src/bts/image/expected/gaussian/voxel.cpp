@@ -35,21 +35,22 @@ namespace FTS {
             namespace Gaussian {
                 
                 Voxel::Voxel(Buffer& buffer, const Index& coord)
-                        : Expected::Voxel(buffer, coord, buffer.diffusion_model), image(&buffer) {
+                        : Expected::Voxel(buffer, coord, *buffer.diffusion_model), image(&buffer) {
                 }
                 
                 double Voxel::interpolate(const Coord& pos) {
                     
                     Coord disp = pos - centre();
                     
-                    Coord interpolate(
-                            exp(-MR::Math::pow2(disp[X]) / (2.0 * image->gauss_exp_var())),
-                            exp(-MR::Math::pow2(disp[Y]) / (2.0 * image->gauss_exp_var())),
-                            exp(-MR::Math::pow2(disp[Z]) / (2.0 * image->gauss_exp_var())));
+                    return axis_interpolate(disp[X], X) * axis_interpolate(disp[Y], Y)
+                           * axis_interpolate(disp[Z], Z);
                     
-                    interpolate /= sqrt(2.0 * M_PI * image->gauss_exp_var());
+                }
+                
+                double Voxel::axis_interpolate(double disp, size_t dim_i) {
                     
-                    return interpolate[X] * interpolate[Y] * interpolate[Z];
+                    return exp(-MR::Math::pow2(disp) / (2.0 * image->gauss_exp_var()))
+                           / sqrt(2.0 * M_PI * image->gauss_exp_var());
                     
                 }
                 
@@ -38,7 +38,7 @@ namespace FTS {
             namespace Quartic {
                 
                 Voxel::Voxel(Buffer& buffer, const Index& coord)
-                        : Expected::Voxel(buffer, coord, buffer.diffusion_model), image(&buffer) {
+                        : Expected::Voxel(buffer, coord, *buffer.diffusion_model), image(&buffer) {
                 }
                 
 //----------------------//
@@ -49,22 +49,19 @@ namespace FTS {
                     
                     Coord disp = pos - this->centre();
                     
-                    Coord interpolate;
+                    return axis_interpolate(disp[X], X) * axis_interpolate(disp[Y], Y)
+                           * axis_interpolate(disp[Z], Z);
+                    
+                }
+                
+                double Voxel::axis_interpolate(double disp, size_t dim_i) {
                     
                     double interpolation;
                     
-                    if (disp.lower_bounded(-1.0) && disp.upper_bounded(1.0)) {
-                        
-                        for (size_t dim_i = 0; dim_i < 3; ++dim_i)
-                            interpolate[dim_i] = MR::Math::pow4(disp[dim_i])
-                                    - 2.0 * MR::Math::pow2(disp[dim_i])
-                                                 + 1;
-                        
-                        interpolation = interpolate[X] * interpolate[Y] * interpolate[Z];
-                        
-                    } else {
+                    if (disp >= -1.0 && disp <= 1.0)
+                        interpolation = MR::Math::pow4(disp) - 2.0 * MR::Math::pow2(disp) + 1;
+                    else
                         interpolation = 0.0;
-                    }
                     
                     return interpolation;
                     
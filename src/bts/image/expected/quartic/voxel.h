@@ -103,6 +103,8 @@ namespace FTS {
                         
                         double interpolate(const Coord& pos);
 
+                        double axis_interpolate(double disp, size_t dim_i);
+
                         double interpolate(const Coord& pos, Coord& gradient);
 
                         double interpolate(const Coord& triple, Coord& gradient,
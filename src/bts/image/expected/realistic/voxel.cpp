@@ -35,39 +35,37 @@ namespace FTS {
             namespace Realistic {
                 
                 Voxel::Voxel(Buffer& buffer, const Index& coord)
-                        : Expected::Voxel(buffer, coord, buffer.diffusion_model), image(&buffer) {
+                        : Expected::Voxel(buffer, coord, *buffer.diffusion_model), image(&buffer) {
                 }
                 
                 double Expected::Realistic::Voxel::interpolate(const Coord& pos) {
                     
                     Coord disp = pos - this->centre();
                     
-                    Coord interpolate;
+                    return axis_interpolate(disp[X], X) * axis_interpolate(disp[Y], Y)
+                           * axis_interpolate(disp[Z], Z);
+                    
+                }
+                
+                double Expected::Realistic::Voxel::axis_interpolate(double disp, size_t dim_i) {
                     
                     double interpolation;
                     
                     //Truncate the sinc function at a consitent distance from the voxel centre.
-                    if (disp.lower_bounded(-image->get_extent()) && disp.upper_bounded(
-                                image->get_extent())) {
+                    if (disp >= -image->get_extent() && disp <= image->get_extent()) {
                         
                         //Do X and Y as a Sinc
-                        for (size_t dim_i = 0; dim_i < 2; ++dim_i) {
+                        if (dim_i != Z) {
                             
-                            if (disp[dim_i] == 0.0)
-                                interpolate[dim_i] = 1.0;
+                            if (disp == 0.0)
+                                interpolation = 1.0;
                             else
-                                interpolate[dim_i] = MR::Math::sin(M_PI * disp[dim_i])
-                                        / (M_PI * disp[dim_i]);
-                        }
-                        
-                        if ((disp[Z] < 1) && (disp[Z] > -1))
-                            interpolate[Z] = (MR::Math::pow4(disp[Z])
-                                    - 2.0 * MR::Math::pow2(disp[Z])
-                                              + 1);
+                                interpolation = MR::Math::sin(M_PI * disp) / (M_PI * disp);
+                            
+                        } else if ((disp < 1) && (disp > -1))
+                            interpolation = (MR::Math::pow4(disp) - 2.0 * MR::Math::pow2(disp) + 1);
                         else
-                            interpolate[Z] = 0.0;
-                        
-                        interpolation = interpolate[X] * interpolate[Y] * interpolate[Z];
+                            interpolation = 0.0;
                         
                     } else
                         interpolation = 0.0;
@@ -35,21 +35,25 @@ namespace FTS {
             namespace ReverseSqrt {
                 
                 Voxel::Voxel(Buffer& buffer, const Index& coord)
-                        : Expected::Voxel(buffer, coord, buffer.diffusion_model), image(&buffer) {
+                        : Expected::Voxel(buffer, coord, *buffer.diffusion_model), image(&buffer) {
                 }
                 
                 double Expected::ReverseSqrt::Voxel::interpolate(const Coord& pos) {
                     
                     Coord disp = pos - centre();
                     
-                    double scalar = 1.0;
+                    return axis_interpolate(disp[X], X) * axis_interpolate(disp[Y], Y)
+                           * axis_interpolate(disp[Z], Z);
                     
-                    if (disp.upper_bounded(1.0) && disp.lower_bounded(-1.0)) {
-                        
-                        for (size_t dim_i = 0; dim_i < 3; dim_i++)
-                            scalar *= MR::Math::sqrt(1.0 - MR::Math::abs(disp[dim_i]));    // * 3.0 / 2.0;
-                                                             
-                    } else
+                }
+                
+                double Expected::ReverseSqrt::Voxel::axis_interpolate(double disp, size_t dim_i) {
+                    
+                    double scalar;
+                    
+                    if (disp <= 1.0 && disp >= -1.0)
+                        scalar = MR::Math::sqrt(1.0 - MR::Math::abs(disp));    // * 3.0 / 2.0;
+                    else
                         scalar = 0.0;
                     
                     return scalar;
@@ -0,0 +1,142 @@
+/*
+ Copyright 2010 Brain Research Institute/National ICT Australia (NICTA), Melbourne, Australia
+ 
+ Written by Thomas G Close, 5/05/09.
+ 
+ This file is part of Fourier Tract Sampling (FouTS).
+ 
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+ 
+ */
+
+#ifndef __bts_image_expected_signalrecord_h__
+#define __bts_image_expected_signalrecord_h__
+
+namespace FTS {
+    
+    namespace Image {
+        
+        namespace Expected {
+            
+            class SignalRecord;
+        
+        }
+    
+    }
+
+}
+
+#include <vector>
+
+#include "bts/common.h"
+
+#include "bts/image/index.h"
+#include "bts/image/voxel.h"
+
+namespace FTS {
+    
+    namespace Image {
+        
+        namespace Expected {
+            
+            /*! The signals of the voxels touched by an in-place update of an expected image, each recorded before the voxel
+             *  is first modified so that the update can be scored (see Prob::Likelihood::log_prob_delta) and reverted.
+             *  Voxels are identified by their position in the storage of the image, which doesn't change once they are
+             *  created. The vectors keep their capacity when cleared, so once a record has grown to fit the largest
+             *  update no further allocations are made.
+             */
+            class SignalRecord {
+                    
+                protected:
+                    
+                    size_t num_encods;
+                    
+                    std::vector<size_t> positions;
+                    std::vector<Index> coords;
+                    std::vector<double> signals;
+                    
+                    // Flags the storage positions that have already been recorded since the last call to 'clear'.
+                    std::vector<bool> recorded;
+                    
+                public:
+                    
+                    SignalRecord()
+                            : num_encods(0) {
+                    }
+                    
+                    void clear() {
+                        
+                        for (size_t record_i = 0; record_i < positions.size(); ++record_i)
+                            recorded[positions[record_i]] = false;
+                        
+                        positions.clear();
+                        coords.clear();
+                        signals.clear();
+                    
+                    }
+                    
+                    //! Records the signal of the voxel at 'position' unless it has already been recorded.
+                    void record(size_t position, const Index& coord, const Image::Voxel<double>& voxel) {
+                        
+                        if (position >= recorded.size())
+                            recorded.resize(max2(position + 1, 2 * recorded.size()), false);
+                        
+                        if (recorded[position])
+                            return;
+                        
+                        recorded[position] = true;
+                        
+                        num_encods = voxel.num_encodings();
+                        
+                        positions.push_back(position);
+                        coords.push_back(coord);
+                        
+                        for (size_t encode_i = 0; encode_i < num_encods; encode_i++)
+                            signals.push_back(voxel[encode_i]);
+                    
+                    }
+                    
+                    size_t size() const {
+                        return positions.size();
+                    }
+                    
+                    bool empty() const {
+                        return positions.empty();
+                    }
+                    
+                    size_t num_encodings() const {
+                        return num_encods;
+                    }
+                    
+                    size_t position(size_t record_i) const {
+                        return positions[record_i];
+                    }
+                    
+                    const Index& coord(size_t record_i) const {
+                        return coords[record_i];
+                    }
+                    
+                    const double* signal(size_t record_i) const {
+                        return &signals[record_i * num_encods];
+                    }
+            
+            };
+        
+        }
+    
+    }
+
+}
+
+#endif
@@ -38,31 +38,29 @@ namespace FTS {
             namespace Sinc {
                 
                 Voxel::Voxel(Buffer& buffer, const Index& coord)
-                        : Expected::Voxel(buffer, coord, buffer.diffusion_model), image(&buffer) {
+                        : Expected::Voxel(buffer, coord, *buffer.diffusion_model), image(&buffer) {
                 }
                 
                 double Voxel::interpolate(const Coord& pos) {
                     
                     Coord disp = pos - centre();
                     
-                    Coord interpolate;
+                    return axis_interpolate(disp[X], X) * axis_interpolate(disp[Y], Y)
+                           * axis_interpolate(disp[Z], Z);
+                    
+                }
+                
+                double Voxel::axis_interpolate(double disp, size_t dim_i) {
                     
                     double interpolation;
                     
                     //Truncate the sinc function at a consitent distance from the voxel centre.
-                    if (disp.lower_bounded(-image->get_extent()) && disp.upper_bounded(
-                                image->get_extent())) {
-                        
-                        for (size_t dim_i = 0; dim_i < 3; ++dim_i) {
-                            
-                            if (disp[dim_i] == 0.0)
-                                interpolate[dim_i] = 1.0;
-                            else
-                                interpolate[dim_i] = MR::Math::sin(M_PI * disp[dim_i])
-                                        / (M_PI * disp[dim_i]);
-                        }
+                    if (disp >= -image->get_extent() && disp <= image->get_extent()) {
                         
-                        interpolation = interpolate[X] * interpolate[Y] * interpolate[Z];
+                        if (disp == 0.0)
+                            interpolation = 1.0;
+                        else
+                            interpolation = MR::Math::sin(M_PI * disp) / (M_PI * disp);
                         
                     } else
                         interpolation = 0.0;
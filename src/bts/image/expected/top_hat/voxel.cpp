@@ -35,16 +35,23 @@ namespace FTS {
             namespace TopHat {
                 
                 Voxel::Voxel(Buffer& buffer, const Index& index)
-                        : Expected::Voxel(buffer, index, buffer.diffusion_model), image(&buffer) {
+                        : Expected::Voxel(buffer, index, *buffer.diffusion_model), image(&buffer) {
                 }
                 
                 double Voxel::interpolate(const Coord& pos) {
                     
                     Coord disp = pos - centre();
                     
+                    return axis_interpolate(disp[X], X) * axis_interpolate(disp[Y], Y)
+                           * axis_interpolate(disp[Z], Z);
+                    
+                }
+                
+                double Voxel::axis_interpolate(double disp, size_t dim_i) {
+                    
                     double scalar;
                     
-                    if (disp.upper_bounded(0.5) && disp.lower_bounded(-0.5))
+                    if (disp <= 0.5 && disp >= -0.5)
                         scalar = 1.0;
                     else
                         scalar = 0.0;
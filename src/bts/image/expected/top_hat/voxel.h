@@ -81,6 +81,8 @@ namespace FTS {
                         
                         double interpolate(const Coord& pos);
 
+                        double axis_interpolate(double disp, size_t dim_i);
+
                         double interpolate(const Coord& pos, Coord& gradient) {
                             throw Exception("Gradient is not defined for Top-hat interpolation.");
                         }
@@ -35,24 +35,28 @@ namespace FTS {
             namespace Trilinear {
                 
                 Voxel::Voxel(Buffer& buffer, const Index& coord)
-                        : Expected::Voxel(buffer, coord, buffer.diffusion_model), image(&buffer) {
+                        : Expected::Voxel(buffer, coord, *buffer.diffusion_model), image(&buffer) {
                 }
                 
                 double Expected::Trilinear::Voxel::interpolate(const Coord& pos) {
                     
                     Coord disp = pos - centre();
-                    Coord interpolate = Coord::Ones - disp.abs();
+                    
+                    return axis_interpolate(disp[X], X) * axis_interpolate(disp[Y], Y)
+                           * axis_interpolate(disp[Z], Z);
+                    
+                }
+                
+                double Expected::Trilinear::Voxel::axis_interpolate(double disp, size_t dim_i) {
+                    
+                    double interpolate = 1.0 - MR::Math::abs(disp);
                     
                     double scalar;
                     
-                    if (interpolate.non_negative()) {
-                        
-                        scalar = interpolate[X] * interpolate[Y] * interpolate[Z];
-                        
-                    } else {
-                        
+                    if (interpolate >= 0.0)
+                        scalar = interpolate;
+                    else
                         scalar = 0.0;
-                    }
                     
                     return scalar;
                     
@@ -68,7 +68,7 @@ namespace FTS {
                     return (this->p[X] > 0.0) && (this->p[Y] > 0.0) && (this->p[Z] > 0.0);
                 }
                 
-                inline bool non_negative() {
+                inline bool non_negative() const {
                     return (this->p[X] >= 0.0) && (this->p[Y] >= 0.0) && (this->p[Z] >= 0.0);
                 }
                 
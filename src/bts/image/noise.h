@@ -108,6 +108,9 @@ namespace FTS {
                         : rand_gen(rand_gen), snr(snr), ref_signal(ref_signal) {
                 }
                 
+                virtual ~Noise() {
+                }
+                
                 virtual Image::Observed::Buffer& noisify(Image::Observed::Buffer& image) = 0;
 
                 virtual Image::Expected::Buffer& noisify(Image::Expected::Buffer& image) = 0;
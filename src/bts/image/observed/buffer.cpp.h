@@ -36,7 +36,7 @@ namespace FTS {
                                                            Triple<double> corner_offsets,
                                                            bool enforce_bounds)
                     
-                    : Image::Buffer_tpl<T>(dimensions, enforce_bounds), voxel_lengths(
+                    : Image::Buffer_tpl<T>(dimensions, enforce_bounds, true), voxel_lengths(
                               voxel_lengths), corner_offsets(corner_offsets) {
                 
                 if (!corner_offsets)
@@ -139,8 +139,9 @@ namespace FTS {
 
                 protected:
                     
+                    // Observed (and expected) images are looked up densely over the image dimensions.
                     Buffer_tpl(bool enforce_bounds)
-                            : Image::Buffer_tpl<T>(enforce_bounds) {
+                            : Image::Buffer_tpl<T>(enforce_bounds, true) {
                     }
                     
                     Buffer_tpl(Triple<size_t> dimensions, Triple<double> voxel_lengths,
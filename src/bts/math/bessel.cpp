@@ -0,0 +1,174 @@
+/*
+ Copyright 2009 Brain Research Institute, Melbourne, Australia
+ 
+ Created by Tom Close on 13/03/09.
+ 
+ This file is part of Fourier Tract Sampling (FouTS).
+ 
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+ 
+ */
+
+#include <cassert>
+#include <cmath>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#include "math/bessel.h"
+
+#include "bts/math/bessel.h"
+
+namespace FTS {
+    
+    namespace Math {
+        
+        namespace Bessel {
+            
+            const double SERIES_LIMIT = 3.0;
+            
+            const size_t NUM_SERIES_TERMS = 15;
+            
+            // 1 / (k!)^2, the coefficients of (x^2/4)^k in the power series of I0(x).
+            const double I0_SERIES[NUM_SERIES_TERMS] = { 1, 1, 0.25, 0.027777777777777776,
+                    0.001736111111111111, 6.9444444444444444e-05, 1.9290123456790124e-06,
+                    3.9367598891408417e-08, 6.1511873267825652e-10, 7.5940584281266239e-12,
+                    7.5940584281266234e-14, 6.2760813455591933e-16, 4.358389823304995e-18,
+                    2.5789288895295828e-20, 1.3157800456783586e-22 };
+            
+            // 1 / (k! (k+1)!), the coefficients of (x^2/4)^k in the power series of 2 I1(x) / x.
+            const double I1_SERIES[NUM_SERIES_TERMS] = { 1, 0.5, 0.083333333333333329,
+                    0.0069444444444444441, 0.00034722222222222224, 1.1574074074074073e-05,
+                    2.7557319223985888e-07, 4.9209498614260522e-09, 6.8346525853139614e-11,
+                    7.5940584281266231e-13, 6.9036894801151122e-15, 5.230067787965994e-17,
+                    3.3526075563884579e-19, 1.842092063949702e-21, 8.7718669711890575e-24 };
+            
+            inline double series(const double* coeffs, double y) {
+                
+                double sum = coeffs[NUM_SERIES_TERMS - 1];
+                
+                for (size_t term_i = NUM_SERIES_TERMS - 1; term_i > 0; --term_i)
+                    sum = sum * y + coeffs[term_i - 1];
+                
+                return sum;
+                
+            }
+            
+            double log_i0_scaled(double x) {
+                
+                if (x <= SERIES_LIMIT)
+                    return std::log(series(I0_SERIES, 0.25 * x * x)) - x;
+                
+                return std::log(MR::Math::Bessel::I0_scaled(x));
+                
+            }
+            
+            double i1_i0_ratio(double x) {
+                
+                if (x <= SERIES_LIMIT) {
+                    double y = 0.25 * x * x;
+                    return 0.5 * x * series(I1_SERIES, y) / series(I0_SERIES, y);
+                }
+                
+                return MR::Math::Bessel::I1_scaled(x) / MR::Math::Bessel::I0_scaled(x);
+                
+            }
+            
+            // Sums the I0 power series at y = min(x, SERIES_LIMIT)^2 / 4, or if 'ratio' is set, the series approximation of
+            // I1(x)/I0(x) at min(x, SERIES_LIMIT). Clamping x means the elements above SERIES_LIMIT, which are replaced by
+            // the caller, can't overflow.
+            inline void clamped_series(const double* x, double* out, bool ratio, size_t num) {
+                
+                size_t elem_i = 0;
+                
+#ifdef __AVX__
+                
+                __m256d limit = _mm256_set1_pd(SERIES_LIMIT);
+                __m256d quarter = _mm256_set1_pd(0.25);
+                __m256d half = _mm256_set1_pd(0.5);
+                
+                for (; elem_i + 4 <= num; elem_i += 4) {
+                    
+                    __m256d x_clamped = _mm256_min_pd(_mm256_loadu_pd(x + elem_i), limit);
+                    __m256d y = _mm256_mul_pd(quarter, _mm256_mul_pd(x_clamped, x_clamped));
+                    
+                    //Evaluate the polynomials in y using Horner's scheme.
+                    __m256d i0_sum = _mm256_set1_pd(I0_SERIES[NUM_SERIES_TERMS - 1]);
+                    
+                    for (size_t term_i = NUM_SERIES_TERMS - 1; term_i > 0; --term_i)
+                        i0_sum = _mm256_add_pd(_mm256_mul_pd(i0_sum, y),
+                                _mm256_set1_pd(I0_SERIES[term_i - 1]));
+                    
+                    if (ratio) {
+                        
+                        __m256d i1_sum = _mm256_set1_pd(I1_SERIES[NUM_SERIES_TERMS - 1]);
+                        
+                        for (size_t term_i = NUM_SERIES_TERMS - 1; term_i > 0; --term_i)
+                            i1_sum = _mm256_add_pd(_mm256_mul_pd(i1_sum, y),
+                                    _mm256_set1_pd(I1_SERIES[term_i - 1]));
+                        
+                        _mm256_storeu_pd(out + elem_i,
+                                _mm256_div_pd(_mm256_mul_pd(_mm256_mul_pd(half, x_clamped), i1_sum), i0_sum));
+                        
+                    } else
+                        _mm256_storeu_pd(out + elem_i, i0_sum);
+                    
+                }
+                
+#endif
+                
+                //Scalar fallback (and remainder of the AVX loop).
+                for (; elem_i < num; ++elem_i) {
+                    
+                    double x_clamped = x[elem_i] < SERIES_LIMIT ? x[elem_i] : SERIES_LIMIT;
+                    double y = 0.25 * x_clamped * x_clamped;
+                    
+                    if (ratio)
+                        out[elem_i] = 0.5 * x_clamped * series(I1_SERIES, y) / series(I0_SERIES, y);
+                    else
+                        out[elem_i] = series(I0_SERIES, y);
+                    
+                }
+                
+            }
+            
+            void log_i0_scaled(const double* x, double* log_i0_scaled, size_t num) {
+                
+                clamped_series(x, log_i0_scaled, false, num);
+                
+                for (size_t elem_i = 0; elem_i < num; ++elem_i)
+                    if (x[elem_i] <= SERIES_LIMIT)
+                        log_i0_scaled[elem_i] = std::log(log_i0_scaled[elem_i]) - x[elem_i];
+                    else
+                        log_i0_scaled[elem_i] = std::log(MR::Math::Bessel::I0_scaled(x[elem_i]));
+                
+            }
+            
+            void i1_i0_ratio(const double* x, double* i1_i0_ratio, size_t num) {
+                
+                clamped_series(x, i1_i0_ratio, true, num);
+                
+                for (size_t elem_i = 0; elem_i < num; ++elem_i)
+                    if (x[elem_i] > SERIES_LIMIT)
+                        i1_i0_ratio[elem_i] = MR::Math::Bessel::I1_scaled(x[elem_i])
+                                              / MR::Math::Bessel::I0_scaled(x[elem_i]);
+                
+            }
+        
+        }
+    
+    }
+
+}
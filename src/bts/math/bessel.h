@@ -0,0 +1,66 @@
+/*
+ Copyright 2009 Brain Research Institute, Melbourne, Australia
+ 
+ Created by Tom Close on 13/03/09.
+ 
+ This file is part of Fourier Tract Sampling (FouTS).
+ 
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+ 
+ */
+
+#ifndef __bts_math_bessel_h__
+#define __bts_math_bessel_h__
+
+#include <cstddef>
+
+namespace FTS {
+    
+    namespace Math {
+        
+        /*! Modified Bessel functions of the first kind for the Rician likelihood, which only ever needs them in the form
+         * log(I0(x)) and I1(x)/I0(x) for x >= 0. Both are evaluated with the exponential growth of I0 and I1 divided out
+         * so they don't overflow for large x. Below SERIES_LIMIT the power series are summed to 15 terms (truncation
+         * error below 1e-16 relative), above it the Chebyshev expansions in 1/x of the scaled functions in
+         * lib/math/bessel.h are used (also accurate to double precision).
+         *
+         * The batched versions evaluate the power series over the whole array in a branch-free loop (4 elements at a
+         * time with AVX, if available), with x clamped to SERIES_LIMIT so the series can't overflow, and then only
+         * replace the elements that lie above SERIES_LIMIT.
+         */
+        namespace Bessel {
+            
+            extern const double SERIES_LIMIT;
+
+            //! log(exp(-x) I0(x))
+            double log_i0_scaled(double x);
+
+            inline double log_i0(double x) {
+                return x + log_i0_scaled(x);
+            }
+            
+            //! I1(x) / I0(x)
+            double i1_i0_ratio(double x);
+
+            void log_i0_scaled(const double* x, double* log_i0_scaled, size_t num);
+
+            void i1_i0_ratio(const double* x, double* i1_i0_ratio, size_t num);
+        
+        }
+    
+    }
+
+}
+
+#endif /* __bts_math_bessel_h__ */
@@ -0,0 +1,255 @@
+/*
+ Copyright 2009 Brain Research Institute, Melbourne, Australia
+ 
+ Created by Tom Close on 13/03/09.
+ 
+ This file is part of Fourier Tract Sampling (FouTS).
+ 
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+ 
+ */
+
+#include <algorithm>
+
+#include "bts/math/block_sparse.h"
+
+#include "bts/common.h"
+
+namespace FTS {
+    
+    namespace Math {
+        
+        BlockSparse& BlockSparse::set_blocks(const std::vector<size_t>& block_sizes) {
+            
+            block_starts.assign(1, 0);
+            
+            for (size_t block_i = 0; block_i < block_sizes.size(); ++block_i)
+                block_starts.push_back(block_starts.back() + block_sizes[block_i]);
+            
+            blocks.clear();
+            
+            return *this;
+            
+        }
+        
+        MR::Math::Matrix<double>& BlockSparse::block(size_t row_block, size_t col_block) {
+            
+            std::pair<size_t, size_t> key(row_block, col_block);
+            
+            iterator block_it = blocks.find(key);
+            
+            if (block_it == blocks.end()) {
+                
+                if (row_block >= num_blocks() || col_block >= num_blocks())
+                    throw Exception(
+                            "Block (" + str(row_block) + ", " + str(col_block) + ") is out of range (" + str(
+                                    num_blocks())
+                            + " blocks).");
+                
+                block_it = blocks.insert(
+                        std::pair<std::pair<size_t, size_t>, MR::Math::Matrix<double> >(key,
+                                MR::Math::Matrix<double>())).first;
+                
+                block_it->second.allocate(block_size(row_block), block_size(col_block));
+                block_it->second.zero();
+                
+            }
+            
+            return block_it->second;
+            
+        }
+        
+        const MR::Math::Matrix<double>* BlockSparse::find_block(size_t row_block,
+                                                                size_t col_block) const {
+            
+            const_iterator block_it = blocks.find(std::pair<size_t, size_t>(row_block, col_block));
+            
+            return block_it == blocks.end() ? 0 : &block_it->second;
+            
+        }
+        
+        BlockSparse& BlockSparse::zero() {
+            
+            for (iterator block_it = blocks.begin(); block_it != blocks.end(); ++block_it)
+                block_it->second.zero();
+            
+            return *this;
+            
+        }
+        
+        BlockSparse& BlockSparse::operator+=(const BlockSparse& A) {
+            
+            if (A.block_starts != block_starts)
+                throw Exception("Block sizes of added matrix do not match.");
+            
+            for (const_iterator block_it = A.begin(); block_it != A.end(); ++block_it)
+                block(block_it->first.first, block_it->first.second) += block_it->second;
+            
+            return *this;
+            
+        }
+        
+        BlockSparse& BlockSparse::add_diagonal(double value) {
+            
+            for (size_t block_i = 0; block_i < num_blocks(); ++block_i) {
+                
+                MR::Math::Matrix<double>& diag_block = block(block_i, block_i);
+                
+                for (size_t elem_i = 0; elem_i < diag_block.rows(); ++elem_i)
+                    diag_block(elem_i, elem_i) += value;
+                
+            }
+            
+            return *this;
+            
+        }
+        
+        size_t BlockSparse::block_index(size_t elem_i) const {
+            
+            return std::upper_bound(block_starts.begin(), block_starts.end(), elem_i)
+                   - block_starts.begin() - 1;
+            
+        }
+        
+        double BlockSparse::operator()(size_t row_i, size_t col_i) const {
+            
+            size_t row_block = block_index(row_i);
+            size_t col_block = block_index(col_i);
+            
+            const MR::Math::Matrix<double>* block_ptr = find_block(row_block, col_block);
+            
+            if (!block_ptr)
+                return 0.0;
+            
+            return (*block_ptr)(row_i - block_starts[row_block], col_i - block_starts[col_block]);
+            
+        }
+        
+        MR::Math::Vector<double>& BlockSparse::mult(MR::Math::Vector<double>& y,
+                                                    const MR::Math::Vector<double>& x) const {
+            
+            y.allocate(size());
+            y.zero();
+            
+            for (const_iterator block_it = begin(); block_it != end(); ++block_it) {
+                
+                size_t row_start = block_starts[block_it->first.first];
+                size_t col_start = block_starts[block_it->first.second];
+                
+                const MR::Math::Matrix<double>& B = block_it->second;
+                
+                for (size_t row_i = 0; row_i < B.rows(); ++row_i)
+                    for (size_t col_i = 0; col_i < B.columns(); ++col_i)
+                        y[row_start + row_i] += B(row_i, col_i) * x[col_start + col_i];
+                
+            }
+            
+            return y;
+            
+        }
+        
+        double BlockSparse::inner(const MR::Math::Vector<double>& x,
+                                  const MR::Math::Vector<double>& y) const {
+            
+            double product = 0.0;
+            
+            for (const_iterator block_it = begin(); block_it != end(); ++block_it) {
+                
+                size_t row_start = block_starts[block_it->first.first];
+                size_t col_start = block_starts[block_it->first.second];
+                
+                const MR::Math::Matrix<double>& B = block_it->second;
+                
+                for (size_t row_i = 0; row_i < B.rows(); ++row_i) {
+                    
+                    double row_product = 0.0;
+                    
+                    for (size_t col_i = 0; col_i < B.columns(); ++col_i)
+                        row_product += B(row_i, col_i) * y[col_start + col_i];
+                    
+                    product += x[row_start + row_i] * row_product;
+                    
+                }
+                
+            }
+            
+            return product;
+            
+        }
+        
+        double BlockSparse::trace_product(const MR::Math::Matrix<double>& B) const {
+            
+            double trace = 0.0;
+            
+            for (const_iterator block_it = begin(); block_it != end(); ++block_it) {
+                
+                size_t row_start = block_starts[block_it->first.first];
+                size_t col_start = block_starts[block_it->first.second];
+                
+                const MR::Math::Matrix<double>& A_block = block_it->second;
+                
+                for (size_t row_i = 0; row_i < A_block.rows(); ++row_i)
+                    for (size_t col_i = 0; col_i < A_block.columns(); ++col_i)
+                        trace += B(col_start + col_i, row_start + row_i) * A_block(row_i, col_i);
+                
+            }
+            
+            return trace;
+            
+        }
+        
+        MR::Math::Matrix<double>& BlockSparse::copy_to(MR::Math::Matrix<double>& A) const {
+            
+            if (A.rows() != size() || A.columns() != size())
+                throw Exception(
+                        "Dense matrix (" + str(A.rows()) + "x" + str(A.columns())
+                        + ") does not match the size of the block sparse matrix (" + str(size()) + ").");
+            
+            A.zero();
+            
+            for (const_iterator block_it = begin(); block_it != end(); ++block_it) {
+                
+                size_t row_start = block_starts[block_it->first.first];
+                size_t col_start = block_starts[block_it->first.second];
+                
+                const MR::Math::Matrix<double>& B = block_it->second;
+                
+                for (size_t row_i = 0; row_i < B.rows(); ++row_i)
+                    for (size_t col_i = 0; col_i < B.columns(); ++col_i)
+                        A(row_start + row_i, col_start + col_i) = B(row_i, col_i);
+                
+            }
+            
+            return A;
+            
+        }
+        
+        BlockSparse& BlockSparse::copy_from(const MR::Math::Matrix<double>& A) {
+            
+            if (A.rows() != A.columns())
+                throw Exception(
+                        "Dense matrix (" + str(A.rows()) + "x" + str(A.columns()) + ") is not square.");
+            
+            set_blocks(std::vector<size_t>(1, A.rows()));
+            
+            if (A.rows())
+                block(0, 0) = A;
+            
+            return *this;
+            
+        }
+    
+    }
+
+}
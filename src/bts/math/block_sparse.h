@@ -0,0 +1,161 @@
+/*
+ Copyright 2009 Brain Research Institute, Melbourne, Australia
+ 
+ Created by Tom Close on 13/03/09.
+ 
+ This file is part of Fourier Tract Sampling (FouTS).
+ 
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+ 
+ */
+
+#ifndef __bts_math_block_sparse_h__
+#define __bts_math_block_sparse_h__
+
+#include <map>
+#include <vector>
+
+#include "math/vector.h"
+#include "math/matrix.h"
+
+namespace FTS {
+    
+    namespace Math {
+        
+        /*! Square matrix whose rows and columns are partitioned into blocks (e.g. the elements of each fibre in a set),
+         * where only the blocks that have been accessed are stored, as dense matrices. Used for the Fisher information of
+         * a set of fibres and its gradients, where fibres only couple to the fibres they share voxels with, so that their
+         * memory grows with the number of overlapping pairs rather than the square (or cube) of the number of elements.
+         */
+        class BlockSparse {
+                
+            public:
+                
+                typedef std::map<std::pair<size_t, size_t>, MR::Math::Matrix<double> >::iterator iterator;
+                typedef std::map<std::pair<size_t, size_t>, MR::Math::Matrix<double> >::const_iterator const_iterator;
+                
+            public:
+                
+                BlockSparse() {
+                }
+                
+                BlockSparse(const std::vector<size_t>& block_sizes) {
+                    set_blocks(block_sizes);
+                }
+                
+                //! Sets the sizes of the blocks along each dimension and removes any stored blocks.
+                BlockSparse& set_blocks(const std::vector<size_t>& block_sizes);
+                
+                //! Sets the block sizes to the sizes ('vsize') of each fibre in the set.
+                template<typename Set> BlockSparse& set_fibre_blocks(const Set& set) {
+                    std::vector<size_t> block_sizes;
+                    for (size_t fibre_i = 0; fibre_i < set.size(); ++fibre_i)
+                        block_sizes.push_back(set[fibre_i].vsize());
+                    return set_blocks(block_sizes);
+                }
+                
+                //! Returns the block at ('row_block', 'col_block'), inserting a zero block if it isn't stored yet.
+                MR::Math::Matrix<double>& block(size_t row_block, size_t col_block);
+                
+                //! Returns the block at ('row_block', 'col_block') or null if it isn't stored.
+                const MR::Math::Matrix<double>* find_block(size_t row_block, size_t col_block) const;
+                
+                //! Sets the stored blocks to zero, keeping the pattern of stored blocks.
+                BlockSparse& zero();
+                
+                //! Removes all stored blocks.
+                BlockSparse& clear() {
+                    blocks.clear();
+                    return *this;
+                }
+                
+                BlockSparse& operator+=(const BlockSparse& A);
+                
+                //! Adds 'value' to each element of the diagonal.
+                BlockSparse& add_diagonal(double value);
+                
+                double operator()(size_t row_i, size_t col_i) const;
+                
+                //! y = A x
+                MR::Math::Vector<double>& mult(MR::Math::Vector<double>& y,
+                                               const MR::Math::Vector<double>& x) const;
+                
+                //! x' A y
+                double inner(const MR::Math::Vector<double>& x, const MR::Math::Vector<double>& y) const;
+                
+                //! trace(B A), where B is a dense matrix of the same size.
+                double trace_product(const MR::Math::Matrix<double>& B) const;
+                
+                //! Copies the matrix into the dense matrix 'A', which needs to be allocated to the same size already.
+                MR::Math::Matrix<double>& copy_to(MR::Math::Matrix<double>& A) const;
+                
+                //! Sets the matrix to a single block holding a copy of the dense matrix 'A', for distributions that only
+                //! provide their Fisher information densely.
+                BlockSparse& copy_from(const MR::Math::Matrix<double>& A);
+                
+                size_t size() const {
+                    return block_starts.size() ? block_starts.back() : 0;
+                }
+                
+                size_t num_blocks() const {
+                    return block_starts.size() ? block_starts.size() - 1 : 0;
+                }
+                
+                size_t block_start(size_t block_i) const {
+                    return block_starts[block_i];
+                }
+                
+                size_t block_size(size_t block_i) const {
+                    return block_starts[block_i + 1] - block_starts[block_i];
+                }
+                
+                //! The index of the block that the row/column lies in.
+                size_t block_index(size_t elem_i) const;
+                
+                //! The number of stored blocks.
+                size_t num_stored() const {
+                    return blocks.size();
+                }
+                
+                //! Stored blocks in ascending (row block, column block) order.
+                iterator begin() {
+                    return blocks.begin();
+                }
+                
+                iterator end() {
+                    return blocks.end();
+                }
+                
+                const_iterator begin() const {
+                    return blocks.begin();
+                }
+                
+                const_iterator end() const {
+                    return blocks.end();
+                }
+                
+            protected:
+                
+                // The first row/column of each block followed by the size of the matrix.
+                std::vector<size_t> block_starts;
+                
+                std::map<std::pair<size_t, size_t>, MR::Math::Matrix<double> > blocks;
+                
+        };
+    
+    }
+
+}
+
+#endif
@@ -0,0 +1,427 @@
+/*
+ Copyright 2009 Brain Research Institute, Melbourne, Australia
+ 
+ Created by Tom Close on 13/03/09.
+ 
+ This file is part of Fourier Tract Sampling (FouTS).
+ 
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+ 
+ */
+
+#include <set>
+#include <algorithm>
+#include <cmath>
+
+#include "bts/math/sparse_cholesky.h"
+#include "bts/math/block_sparse.h"
+
+#include "bts/common.h"
+
+namespace FTS {
+    
+    namespace Math {
+        
+        SparseCholesky& SparseCholesky::decomp(const MR::Math::Matrix<double>& A) {
+            
+            if (A.rows() != A.columns())
+                throw Exception(
+                        "Matrix to decompose is not square (" + str(A.rows()) + "x" + str(A.columns())
+                        + ").");
+            
+            size_t new_dim = A.rows();
+            
+            std::vector<size_t> starts(1, 0);
+            std::vector<size_t> rows;
+            
+            lower_values.clear();
+            diag_values.resize(new_dim);
+            
+            for (size_t col_i = 0; col_i < new_dim; ++col_i) {
+                
+                diag_values[col_i] = A(col_i, col_i);
+                
+                for (size_t row_i = col_i + 1; row_i < new_dim; ++row_i)
+                    if (A(row_i, col_i) != 0.0) {
+                        rows.push_back(row_i);
+                        lower_values.push_back(A(row_i, col_i));
+                    }
+                
+                starts.push_back(rows.size());
+                
+            }
+            
+            return factorise(new_dim, starts, rows);
+            
+        }
+        
+        SparseCholesky& SparseCholesky::decomp(const BlockSparse& A) {
+            
+            size_t new_dim = A.size();
+            
+            // The stored blocks in the lower triangle of each block column, in ascending order of block row.
+            std::vector<std::vector<std::pair<size_t, const MR::Math::Matrix<double>*> > > block_columns(
+                    A.num_blocks());
+            
+            for (BlockSparse::const_iterator block_it = A.begin(); block_it != A.end(); ++block_it)
+                if (block_it->first.first >= block_it->first.second)
+                    block_columns[block_it->first.second].push_back(
+                            std::pair<size_t, const MR::Math::Matrix<double>*>(block_it->first.first,
+                                    &block_it->second));
+            
+            // The pattern is taken from the stored blocks rather than their nonzero elements, so it (and the analysis)
+            // stays the same as long as the same pairs of fibres overlap.
+            std::vector<size_t> starts(1, 0);
+            std::vector<size_t> rows;
+            
+            lower_values.clear();
+            diag_values.assign(new_dim, 0.0);
+            
+            for (size_t col_block = 0; col_block < A.num_blocks(); ++col_block) {
+                
+                size_t col_start = A.block_start(col_block);
+                
+                for (size_t block_col_i = 0; block_col_i < A.block_size(col_block); ++block_col_i) {
+                    
+                    for (size_t block_i = 0; block_i < block_columns[col_block].size(); ++block_i) {
+                        
+                        size_t row_block = block_columns[col_block][block_i].first;
+                        const MR::Math::Matrix<double>& block = *block_columns[col_block][block_i].second;
+                        
+                        size_t row_start = A.block_start(row_block);
+                        size_t block_row_i = 0;
+                        
+                        if (row_block == col_block) {
+                            diag_values[col_start + block_col_i] = block(block_col_i, block_col_i);
+                            block_row_i = block_col_i + 1;
+                        }
+                        
+                        for (; block_row_i < A.block_size(row_block); ++block_row_i) {
+                            rows.push_back(row_start + block_row_i);
+                            lower_values.push_back(block(block_row_i, block_col_i));
+                        }
+                        
+                    }
+                    
+                    starts.push_back(rows.size());
+                    
+                }
+                
+            }
+            
+            return factorise(new_dim, starts, rows);
+            
+        }
+        
+        SparseCholesky& SparseCholesky::factorise(size_t new_dim, std::vector<size_t>& starts,
+                                                  std::vector<size_t>& rows) {
+            
+            if (new_dim != dim || starts != pattern_starts || rows != pattern_rows) {
+                
+                dim = new_dim;
+                pattern_starts.swap(starts);
+                pattern_rows.swap(rows);
+                
+                analyse();
+                
+            }
+            
+            std::vector<double> work(dim, 0.0);
+            
+            for (size_t col_i = 0; col_i < dim; ++col_i) {
+                
+                size_t orig_col = order[col_i];
+                
+                // Scatter the column of the reordered matrix into the work vector (only the rows in the pattern of L are
+                // needed). The elements of A above the diagonal are read from their transposes in the lower triangle.
+                for (size_t pos_i = col_starts[col_i] + 1; pos_i < col_starts[col_i + 1]; ++pos_i)
+                    work[row_indices[pos_i]] = 0.0;
+                
+                work[col_i] = diag_values[orig_col];
+                
+                for (size_t pos_i = pattern_starts[orig_col]; pos_i < pattern_starts[orig_col + 1];
+                        ++pos_i)
+                    if (positions[pattern_rows[pos_i]] > col_i)
+                        work[positions[pattern_rows[pos_i]]] = lower_values[pos_i];
+                
+                for (size_t entry_i = transpose_starts[orig_col];
+                        entry_i < transpose_starts[orig_col + 1]; ++entry_i)
+                    if (positions[transpose_cols[entry_i]] > col_i)
+                        work[positions[transpose_cols[entry_i]]] =
+                                lower_values[transpose_positions[entry_i]];
+                
+                // Subtract the contributions of the previous columns that have a nonzero element in this row. As the rows
+                // of each column are sorted, the rows at or below this one follow the element in this row.
+                for (size_t entry_i = row_starts[col_i]; entry_i < row_starts[col_i + 1]; ++entry_i) {
+                    
+                    size_t prev_col = row_cols[entry_i];
+                    double l_elem = values[row_positions[entry_i]];
+                    
+                    for (size_t pos_i = row_positions[entry_i]; pos_i < col_starts[prev_col + 1];
+                            ++pos_i)
+                        work[row_indices[pos_i]] -= values[pos_i] * l_elem;
+                    
+                }
+                
+                double diag = work[col_i];
+                
+                if (!(diag > 0.0))
+                    throw Exception(
+                            "Matrix is not positive definite (pivot " + str(col_i) + " is " + str(diag)
+                            + ").");
+                
+                diag = std::sqrt(diag);
+                
+                values[col_starts[col_i]] = diag;
+                
+                for (size_t pos_i = col_starts[col_i] + 1; pos_i < col_starts[col_i + 1]; ++pos_i)
+                    values[pos_i] = work[row_indices[pos_i]] / diag;
+                
+            }
+            
+            return *this;
+            
+        }
+        
+        void SparseCholesky::analyse() {
+            
+            // The elimination graph, which starts as the graph of A and gains the fill-in of L as each row/column is
+            // eliminated.
+            std::vector<std::set<size_t> > adjacency(dim);
+            
+            for (size_t col_i = 0; col_i < dim; ++col_i)
+                for (size_t pos_i = pattern_starts[col_i]; pos_i < pattern_starts[col_i + 1]; ++pos_i) {
+                    adjacency[col_i].insert(pattern_rows[pos_i]);
+                    adjacency[pattern_rows[pos_i]].insert(col_i);
+                }
+            
+            std::vector<bool> eliminated(dim, false);
+            std::vector<std::vector<size_t> > neighbours(dim);
+            
+            order.clear();
+            
+            for (size_t step_i = 0; step_i < dim; ++step_i) {
+                
+                // Eliminate the remaining row/column with the fewest neighbours (ties go to the lowest index).
+                size_t pivot = dim;
+                size_t min_degree = dim + 1;
+                
+                for (size_t node_i = 0; node_i < dim; ++node_i)
+                    if (!eliminated[node_i] && adjacency[node_i].size() < min_degree) {
+                        pivot = node_i;
+                        min_degree = adjacency[node_i].size();
+                    }
+                
+                order.push_back(pivot);
+                eliminated[pivot] = true;
+                
+                // The remaining neighbours of the pivot form the pattern of its column in L and become a clique.
+                std::vector<size_t>& pivot_neighbours = neighbours[pivot];
+                
+                pivot_neighbours.assign(adjacency[pivot].begin(), adjacency[pivot].end());
+                
+                for (size_t neigh_i = 0; neigh_i < pivot_neighbours.size(); ++neigh_i) {
+                    
+                    std::set<size_t>& neigh_adjacency = adjacency[pivot_neighbours[neigh_i]];
+                    
+                    neigh_adjacency.erase(pivot);
+                    
+                    for (size_t neigh_i2 = 0; neigh_i2 < pivot_neighbours.size(); ++neigh_i2)
+                        if (neigh_i2 != neigh_i)
+                            neigh_adjacency.insert(pivot_neighbours[neigh_i2]);
+                    
+                }
+                
+                adjacency[pivot].clear();
+                
+            }
+            
+            positions.resize(dim);
+            
+            for (size_t col_i = 0; col_i < dim; ++col_i)
+                positions[order[col_i]] = col_i;
+            
+            // The strictly lower pattern of A by row, i.e. the strictly upper pattern by column.
+            transpose_starts.assign(dim + 1, 0);
+            
+            for (size_t pos_i = 0; pos_i < pattern_rows.size(); ++pos_i)
+                ++transpose_starts[pattern_rows[pos_i] + 1];
+            
+            for (size_t row_i = 0; row_i < dim; ++row_i)
+                transpose_starts[row_i + 1] += transpose_starts[row_i];
+            
+            transpose_cols.resize(pattern_rows.size());
+            transpose_positions.resize(pattern_rows.size());
+            
+            std::vector<size_t> transpose_fill(transpose_starts.begin(), transpose_starts.end() - 1);
+            
+            for (size_t col_i = 0; col_i < dim; ++col_i)
+                for (size_t pos_i = pattern_starts[col_i]; pos_i < pattern_starts[col_i + 1]; ++pos_i) {
+                    size_t entry_i = transpose_fill[pattern_rows[pos_i]]++;
+                    transpose_cols[entry_i] = col_i;
+                    transpose_positions[entry_i] = pos_i;
+                }
+            
+            col_starts.assign(1, 0);
+            row_indices.clear();
+            
+            std::vector<size_t> row_counts(dim, 0);
+            
+            for (size_t col_i = 0; col_i < dim; ++col_i) {
+                
+                std::vector<size_t>& col_neighbours = neighbours[order[col_i]];
+                
+                std::vector<size_t> col_rows;
+                
+                for (size_t neigh_i = 0; neigh_i < col_neighbours.size(); ++neigh_i)
+                    col_rows.push_back(positions[col_neighbours[neigh_i]]);
+                
+                std::sort(col_rows.begin(), col_rows.end());
+                
+                row_indices.push_back(col_i);
+                row_indices.insert(row_indices.end(), col_rows.begin(), col_rows.end());
+                
+                col_starts.push_back(row_indices.size());
+                
+                for (size_t row_i = 0; row_i < col_rows.size(); ++row_i)
+                    ++row_counts[col_rows[row_i]];
+                
+            }
+            
+            values.assign(row_indices.size(), 0.0);
+            
+            row_starts.assign(1, 0);
+            
+            for (size_t row_i = 0; row_i < dim; ++row_i)
+                row_starts.push_back(row_starts.back() + row_counts[row_i]);
+            
+            row_positions.resize(row_starts.back());
+            row_cols.resize(row_starts.back());
+            
+            std::vector<size_t> row_fill(row_starts.begin(), row_starts.end() - 1);
+            
+            for (size_t col_i = 0; col_i < dim; ++col_i)
+                for (size_t pos_i = col_starts[col_i] + 1; pos_i < col_starts[col_i + 1]; ++pos_i) {
+                    size_t entry_i = row_fill[row_indices[pos_i]]++;
+                    row_positions[entry_i] = pos_i;
+                    row_cols[entry_i] = col_i;
+                }
+            
+        }
+        
+        void SparseCholesky::lower_solve(std::vector<double>& x) const {
+            
+            for (size_t col_i = 0; col_i < dim; ++col_i) {
+                
+                x[col_i] /= values[col_starts[col_i]];
+                
+                for (size_t pos_i = col_starts[col_i] + 1; pos_i < col_starts[col_i + 1]; ++pos_i)
+                    x[row_indices[pos_i]] -= values[pos_i] * x[col_i];
+                
+            }
+            
+        }
+        
+        void SparseCholesky::upper_solve(std::vector<double>& x) const {
+            
+            for (size_t col_i = dim; col_i-- > 0;) {
+                
+                for (size_t pos_i = col_starts[col_i] + 1; pos_i < col_starts[col_i + 1]; ++pos_i)
+                    x[col_i] -= values[pos_i] * x[row_indices[pos_i]];
+                
+                x[col_i] /= values[col_starts[col_i]];
+                
+            }
+            
+        }
+        
+        MR::Math::Vector<double>& SparseCholesky::solve(MR::Math::Vector<double>& x,
+                                                        const MR::Math::Vector<double>& b) const {
+            
+            assert(b.size() == dim);
+            
+            std::vector<double> work(dim);
+            
+            for (size_t elem_i = 0; elem_i < dim; ++elem_i)
+                work[elem_i] = b[order[elem_i]];
+            
+            lower_solve(work);
+            upper_solve(work);
+            
+            x.allocate(dim);
+            
+            for (size_t elem_i = 0; elem_i < dim; ++elem_i)
+                x[order[elem_i]] = work[elem_i];
+            
+            return x;
+            
+        }
+        
+        MR::Math::Vector<double>& SparseCholesky::lower_mult(
+                MR::Math::Vector<double>& y, const MR::Math::Vector<double>& x) const {
+            
+            assert(x.size() == dim);
+            
+            std::vector<double> work(dim, 0.0);
+            
+            for (size_t col_i = 0; col_i < dim; ++col_i)
+                for (size_t pos_i = col_starts[col_i]; pos_i < col_starts[col_i + 1]; ++pos_i)
+                    work[row_indices[pos_i]] += values[pos_i] * x[col_i];
+            
+            y.allocate(dim);
+            
+            for (size_t elem_i = 0; elem_i < dim; ++elem_i)
+                y[order[elem_i]] = work[elem_i];
+            
+            return y;
+            
+        }
+        
+        MR::Math::Matrix<double>& SparseCholesky::inverse(MR::Math::Matrix<double>& A_inv) const {
+            
+            A_inv.allocate(dim, dim);
+            
+            std::vector<double> work(dim);
+            
+            for (size_t col_i = 0; col_i < dim; ++col_i) {
+                
+                work.assign(dim, 0.0);
+                work[col_i] = 1.0;
+                
+                lower_solve(work);
+                upper_solve(work);
+                
+                for (size_t elem_i = 0; elem_i < dim; ++elem_i)
+                    A_inv(order[elem_i], order[col_i]) = work[elem_i];
+                
+            }
+            
+            return A_inv;
+            
+        }
+        
+        double SparseCholesky::log_det() const {
+            
+            double log_det = 0.0;
+            
+            for (size_t col_i = 0; col_i < dim; ++col_i)
+                log_det += std::log(values[col_starts[col_i]]);
+            
+            return 2.0 * log_det;
+            
+        }
+    
+    }
+
+}
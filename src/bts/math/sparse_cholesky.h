@@ -0,0 +1,142 @@
+/*
+ Copyright 2009 Brain Research Institute, Melbourne, Australia
+ 
+ Created by Tom Close on 13/03/09.
+ 
+ This file is part of Fourier Tract Sampling (FouTS).
+ 
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+ 
+ */
+
+#ifndef __bts_math_sparse_cholesky_h__
+#define __bts_math_sparse_cholesky_h__
+
+#include <vector>
+
+#include "math/vector.h"
+#include "math/matrix.h"
+
+namespace FTS {
+    
+    namespace Math {
+        
+        class BlockSparse;
+        
+        /*! Cholesky decomposition of a sparse, symmetric positive definite matrix (such as the Fisher information of a set
+         * of fibres, where fibres only couple to the fibres they share voxels with). The rows and columns are reordered
+         * with a minimum degree ordering to limit the fill-in of the factor, so that
+         *
+         *      P A P' = L L'
+         *
+         * where L is stored in compressed columns. The ordering and the pattern of L are only recalculated when the
+         * pattern of nonzero elements of the decomposed matrix changes, so decomposing a series of matrices with the same
+         * pattern (e.g. successive Newton steps) only pays for the numerical factorisation. When decomposing a BlockSparse
+         * matrix the pattern is that of its stored blocks, so the dense matrix is never formed.
+         */
+        class SparseCholesky {
+                
+            public:
+                
+                SparseCholesky()
+                        : dim(0) {
+                }
+                
+                //! Decomposes A, which is read from its lower triangle. Throws if A isn't positive definite.
+                SparseCholesky& decomp(const MR::Math::Matrix<double>& A);
+                
+                //! Decomposes A, which is read from the stored blocks in its lower triangle (including the diagonal blocks).
+                SparseCholesky& decomp(const BlockSparse& A);
+                
+                //! Solves A x = b.
+                MR::Math::Vector<double>& solve(MR::Math::Vector<double>& x,
+                                                const MR::Math::Vector<double>& b) const;
+                
+                //! Calculates y = P' L x, which is normally distributed with covariance A if x is standard normal.
+                MR::Math::Vector<double>& lower_mult(MR::Math::Vector<double>& y,
+                                                     const MR::Math::Vector<double>& x) const;
+                
+                //! Fills 'A_inv' with the inverse of A, one sparse solve per column.
+                MR::Math::Matrix<double>& inverse(MR::Math::Matrix<double>& A_inv) const;
+                
+                //! Returns the log of the determinant of A.
+                double log_det() const;
+                
+                size_t size() const {
+                    return dim;
+                }
+                
+                //! The number of nonzero elements in L (including the diagonal).
+                size_t num_nonzero() const {
+                    return values.size();
+                }
+                
+            protected:
+                
+                // Finds the minimum degree ordering and the pattern of L from the pattern of A.
+                void analyse();
+                
+                // Factorises the matrix held in 'diag_values' and 'lower_values', whose strictly lower pattern is given by
+                // 'starts' and 'rows' (which are swapped into 'pattern_starts' and 'pattern_rows' if the pattern changed).
+                SparseCholesky& factorise(size_t new_dim, std::vector<size_t>& starts, std::vector<size_t>& rows);
+                
+                // Solves L y = x and L' y = x in place for a vector in the reordered basis.
+                void lower_solve(std::vector<double>& x) const;
+                
+                void upper_solve(std::vector<double>& x) const;
+                
+            protected:
+                
+                size_t dim;
+                
+                // The pattern of the strictly lower triangle of the last decomposed matrix (in its original order), stored in
+                // compressed columns, used to detect when the analysis needs to be redone.
+                std::vector<size_t> pattern_starts;
+                std::vector<size_t> pattern_rows;
+                
+                // The diagonal and the strictly lower elements (matching 'pattern_rows') of the matrix being decomposed.
+                std::vector<double> diag_values;
+                std::vector<double> lower_values;
+                
+                // The strictly lower pattern of A by row, as the column and the position in 'lower_values' of each element,
+                // which gives the elements above the diagonal in each column of A.
+                std::vector<size_t> transpose_starts;
+                std::vector<size_t> transpose_cols;
+                std::vector<size_t> transpose_positions;
+                
+                // 'order[k]' is the original index of the k-th row/column of L.
+                std::vector<size_t> order;
+                
+                // 'positions[i]' is the row/column of L that original index i is moved to.
+                std::vector<size_t> positions;
+                
+                // L in compressed columns (in the reordered basis), with the diagonal element first in each column and the
+                // remaining rows in ascending order.
+                std::vector<size_t> col_starts;
+                std::vector<size_t> row_indices;
+                std::vector<double> values;
+                
+                // For each row of L, the positions in 'values' of its off-diagonal elements (in ascending column order) and
+                // the columns they belong to.
+                std::vector<size_t> row_starts;
+                std::vector<size_t> row_positions;
+                std::vector<size_t> row_cols;
+                
+        };
+    
+    }
+
+}
+
+#endif
@@ -46,6 +46,26 @@ namespace FTS {
             t += t_inc;
             
         }
+        
+        std::vector<double> Annealer::ladder(size_t num_rungs, double hottest_factor) {
+            
+            if (!num_rungs)
+                throw Exception("Number of rungs in annealing ladder must be at least one.");
+            
+            if (hottest_factor <= 0.0 || hottest_factor > 1.0)
+                throw Exception(
+                        "Hottest annealing factor (" + str(hottest_factor)
+                        + ") must be in the range (0, 1].");
+            
+            std::vector<double> factors(num_rungs, 1.0);
+            
+            for (size_t rung_i = 1; rung_i < num_rungs; ++rung_i)
+                factors[rung_i] = MR::Math::exp(
+                        MR::Math::log(hottest_factor) * (double) rung_i / (double) (num_rungs - 1));
+            
+            return factors;
+            
+        }
     
     }
 
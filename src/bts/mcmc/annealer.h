@@ -23,6 +23,8 @@
 #ifndef __bts_mcmc_annealer_h__
 #define __bts_mcmc_annealer_h__
 
+#include <vector>
+
 #include "bts/common.h"
 
 namespace FTS {
@@ -50,6 +52,10 @@ namespace FTS {
                 double factor() const;
 
                 void increment();
+
+                //! Returns a geometric ladder of (fixed) annealing factors, from 1.0 for the first rung down to
+                //! 'hottest_factor' for the last, for use in replica exchange (see MCMC::tempering).
+                static std::vector<double> ladder(size_t num_rungs, double hottest_factor);
                 
         };
     
@@ -0,0 +1,211 @@
+/*
+ Copyright 2008 Brain Research Institute, Melbourne, Australia
+
+ Written by Thomas G Close, 24/01/2011.
+
+ This file is part of MRtrix.
+
+ MRtrix is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ MRtrix is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with MRtrix.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <cmath>
+#include <limits>
+
+#include "bts/mcmc/diagnostics.h"
+
+namespace FTS {
+    
+    namespace MCMC {
+        
+        namespace Diagnostics {
+            
+            namespace {
+                
+                // Splits each trace into its first and second halves (dropping the middle sample of odd-length traces)
+                // and returns the length of the halves.
+                size_t split_traces(const std::vector<std::vector<double> >& traces,
+                                    std::vector<std::vector<double> >& split) {
+                    
+                    if (!traces.size())
+                        throw Exception("At least one trace is required for the convergence diagnostics.");
+                    
+                    size_t half_length = traces[0].size() / 2;
+                    
+                    for (size_t chain_i = 1; chain_i < traces.size(); ++chain_i)
+                        if (traces[chain_i].size() / 2 != half_length)
+                            throw Exception(
+                                    "Length of trace " + str(chain_i) + " (" + str(traces[chain_i].size())
+                                    + ") does not match the first trace (" + str(traces[0].size()) + ").");
+                    
+                    split.clear();
+                    
+                    for (size_t chain_i = 0; chain_i < traces.size(); ++chain_i) {
+                        const std::vector<double>& trace = traces[chain_i];
+                        split.push_back(
+                                std::vector<double>(trace.begin(), trace.begin() + half_length));
+                        split.push_back(std::vector<double>(trace.end() - half_length, trace.end()));
+                    }
+                    
+                    return half_length;
+                    
+                }
+                
+                // The within-chain variance (W) and the pooled estimate of the marginal posterior variance (var+) of the
+                // split chains, along with the mean of each chain.
+                void variances(const std::vector<std::vector<double> >& split, size_t length,
+                               std::vector<double>& means, double& within, double& var_plus) {
+                    
+                    size_t num_chains = split.size();
+                    
+                    means.resize(num_chains);
+                    
+                    within = 0.0;
+                    
+                    double overall_mean = 0.0;
+                    
+                    for (size_t chain_i = 0; chain_i < num_chains; ++chain_i) {
+                        
+                        double mean = 0.0;
+                        for (size_t sample_i = 0; sample_i < length; ++sample_i)
+                            mean += split[chain_i][sample_i];
+                        mean /= (double) length;
+                        
+                        double sum_sq = 0.0;
+                        for (size_t sample_i = 0; sample_i < length; ++sample_i)
+                            sum_sq += MR::Math::pow2(split[chain_i][sample_i] - mean);
+                        
+                        within += sum_sq / (double) (length - 1);
+                        
+                        means[chain_i] = mean;
+                        overall_mean += mean;
+                        
+                    }
+                    
+                    within /= (double) num_chains;
+                    overall_mean /= (double) num_chains;
+                    
+                    // The between-chain variance divided by the chain length (B / n).
+                    double between = 0.0;
+                    for (size_t chain_i = 0; chain_i < num_chains; ++chain_i)
+                        between += MR::Math::pow2(means[chain_i] - overall_mean);
+                    between /= (double) (num_chains - 1);
+                    
+                    var_plus = (double) (length - 1) / (double) length * within + between;
+                    
+                }
+            
+                // The autocorrelation of the split chains at the given lag, combined over the chains.
+                double autocorrelation(const std::vector<std::vector<double> >& split,
+                                       const std::vector<double>& means, size_t length, size_t lag,
+                                       double within, double var_plus) {
+                    
+                    double autocov = 0.0;
+                    
+                    for (size_t chain_i = 0; chain_i < split.size(); ++chain_i)
+                        for (size_t sample_i = 0; sample_i + lag < length; ++sample_i)
+                            autocov += (split[chain_i][sample_i] - means[chain_i])
+                                    * (split[chain_i][sample_i + lag] - means[chain_i]);
+                    
+                    autocov /= (double) (split.size() * length);
+                    
+                    return 1.0 - (within - autocov) / var_plus;
+                    
+                }
+            
+            }
+            
+            double split_rhat(const std::vector<std::vector<double> >& traces) {
+                
+                std::vector<std::vector<double> > split;
+                
+                size_t length = split_traces(traces, split);
+                
+                if (length < 2)
+                    return std::numeric_limits<double>::infinity();
+                
+                std::vector<double> means;
+                double within, var_plus;
+                
+                variances(split, length, means, within, var_plus);
+                
+                // Chains that are constant haven't explored the distribution, whether or not they agree with each other.
+                if (!within)
+                    return std::numeric_limits<double>::infinity();
+                
+                return MR::Math::sqrt(var_plus / within);
+                
+            }
+            
+            double effective_sample_size(const std::vector<std::vector<double> >& traces) {
+                
+                std::vector<std::vector<double> > split;
+                
+                size_t length = split_traces(traces, split);
+                
+                if (length < 4)
+                    return 0.0;
+                
+                size_t num_chains = split.size();
+                
+                std::vector<double> means;
+                double within, var_plus;
+                
+                variances(split, length, means, within, var_plus);
+                
+                // Chains that are all stuck at the same value give no information about the distribution.
+                if (!var_plus)
+                    return 0.0;
+                
+                // Sum the autocorrelations in pairs (rho[2k] + rho[2k+1]) while they remain positive, keeping the pair
+                // sums monotonically decreasing (Geyer, 1992). The lag 0 autocorrelation is 1 by definition.
+                double pair_sum = 1.0
+                        + autocorrelation(split, means, length, 1, within, var_plus);
+                double prev_pair_sum = pair_sum;
+                double sum = 0.0;
+                
+                for (size_t lag = 2; pair_sum > 0.0; lag += 2) {
+                    
+                    sum += pair_sum;
+                    
+                    if (lag + 1 >= length)
+                        break;
+                    
+                    pair_sum = autocorrelation(split, means, length, lag, within, var_plus)
+                            + autocorrelation(split, means, length, lag + 1, within, var_plus);
+                    
+                    if (pair_sum > prev_pair_sum)
+                        pair_sum = prev_pair_sum;
+                    
+                    prev_pair_sum = pair_sum;
+                    
+                }
+                
+                double tau = -1.0 + 2.0 * sum;
+                
+                // Antithetic chains can give tau < 1, which is bounded to avoid an implausibly large sample size.
+                double min_tau = 1.0 / std::log10((double) (num_chains * length));
+                
+                if (tau < min_tau)
+                    tau = min_tau;
+                
+                return (double) (num_chains * length) / tau;
+                
+            }
+        
+        }
+    
+    }
+
+}
@@ -0,0 +1,53 @@
+/*
+ Copyright 2008 Brain Research Institute, Melbourne, Australia
+
+ Written by Thomas G Close, 24/01/2011.
+
+ This file is part of MRtrix.
+
+ MRtrix is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ MRtrix is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with MRtrix.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef __bts_mcmc_diagnostics_h__
+#define __bts_mcmc_diagnostics_h__
+
+#include <vector>
+
+#include "bts/common.h"
+
+namespace FTS {
+    
+    namespace MCMC {
+        
+        // Convergence diagnostics calculated from the traces of a scalar quantity (e.g. the log probability) over
+        // several chains. Each chain is split in half, so that chains that are still drifting are detected as well as
+        // chains that disagree with each other (Gelman et al., Bayesian Data Analysis, 3rd ed., section 11.4-11.5).
+        namespace Diagnostics {
+            
+            //! The potential scale reduction factor of the split chains, which approaches 1.0 as the chains converge.
+            //! Returns infinity if the chains are constant, even if they are all stuck at the same value.
+            double split_rhat(const std::vector<std::vector<double> >& traces);
+
+            //! The effective sample size of the split chains, using Geyer's initial monotone sequence to truncate the
+            //! sum of the autocorrelations. Returns 0 if all the chains are stuck at the same value.
+            double effective_sample_size(const std::vector<std::vector<double> >& traces);
+        
+        }
+    
+    }
+
+}
+
+#endif /* __bts_mcmc_diagnostics_h__ */
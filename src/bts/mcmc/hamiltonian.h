@@ -33,6 +33,7 @@ extern "C" {
 #include "progressbar.h"
 
 #include "bts/mcmc/common.h"
+#include "bts/mcmc/timing.h"
 
 #include "bts/common.h"
 
@@ -67,6 +68,8 @@ namespace FTS {
 //      sample_header.push_back("likelihood");
 //      sample_header.push_back("prior");
             
+            Timing::append_keys(sample_header);
+            
             std::vector<std::string> components_list = prior.list_components();
             
             sample_header.insert(sample_header.end(), components_list.begin(),
@@ -149,6 +152,9 @@ namespace FTS {
             
             size_t iteration_count = 0;
             
+            Timing timing;
+            timing.start(likelihood);
+            
             // Initialise the progress bar
             MR::ProgressBar progress_bar(
                     "Generating " + str(num_samples) + " Hamiltonian MCMC samples ...",
@@ -168,7 +174,7 @@ namespace FTS {
                 
                 double H = log_kinetic_energy - px;
                 
-                clock_t sample_starttime = clock();
+                double sample_starttime = Utilities::monotonic_seconds();
                 
                 State prop_x = x;
                 State prop_gradient = gradient;
@@ -189,8 +195,8 @@ namespace FTS {
                             
                     if (save_iterations) {
                         
-                        prop_x.set_extend_prop("pred_d_log_px",
-                                str(momentum.predicted_change(prop_gradient)));
+                        prop_x.set_extend_prop_number("pred_d_log_px",
+                                momentum.predicted_change(prop_gradient));
 //            prop_x.set_extend_prop("curv_pred_d_log_px"] = str(momentum.predicted_change(curv_gradient));
 //            prop_x.set_extend_prop("end_pred_d_log_px"] = str(momentum.predicted_change(end_gradient));
 //            prop_x.set_extend_prop("all_pred_d_log_px"] = str(momentum.predicted_change(all_gradient));
@@ -202,23 +208,31 @@ namespace FTS {
                     
                     momentum.update_state(prop_x);    //prop_x += leapfrog_step_size * momentum;
                             
+                    timing.lap(Timing::PROPOSAL);
+                    
                     prop_px = prior.log_prob(prop_x, prior_gradient);
                     
-                    if (!prior_only)
+                    timing.lap(Timing::PRIOR);
+                    
+                    if (!prior_only) {
                         prop_px += likelihood.log_prob(prop_x, likelihood_gradient);
+                        timing.lap_likelihood(likelihood);
+                    }
                     
                     prop_gradient = prior_gradient + likelihood_gradient;
                     
                     // NB: Since we want to find maxima not minima the gradient of x is inverted when compared from the classical algorithm.
                     momentum.half_update_momentum(prop_gradient);    // momentum += prop_gradient * (leapfrog_step_size / 2.0);
                             
+                    timing.lap(Timing::PROPOSAL);
+                    
                     if (save_iterations) {
                         
-                        prop_x.set_extend_prop("log_px", str(prop_px));
-                        prop_x.set_extend_prop("act_d_log_px", str(prop_px - prev_prop_px));
-                        prop_x.set_extend_prop("grad_norm2", str(prop_gradient.norm2()));
-                        prop_x.set_extend_prop("log_kinetic_energy",
-                                str(momentum.log_kinetic_energy()));
+                        prop_x.set_extend_prop_number("log_px", prop_px);
+                        prop_x.set_extend_prop_number("act_d_log_px", prop_px - prev_prop_px);
+                        prop_x.set_extend_prop_number("grad_norm2", prop_gradient.norm2());
+                        prop_x.set_extend_prop_number("log_kinetic_energy",
+                                momentum.log_kinetic_energy());
 //            iteration_gradients.append(prop_gradient);
 //            iteration_likelihood_gradients.append(likelihood_gradient);
 //            iteration_prior_gradients.append(prior_gradient);
@@ -246,10 +260,12 @@ namespace FTS {
                         for (std::map<std::string, double>::iterator comp_it =
                                 prop_component_values.begin();
                                 comp_it != prop_component_values.end(); ++comp_it)
-                            prop_x.set_extend_prop(comp_it->first, str(comp_it->second));
+                            prop_x.set_extend_prop_number(comp_it->first, comp_it->second);
                         
                         iterations.append(prop_x);
                         
+                        timing.lap(Timing::WRITE);
+                        
                     }
                     ++iteration_count;
                 }
@@ -266,8 +282,7 @@ namespace FTS {
                 // NB: Since we want to find maxima not minima the order of this subtraction is reversed.
                 double dH = prop_H - H;
                 
-                double elapsed_time = (double) (clock() - sample_starttime)
-                        / (double) CLOCKS_PER_SEC;
+                double elapsed_time = Utilities::monotonic_seconds() - sample_starttime;
                 
                 // Print out sample properties.
                 if (!suppress_print) {
@@ -287,7 +302,9 @@ namespace FTS {
                 
                 // If Hamiltonian decreases (i.e. there is less energy in the system) or the increase is below log[Y] (where Y is a uniformly distributed random variable between 0 and 1), accept the proposer.
                 
-                if ((dH < 0) || (log(gsl_ran_flat(rand_gen, 0, 1)) < -dH)) {
+                bool accept = (dH < 0) || (log(gsl_ran_flat(rand_gen, 0, 1)) < -dH);
+                
+                if (accept) {
                     x = prop_x;
                     gradient = prop_gradient;
                     px = prop_px;
@@ -296,12 +313,16 @@ namespace FTS {
                 } else if (!suppress_print)
                     std::cout << ", Not accepted." << std::endl;
                 
+                // Each trajectory counts as a single iteration.
+                timing.count_iteration(accept);
+                timing.lap(Timing::PROPOSAL);
+                
                 // Record sample stats.
                 
-                x.set_extend_prop(LOG_PROB_PROP, str(px));
+                x.set_extend_prop_number(LOG_PROB_PROP, px);
 //        x.set_extend_prop(ELAPSED_TIME_PROP] = str(elapsed_time);
-                x.set_extend_prop(H_PROP, str(H));
-                x.set_extend_prop(PROPOSED_H_PROP, str(prop_H));
+                x.set_extend_prop_number(H_PROP, H);
+                x.set_extend_prop_number(PROPOSED_H_PROP, prop_H);
 //        x.set_extend_prop("likelihood"]          = str(likelihood_log_px);
 //        x.set_extend_prop("prior"]               = str(prior_px);
 //        x.set_extend_prop("total_signal"]        = str(total_signal);
@@ -310,15 +331,25 @@ namespace FTS {
                 
                 for (std::map<std::string, double>::iterator comp_it = component_values.begin();
                         comp_it != component_values.end(); ++comp_it)
-                    prop_x.set_extend_prop(comp_it->first, str(comp_it->second));
+                    prop_x.set_extend_prop_number(comp_it->first, comp_it->second);
+                
+                // The time taken to save the sample is recorded with the next one.
+                timing.lap(Timing::WRITE);
+                timing.set_props(x);
+                timing.next_sample();
                 
                 // Save sample.
                 samples.append(x);
                 
+                timing.lap(Timing::WRITE);
+                
                 progress_bar++;
                 
             }
             
+            if (!suppress_print)
+                timing.print_summary(std::cout);
+            
             State out_x = x;
             
             return out_x;
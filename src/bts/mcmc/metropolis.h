@@ -36,6 +36,7 @@ extern "C" {
 #include "bts/mcmc/common.h"
 
 #include "bts/mcmc/annealer.h"
+#include "bts/mcmc/timing.h"
 
 #include "bts/image/expected/buffer.h"
 
@@ -55,6 +56,38 @@ namespace FTS {
             const double BURN_SNR_DEFAULT = 20;
             const double ANNEAL_FRAC_START_DEFAULT = 1.0;    //0.05;
             
+            // Returns the index of the only fibre that differs between the two sets, or -1 if no fibres or more than one
+            // fibre differ or the base intensity has changed (in which case the whole expected image is affected).
+            template<typename State> int single_changed_fibre(const State& x, const State& prop_x) {
+                
+                if (x.size() != prop_x.size() || x.base_intensity() != prop_x.base_intensity())
+                    return -1;
+                
+                int changed_i = -1;
+                
+                for (size_t fibre_i = 0; fibre_i < x.size(); ++fibre_i) {
+                    
+                    const typename State::Element fibre = x[fibre_i];
+                    const typename State::Element prop_fibre = prop_x[fibre_i];
+                    
+                    for (size_t elem_i = 0; elem_i < fibre.vsize(); ++elem_i)
+                        if (fibre.MR::Math::Vector<double>::operator[](elem_i)
+                                != prop_fibre.MR::Math::Vector<double>::operator[](elem_i)) {
+                            
+                            if (changed_i != -1)
+                                return -1;
+                            
+                            changed_i = fibre_i;
+                            break;
+                            
+                        }
+                    
+                }
+                
+                return changed_i;
+                
+            }
+            
         }
         
         template<typename State, typename Likelihood, typename Prior> State metropolis(
@@ -62,7 +95,8 @@ namespace FTS {
                 typename State::Walker& walker, const std::string& samples_location,
                 const std::map<std::string, std::string>& run_properties, size_t num_iterations,
                 size_t sample_period, gsl_rng* rand_gen, double anneal_frac_start = 1.0,
-                bool prior_only = false, bool verbose = true, bool save_images = false) {
+                bool prior_only = false, bool verbose = true, bool save_images = false,
+                bool delta_likelihood = false) {
             
             if (save_images)
                 likelihood.get_observed_image().save(samples_location + ".obs.mif");
@@ -82,6 +116,8 @@ namespace FTS {
             sample_header.push_back("likelihood");
             sample_header.push_back("prior");
             
+            Timing::append_keys(sample_header);
+            
             std::vector<std::string> elem_header;
             
             State::append_characteristic_keys(elem_header);
@@ -136,6 +172,17 @@ namespace FTS {
             
             double px = likelihood_px * annealer.factor() + prior_px;
             
+            // Whether the expected image held by the likelihood matches the current state, which is required before the
+            // likelihood of single fibre proposals can be evaluated incrementally.
+            bool image_is_current = true;
+            
+            // Block-wise walkers report which fibre they perturbed, so the prior and likelihood can be updated
+            // incrementally without comparing the states.
+            bool incremental = delta_likelihood || walker.is_blockwise();
+            
+            Timing timing;
+            timing.start(likelihood);
+            
             //-------------------------//
             //  Take the MCMC samples  //
             //-------------------------//
@@ -151,23 +198,53 @@ namespace FTS {
                 
                 size_t accepted = 0;
                 
-                clock_t sample_starttime = clock();
+                double sample_starttime = Utilities::monotonic_seconds();
                 
                 for (size_t iteration_i = 0; iteration_i < sample_period; iteration_i++) {
                     
                     // Draw a new sample from the proposal distribution centred on the current state.
                     walker.step(x, prop_x, 1.0 / MR::Math::sqrt(annealer.factor()));
                     
+                    int changed_i = walker.changed_fibre();
+                    
+                    if (changed_i == -1 && delta_likelihood)
+                        changed_i = Metropolis::single_changed_fibre(x, prop_x);
+                    
+                    timing.lap(Timing::PROPOSAL);
+                    
                     //Calculate the unnormalised probability of the stepd state.
-                    double prop_prior_px = prior.log_prob(prop_x);
+                    double prop_prior_px;
+                    
+                    if (changed_i != -1)
+                        prop_prior_px = prior_px + prior.log_prob_delta(x, prop_x, changed_i);
+                    else
+                        prop_prior_px = prior.log_prob(prop_x);
+                    
+                    timing.lap(Timing::PRIOR);
                     
                     double prop_likelihood_px;
                     
                     if (prior_only)
                         prop_likelihood_px = 0;
-                    else
+                    else if (changed_i != -1) {
+                        
+                        if (!image_is_current) {
+                            likelihood_px = likelihood.log_prob(x);
+                            image_is_current = true;
+                        }
+                        
+                        // Only the contribution of the changed fibre is updated in the expected image.
+                        prop_likelihood_px = likelihood_px
+                                + likelihood.log_prob_delta(x, prop_x, changed_i);
+                        
+                    } else
                         prop_likelihood_px = likelihood.log_prob(prop_x);
                     
+                    if (prior_only)
+                        timing.lap(Timing::LIKELIHOOD);
+                    else
+                        timing.lap_likelihood(likelihood);
+                    
                     double prop_px = prop_likelihood_px * annealer.factor() + prop_prior_px;
                     
 //          prop_x.set_extend_prop(LOG_PROB_PROP] = str(prop_px);
@@ -189,7 +266,9 @@ namespace FTS {
 //          prop_x.save("/home/tclose/data/tmp.tct");
                     
                     //If the ratio is greater than a uniform value between 0 and 1 then accept the stepd step.
-                    if ((a > 0) || log(gsl_ran_flat(rand_gen, 0.0, 1.0)) <= a) {
+                    bool accept = (a > 0) || log(gsl_ran_flat(rand_gen, 0.0, 1.0)) <= a;
+                    
+                    if (accept) {
                         
                         // Accept the stepd tractlets
                         x = prop_x;
@@ -201,18 +280,41 @@ namespace FTS {
                         
                         accepted++;
                         
-                    }
+                        image_is_current = true;
+                        
+                    } else if (changed_i != -1 && !prior_only)
+                        likelihood.revert_delta();
+                    else
+                        image_is_current = false;
+                    
+                    // Only has an effect if the walker is learning its step sizes (i.e. during the burn-in).
+                    walker.adapt(x, accept);
                     
                     annealer.increment();
                     
                     px = likelihood_px * annealer.factor() + prior_px;
                     
+                    timing.count_iteration(accept);
+                    timing.lap(Timing::PROPOSAL);
+                    
+                }
+                
+                // Refresh the likelihood and prior with full evaluations so that round-off errors from the incremental
+                // updates don't accumulate between samples.
+                if (incremental) {
+                    if (!prior_only) {
+                        likelihood_px = likelihood.log_prob(x);
+                        image_is_current = true;
+                        timing.lap_likelihood(likelihood);
+                    }
+                    prior_px = prior.log_prob(x);
+                    px = likelihood_px * annealer.factor() + prior_px;
+                    timing.lap(Timing::PRIOR);
                 }
                 
                 // Calculate stats about the current sample
                 double acceptance_ratio = ((double) accepted) / (double) sample_period;
-                double elapsed_time = (double) (clock() - sample_starttime)
-                        / (double) CLOCKS_PER_SEC;
+                double elapsed_time = Utilities::monotonic_seconds() - sample_starttime;
                 
                 std::vector<double> areas = x[0].cross_sectional_areas(100);
                 std::vector<double> densities(100);
@@ -220,10 +322,10 @@ namespace FTS {
                     densities[i] = areas[i] / x[0].acs();
                 
                 // Record sample stats.
-                x.set_extend_prop(ANNEAL_LOG_PROB_PROP, str(likelihood_px + prior_px));
-                x.set_extend_prop(LOG_PROB_PROP, str(px));
-                x.set_extend_prop(ACCEPTANCE_RATIO_PROP, str(acceptance_ratio));
-                x.set_extend_prop(ELAPSED_TIME_PROP, str(elapsed_time));
+                x.set_extend_prop_number(ANNEAL_LOG_PROB_PROP, likelihood_px + prior_px);
+                x.set_extend_prop_number(LOG_PROB_PROP, px);
+                x.set_extend_prop_number(ACCEPTANCE_RATIO_PROP, acceptance_ratio);
+                x.set_extend_prop_number(ELAPSED_TIME_PROP, elapsed_time);
                 x.set_extend_prop("densities", str(densities));
                 
 #ifndef TEST_BED
@@ -239,8 +341,8 @@ namespace FTS {
                 
                 State dummy_gradient = x;
                 
-                x.set_extend_prop("likelihood", str(likelihood_px));
-                x.set_extend_prop("prior", str(prior_px));
+                x.set_extend_prop_number("likelihood", likelihood_px);
+                x.set_extend_prop_number("prior", prior_px);
                 
 #ifndef TEST_BED
 //        x.set_extend_prop("total_signal"]     = str(total_signal);
@@ -250,7 +352,7 @@ namespace FTS {
                 
                 for (std::map<std::string, double>::iterator comp_it = component_values.begin();
                         comp_it != component_values.end(); ++comp_it)
-                    x.set_extend_prop(comp_it->first, str(comp_it->second));
+                    x.set_extend_prop_number(comp_it->first, comp_it->second);
                 
 //        x.properties.insert(component_values.begin(), component_values.end());
                 
@@ -273,9 +375,16 @@ namespace FTS {
                 
                 x.set_characteristics();
                 
+                // The time taken to save the sample is recorded with the next one.
+                timing.lap(Timing::WRITE);
+                timing.set_props(x);
+                timing.next_sample();
+                
                 // Save sample.
                 samples.append(x);
                 
+                timing.lap(Timing::WRITE);
+                
                 // Print out sample properties.
                 if (verbose) {
                     std::cout << std::endl;
@@ -293,6 +402,9 @@ namespace FTS {
             
             //MR::ProgressBar::done();
             
+            if (verbose)
+                timing.print_summary(std::cout);
+            
             State x_return(x);
             
             return x_return;
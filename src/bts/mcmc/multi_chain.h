@@ -0,0 +1,311 @@
+/*
+ Copyright 2009 Brain Research Institute, Melbourne, Australia
+ 
+ Created by Tom Close on 13/03/09.
+ 
+ This file is part of Fourier Tract Sampling (FouTS).
+ 
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+ 
+ */
+
+#ifndef __bts_mcmc_multi_chain_h__
+#define __bts_mcmc_multi_chain_h__
+
+extern "C" {
+#include <gsl/gsl_rng.h>
+}
+
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include "progressbar.h"
+
+#include "bts/mcmc/common.h"
+
+#include "bts/mcmc/tempering.h"
+#include "bts/mcmc/diagnostics.h"
+
+#include "bts/common.h"
+#include "bts/file.h"
+#include "bts/utilities/timer.h"
+#include "bts/utilities/threads.h"
+
+namespace FTS {
+    
+    namespace MCMC {
+        
+        namespace MultiChain {
+            
+            const size_t NUM_CHAINS_DEFAULT = 1;
+            const double RHAT_TARGET_DEFAULT = 1.01;
+            const double ESS_TARGET_DEFAULT = 400;
+            const size_t DISPERSAL_STEPS_DEFAULT = 100;
+            
+            const std::string RHAT_PROP = "split_rhat";
+            const std::string ESS_PROP = "ess";
+            
+            //! The location the samples of the given chain are saved to, e.g. 'samples.chain2.tst' for 'samples.tst'.
+            inline std::string chain_location(const std::string& samples_location, size_t chain_i) {
+                return File::strip_extension(samples_location) + ".chain" + str(chain_i) + "."
+                       + File::extension(samples_location);
+            }
+        
+        }
+        
+        /*! Runs independent Metropolis-Hastings chains, each in its own thread, and saves the
+         * samples of each chain to MultiChain::chain_location(samples_location, chain_i). After every sample the split
+         * R-hat and effective sample size of each of the 'conv_keys' (any of the per-sample properties, e.g. 'log_px',
+         * 'likelihood' or a prior component) are calculated over the second half of the samples collected so far, and
+         * sampling stops early once the largest R-hat is below 'rhat_target' and the smallest ESS is above
+         * 'ess_target' (either test is skipped if its target is 0). The first chain starts from 'initial_x' and the others
+         * from 'dispersal_steps' steps of their own walkers away from it (rejecting steps the prior rules out), so that
+         * the chains are overdispersed and chains that never move aren't mistaken for converged ones. Only the objects written to during sampling (the
+         * likelihoods, which hold the expected images, the priors, walkers and random generators) are supplied per chain.
+         * If the likelihoods are copies of each other (see Prob::Likelihood::clone) they share the observed image and
+         * diffusion model. */
+        template<typename State, typename Likelihood, typename Prior> std::vector<State> multi_chain(
+                State& initial_x, std::vector<Likelihood*>& likelihoods,
+                std::vector<Prior*>& priors, std::vector<typename State::Walker*>& walkers,
+                std::vector<gsl_rng*>& rand_gens, const std::string& samples_location,
+                const std::map<std::string, std::string>& run_properties, size_t num_iterations,
+                size_t sample_period, double rhat_target, double ess_target,
+                const std::vector<std::string>& conv_keys,
+                size_t dispersal_steps = MultiChain::DISPERSAL_STEPS_DEFAULT, bool verbose = true) {
+            
+            // A chain is simply a replica that is run at an annealing factor of 1.0 and never swapped.
+            typedef Tempering::Replica<State, Likelihood, Prior> Chain;
+            
+            size_t num_chains = likelihoods.size();
+            
+            if (num_chains < 2)
+                throw Exception(
+                        "At least two chains are required to assess convergence (" + str(num_chains)
+                        + " supplied).");
+            
+            if (priors.size() != num_chains || walkers.size() != num_chains
+                    || rand_gens.size() != num_chains)
+                throw Exception(
+                        "Number of priors (" + str(priors.size()) + "), walkers (" + str(walkers.size())
+                        + ") and random generators (" + str(rand_gens.size())
+                        + ") must match the number of likelihoods (" + str(num_chains) + ").");
+            
+            std::vector<std::string> sample_header;
+            
+            sample_header.push_back(LOG_PROB_PROP);
+            sample_header.push_back(ACCEPTANCE_RATIO_PROP);
+            sample_header.push_back(ELAPSED_TIME_PROP);
+            sample_header.push_back(MultiChain::RHAT_PROP);
+            sample_header.push_back(MultiChain::ESS_PROP);
+            sample_header.push_back("likelihood");
+            sample_header.push_back("prior");
+            
+            std::vector<std::string> elem_header;
+            
+            State::append_characteristic_keys(elem_header);
+            
+            std::vector<std::string> components_list = priors[0]->list_components();
+            
+            sample_header.insert(sample_header.end(), components_list.begin(),
+                    components_list.end());
+            
+            for (size_t key_i = 0; key_i < conv_keys.size(); ++key_i)
+                if (conv_keys[key_i] == MultiChain::RHAT_PROP || conv_keys[key_i] == MultiChain::ESS_PROP
+                        || std::find(sample_header.begin(), sample_header.end(), conv_keys[key_i])
+                           == sample_header.end())
+                    throw Exception(
+                            "Unrecognised convergence key '" + conv_keys[key_i] + "', can be any of "
+                            + str(sample_header) + " apart from '" + MultiChain::RHAT_PROP
+                            + "' and '" + MultiChain::ESS_PROP + "'.");
+            
+            std::vector<typename State::Writer*> writers;
+            
+            for (size_t chain_i = 0; chain_i < num_chains; ++chain_i) {
+                std::map<std::string, std::string> chain_properties = run_properties;
+                chain_properties["chain"] = str(chain_i);
+                writers.push_back(
+                        new typename State::Writer(
+                                MultiChain::chain_location(samples_location, chain_i), initial_x,
+                                sample_header, elem_header, chain_properties));
+            }
+            
+            // The initial probabilities are calculated here, in a single thread, which also generates any matrices that
+            // are cached on first use.
+            std::vector<Chain> chains;
+            
+            for (size_t chain_i = 0; chain_i < num_chains; ++chain_i) {
+                
+                State start_x = initial_x;
+                
+                if (chain_i) {
+                    
+                    State prop_x = initial_x;
+                    
+                    for (size_t step_i = 0; step_i < dispersal_steps; ++step_i) {
+                        
+                        walkers[chain_i]->step(start_x, prop_x);
+                        
+                        double prop_prior_px = priors[chain_i]->log_prob(prop_x);
+                        
+                        if (!isnan(prop_prior_px) && !isinf(prop_prior_px))
+                            start_x = prop_x;
+                        
+                    }
+                    
+                }
+                
+                chains.push_back(
+                        Chain(start_x, likelihoods[chain_i], priors[chain_i], walkers[chain_i],
+                                rand_gens[chain_i], 1.0));
+                
+            }
+            
+            // The trace of each convergence key for each chain.
+            std::vector<std::vector<std::vector<double> > > traces(conv_keys.size(),
+                    std::vector<std::vector<double> >(num_chains));
+            
+            size_t num_samples = num_iterations / sample_period;
+            
+            // Initialise the progress bar
+            MR::ProgressBar progress_bar(
+                    "Generating up to " + str(num_samples) + " Metropolis-Hastings MCMC samples from "
+                    + str(num_chains) + " chains ...",
+                    num_samples);
+            
+            for (size_t sample_i = 0; sample_i < num_samples; sample_i++) {
+                
+                for (size_t chain_i = 0; chain_i < num_chains; ++chain_i) {
+                    chains[chain_i].accepted = 0;
+                    chains[chain_i].num_iterations = sample_period;
+                }
+                
+                double sample_starttime = Utilities::monotonic_seconds();
+                
+                // The first chain is stepped in the calling thread.
+                Utilities::run_in_threads(chains, Chain::run, "step the chains");
+                
+                double elapsed_time = Utilities::monotonic_seconds() - sample_starttime;
+                
+                std::vector<State> xs;
+                double mean_acceptance_ratio = 0.0;
+                
+                for (size_t chain_i = 0; chain_i < num_chains; ++chain_i) {
+                    
+                    Chain& chain = chains[chain_i];
+                    
+                    std::map<std::string, double> values = chain.prior->get_component_values(
+                            chain.x);
+                    
+                    values[LOG_PROB_PROP] = chain.log_prob();
+                    values[ACCEPTANCE_RATIO_PROP] = (double) chain.accepted / (double) sample_period;
+                    values[ELAPSED_TIME_PROP] = elapsed_time;
+                    values["likelihood"] = chain.likelihood_px;
+                    values["prior"] = chain.prior_px;
+                    
+                    for (size_t key_i = 0; key_i < conv_keys.size(); ++key_i)
+                        traces[key_i][chain_i].push_back(values[conv_keys[key_i]]);
+                    
+                    mean_acceptance_ratio += values[ACCEPTANCE_RATIO_PROP] / (double) num_chains;
+                    
+                    State x = chain.x;
+                    
+                    for (std::map<std::string, double>::iterator value_it = values.begin();
+                            value_it != values.end(); ++value_it)
+                        x.set_extend_prop_number(value_it->first, value_it->second);
+                    
+                    xs.push_back(x);
+                    
+                }
+                
+                // The first half of the samples collected so far are discarded as warm-up.
+                size_t num_collected = sample_i + 1;
+                size_t warmup = num_collected / 2;
+                
+                double max_rhat = 0.0;
+                double min_ess = std::numeric_limits<double>::infinity();
+                
+                for (size_t key_i = 0; key_i < conv_keys.size(); ++key_i) {
+                    
+                    std::vector<std::vector<double> > kept(num_chains);
+                    
+                    for (size_t chain_i = 0; chain_i < num_chains; ++chain_i)
+                        kept[chain_i].assign(traces[key_i][chain_i].begin() + warmup,
+                                traces[key_i][chain_i].end());
+                    
+                    max_rhat = std::max(max_rhat, Diagnostics::split_rhat(kept));
+                    min_ess = std::min(min_ess, Diagnostics::effective_sample_size(kept));
+                    
+                }
+                
+                for (size_t chain_i = 0; chain_i < num_chains; ++chain_i) {
+                    
+                    State& x = xs[chain_i];
+                    
+                    x.set_extend_prop_number(MultiChain::RHAT_PROP, max_rhat);
+                    x.set_extend_prop_number(MultiChain::ESS_PROP, min_ess);
+                    
+                    x.set_characteristics();
+                    
+                    // Save sample.
+                    writers[chain_i]->append(x);
+                    
+                }
+                
+                // Print out sample properties.
+                if (verbose) {
+                    std::cout << std::endl;
+                    std::cout << "Iteration: " << (sample_i + 1) * sample_period << "/"
+                              << num_iterations << ", ";
+                    std::cout << "max split R-hat: " << max_rhat << ", ";
+                    std::cout << "min ESS: " << min_ess << ", ";
+                    std::cout << "mean acceptance ratio: " << mean_acceptance_ratio << ", ";
+                    std::cout << "elapsed time: " << elapsed_time;
+                    std::cout << std::endl;
+                }
+                
+                progress_bar++;
+                
+                bool rhat_met = !rhat_target || max_rhat <= rhat_target;
+                bool ess_met = !ess_target || min_ess >= ess_target;
+                
+                if (conv_keys.size() && (rhat_target || ess_target) && rhat_met && ess_met) {
+                    
+                    if (verbose)
+                        std::cout << std::endl << "Convergence targets met after "
+                                  << (sample_i + 1) * sample_period << " iterations." << std::endl;
+                    
+                    break;
+                    
+                }
+                
+            }
+            
+            for (size_t chain_i = 0; chain_i < num_chains; ++chain_i)
+                delete writers[chain_i];
+            
+            std::vector<State> final_xs;
+            
+            for (size_t chain_i = 0; chain_i < num_chains; ++chain_i)
+                final_xs.push_back(chains[chain_i].x);
+            
+            return final_xs;
+            
+        }
+    
+    }
+
+}
+
+#endif
@@ -0,0 +1,474 @@
+/*
+ Copyright 2009 Brain Research Institute, Melbourne, Australia
+ 
+ Created by Tom Close on 13/03/09.
+ 
+ This file is part of Fourier Tract Sampling (FouTS).
+ 
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+ 
+ */
+
+#ifndef __bts_mcmc_nuts_h__
+#define __bts_mcmc_nuts_h__
+
+extern "C" {
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
+}
+
+#include <map>
+#include <algorithm>
+
+#include "progressbar.h"
+
+#include "bts/mcmc/common.h"
+#include "bts/mcmc/timing.h"
+#include "bts/mcmc/proposal/momentum.h"
+
+#include "bts/common.h"
+
+namespace FTS {
+    
+    namespace MCMC {
+        
+        namespace NUTS {
+            
+            const size_t MAX_TREE_DEPTH_DEFAULT = 10;
+            
+            // Trajectories are stopped when the Hamiltonian of a state rises by more than this (a divergence).
+            const double MAX_DELTA_H = 1000.0;
+            
+            const std::string TREE_DEPTH_PROP = "tree_depth";
+            const std::string NUM_LEAPFROG_STEPS_PROP = "num_leapfrog_steps";
+            const std::string STEP_SCALE_PROP = "step_scale";
+            const std::string ACCEPT_STAT_PROP = "accept_stat";
+            const std::string DIVERGENT_PROP = "divergent";
+            
+            // A state on a trajectory, along with its momentum and the log probability and gradient at it.
+            template<typename State> class Node {
+                
+                public:
+                    
+                    State x;
+                    State gradient;
+                    MR::Math::Vector<double> momen;
+                    double log_px;
+                    
+                public:
+                    
+                    // NB: Since we want to find maxima not minima the probability of x is inverted when compared from the
+                    // classical algorithm.
+                    double H() const {
+                        return MR::Math::norm2(momen) / 2.0 - log_px;
+                    }
+                    
+            };
+            
+            // The ends of a (sub)tree of the trajectory and the state drawn from it.
+            template<typename State> class Tree {
+                
+                public:
+                    
+                    Node<State> minus;
+                    Node<State> plus;
+                    Node<State> proposed;
+                    size_t num_valid;
+                    bool keep_going;
+                    bool divergent;
+                    double sum_accept_stat;
+                    size_t num_accept_stat;
+                    
+            };
+            
+            // Builds the binary trees of the No-U-Turn sampler (Hoffman and Gelman 2014, Alg. 6), keeping references to
+            // everything needed to take leapfrog steps.
+            template<typename State, typename Likelihood, typename Prior> class Trajectory {
+                
+                protected:
+                    
+                    Likelihood& likelihood;
+                    Prior& prior;
+                    Proposal::Momentum& momentum;
+                    gsl_rng* rand_gen;
+                    Timing& timing;
+                    bool prior_only;
+                    
+                    State prior_gradient;
+                    State likelihood_gradient;
+                    
+                public:
+                    
+                    // The log slice variable and the Hamiltonian at the start of the trajectory.
+                    double log_u;
+                    double start_H;
+                    size_t num_leapfrog_steps;
+                    
+                public:
+                    
+                    Trajectory(Likelihood& likelihood, Prior& prior, Proposal::Momentum& momentum,
+                               gsl_rng* rand_gen, Timing& timing, bool prior_only, const State& zero)
+                            : likelihood(likelihood), prior(prior), momentum(momentum), rand_gen(
+                                      rand_gen), timing(timing), prior_only(prior_only), prior_gradient(
+                                      zero), likelihood_gradient(zero), log_u(0.0), start_H(0.0), num_leapfrog_steps(
+                                      0) {
+                    }
+                    
+                    void evaluate(Node<State>& node) {
+                        
+                        node.log_px = prior.log_prob(node.x, prior_gradient);
+                        
+                        timing.lap(Timing::PRIOR);
+                        
+                        if (!prior_only) {
+                            node.log_px += likelihood.log_prob(node.x, likelihood_gradient);
+                            timing.lap_likelihood(likelihood);
+                        }
+                        
+                        node.gradient = prior_gradient + likelihood_gradient;
+                        
+                    }
+                    
+                    // NB: Since we want to find maxima not minima the gradient of x is inverted when compared from the
+                    // classical algorithm.
+                    void leapfrog(Node<State>& node, double direction) {
+                        
+                        momentum.set_momentum(node.momen);
+                        
+                        momentum.half_update_momentum(
+                                (const MR::Math::Vector<double>&) node.gradient, direction);
+                        momentum.update_state((MR::Math::Vector<double>&) node.x, direction);
+                        
+                        timing.lap(Timing::PROPOSAL);
+                        
+                        evaluate(node);
+                        
+                        momentum.half_update_momentum(
+                                (const MR::Math::Vector<double>&) node.gradient, direction);
+                                
+                        node.momen = momentum.momentum();
+                        
+                        timing.lap(Timing::PROPOSAL);
+                        
+                        ++num_leapfrog_steps;
+                        
+                    }
+                    
+                    // The trajectory stops when the ends start moving back towards each other, measured in the space
+                    // scaled by the step sizes, where the momentum is the velocity.
+                    bool no_u_turn(const Node<State>& minus, const Node<State>& plus) const {
+                        
+                        const MR::Math::Vector<double>& step = momentum.step_sizes();
+                        const MR::Math::Vector<double>& minus_x = minus.x;
+                        const MR::Math::Vector<double>& plus_x = plus.x;
+                        
+                        double minus_dot = 0.0, plus_dot = 0.0;
+                        
+                        for (size_t elem_i = 0; elem_i < step.size(); ++elem_i)
+                            if (step[elem_i]) {
+                                double span = (plus_x[elem_i] - minus_x[elem_i]) / step[elem_i];
+                                minus_dot += span * minus.momen[elem_i];
+                                plus_dot += span * plus.momen[elem_i];
+                            }
+                            
+                        return minus_dot >= 0.0 && plus_dot >= 0.0;
+                        
+                    }
+                    
+                    void build_tree(const Node<State>& start, double direction, size_t depth,
+                                    Tree<State>& tree) {
+                                    
+                        if (!depth) {
+                            
+                            tree.minus = start;
+                            
+                            leapfrog(tree.minus, direction);
+                            
+                            tree.plus = tree.minus;
+                            tree.proposed = tree.minus;
+                            
+                            double H = tree.minus.H();
+                            
+                            tree.num_valid = -H >= log_u;
+                            tree.divergent = -H < log_u - MAX_DELTA_H;
+                            tree.keep_going = !tree.divergent;
+                            tree.sum_accept_stat = std::min(1.0, MR::Math::exp(start_H - H));
+                            tree.num_accept_stat = 1;
+                            
+                            if (isnan(H)) {
+                                tree.num_valid = 0;
+                                tree.divergent = true;
+                                tree.keep_going = false;
+                                tree.sum_accept_stat = 0.0;
+                            }
+                            
+                            return;
+                            
+                        }
+                        
+                        build_tree(start, direction, depth - 1, tree);
+                        
+                        if (!tree.keep_going)
+                            return;
+                            
+                        Tree<State> second;
+                        
+                        build_tree(direction < 0 ? tree.minus : tree.plus, direction, depth - 1,
+                                second);
+                                
+                        if (direction < 0)
+                            tree.minus = second.minus;
+                        else
+                            tree.plus = second.plus;
+                            
+                        if (second.num_valid
+                                && gsl_rng_uniform(rand_gen) * (double) (tree.num_valid + second.num_valid)
+                                   < (double) second.num_valid)
+                            tree.proposed = second.proposed;
+                            
+                        tree.num_valid += second.num_valid;
+                        tree.sum_accept_stat += second.sum_accept_stat;
+                        tree.num_accept_stat += second.num_accept_stat;
+                        tree.divergent = second.divergent;
+                        tree.keep_going = second.keep_going && no_u_turn(tree.minus, tree.plus);
+                        
+                    }
+                    
+            };
+            
+        }
+        
+        // Hamiltonian MCMC with trajectories that are extended (by doubling) until they make a U-turn instead of a fixed
+        // number of leapfrog steps (the No-U-Turn sampler, Hoffman and Gelman 2014). If the momentum is adapting (see
+        // Proposal::Momentum::start_adaptation) a reasonable step scale is found before the first sample and the step
+        // sizes are adapted after each sample.
+        template<typename State, typename Likelihood, typename Prior> State nuts(
+                State& initial_x, Likelihood& likelihood, Prior& prior,
+                MCMC::Proposal::Momentum& momentum, const std::string& samples_location,
+                const std::map<std::string, std::string>& run_properties, size_t num_samples,
+                size_t max_tree_depth, gsl_rng* rand_gen, bool prior_only = false,
+                bool suppress_print = false) {
+                
+            std::vector<std::string> sample_header;
+            
+            sample_header.push_back(LOG_PROB_PROP);
+            sample_header.push_back(H_PROP);
+            sample_header.push_back(NUTS::TREE_DEPTH_PROP);
+            sample_header.push_back(NUTS::NUM_LEAPFROG_STEPS_PROP);
+            sample_header.push_back(NUTS::STEP_SCALE_PROP);
+            sample_header.push_back(NUTS::ACCEPT_STAT_PROP);
+            sample_header.push_back(NUTS::DIVERGENT_PROP);
+            
+            Timing::append_keys(sample_header);
+            
+            std::vector<std::string> components_list = prior.list_components();
+            
+            sample_header.insert(sample_header.end(), components_list.begin(),
+                    components_list.end());
+                    
+            typename State::Writer samples(samples_location, initial_x, sample_header,
+                    run_properties);
+                    
+            State zero = initial_x;
+            zero.zero();
+            
+            Timing timing;
+            
+            NUTS::Trajectory<State, Likelihood, Prior> trajectory(likelihood, prior, momentum,
+                    rand_gen, timing, prior_only, zero);
+                    
+            NUTS::Node<State> current;
+            
+            current.x = initial_x;
+            current.gradient = zero;
+            
+            trajectory.evaluate(current);
+            
+            // Find a step scale for which a single leapfrog step has an acceptance probability of about a half
+            // (Hoffman and Gelman 2014, Alg. 4), which the dual averaging then starts from.
+            if (momentum.is_adapting()) {
+                
+                double step_scale = momentum.get_step_scale();
+                
+                momentum.randomize();
+                current.momen = momentum.momentum();
+                
+                NUTS::Node<State> stepped = current;
+                trajectory.leapfrog(stepped, 1.0);
+                
+                double delta_H = current.H() - stepped.H();
+                
+                double direction = (delta_H > -MR::Math::log(2.0)) ? 1.0 : -1.0;
+                
+                for (size_t halving_i = 0; halving_i < 100; ++halving_i) {
+                    
+                    if (isnan(delta_H) ? direction > 0 : direction * delta_H <= -direction * MR::Math::log(2.0))
+                        break;
+                        
+                    step_scale *= MR::Math::pow(2.0, direction);
+                    momentum.set_step_scale(step_scale);
+                    
+                    stepped = current;
+                    trajectory.leapfrog(stepped, 1.0);
+                    
+                    delta_H = current.H() - stepped.H();
+                    
+                }
+                
+                momentum.set_step_scale(step_scale);
+                
+                if (!suppress_print)
+                    std::cout << std::endl << "Initial step scale: " << step_scale << std::endl;
+                    
+            }
+            
+            //-------------------------//
+            //  Take the MCMC samples  //
+            //-------------------------//
+            
+            timing.start(likelihood);
+            
+            // Initialise the progress bar
+            MR::ProgressBar progress_bar(
+                    "Generating " + str(num_samples) + " No-U-Turn MCMC samples ...", num_samples);
+                    
+            for (size_t sample_i = 0; sample_i < num_samples; sample_i++) {
+                
+                double sample_starttime = Utilities::monotonic_seconds();
+                
+                momentum.randomize();
+                current.momen = momentum.momentum();
+                
+                trajectory.start_H = current.H();
+                trajectory.log_u = -trajectory.start_H + MR::Math::log(gsl_ran_flat(rand_gen, 0, 1));
+                trajectory.num_leapfrog_steps = 0;
+                
+                NUTS::Tree<State> tree;
+                
+                tree.minus = current;
+                tree.plus = current;
+                
+                size_t num_valid = 1;
+                bool keep_going = true;
+                bool divergent = false;
+                double sum_accept_stat = 0.0;
+                size_t num_accept_stat = 0;
+                size_t depth = 0;
+                
+                NUTS::Tree<State> subtree;
+                
+                while (keep_going && depth < max_tree_depth) {
+                    
+                    double direction = gsl_rng_uniform(rand_gen) < 0.5 ? -1.0 : 1.0;
+                    
+                    trajectory.build_tree(direction < 0 ? tree.minus : tree.plus, direction, depth,
+                            subtree);
+                            
+                    if (direction < 0)
+                        tree.minus = subtree.minus;
+                    else
+                        tree.plus = subtree.plus;
+                        
+                    if (subtree.keep_going && subtree.num_valid
+                            && gsl_rng_uniform(rand_gen) * (double) num_valid
+                               < (double) subtree.num_valid) {
+                        current.x = subtree.proposed.x;
+                        current.gradient = subtree.proposed.gradient;
+                        current.log_px = subtree.proposed.log_px;
+                    }
+                    
+                    num_valid += subtree.num_valid;
+                    keep_going = subtree.keep_going && trajectory.no_u_turn(tree.minus, tree.plus);
+                    divergent = subtree.divergent;
+                    sum_accept_stat += subtree.sum_accept_stat;
+                    num_accept_stat += subtree.num_accept_stat;
+                    
+                    ++depth;
+                    
+                }
+                
+                // The mean acceptance probability over all the states of the trajectory.
+                double accept_stat = num_accept_stat ? sum_accept_stat / (double) num_accept_stat : 0.0;
+                
+                momentum.adapt(accept_stat, current.x);
+                
+                double elapsed_time = Utilities::monotonic_seconds() - sample_starttime;
+                
+                // Print out sample properties.
+                if (!suppress_print) {
+                    std::cout << std::endl;
+                    std::cout << "Sample: " << sample_i << ", ";
+                    std::cout << "log[px]: " << current.log_px << ", ";
+                    std::cout << "Start H: " << trajectory.start_H << ", ";
+                    std::cout << "Tree depth: " << depth << ", ";
+                    std::cout << "Leapfrog steps: " << trajectory.num_leapfrog_steps << ", ";
+                    std::cout << "Step scale: " << momentum.get_step_scale() << ", ";
+                    std::cout << "Acceptance statistic: " << accept_stat << ", ";
+                    std::cout << "Elapsed time: " << elapsed_time;
+                    if (divergent)
+                        std::cout << ", Divergent!";
+                    std::cout << std::endl;
+                }
+                
+                // Each trajectory counts as a single iteration, which is 'accepted' if it moved.
+                timing.count_iteration(num_valid > 1);
+                timing.lap(Timing::PROPOSAL);
+                
+                // Record sample stats.
+                
+                State& x = current.x;
+                
+                x.set_extend_prop_number(LOG_PROB_PROP, current.log_px);
+                x.set_extend_prop_number(H_PROP, trajectory.start_H);
+                x.set_extend_prop_integer(NUTS::TREE_DEPTH_PROP, depth);
+                x.set_extend_prop_integer(NUTS::NUM_LEAPFROG_STEPS_PROP,
+                        trajectory.num_leapfrog_steps);
+                x.set_extend_prop_number(NUTS::STEP_SCALE_PROP, momentum.get_step_scale());
+                x.set_extend_prop_number(NUTS::ACCEPT_STAT_PROP, accept_stat);
+                x.set_extend_prop_integer(NUTS::DIVERGENT_PROP, divergent);
+                
+                std::map<std::string, double> component_values = prior.get_component_values(x);
+                
+                for (std::map<std::string, double>::iterator comp_it = component_values.begin();
+                        comp_it != component_values.end(); ++comp_it)
+                    x.set_extend_prop_number(comp_it->first, comp_it->second);
+                    
+                // The time taken to save the sample is recorded with the next one.
+                timing.lap(Timing::WRITE);
+                timing.set_props(x);
+                timing.next_sample();
+                
+                // Save sample.
+                samples.append(x);
+                
+                timing.lap(Timing::WRITE);
+                
+                progress_bar++;
+                
+            }
+            
+            if (!suppress_print)
+                timing.print_summary(std::cout);
+                
+            State out_x = current.x;
+            
+            return out_x;
+            
+        }
+        
+    }
+    
+}
+
+#endif
@@ -113,6 +113,12 @@ namespace FTS {
 
                     virtual Distribution* clone() const = 0;
 
+                    //! Draws an index uniformly from [0, num_indices), e.g. to select the block to perturb next.
+                    size_t sample_index(size_t num_indices) {
+                        return gsl_rng_uniform_int(rand_gen, num_indices);
+                    }
+                    
+
                     virtual ~Distribution() {
                     }
                     
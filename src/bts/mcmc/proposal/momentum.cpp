@@ -36,6 +36,15 @@ namespace FTS {
             const std::string Momentum::STEP_LOCATION_DEFAULT =
                     "/home/tclose/data/mcmc/hamiltonian/params/momentum/scaling.sta";
             
+            const double Momentum::ADAPT_TARGET_DEFAULT = 0.8;
+            const double Momentum::ADAPT_GAMMA = 0.05;
+            const double Momentum::ADAPT_T0 = 10.0;
+            const double Momentum::ADAPT_KAPPA = 0.75;
+            const double Momentum::ADAPT_INIT_BUFFER = 0.15;
+            const double Momentum::ADAPT_TERM_BUFFER = 0.1;
+            const size_t Momentum::ADAPT_BASE_WINDOW = 25;
+            const double Momentum::ADAPT_REGULARISATION = 0.001;
+            
             void Momentum::set(Distribution* const proposal_distribution,
                                MR::Math::Vector<double> relative_step) {
                 
@@ -77,6 +86,172 @@ namespace FTS {
                 
             }
             
+            void Momentum::set_step_scale(double step_scale) {
+                
+                if (!relative_step.size()) {
+                    relative_step = step;
+                    initial_relative_step = step;
+                }
+                
+                log_step_scale = MR::Math::log(step_scale);
+                
+                if (adapting)
+                    restart_step_scale_adaptation();
+                
+                apply_step_scale();
+                
+            }
+            
+            void Momentum::start_adaptation(double target_accept_stat, size_t num_iterations) {
+                
+                if (target_accept_stat <= 0.0 || target_accept_stat >= 1.0)
+                    throw Exception(
+                            "Target acceptance statistic (" + str(target_accept_stat)
+                            + ") needs to be between 0 and 1.");
+                
+                adapting = true;
+                adapt_target = target_accept_stat;
+                adapt_count = 0;
+                adapt_num_iterations = num_iterations;
+                
+                if (!relative_step.size()) {
+                    relative_step = step;
+                    initial_relative_step = step;
+                    log_step_scale = 0.0;
+                }
+                
+                restart_step_scale_adaptation();
+                
+                // Too short to estimate the relative step sizes, so only the step scale is adapted.
+                size_t init_buffer = ADAPT_INIT_BUFFER * num_iterations;
+                size_t term_buffer = ADAPT_TERM_BUFFER * num_iterations;
+                
+                window_size = std::min(ADAPT_BASE_WINDOW, num_iterations - init_buffer - term_buffer);
+                
+                if (num_iterations < 20 || !window_size)
+                    window_end = 0;
+                else
+                    window_end = init_buffer + window_size;
+                
+                window_count = 0;
+                
+                state_mean.resize(step.size());
+                state_mean = 0.0;
+                state_sum_sq.resize(step.size());
+                state_sum_sq = 0.0;
+                
+            }
+            
+            void Momentum::adapt(double accept_stat, const MR::Math::Vector<double>& state) {
+                
+                if (!adapting)
+                    return;
+                
+                if (state.size() != step.size())
+                    throw Exception(
+                            "Size of state (" + str(state.size())
+                            + ") does not match the step sizes being adapted (" + str(step.size())
+                            + ").");
+                
+                ++adapt_count;
+                
+                // Dual averaging of the log step scale (Hoffman and Gelman 2014, Alg. 5).
+                double m = (double) (adapt_count - adapt_restart);
+                
+                double eta = 1.0 / (m + ADAPT_T0);
+                
+                adapt_H_bar = (1.0 - eta) * adapt_H_bar + eta * (adapt_target - accept_stat);
+                
+                log_step_scale = adapt_mu - MR::Math::sqrt(m) / ADAPT_GAMMA * adapt_H_bar;
+                
+                double weight = MR::Math::pow(m, -ADAPT_KAPPA);
+                
+                log_step_scale_bar = weight * log_step_scale + (1.0 - weight) * log_step_scale_bar;
+                
+                // Running mean and sum of squared deviations of each parameter over the current window (Welford's
+                // algorithm).
+                if (window_end && adapt_count > window_end - window_size && adapt_count <= window_end) {
+                    
+                    ++window_count;
+                    
+                    for (size_t elem_i = 0; elem_i < state.size(); ++elem_i) {
+                        double delta = state[elem_i] - state_mean[elem_i];
+                        state_mean[elem_i] += delta / (double) window_count;
+                        state_sum_sq[elem_i] += delta * (state[elem_i] - state_mean[elem_i]);
+                    }
+                    
+                    if (adapt_count == window_end) {
+                        
+                        // The variances are shrunk towards the initial step sizes, which also keeps parameters that
+                        // don't move from collapsing. Parameters with zero initial step sizes stay fixed.
+                        double n = (double) window_count;
+                        
+                        for (size_t elem_i = 0; elem_i < state.size(); ++elem_i)
+                            if (initial_relative_step[elem_i])
+                                relative_step[elem_i] = MR::Math::sqrt(
+                                        (n / (n + 5.0)) * state_sum_sq[elem_i] / (n - 1.0)
+                                        + (5.0 / (n + 5.0)) * ADAPT_REGULARISATION
+                                          * MR::Math::pow2(initial_relative_step[elem_i]));
+                        
+                        state_mean = 0.0;
+                        state_sum_sq = 0.0;
+                        window_count = 0;
+                        
+                        // The next window doubles in size, and is extended to the start of the terminal buffer if the
+                        // one after it wouldn't fit.
+                        size_t slow_end = adapt_num_iterations
+                                - (size_t) (ADAPT_TERM_BUFFER * adapt_num_iterations);
+                        
+                        window_size *= 2;
+                        
+                        if (window_end + 3 * window_size > slow_end)
+                            window_size = slow_end > window_end ? slow_end - window_end : 0;
+                        
+                        window_end = window_size ? window_end + window_size : 0;
+                        
+                        restart_step_scale_adaptation();
+                        
+                    }
+                    
+                }
+                
+                apply_step_scale();
+                
+            }
+            
+            void Momentum::stop_adaptation() {
+                
+                if (!adapting)
+                    return;
+                
+                adapting = false;
+                
+                if (adapt_count)
+                    log_step_scale = log_step_scale_bar;
+                
+                apply_step_scale();
+                
+            }
+            
+            void Momentum::restart_step_scale_adaptation() {
+                
+                // Bias the dual averaging towards larger step scales than the current one.
+                adapt_mu = log_step_scale + MR::Math::log(10.0);
+                adapt_H_bar = 0.0;
+                log_step_scale_bar = log_step_scale;
+                adapt_restart = adapt_count;
+                
+            }
+            
+            void Momentum::apply_step_scale() {
+                
+                double step_scale = MR::Math::exp(log_step_scale);
+                
+                for (size_t elem_i = 0; elem_i < step.size(); ++elem_i)
+                    step[elem_i] = step_scale * relative_step[elem_i];
+                
+            }
+            
             double Momentum::predicted_change(const MR::Math::Vector<double>& gradient,
                                               double time_direction) const {
                 
@@ -111,6 +111,21 @@ namespace FTS {
                     static const double STEP_SCALE_DEFAULT;
                     static const std::string STEP_LOCATION_DEFAULT;
 
+                    static const double ADAPT_TARGET_DEFAULT;
+
+                    // Parameters of the dual-averaging adaptation of the step scale (Hoffman and Gelman 2014, Alg. 5).
+                    static const double ADAPT_GAMMA;
+                    static const double ADAPT_T0;
+                    static const double ADAPT_KAPPA;
+                    // The fractions of the adaptation period at the start and the end in which only the step scale is
+                    // adapted. The relative step sizes are estimated in the windows between them, which start at
+                    // ADAPT_BASE_WINDOW iterations and double in length.
+                    static const double ADAPT_INIT_BUFFER;
+                    static const double ADAPT_TERM_BUFFER;
+                    static const size_t ADAPT_BASE_WINDOW;
+                    // The fraction of the (squared) initial step sizes the variances are shrunk towards.
+                    static const double ADAPT_REGULARISATION;
+
                     //Public static functions.
                 public:
                     
@@ -127,16 +142,43 @@ namespace FTS {
 
                     Distribution* prop_distr;
 
+                    // Adaptation of the step sizes (see start_adaptation). The step sizes are the product of a global step
+                    // scale, which is adapted by dual averaging to target the mean acceptance statistic of the
+                    // trajectories, and the relative step sizes, which are the standard deviations of the states visited in
+                    // each adaptation window (i.e. a diagonal mass matrix).
+                    bool adapting;
+                    double adapt_target;
+                    size_t adapt_count;
+                    size_t adapt_num_iterations;
+                    double log_step_scale;
+                    double log_step_scale_bar;
+                    double adapt_mu;
+                    double adapt_H_bar;
+                    size_t adapt_restart;
+                    size_t window_end;
+                    size_t window_size;
+                    size_t window_count;
+                    MR::Math::Vector<double> relative_step;
+                    MR::Math::Vector<double> initial_relative_step;
+                    MR::Math::Vector<double> state_mean;
+                    MR::Math::Vector<double> state_sum_sq;
+
                     //Member functions
                 public:
                     
                     Momentum(Distribution* const prop_distr = 0)
-                            : prop_distr(prop_distr) {
+                            : prop_distr(prop_distr), adapting(false), adapt_target(
+                                      ADAPT_TARGET_DEFAULT), adapt_count(0), adapt_num_iterations(0), log_step_scale(
+                                      0.0), log_step_scale_bar(0.0), adapt_mu(0.0), adapt_H_bar(0.0), adapt_restart(
+                                      0), window_end(0), window_size(0), window_count(0) {
                     }
                     
                     Momentum(Distribution* const proposal_distribution,
                              const MR::Math::Vector<double>& relative_step)
-                            : prop_distr(0) {
+                            : prop_distr(0), adapting(false), adapt_target(ADAPT_TARGET_DEFAULT), adapt_count(
+                                      0), adapt_num_iterations(0), log_step_scale(0.0), log_step_scale_bar(
+                                      0.0), adapt_mu(0.0), adapt_H_bar(0.0), adapt_restart(0), window_end(
+                                      0), window_size(0), window_count(0) {
                         set(proposal_distribution, relative_step);
                     }
                     
@@ -146,7 +188,14 @@ namespace FTS {
                     }
                     
                     Momentum(const Momentum& m)
-                            : momen(m.momen), step(m.step) {
+                            : momen(m.momen), step(m.step), adapting(m.adapting), adapt_target(
+                                      m.adapt_target), adapt_count(m.adapt_count), adapt_num_iterations(
+                                      m.adapt_num_iterations), log_step_scale(m.log_step_scale), log_step_scale_bar(
+                                      m.log_step_scale_bar), adapt_mu(m.adapt_mu), adapt_H_bar(m.adapt_H_bar), adapt_restart(
+                                      m.adapt_restart), window_end(m.window_end), window_size(m.window_size), window_count(
+                                      m.window_count), relative_step(m.relative_step), initial_relative_step(
+                                      m.initial_relative_step), state_mean(m.state_mean), state_sum_sq(
+                                      m.state_sum_sq) {
                         if (m.prop_distr)
                             delete prop_distr;
                         prop_distr = m.prop_distr->clone();
@@ -157,6 +206,22 @@ namespace FTS {
                         if (m.prop_distr)
                             delete prop_distr;
                         prop_distr = m.prop_distr->clone();
+                        adapting = m.adapting;
+                        adapt_target = m.adapt_target;
+                        adapt_count = m.adapt_count;
+                        adapt_num_iterations = m.adapt_num_iterations;
+                        log_step_scale = m.log_step_scale;
+                        log_step_scale_bar = m.log_step_scale_bar;
+                        adapt_mu = m.adapt_mu;
+                        adapt_H_bar = m.adapt_H_bar;
+                        adapt_restart = m.adapt_restart;
+                        window_end = m.window_end;
+                        window_size = m.window_size;
+                        window_count = m.window_count;
+                        relative_step = m.relative_step;
+                        initial_relative_step = m.initial_relative_step;
+                        state_mean = m.state_mean;
+                        state_sum_sq = m.state_sum_sq;
                         return *this;
                     }
                     
@@ -181,6 +246,34 @@ namespace FTS {
                     
                     void randomize();
 
+                    void set_momentum(const MR::Math::Vector<double>& momentum) {
+                        momen = momentum;
+                    }
+                    
+                    // The global scale the relative step sizes are multiplied by while adapting (1 before adaptation).
+                    double get_step_scale() const {
+                        return MR::Math::exp(log_step_scale);
+                    }
+                    
+                    // Sets the global step scale, restarting the dual averaging from it if adapting.
+                    void set_step_scale(double step_scale);
+
+                    // Starts adapting the step sizes over the next 'num_iterations' calls to 'adapt', targeting the
+                    // given mean acceptance statistic.
+                    void start_adaptation(double target_accept_stat, size_t num_iterations);
+
+                    // Updates the step sizes after a trajectory with the given acceptance statistic (the mean Metropolis
+                    // acceptance probability of its states) that ended at 'state'.
+                    void adapt(double accept_stat, const MR::Math::Vector<double>& state);
+
+                    // Fixes the step sizes at the dual-averaged step scale.
+                    void stop_adaptation();
+
+                    bool is_adapting() const {
+                        return adapting;
+                    }
+                    
+
                     virtual void half_update_momentum(const MR::Math::Vector<double>& gradient,
                                                       double time_direction = 1.0);
 
@@ -219,6 +312,12 @@ namespace FTS {
                     
                     friend std::ostream& operator<<(std::ostream& stream, const Momentum& momen);
                     
+                protected:
+                    
+                    void restart_step_scale_adaptation();
+
+                    void apply_step_scale();
+
             };
             
             std::ostream& operator<<(std::ostream& stream, const Momentum& momen);
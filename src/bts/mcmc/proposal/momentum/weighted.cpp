@@ -79,6 +79,32 @@ namespace FTS {
                 
             }
             
+            double Momentum::Weighted::log_kinetic_energy(
+                    const Math::SparseCholesky& weights_chol) const {
+                
+                MR::Math::Vector<double> weights_momen(size());
+                
+                weights_chol.solve(weights_momen, momen);
+                double energy = MR::Math::dot(weights_momen, momen) / 2.0;
+                
+                // The log determinant is used directly as the determinant of large weighting matrices can overflow.
+                energy += 0.5 * (LOG_2 + LOG_PI * size() + weights_chol.log_det());
+                
+                return energy;
+                
+            }
+            
+            void Momentum::Weighted::randomize(const Math::SparseCholesky& cholesky) {
+                
+                MR::Math::Vector<double> random_vec(size());
+                
+                for (size_t elem_i = 0; elem_i < size(); ++elem_i)
+                    random_vec[elem_i] = prop_distr->sample(0.0, 1.0);
+                
+                cholesky.lower_mult(momen, random_vec);
+                
+            }
+            
             void Momentum::Weighted::update_state(MR::Math::Vector<double>& state,
                                                   const MR::Math::Matrix<double>& weights_chol,
                                                   double time_direction) const {
@@ -24,6 +24,7 @@
 #define __bts_mcmc_proposal_momentum_weighted_h__
 
 #include "bts/mcmc/proposal/momentum.h"
+#include "bts/math/sparse_cholesky.h"
 
 namespace FTS {
     
@@ -91,6 +92,10 @@ namespace FTS {
 
                     double log_kinetic_energy(const MR::Math::Matrix<double>& cholesky) const;
 
+                    void randomize(const Math::SparseCholesky& cholesky);
+
+                    double log_kinetic_energy(const Math::SparseCholesky& cholesky) const;
+
                     //For debugging purposes.
                     double predicted_change(const MR::Math::Vector<double>& gradient,
                                             const MR::Math::Matrix<double>& weights_chol,
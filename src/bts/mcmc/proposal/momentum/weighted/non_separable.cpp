@@ -63,6 +63,23 @@ namespace FTS {
                 return pred_change * time_direction;
                 
             }
+            
+            double Momentum::Weighted::NonSeparable::predicted_change(
+                    const MR::Math::Vector<double>& gradient,
+                    const Math::SparseCholesky& fisher_chol, double time_direction) const {
+                
+                double pred_change = 0.0;
+                
+                MR::Math::Vector<double> working(gradient.size());
+                
+                fisher_chol.solve(working, momen);
+                
+                for (size_t elem_i = 0; elem_i < size(); elem_i++)
+                    pred_change += working[elem_i] * gradient[elem_i] * step[elem_i];
+                
+                return pred_change * time_direction;
+                
+            }
         
         }
     
@@ -23,7 +23,9 @@
 #ifndef __bts_mcmc_proposal_momentum_weighted_nonseparable_h__
 #define __bts_mcmc_proposal_momentum_weighted_nonseparable_h__
 
+#include "math/cholesky.h"
 #include "bts/math/common.h"
+#include "bts/math/block_sparse.h"
 #include "bts/mcmc/naninf_exception.h"
 #include "bts/mcmc/proposal/momentum/weighted.h"
 
@@ -47,6 +49,7 @@ namespace FTS {
                     MR::Math::Vector<double> working2;
                     std::vector<MR::Math::Matrix<double> > Winv_dWdx;
                     std::vector<double> trace_Winv_dWdx;
+                    MR::Math::Matrix<double> weights_inv;
 
                     //Public static functions
                 public:
@@ -68,10 +71,7 @@ namespace FTS {
                                  size_t num_newton_steps)
                             : Weighted(proposal_distribution, step_sizes), tmp_momen(
                                       step_sizes.size()), working1(step_sizes.size()), working2(
-                                      step_sizes.size()), Winv_dWdx(step_sizes.size(),
-                                      MR::Math::Matrix<double>(step_sizes.size(),
-                                              step_sizes.size())), trace_Winv_dWdx(
-                                      step_sizes.size()) {
+                                      step_sizes.size()), trace_Winv_dWdx(step_sizes.size()) {
                     }
                     
                     virtual ~NonSeparable() {
@@ -80,7 +80,7 @@ namespace FTS {
                     NonSeparable(const NonSeparable& NS)
                             : Weighted(NS), tmp_momen(NS.tmp_momen), working1(NS.working1), working2(
                                       NS.working2), Winv_dWdx(NS.Winv_dWdx), trace_Winv_dWdx(
-                                      NS.trace_Winv_dWdx) {
+                                      NS.trace_Winv_dWdx), weights_inv(NS.weights_inv) {
                     }
                     
                     NonSeparable& operator=(const NonSeparable& NS) {
@@ -91,6 +91,7 @@ namespace FTS {
                         working2 = NS.working2;
                         Winv_dWdx = NS.Winv_dWdx;
                         trace_Winv_dWdx = NS.trace_Winv_dWdx;
+                        weights_inv = NS.weights_inv;
                         
                         return *this;
                     }
@@ -99,6 +100,10 @@ namespace FTS {
                         Momentum::Weighted::randomize(weights_chol);
                     }
                     
+                    void randomize(const Math::SparseCholesky& weights_chol) {
+                        Momentum::Weighted::randomize(weights_chol);
+                    }
+                    
 //          double                                  log_kinetic_energy(const MR::Math::Matrix<double>& weights_chol) const;
                     
                     template<typename T> void half_update_momentum(
@@ -117,6 +122,26 @@ namespace FTS {
                         return predicted_change(gradient, fisher_chol, time_direction);
                     }
                     
+                    /*! Same as above but with a sparse decomposition of the weights and block-sparse weight gradients.
+                     * Instead of forming W^-1 dW/dx_i for each element (d^2 solves and d^3 memory) the trace term is taken
+                     * from the stored blocks of dW/dx_i against W^-1, and the quadratic term is evaluated as v' dW/dx_i v
+                     * with v = W^-1 p. */
+                    template<typename T> void half_update_momentum(
+                            const MR::Math::Vector<double>& gradient,
+                            const Math::SparseCholesky& weights_chol,
+                            std::vector<Math::BlockSparse>& weights_gradient, double time_direction,
+                            size_t num_newton_steps = 1);
+
+                    double predicted_change(const MR::Math::Vector<double>& gradient,
+                                            const Math::SparseCholesky& fisher_chol,
+                                            double time_direction) const;
+
+                    template<typename T> double predicted_change(
+                            const T& gradient, const Math::SparseCholesky& fisher_chol,
+                            double time_direction) const {
+                        return predicted_change(gradient, fisher_chol, time_direction);
+                    }
+                    
             };
             
             template<typename T> void Momentum::Weighted::NonSeparable::half_update_momentum(
@@ -127,6 +152,9 @@ namespace FTS {
                 
                 assert((time_direction == -1.0) || (time_direction == 1.0));
                 
+                if (Winv_dWdx.size() != size())
+                    Winv_dWdx.assign(size(), MR::Math::Matrix<double>(size(), size()));
+                
                 for (size_t elem_i = 0; elem_i < size(); ++elem_i) {
                     
                     //More numerically sound than calculating the inverse and multiplying it with the gradient.
@@ -169,6 +197,47 @@ namespace FTS {
                 momen = tmp_momen;
                 
             }
+            
+            template<typename T> void Momentum::Weighted::NonSeparable::half_update_momentum(
+                    const MR::Math::Vector<double>& gradient,
+                    const Math::SparseCholesky& weights_chol,
+                    std::vector<Math::BlockSparse>& weights_gradient, double time_direction,
+                    size_t num_newton_steps) {
+                
+                assert((time_direction == -1.0) || (time_direction == 1.0));
+                
+                weights_chol.inverse(weights_inv);
+                
+                // trace(W^-1 dW/dx_i) only involves the elements of W^-1 over the stored blocks of dW/dx_i.
+                for (size_t elem_i = 0; elem_i < size(); ++elem_i)
+                    trace_Winv_dWdx[elem_i] = weights_gradient[elem_i].trace_product(weights_inv) / 2.0;
+                
+                tmp_momen = momen;
+                
+                MR::Math::Vector<double> weights_momen(size());
+                
+                for (size_t newton_i = 0; newton_i < num_newton_steps; ++newton_i) {
+                    
+                    weights_chol.solve(weights_momen, tmp_momen);
+                    
+                    for (size_t elem_i = 0; elem_i < size(); ++elem_i)
+                        working2[elem_i] = weights_gradient[elem_i].inner(weights_momen, weights_momen) / 2.0;
+                    
+                    for (size_t elem_i = 0; elem_i < size(); ++elem_i) {
+                        
+                        tmp_momen[elem_i] = momen[elem_i]
+                                + 0.5 * time_direction * step[elem_i]
+                                  * (gradient[elem_i] - trace_Winv_dWdx[elem_i] + working2[elem_i]);
+                        
+                        if (isnan(tmp_momen[elem_i]) || isinf(tmp_momen[elem_i]))
+                            throw NanInfException();
+                    }
+                    
+                }
+                
+                momen = tmp_momen;
+                
+            }
         
         }
     
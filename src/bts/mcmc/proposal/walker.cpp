@@ -34,6 +34,16 @@ namespace FTS {
             const std::string Walker::STEP_LOCATION_DEFAULT =
                     "/home/tclose/data/mcmc/parameters/walker.sta";
             
+            const double Walker::ADAPT_TARGET_DEFAULT = 0.234;
+            const size_t Walker::ADAPT_RANK_DEFAULT = 0;
+            const double Walker::ADAPT_DECAY = 0.6;
+            const size_t Walker::ADAPT_WARMUP = 100;
+            const size_t Walker::ADAPT_HISTORY_PERIOD = 10;
+            const double Walker::ADAPT_REGULARISATION = 0.01;
+            
+            const char* Walker::BLOCK_DEFAULT = "none";
+            const char* Walker::SCAN_DEFAULT = "random";
+            
             void Walker::set(Distribution* const proposal_distribution,
                              MR::Math::Vector<double> relative_step_sizes) {
                 
@@ -51,10 +61,183 @@ namespace FTS {
                 
                 assert(current.size() == proposed.size());
                 
+                if (block_starts.size()) {
+                    
+                    if (systematic_scan) {
+                        last_block = next_block;
+                        next_block = (next_block + 1) % block_starts.size();
+                    } else
+                        last_block = prop_distr->sample_index(block_starts.size());
+                    
+                    // Only the elements of the selected block are perturbed. The low-rank term of the adaptive walker
+                    // moves every element so it isn't used for block-wise proposals.
+                    for (size_t elem_i = 0; elem_i < current.size(); elem_i++)
+                        proposed[elem_i] = current[elem_i];
+                    
+                    for (size_t elem_i = block_starts[last_block]; elem_i < block_ends[last_block];
+                            elem_i++)
+                        proposed[elem_i] = prop_distr->sample(current[elem_i],
+                                step_sizes[elem_i] * scalar);
+                    
+                    return;
+                    
+                }
+                
                 for (size_t elem_i = 0; elem_i < current.size(); elem_i++)
                     proposed[elem_i] = prop_distr->sample(current[elem_i],
                             step_sizes[elem_i] * scalar);
                 
+                // Adds a random combination of the deviations of the stored states from their mean, whose covariance is
+                // the sample covariance of the stored states.
+                if (adapt_rank && state_history.size() == adapt_rank) {
+                    
+                    double history_scale = scalar * MR::Math::exp(log_adapt_scale) * 2.38
+                            / MR::Math::sqrt((double) (adapt_rank * current.size()));
+                    
+                    for (size_t history_i = 0; history_i < adapt_rank; ++history_i) {
+                        
+                        double weight = prop_distr->sample(0.0, history_scale);
+                        
+                        const MR::Math::Vector<double>& past_state = state_history[history_i];
+                        
+                        for (size_t elem_i = 0; elem_i < current.size(); elem_i++)
+                            if (initial_step_sizes[elem_i])
+                                proposed[elem_i] += weight * (past_state[elem_i] - state_mean[elem_i]);
+                        
+                    }
+                    
+                }
+                
+            }
+            
+            void Walker::set_blocks(const std::vector<size_t>& starts,
+                                    const std::vector<size_t>& ends, const std::vector<int>& fibres,
+                                    const std::string& scan) {
+                
+                if (starts.size() != ends.size() || starts.size() != fibres.size())
+                    throw Exception(
+                            "Number of block starts (" + str(starts.size()) + "), ends (" + str(ends.size())
+                            + ") and fibre indices (" + str(fibres.size()) + ") do not match.");
+                
+                if (scan == "systematic")
+                    systematic_scan = true;
+                else if (scan == "random")
+                    systematic_scan = false;
+                else
+                    throw Exception(
+                            "Unrecognised block scan '" + scan + "' (can be 'random' or 'systematic').");
+                
+                clear_blocks();
+                
+                for (size_t block_i = 0; block_i < starts.size(); ++block_i) {
+                    
+                    if (starts[block_i] > ends[block_i] || ends[block_i] > step_sizes.size())
+                        throw Exception(
+                                "Block (" + str(starts[block_i]) + ", " + str(ends[block_i])
+                                + ") lies outside the step sizes (" + str(step_sizes.size()) + ").");
+                    
+                    bool is_fixed = true;
+                    
+                    for (size_t elem_i = starts[block_i]; elem_i < ends[block_i]; ++elem_i)
+                        if (step_sizes[elem_i]) {
+                            is_fixed = false;
+                            break;
+                        }
+                    
+                    if (!is_fixed) {
+                        block_starts.push_back(starts[block_i]);
+                        block_ends.push_back(ends[block_i]);
+                        block_fibres.push_back(fibres[block_i]);
+                    }
+                    
+                }
+                
+                if (!block_starts.size())
+                    throw Exception("All blocks have zero step sizes.");
+                
+                next_block = 0;
+                last_block = 0;
+                
+            }
+            
+            void Walker::start_adaptation(double target_acceptance, size_t rank) {
+                
+                if (target_acceptance <= 0.0 || target_acceptance >= 1.0)
+                    throw Exception(
+                            "Target acceptance rate (" + str(target_acceptance)
+                            + ") needs to be between 0 and 1.");
+                
+                adapting = true;
+                adapt_target = target_acceptance;
+                adapt_rank = rank;
+                adapt_count = 0;
+                log_adapt_scale = 0.0;
+                
+                initial_step_sizes = step_sizes;
+                
+                state_mean.resize(step_sizes.size());
+                state_mean = 0.0;
+                state_sum_sq.resize(step_sizes.size());
+                state_sum_sq = 0.0;
+                
+                state_history.clear();
+                history_next = 0;
+                
+            }
+            
+            void Walker::adapt(const MR::Math::Vector<double>& state, bool accepted) {
+                
+                if (!adapting)
+                    return;
+                
+                if (state.size() != initial_step_sizes.size())
+                    throw Exception(
+                            "Size of state (" + str(state.size())
+                            + ") does not match the step sizes being adapted ("
+                            + str(initial_step_sizes.size()) + ").");
+                
+                ++adapt_count;
+                
+                // Robbins-Monro update of the global scale towards the target acceptance rate.
+                double gain = MR::Math::pow((double) adapt_count, -ADAPT_DECAY);
+                
+                log_adapt_scale += gain * ((accepted ? 1.0 : 0.0) - adapt_target);
+                
+                // Running mean and sum of squared deviations of each parameter (Welford's algorithm).
+                for (size_t elem_i = 0; elem_i < state.size(); ++elem_i) {
+                    double delta = state[elem_i] - state_mean[elem_i];
+                    state_mean[elem_i] += delta / (double) adapt_count;
+                    state_sum_sq[elem_i] += delta * (state[elem_i] - state_mean[elem_i]);
+                }
+                
+                if (adapt_rank && !(adapt_count % ADAPT_HISTORY_PERIOD)) {
+                    
+                    if (state_history.size() < adapt_rank)
+                        state_history.push_back(state);
+                    else
+                        state_history[history_next] = state;
+                    
+                    history_next = (history_next + 1) % adapt_rank;
+                    
+                }
+                
+                double scale = MR::Math::exp(log_adapt_scale);
+                
+                if (adapt_count > ADAPT_WARMUP) {
+                    
+                    // The optimal scaling for a Gaussian target of the given dimension (Roberts and Rosenthal).
+                    scale *= 2.38 / MR::Math::sqrt((double) state.size());
+                    
+                    for (size_t elem_i = 0; elem_i < state.size(); ++elem_i)
+                        if (initial_step_sizes[elem_i])
+                            step_sizes[elem_i] = scale * MR::Math::sqrt(
+                                    state_sum_sq[elem_i] / (double) (adapt_count - 1)
+                                    + ADAPT_REGULARISATION * MR::Math::pow2(initial_step_sizes[elem_i]));
+                    
+                } else
+                    for (size_t elem_i = 0; elem_i < state.size(); ++elem_i)
+                        step_sizes[elem_i] = scale * initial_step_sizes[elem_i];
+                
             }
         
         }
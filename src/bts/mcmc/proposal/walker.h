@@ -48,7 +48,22 @@ namespace FTS {
    + Argument ("walk_step_location", "").type_text(), \
 \
   Option ("walk_intens_scale", "Intensity step size scaling.") \
-   + Argument ("walk_intens_scale", "").type_float (0.0, 1e5, NAN)
+   + Argument ("walk_intens_scale", "").type_float (0.0, 1e5, NAN), \
+\
+  Option ("walk_adapt_target", "The acceptance rate targeted by the 'adaptive' walker while it learns the step sizes during the burn-in.") \
+   + Argument ("walk_adapt_target", "").type_float (0.0, MCMC::Proposal::Walker::ADAPT_TARGET_DEFAULT, 1.0), \
+\
+  Option ("walk_adapt_rank", "The number of past states used to add a low-rank estimate of the covariance to the proposals of the 'adaptive' walker (0 for per-parameter step sizes only).") \
+   + Argument ("walk_adapt_rank", "").type_integer (0, MCMC::Proposal::Walker::ADAPT_RANK_DEFAULT, LARGE_INT), \
+\
+  Option ("walk_adapt_save", "The location to save the step sizes learned by the 'adaptive' walker over the burn-in, which can be passed to '-walk_step_location' in later runs.") \
+   + Argument ("walk_adapt_save", "").type_text(), \
+\
+  Option ("walk_block", "Perturb a single block of parameters per step instead of every parameter at once, either 'fibre' (one fibre per step) or 'axis' (one axis of a tractlet per step, the same as 'fibre' for strands). Parameters that don't belong to a fibre, such as the base intensity, form a block of their own.") \
+   + Argument ("walk_block", "").type_text(MCMC::Proposal::Walker::BLOCK_DEFAULT), \
+\
+  Option ("walk_scan", "The order the blocks are perturbed in when '-walk_block' is used, either 'random' or 'systematic'.") \
+   + Argument ("walk_scan", "").type_text(MCMC::Proposal::Walker::SCAN_DEFAULT)
 
 //Loads the 'proposal' parameters into variables
 #define SET_PROPOSAL_WALKER_PARAMETERS(state_location) \
@@ -89,7 +104,34 @@ namespace FTS {
   \
   walk_opt = get_options("walk_base_intens_scale"); \
   if (walk_opt.size()) \
-   walk_base_intens_scale = walk_opt[0][0];
+   walk_base_intens_scale = walk_opt[0][0]; \
+  \
+  double walk_adapt_target = MCMC::Proposal::Walker::ADAPT_TARGET_DEFAULT; \
+  size_t walk_adapt_rank = MCMC::Proposal::Walker::ADAPT_RANK_DEFAULT; \
+  std::string walk_adapt_save; \
+  \
+  walk_opt = get_options("walk_adapt_target"); \
+  if (walk_opt.size()) \
+   walk_adapt_target = walk_opt[0][0]; \
+  \
+  walk_opt = get_options("walk_adapt_rank"); \
+  if (walk_opt.size()) \
+   walk_adapt_rank = walk_opt[0][0]; \
+  \
+  walk_opt = get_options("walk_adapt_save"); \
+  if (walk_opt.size()) \
+   walk_adapt_save = walk_opt[0][0].c_str(); \
+  \
+  std::string walk_block = MCMC::Proposal::Walker::BLOCK_DEFAULT; \
+  std::string walk_scan = MCMC::Proposal::Walker::SCAN_DEFAULT; \
+  \
+  walk_opt = get_options("walk_block"); \
+  if (walk_opt.size()) \
+   walk_block = walk_opt[0][0].c_str(); \
+  \
+  walk_opt = get_options("walk_scan"); \
+  if (walk_opt.size()) \
+   walk_scan = walk_opt[0][0].c_str();
 
 //Adds the 'proposal' parameters to the properties to be saved with the data.
 #define ADD_PROPOSAL_WALKER_PROPERTIES(properties) \
@@ -97,10 +139,22 @@ namespace FTS {
   properties["walk_step_scale"]                 = str(walk_step_scale); \
   properties["walk_base_intens_scale"]          = str(walk_base_intens_scale); \
 \
-  if (walk_type == "standard") { \
+  if (walk_type == "standard" || walk_type == "adaptive") { \
     properties["walk_step"]                     = Fibre::Base::Object::load_matlab_str(walk_step_location, walk_step_scale); \
     properties["walk_step_location"]            = walk_step_location; \
 \
+  } \
+\
+  if (walk_type == "adaptive") { \
+    properties["walk_adapt_target"]             = str(walk_adapt_target); \
+    properties["walk_adapt_rank"]               = str(walk_adapt_rank); \
+    if (walk_adapt_save.size()) \
+      properties["walk_adapt_save"]             = walk_adapt_save; \
+  } \
+\
+  if (walk_block != "none") { \
+    properties["walk_block"]                    = walk_block; \
+    properties["walk_scan"]                     = walk_scan; \
   }
 
 #include "bts/mcmc/proposal/distribution.h"
@@ -120,6 +174,22 @@ namespace FTS {
                     const static double STEP_SCALE_DEFAULT;
                     const static std::string STEP_LOCATION_DEFAULT;
 
+                    const static double ADAPT_TARGET_DEFAULT;
+                    const static size_t ADAPT_RANK_DEFAULT;
+
+                    // The gains of the adaptation decay as (iteration)^-ADAPT_DECAY so that it settles down over the burn-in.
+                    const static double ADAPT_DECAY;
+                    // The number of iterations the initial step sizes are used for before the variances of the states
+                    // visited are used in their place.
+                    const static size_t ADAPT_WARMUP;
+                    // The number of iterations between the states that are stored for the low-rank covariance.
+                    const static size_t ADAPT_HISTORY_PERIOD;
+                    // The fraction of the (squared) initial step sizes added to the variances to keep them from collapsing.
+                    const static double ADAPT_REGULARISATION;
+
+                    const static char* BLOCK_DEFAULT;
+                    const static char* SCAN_DEFAULT;
+
                     //Member variables
                 protected:
                     
@@ -127,16 +197,46 @@ namespace FTS {
 
                     Distribution* prop_distr;
 
+                    // Adaptation of the step sizes (see start_adaptation). The step sizes are the variances of the states
+                    // visited (or the initial step sizes during the warm-up) times a global scale, which is adjusted after
+                    // each iteration to target the acceptance rate. If 'adapt_rank' is nonzero a low-rank estimate of the
+                    // covariance is added to the proposals, taken from the deviations of the stored states from the mean.
+                    bool adapting;
+                    double adapt_target;
+                    size_t adapt_rank;
+                    size_t adapt_count;
+                    double log_adapt_scale;
+                    MR::Math::Vector<double> initial_step_sizes;
+                    MR::Math::Vector<double> state_mean;
+                    MR::Math::Vector<double> state_sum_sq;
+                    std::vector<MR::Math::Vector<double> > state_history;
+                    size_t history_next;
+
+                    // Block-wise proposals (see set_blocks). Each block is a range of elements that belong to a single
+                    // fibre, or to none of them (e.g. the base intensity) in which case its fibre index is -1. The
+                    // scheduler state is updated by 'step' so it is mutable.
+                    std::vector<size_t> block_starts;
+                    std::vector<size_t> block_ends;
+                    std::vector<int> block_fibres;
+                    bool systematic_scan;
+                    mutable size_t next_block;
+                    mutable size_t last_block;
+
                     //Member functions
                 public:
                     
                     Walker(Distribution* const prop_distr = 0)
-                            : prop_distr(prop_distr) {
+                            : prop_distr(prop_distr), adapting(false), adapt_target(
+                                      ADAPT_TARGET_DEFAULT), adapt_rank(0), adapt_count(0), log_adapt_scale(
+                                      0.0), history_next(0), systematic_scan(false), next_block(0), last_block(
+                                      0) {
                     }
                     
                     Walker(Distribution* const proposal_distribution,
                            const MR::Math::Vector<double>& relative_step_sizes)
-                            : prop_distr(0)
+                            : prop_distr(0), adapting(false), adapt_target(ADAPT_TARGET_DEFAULT), adapt_rank(
+                                      0), adapt_count(0), log_adapt_scale(0.0), history_next(0), systematic_scan(
+                                      false), next_block(0), last_block(0)
 
                     {
                         set(proposal_distribution, relative_step_sizes);
@@ -148,7 +248,14 @@ namespace FTS {
                     }
                     
                     Walker(const Walker& m)
-                            : step_sizes(m.step_sizes) {
+                            : step_sizes(m.step_sizes), adapting(m.adapting), adapt_target(
+                                      m.adapt_target), adapt_rank(m.adapt_rank), adapt_count(
+                                      m.adapt_count), log_adapt_scale(m.log_adapt_scale), initial_step_sizes(
+                                      m.initial_step_sizes), state_mean(m.state_mean), state_sum_sq(
+                                      m.state_sum_sq), state_history(m.state_history), history_next(
+                                      m.history_next), block_starts(m.block_starts), block_ends(
+                                      m.block_ends), block_fibres(m.block_fibres), systematic_scan(
+                                      m.systematic_scan), next_block(m.next_block), last_block(m.last_block) {
                         if (m.prop_distr)
                             prop_distr = m.prop_distr->clone();
                     }
@@ -157,6 +264,22 @@ namespace FTS {
                         step_sizes = m.step_sizes;
                         if (m.prop_distr)
                             prop_distr = m.prop_distr->clone();
+                        adapting = m.adapting;
+                        adapt_target = m.adapt_target;
+                        adapt_rank = m.adapt_rank;
+                        adapt_count = m.adapt_count;
+                        log_adapt_scale = m.log_adapt_scale;
+                        initial_step_sizes = m.initial_step_sizes;
+                        state_mean = m.state_mean;
+                        state_sum_sq = m.state_sum_sq;
+                        state_history = m.state_history;
+                        history_next = m.history_next;
+                        block_starts = m.block_starts;
+                        block_ends = m.block_ends;
+                        block_fibres = m.block_fibres;
+                        systematic_scan = m.systematic_scan;
+                        next_block = m.next_block;
+                        last_block = m.last_block;
                         return *this;
                     }
                     
@@ -166,6 +289,53 @@ namespace FTS {
                     void set(Distribution* const proposal_distribution,
                              MR::Math::Vector<double> relative_step_sizes);
                     
+                    //! Starts learning the step sizes from the states passed to 'adapt', starting from the current step
+                    //! sizes. Parameters with a step size of zero are kept fixed.
+                    void start_adaptation(double target_acceptance = ADAPT_TARGET_DEFAULT,
+                                          size_t rank = ADAPT_RANK_DEFAULT);
+
+                    //! Freezes the step sizes (and low-rank covariance) learned so far, after which the proposals are
+                    //! symmetric again.
+                    void stop_adaptation() {
+                        adapting = false;
+                    }
+                    
+                    bool is_adapting() const {
+                        return adapting;
+                    }
+                    
+                    //! Updates the step sizes given the state of the chain after an iteration and whether the proposal was
+                    //! accepted. Does nothing unless adaptation has been started.
+                    void adapt(const MR::Math::Vector<double>& state, bool accepted);
+
+                    const MR::Math::Vector<double>& get_step_sizes() const {
+                        return step_sizes;
+                    }
+                    
+                    //! Restricts each step to a single block of elements, [starts[i], ends[i]), which is chosen either
+                    //! uniformly at random ('random') or in turn ('systematic'). 'fibres' holds the index of the fibre
+                    //! each block belongs to (or -1). Blocks whose step sizes are all zero are dropped.
+                    void set_blocks(const std::vector<size_t>& starts, const std::vector<size_t>& ends,
+                                    const std::vector<int>& fibres, const std::string& scan);
+
+                    //! Returns to perturbing every element in each step.
+                    void clear_blocks() {
+                        block_starts.clear();
+                        block_ends.clear();
+                        block_fibres.clear();
+                    }
+                    
+                    bool is_blockwise() const {
+                        return block_starts.size();
+                    }
+                    
+                    //! The index of the only fibre perturbed by the last step, or -1 if the step wasn't restricted to a
+                    //! single fibre.
+                    int changed_fibre() const {
+                        return block_starts.size() ? block_fibres[last_block] : -1;
+                    }
+                    
+                    
             };
         
         }
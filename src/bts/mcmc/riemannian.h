@@ -31,11 +31,13 @@ extern "C" {
 #include <map>
 
 #include "progressbar.h"
-#include "math/cholesky.h"
+#include "bts/math/sparse_cholesky.h"
+#include "bts/math/block_sparse.h"
 
 #include "bts/fibre/strand/set/tensor.h"
 #include "bts/fibre/tractlet/set/tensor.h"
 #include "bts/mcmc/common.h"
+#include "bts/mcmc/timing.h"
 
 #include "bts/mcmc/proposal/momentum/weighted/non_separable.h"
 #include "bts/mcmc/naninf_exception.h"
@@ -74,89 +76,108 @@ namespace FTS {
                 size_t dimension;
 
                 State_T prior_gradient, likelihood_gradient;
-                typename State_T::Tensor prior_fisher, likelihood_fisher;
-                std::vector<typename State_T::Tensor> prior_fisher_gradient,
-                        likelihood_fisher_gradient;
+                Math::BlockSparse prior_fisher, likelihood_fisher;
+                std::vector<Math::BlockSparse> prior_fisher_gradient, likelihood_fisher_gradient;
+
+                // Dense copy of the Fisher information for the writer.
+                typename State_T::Tensor dense_fisher;
 
                 typename State_T::Tensor::Writer fisher_writer;
 
+                Timing* timing;
+
                 //Public member functions
             public:
                 
                 Posterior(const State_T& state, Prior_T& prior, Likelihood_T& likelihood,
                           double precondition = 0.0)
                         : prior(prior), likelihood(likelihood), precondition(precondition), dimension(
-                                  state.vsize()), prior_gradient(state), likelihood_gradient(state), prior_fisher(
-                                  state), likelihood_fisher(state) {
+                                  state.vsize()), prior_gradient(state), likelihood_gradient(state), dense_fisher(
+                                  state), timing(0) {
                     
                     prior_gradient.zero();
                     likelihood_gradient.zero();
                     
-                    prior_fisher.zero();
-                    likelihood_fisher.zero();
-                    
-                    for (size_t elem_i = 0; elem_i < dimension; ++elem_i) {
-                        prior_fisher_gradient.push_back(prior_fisher);
-                        likelihood_fisher_gradient.push_back(likelihood_fisher);
-                    }
-                    
                     fisher_writer.create("/home/tclose/data/mcmc/riemannian/fishers.sta.tnr",
                             state);
                     
                 }
                 
+                //! Laps 'timing' (if not null) over the prior and likelihood evaluations.
+                void set_timing(Timing* timing) {
+                    this->timing = timing;
+                }
+                
                 double log_prob_and_fisher(const State_T& state, State_T& gradient,
-                                           typename State_T::Tensor& fisher,
-                                           std::vector<typename State_T::Tensor>& fisher_gradient) {
+                                           Math::BlockSparse& fisher,
+                                           std::vector<Math::BlockSparse>& fisher_gradient) {
+                    
+                    lap(Timing::PROPOSAL);
                     
                     double px = prior.log_prob_and_fisher(state, prior_gradient, prior_fisher,
                             prior_fisher_gradient);
+                    
+                    lap(Timing::PRIOR);
+                    
                     px += likelihood.log_prob_and_fisher(state, likelihood_gradient,
                             likelihood_fisher, likelihood_fisher_gradient);
                     
+                    lap_likelihood();
+                    
                     gradient = prior_gradient + likelihood_gradient;
                     fisher = prior_fisher;
                     fisher += likelihood_fisher;
                     
-                    if (precondition) {
-                        
-                        for (size_t elem_i = 0; elem_i < dimension; ++elem_i)
-                            fisher(elem_i, elem_i) += precondition;
-                        
-                    }
+                    if (precondition)
+                        fisher.add_diagonal(precondition);
+                    
+                    fisher_gradient.resize(dimension);
                     
                     for (size_t elem_i = 0; elem_i < dimension; ++elem_i) {
                         fisher_gradient[elem_i] = prior_fisher_gradient[elem_i];
                         fisher_gradient[elem_i] += likelihood_fisher_gradient[elem_i];
                     }
                     
-                    fisher_writer.append(fisher);
+                    lap(Timing::PROPOSAL);
+                    
+                    fisher.copy_to(dense_fisher);
+                    fisher_writer.append(dense_fisher);
+                    
+                    lap(Timing::WRITE);
                     
                     return px;
                     
                 }
                 
                 double log_prob_and_fisher(const State_T& state, State_T& gradient,
-                                           typename State_T::Tensor& fisher) {
+                                           Math::BlockSparse& fisher) {
+                    
+                    lap(Timing::PROPOSAL);
                     
                     double px = prior.log_prob_and_fisher(state, prior_gradient, prior_fisher);
+                    
+                    lap(Timing::PRIOR);
+                    
                     px += likelihood.log_prob_and_fisher(state, likelihood_gradient,
                             likelihood_fisher);
                     
+                    lap_likelihood();
+                    
                     gradient = prior_gradient;
                     gradient += likelihood_gradient;
                     
                     fisher = prior_fisher;
                     fisher += likelihood_fisher;
                     
-                    if (precondition) {
-                        
-                        for (size_t elem_i = 0; elem_i < dimension; ++elem_i)
-                            fisher(elem_i, elem_i) += precondition;
-                        
-                    }
+                    if (precondition)
+                        fisher.add_diagonal(precondition);
+                    
+                    lap(Timing::PROPOSAL);
+                    
+                    fisher.copy_to(dense_fisher);
+                    fisher_writer.append(dense_fisher);
                     
-                    fisher_writer.append(fisher);
+                    lap(Timing::WRITE);
                     
                     return px;
                     
@@ -165,6 +186,16 @@ namespace FTS {
                 //Protected member functions
             protected:
                 
+                void lap(Timing::Phase phase) {
+                    if (timing)
+                        timing->lap(phase);
+                }
+                
+                void lap_likelihood() {
+                    if (timing)
+                        timing->lap_likelihood(likelihood);
+                }
+                
         };
         
         template<typename State_T, typename Likelihood_T, typename Prior_T> State_T riemannian(
@@ -185,6 +216,8 @@ namespace FTS {
             sample_header.push_back(H_PROP);
             sample_header.push_back(PROPOSED_H_PROP);
             
+            Timing::append_keys(sample_header);
+            
             std::vector<std::string> components_list = prior.list_components();
             
             sample_header.insert(sample_header.end(), components_list.begin(),
@@ -218,23 +251,25 @@ namespace FTS {
             
             size_t dimension = x.vsize();
             
+            Timing timing;
+            timing.start(likelihood);
+            posterior.set_timing(&timing);
+            
             State_T gradient(x);
             gradient.zero();
             
-            typename State_T::Tensor fisher(x);
-            fisher.zero();
-            
-            std::vector<typename State_T::Tensor> fisher_gradient;
-            for (size_t elem_i = 0; elem_i < dimension; ++elem_i)
-                fisher_gradient.push_back(fisher);
+            // The Fisher information is only coupled between elements of the state that interact (e.g. fibres that share
+            // voxels), so it and its gradients are stored block-sparse and decomposed with a sparse Cholesky decomposition.
+            // The ordering and pattern of the decomposition are kept between decompositions (including copies of it) while
+            // the pattern of stored blocks doesn't change.
+            Math::BlockSparse fisher;
+            std::vector<Math::BlockSparse> fisher_gradient;
             
-            typename State_T::Tensor fisher_chol(fisher);
+            Math::SparseCholesky fisher_chol;
             
             double px = posterior.log_prob_and_fisher(x, gradient, fisher, fisher_gradient);
             
-            fisher_chol = fisher;
-            
-            MR::Math::Cholesky::decomp(fisher_chol);
+            fisher_chol.decomp(fisher);
             
             //-------------------------//
             //  Take the MCMC samples  //
@@ -258,12 +293,12 @@ namespace FTS {
                 
                 double H = log_kinetic_energy - px;
                 
-                clock_t sample_starttime = clock();
+                double sample_starttime = Utilities::monotonic_seconds();
                 
                 State_T prop_x = x;
                 State_T prop_gradient = gradient;
-                typename State_T::Tensor prop_fisher = fisher;
-                typename State_T::Tensor prop_fisher_chol = fisher_chol;
+                Math::BlockSparse prop_fisher = fisher;
+                Math::SparseCholesky prop_fisher_chol = fisher_chol;
                 double prop_px = px;
                 
                 //Randomly select to evolve forwards or backwards in time.
@@ -285,10 +320,9 @@ namespace FTS {
                         
                         if (save_iterations) {
                             
-                            prop_x.set_extend_prop("pred_d_log_px",
-                                    str(
-                                            momentum.predicted_change(prop_gradient,
-                                                    prop_fisher_chol, time_direction)));
+                            prop_x.set_extend_prop_number("pred_d_log_px",
+                                    momentum.predicted_change(prop_gradient, prop_fisher_chol,
+                                            time_direction));
                             
                         }
                         
@@ -305,15 +339,14 @@ namespace FTS {
                         State_T tmp_x(prop_x);
                         MR::Math::Vector<double>& tmp_x_vector = tmp_x;
                         
-                        MR::Math::Cholesky::solve(fishinv_momen, fisher_chol, momentum.momentum());
+                        fisher_chol.solve(fishinv_momen, momentum.momentum());
                         
                         for (size_t newton_i = 0; newton_i < num_newton_steps; ++newton_i) {
                             
                             posterior.log_prob_and_fisher(tmp_x, prop_gradient, prop_fisher);
                             
-                            MR::Math::Cholesky::decomp(prop_fisher_chol = prop_fisher);
-                            MR::Math::Cholesky::solve(tmp_fishinv_momen, prop_fisher_chol,
-                                    momentum.momentum());
+                            prop_fisher_chol.decomp(prop_fisher);
+                            prop_fisher_chol.solve(tmp_fishinv_momen, momentum.momentum());
                             
                             for (size_t elem_i = 0; elem_i < dimension; ++elem_i) {
                                 tmp_x_vector[elem_i] =
@@ -333,7 +366,7 @@ namespace FTS {
                         prop_px = posterior.log_prob_and_fisher(prop_x, prop_gradient, prop_fisher,
                                 fisher_gradient);
                         
-                        MR::Math::Cholesky::decomp(prop_fisher_chol = prop_fisher);
+                        prop_fisher_chol.decomp(prop_fisher);
                         
                         // NB: Since we want to find maxima not minima the gradient of x is inverted when compared from the classical algorithm.
                         momentum.half_update_momentum<State_T>(prop_gradient, prop_fisher_chol,
@@ -341,11 +374,11 @@ namespace FTS {
                         
                         if (save_iterations) {
                             
-                            prop_x.set_extend_prop("log_px", str(prop_px));
-                            prop_x.set_extend_prop("act_d_log_px", str(prop_px - prev_prop_px));
-                            prop_x.set_extend_prop("grad_norm2", str(prop_gradient.norm2()));
-                            prop_x.set_extend_prop("log_kinetic_energy",
-                                    str(momentum.log_kinetic_energy(prop_fisher_chol)));
+                            prop_x.set_extend_prop_number("log_px", prop_px);
+                            prop_x.set_extend_prop_number("act_d_log_px", prop_px - prev_prop_px);
+                            prop_x.set_extend_prop_number("grad_norm2", prop_gradient.norm2());
+                            prop_x.set_extend_prop_number("log_kinetic_energy",
+                                    momentum.log_kinetic_energy(prop_fisher_chol));
                             
                             std::map<std::string, double> prop_component_values =
                                     prior.get_component_values(prop_x);
@@ -353,11 +386,13 @@ namespace FTS {
                             for (std::map<std::string, double>::iterator comp_it =
                                     prop_component_values.begin();
                                     comp_it != prop_component_values.end(); ++comp_it)
-                                prop_x.set_extend_prop(comp_it->first, str(comp_it->second));
+                                prop_x.set_extend_prop_number(comp_it->first, comp_it->second);
                             
                             iterations.append(prop_x);
                             gradient_iterations.append(prop_gradient);
                             
+                            timing.lap(Timing::WRITE);
+                            
                         }
                         
                         ++iteration_count;
@@ -373,8 +408,7 @@ namespace FTS {
                     // NB: Since we want to find maxima not minima the order of this subtraction is reversed.
                     double dH = prop_H - H;
                     
-                    double elapsed_time = (double) (clock() - sample_starttime)
-                            / (double) CLOCKS_PER_SEC;
+                    double elapsed_time = Utilities::monotonic_seconds() - sample_starttime;
                     
                     // Print out sample properties.
                     if (!suppress_print) {
@@ -391,7 +425,9 @@ namespace FTS {
                     }
                     
                     // If Hamiltonian decreases (i.e. there is less energy in the system) or the increase is below log[Y] (where Y is a uniformly distributed random variable between 0 and 1), accept the proposer.
-                    if ((dH < 0) || (log(gsl_ran_flat(rand_gen, 0, 1)) < -dH)) {
+                    bool accept = (dH < 0) || (log(gsl_ran_flat(rand_gen, 0, 1)) < -dH);
+                    
+                    if (accept) {
                         x = prop_x;
                         gradient = prop_gradient;
                         fisher = prop_fisher;
@@ -404,17 +440,20 @@ namespace FTS {
                     } else if (!suppress_print)
                         std::cout << ", Not accepted." << std::endl;
                     
+                    // Each trajectory counts as a single iteration.
+                    timing.count_iteration(accept);
+                    
                     // Record sample stats.
                     
-                    x.set_extend_prop(LOG_PROB_PROP, str(px));
-                    x.set_extend_prop(H_PROP, str(H));
-                    x.set_extend_prop(PROPOSED_H_PROP, str(prop_H));
+                    x.set_extend_prop_number(LOG_PROB_PROP, px);
+                    x.set_extend_prop_number(H_PROP, H);
+                    x.set_extend_prop_number(PROPOSED_H_PROP, prop_H);
                     
                     std::map<std::string, double> component_values = prior.get_component_values(x);
                     
                     for (std::map<std::string, double>::iterator comp_it = component_values.begin();
                             comp_it != component_values.end(); ++comp_it)
-                        x.set_extend_prop(comp_it->first, str(comp_it->second));
+                        x.set_extend_prop_number(comp_it->first, comp_it->second);
                     
                 } catch (const NanInfException& e) {
                     
@@ -422,15 +461,27 @@ namespace FTS {
                     std::cout << "Sample: " << sample_i << " - ";
                     std::cout << "Not accepted due to NaN or Inf values found" << std::endl;
                     
+                    timing.count_iteration(false);
+                    
                 }
                 
+                // The time taken to save the sample is recorded with the next one.
+                timing.lap(Timing::PROPOSAL);
+                timing.set_props(x);
+                timing.next_sample();
+                
                 // Save sample.
                 samples.append(x);
                 
+                timing.lap(Timing::WRITE);
+                
                 progress_bar++;
                 
             }
             
+            if (!suppress_print)
+                timing.print_summary(std::cout);
+            
             State_T out_x = x;
             
             return out_x;
@@ -152,6 +152,18 @@ namespace FTS {
                     
                 }
                 
+                void set_extend_prop_number(const std::string& prop, double value) {
+                    
+                    properties[prop] = str(value);
+                    
+                }
+                
+                void set_extend_prop_integer(const std::string& prop, int64_t value) {
+                    
+                    properties[prop] = str(value);
+                    
+                }
+                
                 State operator+(const State& state) const {
                     State answer = *this;
                     answer += state;
@@ -0,0 +1,312 @@
+/*
+ Copyright 2009 Brain Research Institute, Melbourne, Australia
+ 
+ Created by Tom Close on 13/03/09.
+ 
+ This file is part of Fourier Tract Sampling (FouTS).
+ 
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+ 
+ */
+
+#ifndef __bts_mcmc_tempering_h__
+#define __bts_mcmc_tempering_h__
+
+extern "C" {
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
+}
+
+#include <map>
+#include <vector>
+#include "progressbar.h"
+
+#include "bts/mcmc/common.h"
+
+#include "bts/mcmc/annealer.h"
+
+#include "bts/common.h"
+#include "bts/utilities/timer.h"
+#include "bts/utilities/threads.h"
+
+namespace FTS {
+    
+    namespace MCMC {
+        
+        namespace Tempering {
+            
+            const size_t NUM_ITERATIONS_DEFAULT = 1e5;
+            const size_t SAMPLE_PERIOD_DEFAULT = 1e3;
+            const size_t NUM_REPLICAS_DEFAULT = 4;
+            const size_t SWAP_PERIOD_DEFAULT = 100;
+            const double HOTTEST_FACTOR_DEFAULT = 0.05;
+            
+            const std::string SWAP_RATIO_PROP = "swap_ratio";
+            
+            // A Metropolis chain run at a fixed annealing factor. Each replica has its own likelihood (and therefore
+            // expected image), prior, walker and random generator so that they can be stepped in separate threads.
+            template<typename State, typename Likelihood, typename Prior> class Replica {
+                    
+                public:
+                    
+                    State x;
+                    State prop_x;
+
+                    Likelihood* likelihood;
+                    Prior* prior;
+                    typename State::Walker* walker;
+                    gsl_rng* rand_gen;
+
+                    double factor;
+                    double likelihood_px;
+                    double prior_px;
+
+                    size_t num_iterations;
+                    size_t accepted;
+
+                public:
+                    
+                    Replica(const State& initial_x, Likelihood* likelihood, Prior* prior,
+                            typename State::Walker* walker, gsl_rng* rand_gen, double factor)
+                            : x(initial_x), prop_x(initial_x), likelihood(likelihood), prior(prior), walker(
+                                      walker), rand_gen(rand_gen), factor(factor), num_iterations(0), accepted(
+                                      0) {
+                        
+                        prior_px = prior->log_prob(x);
+                        likelihood_px = likelihood->log_prob(x);
+                        
+                    }
+                    
+                    double log_prob() const {
+                        return likelihood_px * factor + prior_px;
+                    }
+                    
+                    // Swaps the states (and their probabilities) of two replicas, leaving their annealing factors.
+                    void swap(Replica& replica) {
+                        
+                        State tmp_x = x;
+                        x = replica.x;
+                        replica.x = tmp_x;
+                        
+                        std::swap(likelihood_px, replica.likelihood_px);
+                        std::swap(prior_px, replica.prior_px);
+                        
+                    }
+                    
+                    // Performs 'num_iterations' Metropolis-Hastings steps. Has the signature required by pthread_create.
+                    static void* run(void* replica_ptr) {
+                        
+                        Replica& replica = *(Replica*) replica_ptr;
+                        
+                        for (size_t iteration_i = 0; iteration_i < replica.num_iterations;
+                                iteration_i++) {
+                            
+                            replica.walker->step(replica.x, replica.prop_x,
+                                    1.0 / MR::Math::sqrt(replica.factor));
+                            
+                            double prop_prior_px = replica.prior->log_prob(replica.prop_x);
+                            double prop_likelihood_px = replica.likelihood->log_prob(replica.prop_x);
+                            
+                            double a = (prop_likelihood_px - replica.likelihood_px) * replica.factor
+                                    + prop_prior_px
+                                       - replica.prior_px;
+                            
+                            if ((a > 0) || log(gsl_ran_flat(replica.rand_gen, 0.0, 1.0)) <= a) {
+                                
+                                replica.x = replica.prop_x;
+                                replica.likelihood_px = prop_likelihood_px;
+                                replica.prior_px = prop_prior_px;
+                                
+                                replica.accepted++;
+                                
+                            }
+                            
+                        }
+                        
+                        return 0;
+                        
+                    }
+                    
+            };
+            
+        }
+        
+        /*! Replica exchange (parallel tempering) sampling. One replica is run per annealing factor of
+         * Annealer::ladder(likelihoods.size(), hottest_factor), each in its own thread, and after every 'swap_period'
+         * iterations swaps are proposed between the states of neighbouring replicas (alternating between even and odd
+         * pairs). Only the samples of the cold replica (factor = 1.0) are saved. The likelihoods, priors, walkers and
+         * random generators are supplied per replica and must not be shared between them. */
+        template<typename State, typename Likelihood, typename Prior> State tempering(
+                State& initial_x, std::vector<Likelihood*>& likelihoods,
+                std::vector<Prior*>& priors, std::vector<typename State::Walker*>& walkers,
+                std::vector<gsl_rng*>& rand_gens, const std::string& samples_location,
+                const std::map<std::string, std::string>& run_properties, size_t num_iterations,
+                size_t sample_period, size_t swap_period, double hottest_factor,
+                bool verbose = true) {
+            
+            typedef Tempering::Replica<State, Likelihood, Prior> Replica;
+            
+            size_t num_replicas = likelihoods.size();
+            
+            if (!num_replicas)
+                throw Exception("At least one replica is required for tempering.");
+            
+            if (priors.size() != num_replicas || walkers.size() != num_replicas
+                    || rand_gens.size() != num_replicas)
+                throw Exception(
+                        "Number of priors (" + str(priors.size()) + "), walkers (" + str(walkers.size())
+                        + ") and random generators (" + str(rand_gens.size())
+                        + ") must match the number of likelihoods (" + str(num_replicas) + ").");
+            
+            if (!swap_period || sample_period % swap_period)
+                throw Exception(
+                        "Sample period (" + str(sample_period)
+                        + ") needs to be a multiple of the swap period (" + str(swap_period) + ").");
+            
+            std::vector<std::string> sample_header;
+            
+            sample_header.push_back(LOG_PROB_PROP);
+            sample_header.push_back(ACCEPTANCE_RATIO_PROP);
+            sample_header.push_back(Tempering::SWAP_RATIO_PROP);
+            sample_header.push_back(ELAPSED_TIME_PROP);
+            sample_header.push_back("likelihood");
+            sample_header.push_back("prior");
+            
+            std::vector<std::string> elem_header;
+            
+            State::append_characteristic_keys(elem_header);
+            
+            std::vector<std::string> components_list = priors[0]->list_components();
+            
+            sample_header.insert(sample_header.end(), components_list.begin(),
+                    components_list.end());
+            
+            typename State::Writer samples(samples_location, initial_x, sample_header, elem_header,
+                    run_properties);
+            
+            std::vector<double> factors = Annealer::ladder(num_replicas, hottest_factor);
+            
+            // The initial probabilities are calculated here, in a single thread, which also generates any matrices that
+            // are cached on first use.
+            std::vector<Replica> replicas;
+            
+            for (size_t replica_i = 0; replica_i < num_replicas; ++replica_i)
+                replicas.push_back(
+                        Replica(initial_x, likelihoods[replica_i], priors[replica_i],
+                                walkers[replica_i], rand_gens[replica_i], factors[replica_i]));
+            
+            size_t num_samples = num_iterations / sample_period;
+            size_t num_rounds = sample_period / swap_period;
+            
+            // Initialise the progress bar
+            MR::ProgressBar progress_bar(
+                    "Generating " + str(num_samples) + " replica exchange MCMC samples ("
+                    + str(num_replicas) + " replicas) ...",
+                    num_samples);
+            
+            for (size_t sample_i = 0; sample_i < num_samples; sample_i++) {
+                
+                size_t swaps_proposed = 0;
+                size_t swaps_accepted = 0;
+                
+                for (size_t replica_i = 0; replica_i < num_replicas; ++replica_i) {
+                    replicas[replica_i].accepted = 0;
+                    replicas[replica_i].num_iterations = swap_period;
+                }
+                
+                double sample_starttime = Utilities::monotonic_seconds();
+                
+                for (size_t round_i = 0; round_i < num_rounds; round_i++) {
+                    
+                    // The cold replica is stepped in the calling thread.
+                    Utilities::run_in_threads(replicas, Replica::run, "step the replicas");
+                    
+                    // Propose swaps between neighbouring replicas. As the prior isn't annealed it cancels out of the
+                    // acceptance ratio.
+                    for (size_t replica_i = (sample_i * num_rounds + round_i) % 2;
+                            replica_i + 1 < num_replicas; replica_i += 2) {
+                        
+                        Replica& cold = replicas[replica_i];
+                        Replica& hot = replicas[replica_i + 1];
+                        
+                        double a = (cold.factor - hot.factor)
+                                * (hot.likelihood_px - cold.likelihood_px);
+                        
+                        swaps_proposed++;
+                        
+                        if ((a > 0) || log(gsl_ran_flat(rand_gens[0], 0.0, 1.0)) <= a) {
+                            cold.swap(hot);
+                            swaps_accepted++;
+                        }
+                        
+                    }
+                    
+                }
+                
+                Replica& cold = replicas[0];
+                
+                // Calculate stats about the current sample
+                double acceptance_ratio = (double) cold.accepted / (double) sample_period;
+                double swap_ratio = swaps_proposed ? (double) swaps_accepted / (double) swaps_proposed : 0.0;
+                double elapsed_time = Utilities::monotonic_seconds() - sample_starttime;
+                
+                State x = cold.x;
+                
+                // Record sample stats.
+                x.set_extend_prop_number(LOG_PROB_PROP, cold.log_prob());
+                x.set_extend_prop_number(ACCEPTANCE_RATIO_PROP, acceptance_ratio);
+                x.set_extend_prop_number(Tempering::SWAP_RATIO_PROP, swap_ratio);
+                x.set_extend_prop_number(ELAPSED_TIME_PROP, elapsed_time);
+                x.set_extend_prop_number("likelihood", cold.likelihood_px);
+                x.set_extend_prop_number("prior", cold.prior_px);
+                
+                std::map<std::string, double> component_values = cold.prior->get_component_values(
+                        x);
+                
+                for (std::map<std::string, double>::iterator comp_it = component_values.begin();
+                        comp_it != component_values.end(); ++comp_it)
+                    x.set_extend_prop_number(comp_it->first, comp_it->second);
+                
+                x.set_characteristics();
+                
+                // Save sample.
+                samples.append(x);
+                
+                // Print out sample properties.
+                if (verbose) {
+                    std::cout << std::endl;
+                    std::cout << "Iteration: " << (sample_i + 1) * sample_period << "/"
+                              << num_iterations << ", ";
+                    std::cout << "log[px]: " << cold.log_prob() << ", ";
+                    std::cout << "acceptance ratio: " << acceptance_ratio << ", ";
+                    std::cout << "swap ratio: " << swap_ratio << ", ";
+                    std::cout << "elapsed time: " << elapsed_time;
+                    std::cout << std::endl;
+                }
+                
+                progress_bar++;
+                
+            }
+            
+            State x_return(replicas[0].x);
+            
+            return x_return;
+            
+        }
+    
+    }
+
+}
+
+#endif
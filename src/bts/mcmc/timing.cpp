@@ -0,0 +1,169 @@
+/*
+ Copyright 2008 Brain Research Institute, Melbourne, Australia
+
+ Written by Thomas G Close, 24/01/2011.
+
+ This file is part of MRtrix.
+
+ MRtrix is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ MRtrix is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with MRtrix.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <iomanip>
+
+#include "bts/prob/likelihood.h"
+
+#include "bts/mcmc/timing.h"
+
+#include "bts/image/inline_functions.h"
+
+namespace FTS {
+    
+    namespace MCMC {
+        
+        const char* Timing::PHASE_NAMES[Timing::NUM_PHASES] = { "proposal", "sections", "image",
+                "likelihood", "prior", "write" };
+        
+        const std::string Timing::ITERATION_RATE_PROP = "iterations_per_s";
+        const std::string Timing::ACCEPTANCE_RATE_PROP = "accepted_per_s";
+        const std::string Timing::VOXEL_ENCODING_TIME_PROP = "ns_per_voxel_encoding";
+        
+        Timing::Timing()
+                : total_iterations(0), total_accepted(0), total_voxel_encodings(0.0) {
+            
+            for (size_t phase_i = 0; phase_i < NUM_PHASES; ++phase_i)
+                total_times[phase_i] = 0.0;
+            
+            restart();
+            
+        }
+        
+        void Timing::restart(double image_seconds, double section_seconds) {
+            
+            mark = Utilities::monotonic_seconds();
+            sample_start = mark;
+            timing_start = mark;
+            
+            last_image_seconds = image_seconds;
+            last_section_seconds = section_seconds;
+            
+            for (size_t phase_i = 0; phase_i < NUM_PHASES; ++phase_i)
+                sample_times[phase_i] = 0.0;
+            
+            sample_iterations = 0;
+            sample_accepted = 0;
+            sample_voxel_encodings = 0.0;
+            
+        }
+        
+        void Timing::restart_from(Prob::Likelihood* likelihood) {
+            
+            const Image::Expected::Buffer& exp_image = likelihood->get_expected_image();
+            
+            restart(exp_image.get_image_seconds(), exp_image.get_section_seconds());
+            
+        }
+        
+        void Timing::lap_from(Prob::Likelihood* likelihood) {
+            
+            const Image::Expected::Buffer& exp_image = likelihood->get_expected_image();
+            
+            lap_likelihood(exp_image.get_image_seconds(), exp_image.get_section_seconds(),
+                    (double) exp_image.num_not_empty_voxels() * (double) exp_image.num_encodings());
+            
+        }
+        
+        void Timing::lap_likelihood(double image_seconds, double section_seconds,
+                                    double voxel_encodings) {
+            
+            lap(LIKELIHOOD);
+            
+            double image_time = image_seconds - last_image_seconds;
+            double section_time = section_seconds - last_section_seconds;
+            
+            sample_times[LIKELIHOOD] -= image_time;
+            sample_times[IMAGE] += image_time - section_time;
+            sample_times[SECTIONS] += section_time;
+            
+            last_image_seconds = image_seconds;
+            last_section_seconds = section_seconds;
+            
+            sample_voxel_encodings += voxel_encodings;
+            
+        }
+        
+        void Timing::append_keys(std::vector<std::string>& header) {
+            
+            for (size_t phase_i = 0; phase_i < NUM_PHASES; ++phase_i)
+                header.push_back(phase_key(phase_i));
+            
+            header.push_back(ITERATION_RATE_PROP);
+            header.push_back(ACCEPTANCE_RATE_PROP);
+            header.push_back(VOXEL_ENCODING_TIME_PROP);
+            
+        }
+        
+        void Timing::next_sample() {
+            
+            for (size_t phase_i = 0; phase_i < NUM_PHASES; ++phase_i) {
+                total_times[phase_i] += sample_times[phase_i];
+                sample_times[phase_i] = 0.0;
+            }
+            
+            total_iterations += sample_iterations;
+            total_accepted += sample_accepted;
+            total_voxel_encodings += sample_voxel_encodings;
+            
+            sample_iterations = 0;
+            sample_accepted = 0;
+            sample_voxel_encodings = 0.0;
+            
+            sample_start = mark;
+            
+        }
+        
+        void Timing::print_summary(std::ostream& stream) const {
+            
+            double elapsed = mark - timing_start;
+            
+            double times[NUM_PHASES];
+            double timed = 0.0;
+            
+            for (size_t phase_i = 0; phase_i < NUM_PHASES; ++phase_i) {
+                times[phase_i] = total_times[phase_i] + sample_times[phase_i];
+                timed += times[phase_i];
+            }
+            
+            size_t iterations = total_iterations + sample_iterations;
+            size_t accepted = total_accepted + sample_accepted;
+            
+            stream << std::endl << "Timing (" << elapsed << " s over " << iterations
+                   << " iterations):" << std::endl;
+            
+            for (size_t phase_i = 0; phase_i < NUM_PHASES; ++phase_i)
+                stream << "  " << std::setw(12) << std::left << PHASE_NAMES[phase_i] << std::right
+                       << std::setw(12) << times[phase_i] << " s  " << std::setw(6)
+                       << std::setprecision(3) << (timed ? 100.0 * times[phase_i] / timed : 0.0)
+                       << std::setprecision(6) << " %" << std::endl;
+            
+            stream << "  iterations/s: " << rate(iterations, elapsed) << ", accepted/s: "
+                   << rate(accepted, elapsed) << ", ns per voxel-encoding: "
+                   << voxel_encoding_time(times, total_voxel_encodings + sample_voxel_encodings)
+                   << std::endl;
+            
+        }
+    
+    }
+
+}
@@ -0,0 +1,181 @@
+/*
+ Copyright 2008 Brain Research Institute, Melbourne, Australia
+
+ Written by Thomas G Close, 24/01/2011.
+
+ This file is part of MRtrix.
+
+ MRtrix is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ MRtrix is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with MRtrix.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef __bts_mcmc_timing_h__
+#define __bts_mcmc_timing_h__
+
+#include <vector>
+#include <string>
+#include <ostream>
+
+#include "bts/utilities/timer.h"
+
+#include "bts/common.h"
+
+namespace FTS {
+    
+    namespace Prob {
+        class Likelihood;
+    }
+    
+    namespace MCMC {
+        
+        /*! Breaks the wall time of the sampler loops into phases. The time since the previous lap is added to the phase
+         *  passed to lap(), and the expected image keeps its own count of the time spent generating images and their
+         *  sections, which lap_likelihood() moves out of the likelihood phase. The times and throughput of the current
+         *  sample are recorded as sample properties (see append_keys and set_props) before being added to the totals
+         *  printed by print_summary.
+         */
+        class Timing {
+                
+            public:
+                
+                enum Phase {
+                    PROPOSAL, SECTIONS, IMAGE, LIKELIHOOD, PRIOR, WRITE, NUM_PHASES
+                };
+
+                const static char* PHASE_NAMES[NUM_PHASES];
+
+                const static std::string ITERATION_RATE_PROP;
+                const static std::string ACCEPTANCE_RATE_PROP;
+                const static std::string VOXEL_ENCODING_TIME_PROP;
+
+            protected:
+                
+                double mark;
+                double sample_start;
+                double timing_start;
+
+                double last_image_seconds;
+                double last_section_seconds;
+
+                double sample_times[NUM_PHASES];
+                size_t sample_iterations;
+                size_t sample_accepted;
+                double sample_voxel_encodings;
+
+                double total_times[NUM_PHASES];
+                size_t total_iterations;
+                size_t total_accepted;
+                double total_voxel_encodings;
+
+            public:
+                
+                Timing();
+
+                //! Starts the first lap and sample, taking the current image times of the expected image.
+                void restart(double image_seconds = 0.0, double section_seconds = 0.0);
+
+                //! Restarts the timing from the current image times of the likelihood's expected image. Likelihoods that
+                //! aren't derived from Prob::Likelihood (e.g. the test landscapes) have no expected image and are timed
+                //! as a whole.
+                template<typename Likelihood> void start(Likelihood& likelihood) {
+                    restart_from(&likelihood);
+                }
+                
+                //! Adds the time since the last lap to 'phase'.
+                void lap(Phase phase) {
+                    double now = Utilities::monotonic_seconds();
+                    sample_times[phase] += now - mark;
+                    mark = now;
+                }
+                
+                //! Adds the time since the last lap to the likelihood, less the time the expected image has spent
+                //! generating images (and sections) since the last call, given its running totals, which is added to the
+                //! image (and section) phases instead. 'voxel_encodings' is the number of voxels x encodings scored.
+                void lap_likelihood(double image_seconds, double section_seconds,
+                                    double voxel_encodings);
+
+                //! As above, taking the image times and size from the likelihood's expected image, or just adding the
+                //! time since the last lap to the likelihood for likelihoods that aren't derived from Prob::Likelihood.
+                template<typename Likelihood> void lap_likelihood(Likelihood& likelihood) {
+                    lap_from(&likelihood);
+                }
+                
+                void count_iteration(bool accepted) {
+                    ++sample_iterations;
+                    if (accepted)
+                        ++sample_accepted;
+                }
+                
+                static void append_keys(std::vector<std::string>& header);
+
+                //! Records the time of each phase and the throughput of the current sample in the properties of 'x'.
+                template<typename State> void set_props(State& x) const {
+                    
+                    for (size_t phase_i = 0; phase_i < NUM_PHASES; ++phase_i)
+                        x.set_extend_prop_number(phase_key(phase_i), sample_times[phase_i]);
+                    
+                    double elapsed = mark - sample_start;
+                    
+                    x.set_extend_prop_number(ITERATION_RATE_PROP, rate(sample_iterations, elapsed));
+                    x.set_extend_prop_number(ACCEPTANCE_RATE_PROP, rate(sample_accepted, elapsed));
+                    x.set_extend_prop_number(VOXEL_ENCODING_TIME_PROP,
+                            voxel_encoding_time(sample_times, sample_voxel_encodings));
+                    
+                }
+                
+                //! Adds the current sample to the totals and starts the next one. The write phase of a sample is only
+                //! known once it has been saved, so it is recorded with the following sample.
+                void next_sample();
+
+                void print_summary(std::ostream& stream) const;
+
+            protected:
+                
+                // The likelihood is passed by pointer so that the overload is picked on whether it is derived from
+                // Prob::Likelihood, as a pointer to a derived class converts to a pointer to its base in preference to
+                // void*. Overloading on a reference instead would select the template for the concrete likelihood types.
+                void restart_from(Prob::Likelihood* likelihood);
+
+                void restart_from(void*) {
+                    restart();
+                }
+                
+                void lap_from(Prob::Likelihood* likelihood);
+
+                void lap_from(void*) {
+                    lap(LIKELIHOOD);
+                }
+                
+                static std::string phase_key(size_t phase_i) {
+                    return "time_" + std::string(PHASE_NAMES[phase_i]);
+                }
+                
+                static double rate(double count, double seconds) {
+                    return seconds > 0.0 ? count / seconds : 0.0;
+                }
+                
+                // Nanoseconds spent generating and scoring the expected image per voxel and encoding.
+                static double voxel_encoding_time(const double* times, double voxel_encodings) {
+                    return voxel_encodings ? (times[SECTIONS] + times[IMAGE] + times[LIKELIHOOD]) * 1e9
+                                             / voxel_encodings :
+                                             0.0;
+                }
+                
+        };
+    
+    }
+
+}
+
+#endif /* __bts_mcmc_timing_h__ */
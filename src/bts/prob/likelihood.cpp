@@ -20,6 +20,8 @@
 
  */
 
+#include <pthread.h>
+
 #include "bts/prob/likelihood.h"
 #include "bts/image/observed/buffer.h"
 #include "bts/image/expected/trilinear/buffer.h"
@@ -45,6 +47,7 @@ namespace FTS {
         const char* Likelihood::B0_INCLUDE_DEFAULT = "none";    //Also "half" or "full"
         const double Likelihood::OUTSIDE_SCALE_DEFAULT = 1.0;
         const char* Likelihood::REF_B0_DEFAULT = "max";    // Also could be "average"
+        const size_t Likelihood::REDUCTION_BLOCK_SIZE = 64;
         
         const Image::Observed::Buffer Likelihood::dummy_observed_buffer;
         const Image::Expected::Trilinear::Buffer Likelihood::dummy_expected_buffer;
@@ -101,13 +104,14 @@ namespace FTS {
                                const std::string& b0_include, double outside_scale,
                                const std::string& ref_b0, double ref_signal,
                                const Image::Double::Buffer& noise_map)
-                : sigma2_map(noise_map), obs_image(observed_image), exp_image(expected_image->clone()),
-                  b0_include(b0_include) {
+                : sigma2_map(noise_map), obs_image(new Image::Observed::Buffer(observed_image)),
+                  exp_image(expected_image->clone()),
+                  b0_include(b0_include), reduction_prepared(false) {
             
-            if (!expected_image->dims_match(obs_image))
+            if (!expected_image->dims_match(*obs_image))
                 throw Exception(
                         "Expected image dimensions (" + str(expected_image->dims())
-                        + ") do not match and observed image (" + str(obs_image.dims()) + ").");
+                        + ") do not match and observed image (" + str(obs_image->dims()) + ").");
             
             if (!sigma2_map.dim(X))
                 set_assumed_snr(assumed_snr, ref_b0, ref_signal);
@@ -124,13 +128,17 @@ namespace FTS {
             
             this->exp_image->zero();
             
+            // Prepared up front so that copies of the likelihood can share the flattened observed signals.
+            prepare_reduction(*this->exp_image);
+            
         }
         
         Likelihood::Likelihood(const Likelihood& l)
                 : sigma2(l.sigma2), sigma2_map(l.sigma2_map), obs_image(l.obs_image),
                   exp_image(l.exp_image->clone()), difference_mode(l.difference_mode),
-                  b0_include(l.b0_include)
-                   {
+                  b0_include(l.b0_include), reduction_prepared(l.reduction_prepared),
+                  flat_observed(l.flat_observed), flat_sigma2(l.flat_sigma2), dw_mask(l.dw_mask),
+                  b0_encodings(l.b0_encodings), zero_signal(l.zero_signal) {
         }
         
         Likelihood& Likelihood::operator=(const Likelihood& l) {
@@ -143,6 +151,13 @@ namespace FTS {
             exp_image = l.exp_image->clone();
             b0_include = l.b0_include;
             difference_mode = l.difference_mode;
+            reduction_prepared = l.reduction_prepared;
+            flat_observed = l.flat_observed;
+            flat_sigma2 = l.flat_sigma2;
+            dw_mask = l.dw_mask;
+            b0_encodings = l.b0_encodings;
+            zero_signal = l.zero_signal;
+            delta_previous.clear();
             
             return *this;
             
@@ -158,12 +173,12 @@ namespace FTS {
 
             if (!isnan(reference_signal))
                 ref_signal = reference_signal;
-            else if (obs_image.properties().count("noise_ref_signal"))
-                ref_signal = to<double>(obs_image.properties()["noise_ref_signal"]);
+            else if (obs_image->properties().count("noise_ref_signal"))
+                ref_signal = to<double>(obs_image->properties().find("noise_ref_signal")->second);
             else if (ref_b0 == "average")
-                ref_signal = obs_image.average_b0();
+                ref_signal = obs_image->average_b0();
             else if (ref_b0 == "max")
-                ref_signal = obs_image.max_b0();
+                ref_signal = obs_image->max_b0();
             else
                 throw Exception(
                         "Unrecognised value for '-like_ref_b0' ('" + ref_b0
@@ -174,6 +189,8 @@ namespace FTS {
 
             sigma2 = MR::Math::pow2(ref_signal / assumed_snr);
             
+            reduction_prepared = false;
+            
         }
         
         void Likelihood::set_enforce_bounds(bool flag) {
@@ -185,44 +202,287 @@ namespace FTS {
             
         }
         
-        //TODO: Collapse the workings of the different log_prob_tpl's into common subfunctions.
         double Likelihood::log_prob(Image::Expected::Buffer& image) {
             
-            double lprob = 0.0;
+            if (!reduction_prepared)
+                prepare_reduction(image);
+            
+            // The voxels are visited in blocks of a fixed size, first those within the bounds in linear order followed
+            // by the stored voxels that lie outside of them. As the blocks don't depend on the number of threads, neither
+            // does the result.
+            size_t num_items = flat_sigma2->size() + image.num_not_empty_voxels();
+            size_t num_blocks = (num_items + REDUCTION_BLOCK_SIZE - 1) / REDUCTION_BLOCK_SIZE;
+            
+            block_log_probs.resize(num_blocks);
+            
+            size_t num_jobs = min2(image.get_num_threads(), num_blocks);
+            
+            if (num_jobs > 1) {
+                
+                reduction_jobs.resize(num_jobs);
+                reduction_threads.resize(num_jobs);
+                
+                for (size_t job_i = 0; job_i < num_jobs; ++job_i) {
+                    reduction_jobs[job_i].likelihood = this;
+                    reduction_jobs[job_i].image = &image;
+                    reduction_jobs[job_i].start = (num_blocks * job_i) / num_jobs;
+                    reduction_jobs[job_i].end = (num_blocks * (job_i + 1)) / num_jobs;
+                }
+                
+                // The first job is run in the calling thread.
+                for (size_t job_i = 1; job_i < num_jobs; ++job_i)
+                    if (pthread_create(&reduction_threads[job_i], NULL, run_reduction_job,
+                            &reduction_jobs[job_i]))
+                        throw Exception(
+                                "Could not create thread " + str(job_i)
+                                + " to calculate the likelihood.");
+                
+                run_reduction_job(&reduction_jobs[0]);
+                
+                for (size_t job_i = 1; job_i < num_jobs; ++job_i)
+                    pthread_join(reduction_threads[job_i], NULL);
+                
+            } else
+                reduce_blocks(image, 0, num_blocks);
+            
+            return pairwise_sum(num_blocks ? &block_log_probs[0] : 0, num_blocks);
+            
+        }
+        
+        void Likelihood::prepare_reduction(const Image::Expected::Buffer& image) {
+            
+            size_t num_encodings = image.num_encodings();
+            
+            dw_mask.resize(num_encodings);
+            b0_encodings.clear();
+            
+            for (size_t encode_i = 0; encode_i < num_encodings; encode_i++)
+                if (image.encoding(encode_i).b_value())
+                    dw_mask[encode_i] = 1.0;
+                else {
+                    dw_mask[encode_i] = 0.0;
+                    b0_encodings.push_back(encode_i);
+                }
             
-            std::set<Image::Index> coords = image.non_empty();
+            zero_signal.assign(num_encodings, 0.0);
             
-            for (size_t x = 0; x < image.dim(X); ++x)
+            size_t num_voxels = image.dim(X) * image.dim(Y) * image.dim(Z);
+            
+            // Allocated afresh rather than resized, as the previous arrays may be shared with copies of the likelihood.
+            flat_observed = new std::vector<double>(num_voxels * num_encodings);
+            flat_sigma2 = new std::vector<double>(num_voxels);
+            
+            size_t voxel_i = 0;
+            
+            for (size_t z = 0; z < image.dim(Z); ++z)
                 for (size_t y = 0; y < image.dim(Y); ++y)
-                    for (size_t z = 0; z < image.dim(Z); ++z)
-                        coords.insert(Image::Index(x, y, z));
+                    for (size_t x = 0; x < image.dim(X); ++x) {
+                        
+                        Image::Index coord(x, y, z);
+                        
+                        // Voxels that haven't been set in the observed image are left at zero.
+                        if (!obs_image->is_empty(coord))
+                            for (size_t encode_i = 0; encode_i < num_encodings; encode_i++)
+                                (*flat_observed)[voxel_i * num_encodings + encode_i] =
+                                        (*obs_image)(coord)[encode_i];
+                        
+                        if (sigma2_map.in_bounds(coord))
+                            (*flat_sigma2)[voxel_i] = sigma2_map(coord);
+                        else
+                            (*flat_sigma2)[voxel_i] = sigma2;
+                        
+                        ++voxel_i;
+                        
+                    }
+            
+            reduction_prepared = true;
+            
+        }
+        
+        void Likelihood::reduce_blocks(const Image::Expected::Buffer& image, size_t start,
+                                       size_t end) {
+            
+            size_t num_encodings = dw_mask.size();
+            size_t num_in_bounds = flat_sigma2->size();
+            size_t num_items = num_in_bounds + image.num_not_empty_voxels();
+            
+            const std::vector<double>& observed = *flat_observed;
+            const std::vector<double>& voxel_sigma2 = *flat_sigma2;
             
-            for (std::set<Image::Index>::iterator index_it = coords.begin();
-                    index_it != coords.end(); ++index_it) {
+            for (size_t block_i = start; block_i < end; ++block_i) {
                 
-                const Image::Expected::Voxel& exp_voxel = image.operator()(*index_it);
+                // Kahan summation within each block.
+                double sum = 0.0, compensation = 0.0;
                 
-                for (size_t encode_i = 0; encode_i < image.num_encodings(); encode_i++) {
+                size_t block_end = min2(num_items, (block_i + 1) * REDUCTION_BLOCK_SIZE);
+                
+                for (size_t item_i = block_i * REDUCTION_BLOCK_SIZE; item_i < block_end; ++item_i) {
                     
-                    double observed;
+                    double lprob;
                     
-                    if (obs_image.in_bounds(*index_it))
-                        observed = obs_image(*index_it)[encode_i];
-                    else
-                        observed = 0.0;
+                    if (item_i < num_in_bounds) {
+                        
+                        Image::Index coord(item_i % image.dim(X), (item_i / image.dim(X)) % image.dim(Y),
+                                item_i / (image.dim(X) * image.dim(Y)));
+                        
+                        size_t position = image.stored_position(coord);
+                        
+                        const double* expected =
+                                position == Image::Buffer_tpl<Image::Expected::Voxel>::EMPTY ?
+                                        &zero_signal[0] : &image.stored_voxel(position)[0];
+                        
+                        lprob = signal_log_prob(expected, &observed[item_i * num_encodings], coord,
+                                voxel_sigma2[item_i]);
+                        
+                    } else {
+                        
+                        size_t position = item_i - num_in_bounds;
+                        
+                        const Image::Index& coord = image.stored_coord(position);
+                        
+                        // Voxels within the bounds have already been visited.
+                        if (coord.non_negative() && coord.bounded_by(image.dims()))
+                            continue;
+                        
+                        lprob = signal_log_prob(&image.stored_voxel(position)[0], &zero_signal[0],
+                                coord, sigma2);
+                        
+                    }
                     
-                    if (image.encoding(encode_i).b_value())
-                        lprob += log_prob(exp_voxel[encode_i], observed, *index_it);
-                    else
-                        lprob += b0_log_prob(exp_voxel[encode_i], observed);
+                    double term = lprob - compensation;
+                    double new_sum = sum + term;
+                    compensation = (new_sum - sum) - term;
+                    sum = new_sum;
                     
                 }
                 
+                block_log_probs[block_i] = sum;
+                
+            }
+            
+        }
+        
+        void* Likelihood::run_reduction_job(void* job_ptr) {
+            
+            ReductionJob& job = *(ReductionJob*) job_ptr;
+            
+            job.likelihood->reduce_blocks(*job.image, job.start, job.end);
+            
+            return 0;
+            
+        }
+        
+        double Likelihood::log_prob_delta(const Image::Expected::Buffer& image,
+                                          const Image::Expected::SignalRecord& previous) {
+            
+            if (!reduction_prepared)
+                throw Exception(
+                        "'log_prob(Image::Expected::Buffer&)' needs to be called before the change in log likelihood over "
+                        "a set of voxels can be calculated.");
+            
+            size_t num_encodings = dw_mask.size();
+            
+            double delta = 0.0;
+            
+            for (size_t record_i = 0; record_i < previous.size(); ++record_i) {
+                
+                const Image::Index& coord = previous.coord(record_i);
+                
+                const double* expected = &image.stored_voxel(previous.position(record_i))[0];
+                
+                const double* observed;
+                double sig2;
+                
+                // Voxels outside the bounds are compared against a zero signal as in 'reduce_blocks'.
+                if (coord.non_negative() && coord.bounded_by(image.dims())) {
+                    size_t item_i = coord[X] + image.dim(X) * (coord[Y] + image.dim(Y) * coord[Z]);
+                    observed = &(*flat_observed)[item_i * num_encodings];
+                    sig2 = (*flat_sigma2)[item_i];
+                } else {
+                    observed = &zero_signal[0];
+                    sig2 = sigma2;
+                }
+                
+                delta += signal_log_prob(expected, observed, coord, sig2)
+                         - signal_log_prob(previous.signal(record_i), observed, coord, sig2);
+                
+            }
+            
+            return delta;
+            
+        }
+        
+        double Likelihood::signal_log_prob(const double* expected, const double* observed,
+                                           const Image::Index& index, double sig2) {
+            
+            double lprob = 0.0;
+            
+            for (size_t encode_i = 0; encode_i < dw_mask.size(); encode_i++) {
+                
+                if (dw_mask[encode_i])
+                    lprob += log_prob(expected[encode_i], observed[encode_i], index);
+                else
+                    lprob += b0_log_prob(expected[encode_i], observed[encode_i]);
+                
             }
             
             return lprob;
             
         }
+        
+        double Likelihood::sum_square_residuals(const double* expected, const double* observed,
+                                                const double* mask, size_t num_encodings,
+                                                bool one_sided) {
+            
+            double sums[4] = { 0.0, 0.0, 0.0, 0.0 };
+            
+            size_t encode_i = 0;
+            
+            for (; encode_i + 4 <= num_encodings; encode_i += 4)
+                for (size_t lane_i = 0; lane_i < 4; ++lane_i) {
+                    
+                    double diff = expected[encode_i + lane_i] - observed[encode_i + lane_i];
+                    
+                    if (one_sided)
+                        diff = diff > 0.0 ? diff : 0.0;
+                    
+                    sums[lane_i] += mask[encode_i + lane_i] * diff * diff;
+                    
+                }
+            
+            for (; encode_i < num_encodings; ++encode_i) {
+                
+                double diff = expected[encode_i] - observed[encode_i];
+                
+                if (one_sided)
+                    diff = diff > 0.0 ? diff : 0.0;
+                
+                sums[0] += mask[encode_i] * diff * diff;
+                
+            }
+            
+            return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+            
+        }
+        
+        double Likelihood::pairwise_sum(const double* values, size_t num_values) {
+            
+            if (num_values <= 8) {
+                
+                double sum = 0.0;
+                
+                for (size_t value_i = 0; value_i < num_values; ++value_i)
+                    sum += values[value_i];
+                
+                return sum;
+                
+            }
+            
+            size_t half = num_values / 2;
+            
+            return pairwise_sum(values, half) + pairwise_sum(values + half, num_values - half);
+            
+        }
     
     }
 
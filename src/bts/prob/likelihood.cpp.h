@@ -42,90 +42,60 @@ namespace FTS {
             
         }
         
+        template<typename T> double Likelihood::log_prob_delta_tpl(const typename T::Set& current,
+                                                                   const typename T::Set& proposed,
+                                                                   size_t fibre_index) {
+            
+            exp_image->update_image(current[fibre_index], proposed[fibre_index],
+                    proposed.base_intensity(), delta_previous);
+            
+            // Only the voxels touched by the old or new fibre need to be rescored.
+            return log_prob_delta(*exp_image, delta_previous);
+            
+        }
+        
         template<typename T> double Likelihood::log_prob_tpl(const typename T::Set& fibres,
                                                              typename T::Set& gradient) {
             
-            typename Image::Reference::Buffer<typename T::Section>::Set& section_references =
-                    exp_image->expected_image_with_references(fibres);
-            
-            exp_image->precalculate_section_weighting_gradients(T());
+            exp_image->expected_image(fibres);
             
-            double lprob = 0.0;
+            double lprob = log_prob(*exp_image);
             
-            gradient = fibres;
-            gradient.zero();
+            // The derivative of the log likelihood w.r.t. the signal of each stored voxel, which is then pulled back
+            // through the sections that contributed to it (see Image::Expected::Buffer_tpl::adjoint_gradient). Empty
+            // voxels aren't stored, and as no section touches them they don't contribute to the gradient. The b0 encodings
+            // are differentiated through 'b0_log_prob', as they are scored by it in the reduction.
+            size_t num_encodings = exp_image->num_encodings();
             
-            std::set<Image::Index> coords = exp_image->non_empty_or_inbounds();
+            signal_adjoint.assign(exp_image->num_not_empty_voxels() * num_encodings, 0.0);
             
-            for (std::set<Image::Index>::iterator index_it = coords.begin();
-                    index_it != coords.end(); ++index_it) {
+            for (size_t pos_i = 0; pos_i < exp_image->num_not_empty_voxels(); ++pos_i) {
                 
-                Image::Expected::Voxel& voxel = exp_image->operator()(*index_it);
+                const Image::Index& index = exp_image->stored_coord(pos_i);
+                const Image::Expected::Voxel& voxel = exp_image->stored_voxel(pos_i);
                 
-                std::vector<double> d_lprob(exp_image->num_encodings());
+                bool in_bounds = obs_image->in_bounds(index);
                 
-                for (size_t encode_i = 0; encode_i < exp_image->num_encodings(); encode_i++) {
+                for (size_t encode_i = 0; encode_i < num_encodings; encode_i++) {
                     
-                    if (b0_include == "full" || exp_image->encoding(encode_i).b_value()) {
-                        
-                        double observed;
-                        
-                        if (obs_image.in_bounds(*index_it))
-                            observed = obs_image(*index_it)[encode_i];
-                        else
-                            observed = 0;
-                        
-                        lprob += log_prob(exp_image->operator()(*index_it)[encode_i], observed,
-                                d_lprob[encode_i], *index_it);
-                        
-                    }
+                    double observed = in_bounds ? (*obs_image)(index)[encode_i] : 0.0;
                     
-                }
-                
-                for (size_t fibre_i = 0; fibre_i < fibres.size(); fibre_i++) {
+                    double& d_lprob = signal_adjoint[pos_i * num_encodings + encode_i];
                     
-                    if (!section_references[fibre_i].is_empty(*index_it)) {
-                        
-                        std::vector<typename T::Section*>& voxel_section_references =
-                                section_references[fibre_i](*index_it);
-                        
-                        for (typename std::vector<typename T::Section*>::iterator section_it =
-                                voxel_section_references.begin();
-                                section_it != voxel_section_references.end(); ++section_it) {
-                            
-                            typename T::Section& section = **section_it;
-                            typename T::Section section_gradient;
-                            
-                            voxel.precalculate_interpolation_gradient(section);
-                            
-                            for (size_t encode_i = 0; encode_i < exp_image->num_encodings();
-                                    encode_i++) {
-                                
-                                if (b0_include == "full" || exp_image->encoding(encode_i).b_value()) {
-                                    
-                                    voxel.direction(encode_i).signal(section, section_gradient);
-                                    
-                                    section_gradient.unnormalize_gradient(exp_image->vox_lengths());
-                                    
-                                    //Pre-multiply the section gradient with the lprob derivative, so it can be added directly to the
-                                    //fibre gradient.
-                                    section_gradient *= d_lprob[encode_i];
-                                    
-                                    gradient[fibre_i].add_section_gradient(fibres[fibre_i], section,
-                                            section_gradient);
-                                    
-                                }
-                                
-                            }
-                            
-                        }
-                        
-                    }
+                    if (exp_image->encoding(encode_i).b_value())
+                        log_prob(voxel[encode_i], observed, d_lprob, index);
+                    else
+                        b0_log_prob(voxel[encode_i], observed, d_lprob);
                     
                 }
                 
             }
             
+            gradient = fibres;
+            gradient.zero();
+            
+            exp_image->adjoint_gradient(fibres, signal_adjoint, gradient);
+            
             return lprob;
             
         }
@@ -182,8 +152,8 @@ namespace FTS {
                         
                         double observed;
                         
-                        if (obs_image.in_bounds(*index_it))
-                            observed = obs_image(*index_it)[encode_i];
+                        if (obs_image->in_bounds(*index_it))
+                            observed = (*obs_image)(*index_it)[encode_i];
                         else
                             observed = 0;
                         
@@ -113,6 +113,10 @@ namespace FTS {
         properties["like_noise_map"] = like_noise_map_name; \
   } \
 
+#include <pthread.h>
+
+#include "ptr.h"
+
 #include "bts/image/expected/buffer.h"
 #include "bts/image/expected/trilinear/buffer.h"
 #include "bts/image/observed/buffer.h"
@@ -148,6 +152,9 @@ namespace FTS {
                 const static Image::Observed::Buffer dummy_observed_buffer;
                 const static Image::Expected::Trilinear::Buffer dummy_expected_buffer;
 
+                //! The number of voxels summed into each partial sum by 'log_prob(Image::Expected::Buffer&)'.
+                const static size_t REDUCTION_BLOCK_SIZE;
+
             public:
                 
                 static Likelihood* factory(const std::string& type,
@@ -162,7 +169,8 @@ namespace FTS {
                 double sigma2;
                 Image::Double::Buffer sigma2_map;
 
-                Image::Observed::Buffer obs_image;
+                // Shared between copies of the likelihood (e.g. the chains of a multi-chain run), as it is only read.
+                MR::RefPtr<const Image::Observed::Buffer> obs_image;
                 Image::Expected::Buffer* exp_image;
 
                 Image::Container::Buffer<Fibre::Strand>::Set recycled_strand_gradients;
@@ -174,6 +182,47 @@ namespace FTS {
 
                 std::string b0_include;
 
+                //! The signals of the voxels touched by the last call to 'log_prob_delta', prior to the update.
+                Image::Expected::SignalRecord delta_previous;
+
+                //! Precalculated on the first call to 'log_prob(Image::Expected::Buffer&)' (see prepare_reduction). The
+                //! observed signal and noise variance of every voxel within the image bounds in linear order (x fastest),
+                //! which are shared between copies of the likelihood like the observed image.
+                bool reduction_prepared;
+                MR::RefPtr<std::vector<double> > flat_observed;
+                MR::RefPtr<std::vector<double> > flat_sigma2;
+
+                //! 1.0 for the diffusion-weighted encodings and 0.0 for the b=0 encodings, which are listed separately.
+                std::vector<double> dw_mask;
+                std::vector<size_t> b0_encodings;
+
+                //! The signal of empty voxels, and the observed signal of voxels outside the image bounds.
+                std::vector<double> zero_signal;
+
+                //! The derivatives of the log likelihood w.r.t. the signal of each stored voxel, kept between calls to the
+                //! gradient version of 'log_prob' to avoid reallocating it.
+                std::vector<double> signal_adjoint;
+
+                //! Partial sums of each block of non-empty voxels, and the threads they are calculated in.
+                std::vector<double> block_log_probs;
+
+                class ReductionJob {
+                        
+                    public:
+                        
+                        Likelihood* likelihood;
+                        const Image::Expected::Buffer* image;
+                        size_t start, end;
+
+                        ReductionJob()
+                                : likelihood(0), image(0), start(0), end(0) {
+                        }
+                        
+                };
+                
+                std::vector<ReductionJob> reduction_jobs;
+                std::vector<pthread_t> reduction_threads;
+
             public:
                 
                 Likelihood(const Image::Observed::Buffer& observed_image,
@@ -188,6 +237,10 @@ namespace FTS {
                     delete this->exp_image;
                 }
                 
+                //! Copies share the observed image, the diffusion model and the flattened observed signals, but get their own
+                //! expected image.
+                virtual Likelihood* clone() const = 0;
+                
                 Likelihood& operator=(const Likelihood& l);
 
                 virtual double log_prob(Image::Expected::Buffer& image);
@@ -264,8 +317,43 @@ namespace FTS {
                     throw Exception("should be implemented in derrived class.");
                 }
                 
+                /*! Returns the change in log likelihood between 'current' and 'proposed' where only the fibre at
+                 *  'fibre_index' differs between them. The expected image must hold the image of 'current' (i.e. from the
+                 *  last call to 'log_prob' or an accepted 'log_prob_delta'), and is updated in place to hold the image of
+                 *  'proposed'. If the proposal is rejected 'revert_delta' should be called to restore it.
+                 */
+                virtual double log_prob_delta(const Fibre::Strand::Set& current,
+                                              const Fibre::Strand::Set& proposed,
+                                              size_t fibre_index) {
+                    return log_prob_delta_tpl<Fibre::Strand>(current, proposed, fibre_index);
+                }
+                
+                virtual double log_prob_delta(const Fibre::Tractlet::Set& current,
+                                              const Fibre::Tractlet::Set& proposed,
+                                              size_t fibre_index) {
+                    return log_prob_delta_tpl<Fibre::Tractlet>(current, proposed, fibre_index);
+                }
+                
+                /*! Returns the change in log likelihood when the signals of the voxels recorded in 'previous' change to
+                 *  their signals in 'image' (e.g. a copy of the expected image updated with 'part_image'). Only reads the
+                 *  members precalculated by 'log_prob(Image::Expected::Buffer&)', which must have been called first, so
+                 *  it is safe to call from multiple threads on separate images.
+                 */
+                double log_prob_delta(const Image::Expected::Buffer& image,
+                                      const Image::Expected::SignalRecord& previous);
+
+                //! Restores the expected image to its state before the last call to 'log_prob_delta'.
+                void revert_delta() {
+                    exp_image->revert_image(delta_previous);
+                    delta_previous.clear();
+                }
+                
                 template<typename T> double log_prob_tpl(const typename T::Set& fibres);
 
+                template<typename T> double log_prob_delta_tpl(const typename T::Set& current,
+                                                               const typename T::Set& proposed,
+                                                               size_t fibre_index);
+
                 template<typename T> double log_prob_tpl(const typename T::Set& fibres,
                                                          typename T::Set& gradient);
 
@@ -277,6 +365,9 @@ namespace FTS {
 
                 virtual double b0_log_prob(double expected, double observed) = 0;
 
+                //! Also returns the derivative of 'b0_log_prob' w.r.t. the expected signal in 'd_lprob'.
+                virtual double b0_log_prob(double expected, double observed, double& d_lprob) = 0;
+
                 virtual double log_prob(double expected, double observed, double& d_lprob, const Image::Index& index) = 0;
 
                 virtual double log_prob(double expected, double observed, double& d_lprob,
@@ -294,7 +385,7 @@ namespace FTS {
                 
                 const Image::Observed::Buffer& get_observed_image()    //Used for debugging
                 {
-                    return obs_image;
+                    return *obs_image;
                 }
                 
                 void set_enforce_bounds(bool flag);
@@ -303,13 +394,38 @@ namespace FTS {
 
             protected:
                 
+                /*! The log likelihood of a single voxel given its expected and observed signals (one per encoding) and noise
+                 *  variance. Likelihoods that can be evaluated in a single sweep over the encodings override it, otherwise
+                 *  'log_prob' or 'b0_log_prob' is called for each encoding. Must be safe to call from multiple threads.
+                 */
+                virtual double signal_log_prob(const double* expected, const double* observed,
+                                               const Image::Index& index, double sig2);
+
+                //! Fills the precalculated members used by 'log_prob(Image::Expected::Buffer&)'.
+                void prepare_reduction(const Image::Expected::Buffer& image);
+
+                //! Sums the log likelihoods of the voxels in blocks [start, end) into 'block_log_probs' (see log_prob).
+                void reduce_blocks(const Image::Expected::Buffer& image, size_t start, size_t end);
+
+                static void* run_reduction_job(void* job);
+
+                //! Sums the residuals squared of the (masked) encodings using independent accumulators so the loop can be
+                //! vectorised. If 'one_sided' only the residuals where the expected signal exceeds the observed are included.
+                static double sum_square_residuals(const double* expected, const double* observed,
+                                                   const double* mask, size_t num_encodings,
+                                                   bool one_sided = false);
+
+                //! Sums the values by recursive halving so the rounding error only grows with the log of their number.
+                static double pairwise_sum(const double* values, size_t num_values);
+
                 //! Used to get the right used gradients for the templated type.
                 template<typename T> typename Image::Container::Buffer<T>::Set& get_recycled_gradients();
 
                 //! Used to get the right used hessians for the templated type.
                 template<typename T> typename Image::Container::Buffer<typename T::Tensor>::Set& get_recycled_hessians();
 
-                Likelihood() {
+                Likelihood()
+                        : reduction_prepared(false) {
                 }
                 
                 friend std::ostream& operator<<(std::ostream& stream, const Likelihood& likelihood);
@@ -29,8 +29,7 @@ namespace FTS {
         
         template<typename T> double Likelihood::Gaussian::log_prob_and_fisher_tpl(
                 const typename T::Set& fibres, typename T::Set& gradient,
-                typename T::Set::Tensor& fisher_info,
-                std::vector<typename T::Set::Tensor>& fisher_info_gradients) {
+                Math::BlockSparse& fisher_info, std::vector<Math::BlockSparse>& fisher_info_gradients) {
             
             size_t fibres_vector_size = fibres.vsize();
             
@@ -42,15 +41,19 @@ namespace FTS {
             double lprob = 0.0;
             
             gradient = fibres;
-            fisher_info = typename T::Set::Tensor(fibres);
-            
             gradient.zero();
-            fisher_info.zero();
             
-            fisher_info_gradients.clear();
+            // Only the blocks between fibres that share a voxel are stored, and the gradient with respect to an element of
+            // a fibre only has blocks in that fibre's row and column.
+            fisher_info.set_fibre_blocks(fibres);
+            
+            for (size_t fibre_i = 0; fibre_i < fibres.size(); fibre_i++)
+                fisher_info.block(fibre_i, fibre_i);
+            
+            fisher_info_gradients.assign(fibres_vector_size, Math::BlockSparse());
             
             for (size_t elem_i = 0; elem_i < fibres_vector_size; elem_i++)
-                fisher_info_gradients.push_back(fisher_info);
+                fisher_info_gradients[elem_i].set_fibre_blocks(fibres);
             
             //      bool has_base_intensity = fibres.has_intrinsic_property("base_intensity");
             //
@@ -95,8 +98,8 @@ namespace FTS {
                         
                         double observed;
                         
-                        if (obs_image.in_bounds(*index_it))
-                            observed = obs_image(*index_it)[encode_i];
+                        if (obs_image->in_bounds(*index_it))
+                            observed = (*obs_image)(*index_it)[encode_i];
                         else
                             observed = 0;
                         
@@ -186,56 +189,72 @@ namespace FTS {
                         for (size_t nonzero_i1 = 0; nonzero_i1 < nonzero_fibres.size();
                                 ++nonzero_i1) {
                             
-                            size_t start1 = fibre_block_start[nonzero_fibres[nonzero_i1]];
+                            size_t fibre1 = nonzero_fibres[nonzero_i1];
+                            size_t start1 = fibre_block_start[fibre1];
                             MR::Math::Vector<double>& gradient1 = gradient_vectors[nonzero_i1];
                             MR::Math::Matrix<double>& hessian1 = hessian_matrices[nonzero_i1];
                             
+                            MR::Math::Matrix<double>& fisher_block11 = fisher_info.block(fibre1, fibre1);
+                            
                             for (size_t i1 = 0; i1 < gradient1.size(); i1++)
                                 for (size_t i2 = 0; i2 < gradient1.size(); i2++) {
-                                    fisher_info(start1 + i1, start1 + i2) += d2_lprob2[encode_i]
-                                            * gradient1[i1] * gradient1[i2];
+                                    fisher_block11(i1, i2) += d2_lprob2[encode_i] * gradient1[i1]
+                                            * gradient1[i2];
 //                  std::cout << "fisher_info(" << start1 + i1 << ", " << start1 + i2 << ") = " << fisher_info(start1 + i1, start1 + i2) << " (" << d2_lprob2[encode_i] * gradient1[i1] * gradient1[i2] << ")" << std::endl;
                                 }
                             
-                            for (size_t i1 = 0; i1 < gradient1.size(); i1++)
+                            for (size_t i1 = 0; i1 < gradient1.size(); i1++) {
+                                
+                                MR::Math::Matrix<double>& gradient_block11 =
+                                        fisher_info_gradients[start1 + i1].block(fibre1, fibre1);
+                                
                                 for (size_t i2 = 0; i2 < gradient1.size(); i2++)
                                     for (size_t i3 = 0; i3 < gradient1.size(); i3++)
-                                        fisher_info_gradients[start1 + i1](start1 + i2, start1 + i3) +=
-                                                d2_lprob2[encode_i] * (hessian1(i2, i1)
-                                                        * gradient1[i3]
-                                                                       + gradient1[i2] * hessian1(
-                                                                                 i3, i1));
+                                        gradient_block11(i2, i3) += d2_lprob2[encode_i]
+                                                * (hessian1(i2, i1) * gradient1[i3]
+                                                   + gradient1[i2] * hessian1(i3, i1));
+                                
+                            }
                             
                             for (size_t nonzero_i2 = nonzero_i1 + 1;
                                     nonzero_i2 < nonzero_fibres.size(); ++nonzero_i2) {
                                 
-                                size_t start2 = fibre_block_start[nonzero_fibres[nonzero_i2]];
+                                size_t fibre2 = nonzero_fibres[nonzero_i2];
                                 MR::Math::Vector<double>& gradient2 = gradient_vectors[nonzero_i2];
                                 
+                                MR::Math::Matrix<double>& fisher_block12 = fisher_info.block(fibre1, fibre2);
+                                MR::Math::Matrix<double>& fisher_block21 = fisher_info.block(fibre2, fibre1);
+                                
                                 for (size_t i1 = 0; i1 < gradient1.size(); i1++)
                                     for (size_t i2 = 0; i2 < gradient2.size(); i2++) {
                                         
                                         double incr = d2_lprob2[encode_i] * gradient1[i1]
                                                       * gradient2[i2];
                                         
-                                        fisher_info(start1 + i1, start2 + i2) += incr;
-                                        fisher_info(start2 + i2, start1 + i1) += incr;
+                                        fisher_block12(i1, i2) += incr;
+                                        fisher_block21(i2, i1) += incr;
                                         
                                     }
                                 
-                                for (size_t i1 = 0; i1 < gradient1.size(); i1++)
+                                for (size_t i1 = 0; i1 < gradient1.size(); i1++) {
+                                    
+                                    MR::Math::Matrix<double>& gradient_block12 =
+                                            fisher_info_gradients[start1 + i1].block(fibre1, fibre2);
+                                    MR::Math::Matrix<double>& gradient_block21 =
+                                            fisher_info_gradients[start1 + i1].block(fibre2, fibre1);
+                                    
                                     for (size_t i2 = 0; i2 < gradient1.size(); i2++)
                                         for (size_t i3 = 0; i3 < gradient2.size(); i3++) {
                                             
                                             double incr = d2_lprob2[encode_i] * hessian1(i2, i1)
                                                           * gradient2[i3];
                                             
-                                            fisher_info_gradients[start1 + i1](start1 + i2,
-                                                    start2 + i3) += incr;
-                                            fisher_info_gradients[start1 + i1](start2 + i3,
-                                                    start1 + i2) += incr;
+                                            gradient_block12(i2, i3) += incr;
+                                            gradient_block21(i3, i2) += incr;
                                             
                                         }
+                                    
+                                }
                                 
                             }
                             
@@ -251,7 +270,7 @@ namespace FTS {
         
         template<typename T> double Likelihood::Gaussian::log_prob_and_fisher_tpl(
                 const typename T::Set& fibres, typename T::Set& gradient,
-                typename T::Set::Tensor& fisher_info) {
+                Math::BlockSparse& fisher_info) {
             
             typename Image::Reference::Buffer<typename T::Section>::Set& section_references =
                     exp_image->expected_image_with_references(fibres);
@@ -261,23 +280,12 @@ namespace FTS {
             double lprob = 0.0;
             
             gradient = fibres;
-            fisher_info = typename T::Set::Tensor(fibres);
-            
             gradient.zero();
-            fisher_info.zero();
             
-            std::vector<size_t> fibre_block_start;
-            std::vector<size_t> fibre_block_end;
+            fisher_info.set_fibre_blocks(fibres);
             
-            //      size_t block_start = has_base_intensity;
-            size_t block_start = 0;
-            
-            for (size_t fibre_i = 0; fibre_i < fibres.size(); fibre_i++) {
-                fibre_block_start.push_back(block_start);
-                fibre_block_end.push_back(block_start += fibres[fibre_i].vsize());
-            }
-            
-            //      assert(block_start == fibre_vector_size);
+            for (size_t fibre_i = 0; fibre_i < fibres.size(); fibre_i++)
+                fisher_info.block(fibre_i, fibre_i);
             
             std::set<Image::Index> coords = exp_image->non_empty_or_inbounds();
             
@@ -298,8 +306,8 @@ namespace FTS {
                         
                         double observed;
                         
-                        if (obs_image.in_bounds(*index_it))
-                            observed = obs_image(*index_it)[encode_i];
+                        if (obs_image->in_bounds(*index_it))
+                            observed = (*obs_image)(*index_it)[encode_i];
                         else
                             observed = 0;
                         
@@ -401,6 +409,9 @@ namespace FTS {
                                         
                                         MR::Math::Vector<double>& gradient_vector2 = gradient2;
                                         
+                                        MR::Math::Matrix<double>& fisher_block = fisher_info.block(
+                                                fibre_i1, fibre_i2);
+                                        
                                         //--------------------------------------------------------------------------------------------//
                                         //  Add the outer product of the two gradient vectors to the appropriate block of the Hessian //
                                         //--------------------------------------------------------------------------------------------//
@@ -409,17 +420,11 @@ namespace FTS {
                                                 fibre_elem_i1 < gradient_vector1.size();
                                                 fibre_elem_i1++) {
                                             
-                                            size_t elem_i1 = fibre_block_start[fibre_i1]
-                                                    + fibre_elem_i1;
-                                            
                                             for (size_t fibre_elem_i2 = 0;
                                                     fibre_elem_i2 < gradient_vector2.size();
                                                     fibre_elem_i2++) {
                                                 
-                                                size_t elem_i2 = fibre_block_start[fibre_i2]
-                                                        + fibre_elem_i2;
-                                                
-                                                fisher_info(elem_i1, elem_i2) +=
+                                                fisher_block(fibre_elem_i1, fibre_elem_i2) +=
                                                         gradient_vector1[fibre_elem_i1] * gradient_vector2[fibre_elem_i2]
                                                         * d2_lprob2[encode_i];
                                                 
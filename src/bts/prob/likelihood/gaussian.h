@@ -26,6 +26,7 @@
 #include "bts/prob/prob.h"
 #include "bts/prob/likelihood.h"
 #include "bts/prob/likelihood.h"
+#include "bts/math/block_sparse.h"
 
 namespace FTS {
     
@@ -52,6 +53,10 @@ namespace FTS {
                         : Likelihood(s) {
                 }
                 
+                Gaussian* clone() const {
+                    return new Gaussian(*this);
+                }
+                
                 ~Gaussian() {
                 }
                 
@@ -62,11 +67,41 @@ namespace FTS {
                 
                 using Likelihood::log_prob;
 
+                double signal_log_prob(const double* expected, const double* observed,
+                                       const Image::Index& index, double sig2) {
+                    
+                    double lprob = -sum_square_residuals(expected, observed, &dw_mask[0], dw_mask.size())
+                            / (2.0 * sig2);
+                    
+                    for (size_t b0_i = 0; b0_i < b0_encodings.size(); ++b0_i)
+                        lprob += b0_log_prob(expected[b0_encodings[b0_i]], observed[b0_encodings[b0_i]]);
+                    
+                    return lprob;
+                    
+                }
+                
+
+                //! The Fisher information and its gradients are assembled block-sparse, where only the blocks between
+                //! fibres that share a voxel are stored.
+                double log_prob_and_fisher(const Fibre::Strand::Set& strands, Fibre::Strand::Set& gradient,
+                                           Math::BlockSparse& fisher_info,
+                                           std::vector<Math::BlockSparse>& fisher_info_gradients) {
+                    return log_prob_and_fisher_tpl<Fibre::Strand>(strands, gradient, fisher_info,
+                            fisher_info_gradients);
+                }
+                
+                double log_prob_and_fisher(const Fibre::Tractlet::Set& tractlets,
+                                           Fibre::Tractlet::Set& gradient, Math::BlockSparse& fisher_info,
+                                           std::vector<Math::BlockSparse>& fisher_info_gradients) {
+                    return log_prob_and_fisher_tpl<Fibre::Tractlet>(tractlets, gradient, fisher_info,
+                            fisher_info_gradients);
+                }
+                
                 double log_prob_and_fisher(
                         const Fibre::Strand::Set& strands, Fibre::Strand::Set& gradient,
                         Fibre::Strand::Set::Tensor& fisher_info,
                         std::vector<Fibre::Strand::Set::Tensor>& fisher_info_gradients) {
-                    return log_prob_and_fisher_tpl<Fibre::Strand>(strands, gradient, fisher_info,
+                    return dense_log_prob_and_fisher<Fibre::Strand>(strands, gradient, fisher_info,
                             fisher_info_gradients);
                 }
                 
@@ -74,31 +109,82 @@ namespace FTS {
                         const Fibre::Tractlet::Set& tractlets, Fibre::Tractlet::Set& gradient,
                         Fibre::Tractlet::Set::Tensor& fisher_info,
                         std::vector<Fibre::Tractlet::Set::Tensor>& fisher_info_gradients) {
-                    return log_prob_and_fisher_tpl<Fibre::Tractlet>(tractlets, gradient,
+                    return dense_log_prob_and_fisher<Fibre::Tractlet>(tractlets, gradient,
                             fisher_info, fisher_info_gradients);
                 }
                 
                 template<typename T> double log_prob_and_fisher_tpl(
                         const typename T::Set& fibres, typename T::Set& gradient,
-                        typename T::Set::Tensor& fisher_info,
-                        std::vector<typename T::Set::Tensor>& fisher_info_gradients);
+                        Math::BlockSparse& fisher_info,
+                        std::vector<Math::BlockSparse>& fisher_info_gradients);
 
+                double log_prob_and_fisher(const Fibre::Strand::Set& strands,
+                                           Fibre::Strand::Set& gradient, Math::BlockSparse& fisher_info) {
+                    return log_prob_and_fisher_tpl<Fibre::Strand>(strands, gradient, fisher_info);
+                }
+                
+                double log_prob_and_fisher(const Fibre::Tractlet::Set& strands,
+                                           Fibre::Tractlet::Set& gradient,
+                                           Math::BlockSparse& fisher_info) {
+                    return log_prob_and_fisher_tpl<Fibre::Tractlet>(strands, gradient, fisher_info);
+                }
+                
                 double log_prob_and_fisher(const Fibre::Strand::Set& strands,
                                            Fibre::Strand::Set& gradient,
                                            Fibre::Strand::Set::Tensor& fisher_info) {
-                    return log_prob_and_fisher_tpl<Fibre::Strand>(strands, gradient, fisher_info);
+                    return dense_log_prob_and_fisher<Fibre::Strand>(strands, gradient, fisher_info);
                 }
                 
                 double log_prob_and_fisher(const Fibre::Tractlet::Set& strands,
                                            Fibre::Tractlet::Set& gradient,
                                            Fibre::Tractlet::Set::Tensor& fisher_info) {
-                    return log_prob_and_fisher_tpl<Fibre::Tractlet>(strands, gradient, fisher_info);
+                    return dense_log_prob_and_fisher<Fibre::Tractlet>(strands, gradient, fisher_info);
                 }
                 
                 template<typename T> double log_prob_and_fisher_tpl(
                         const typename T::Set& fibres, typename T::Set& gradient,
-                        typename T::Set::Tensor& fisher_info);
+                        Math::BlockSparse& fisher_info);
 
+                //! Dense copies of the block-sparse Fisher information (and gradients), for the testers and tools that
+                //! need the full matrices.
+                template<typename T> double dense_log_prob_and_fisher(
+                        const typename T::Set& fibres, typename T::Set& gradient,
+                        typename T::Set::Tensor& fisher_info,
+                        std::vector<typename T::Set::Tensor>& fisher_info_gradients) {
+                    
+                    Math::BlockSparse sparse_fisher;
+                    std::vector<Math::BlockSparse> sparse_fisher_gradients;
+                    
+                    double lprob = log_prob_and_fisher_tpl<T>(fibres, gradient, sparse_fisher,
+                            sparse_fisher_gradients);
+                    
+                    fisher_info = typename T::Set::Tensor(fibres);
+                    sparse_fisher.copy_to(fisher_info);
+                    
+                    fisher_info_gradients.assign(sparse_fisher_gradients.size(), fisher_info);
+                    
+                    for (size_t elem_i = 0; elem_i < sparse_fisher_gradients.size(); ++elem_i)
+                        sparse_fisher_gradients[elem_i].copy_to(fisher_info_gradients[elem_i]);
+                    
+                    return lprob;
+                    
+                }
+                
+                template<typename T> double dense_log_prob_and_fisher(
+                        const typename T::Set& fibres, typename T::Set& gradient,
+                        typename T::Set::Tensor& fisher_info) {
+                    
+                    Math::BlockSparse sparse_fisher;
+                    
+                    double lprob = log_prob_and_fisher_tpl<T>(fibres, gradient, sparse_fisher);
+                    
+                    fisher_info = typename T::Set::Tensor(fibres);
+                    sparse_fisher.copy_to(fisher_info);
+                    
+                    return lprob;
+                    
+                }
+                
                 double log_prob(double expected, double observed, const Image::Index& index) {
                     
                     double sig2;
@@ -135,6 +221,19 @@ namespace FTS {
                     
                 }
                 
+                double b0_log_prob(double expected, double observed, double& d_lprob) {
+                    
+                    double diff = expected - observed;
+                    
+                    if (b0_include == "full" || ((b0_include == "half") && diff > 0))
+                        d_lprob = -diff / this->sigma2;
+                    else
+                        d_lprob = 0.0;
+                    
+                    return b0_log_prob(expected, observed);
+                    
+                }
+                
                 double log_prob(double expected, double observed, double& d_lprob, const Image::Index& index) {
                     
                     double diff = expected - observed;
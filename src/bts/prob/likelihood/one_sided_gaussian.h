@@ -52,6 +52,10 @@ namespace FTS {
                         : Likelihood(s) {
                 }
                 
+                OneSidedGaussian* clone() const {
+                    return new OneSidedGaussian(*this);
+                }
+                
                 ~OneSidedGaussian() {
                 }
                 
@@ -62,10 +66,24 @@ namespace FTS {
                 
                 using Likelihood::log_prob;
 
+                double signal_log_prob(const double* expected, const double* observed,
+                                       const Image::Index& index, double sig2) {
+                    
+                    double lprob = -sum_square_residuals(expected, observed, &dw_mask[0], dw_mask.size(), true)
+                            / (2.0 * sig2);
+                    
+                    for (size_t b0_i = 0; b0_i < b0_encodings.size(); ++b0_i)
+                        lprob += b0_log_prob(expected[b0_encodings[b0_i]], observed[b0_encodings[b0_i]]);
+                    
+                    return lprob;
+                    
+                }
+                
+
                 double log_prob(double expected, double observed, const Image::Index& index) {
                     
                     double sig2;
-                    if (!sigma2_map)
+                    if (sigma2_map.in_bounds(index))
                         sig2 = sigma2_map(index);
                     else
                         sig2 = sigma2;
@@ -103,6 +121,19 @@ namespace FTS {
                     
                 }
                 
+                double b0_log_prob(double expected, double observed, double& d_lprob) {
+                    
+                    double diff = expected - observed;
+                    
+                    if ((this->b0_include == "full" || this->b0_include == "half") && diff > 0)
+                        d_lprob = -diff / this->sigma2;
+                    else
+                        d_lprob = 0.0;
+                    
+                    return b0_log_prob(expected, observed);
+                    
+                }
+                
                 double log_prob(double expected, double observed, double& d_lprob, const Image::Index& index) {
                     
                     double diff = expected - observed;
@@ -24,7 +24,7 @@
 #define __bts_prob_likelihood_imagediff_rician_h__
 
 #include "math/math.h"
-#include "math/bessel.h"
+#include "bts/math/bessel.h"
 
 #include "bts/prob/likelihood.h"
 
@@ -53,6 +53,10 @@ namespace FTS {
                         : Likelihood(s) {
                 }
                 
+                Rician* clone() const {
+                    return new Rician(*this);
+                }
+                
                 ~Rician() {
                 }
                 
@@ -106,65 +110,140 @@ namespace FTS {
                 
                 double log_prob(double expected, double observed, const Image::Index& index) {
                     
-                    assert(expected > 0.0 && observed > 0.0);
+                    assert(expected >= 0.0 && observed > 0.0);
                     
                     double sig2;
-                    if (!sigma2_map)
+                    if (sigma2_map.in_bounds(index))
                         sig2 = sigma2_map(index);
                     else
                         sig2 = sigma2;
 
-                    double bessel_x = expected * observed / this->sigma2;
-                    
-                    double lprob = MR::Math::log(
-                                           observed / this->sigma2 * MR::Math::exp(
-                                                   -(MR::Math::pow2(observed) + MR::Math::pow2(
-                                                             expected))
-                                                   / (2.0 * sig2))
-                                           * MR::Math::Bessel::I0_scaled(bessel_x))
-                                   + bessel_x;
-                    
-                    return lprob;
+                    return rician_log_prob(expected, observed, sig2,
+                            Math::Bessel::log_i0_scaled(expected * observed / sig2));
                     
                 }
                 
                 double b0_log_prob(double expected, double observed) {
                     
-                    assert(expected > 0.0 && observed > 0.0);
+                    assert(expected >= 0.0 && observed > 0.0);
                     
                     double lprob;
                     
-                    if (b0_include == "full") {
-                        
-                        double bessel_x = expected * observed / this->sigma2;
-                        
-                        lprob = MR::Math::log(
-                                        observed / this->sigma2 * MR::Math::exp(
-                                                -(MR::Math::pow2(observed) + MR::Math::pow2(
-                                                          expected))
-                                                / (2.0 * this->sigma2))
-                                        * MR::Math::Bessel::I0_scaled(bessel_x))
-                                + bessel_x;
-                        
-                    } else
+                    if (b0_include == "full")
+                        lprob = rician_log_prob(expected, observed, this->sigma2,
+                                Math::Bessel::log_i0_scaled(expected * observed / this->sigma2));
+                    else
                         lprob = 0.0;
                     
                     return lprob;
                     
                 }
                 
+                double b0_log_prob(double expected, double observed, double& d_lprob) {
+                    
+                    assert(expected >= 0.0 && observed > 0.0);
+                    
+                    if (b0_include == "full")
+                        d_lprob = (observed
+                                   * Math::Bessel::i1_i0_ratio(expected * observed / this->sigma2)
+                                   - expected) / this->sigma2;
+                    else
+                        d_lprob = 0.0;
+                    
+                    return b0_log_prob(expected, observed);
+                    
+                }
+                
                 double log_prob(double expected, double observed, double& d_lprob, const Image::Index& index) {
                     
-                    throw Exception("Not implemented yet.");
+                    double d2_lprob2;
+                    
+                    return log_prob(expected, observed, d_lprob, d2_lprob2, index);
                     
                 }
                 
+                // With x = e*o/sig2 and R = I1(x)/I0(x), using d/dx log(I0(x)) = R and dR/dx = 1 - R/x - R^2.
                 double log_prob(double expected, double observed, double& d_lprob,
                                 double& d2_lprob2, const Image::Index& index) {
                     
-                    throw Exception("Not implemented yet.");
+                    assert(expected >= 0.0 && observed > 0.0);
+                    
+                    double sig2;
+                    if (sigma2_map.in_bounds(index))
+                        sig2 = sigma2_map(index);
+                    else
+                        sig2 = sigma2;
+                    
+                    double bessel_x = expected * observed / sig2;
+                    
+                    double ratio = Math::Bessel::i1_i0_ratio(bessel_x);
+                    
+                    // R/x tends to 1/2 as x tends to 0.
+                    double ratio_on_x = bessel_x > 1e-8 ? ratio / bessel_x : 0.5;
+                    
+                    d_lprob = (observed * ratio - expected) / sig2;
+                    
+                    d2_lprob2 = -1.0 / sig2
+                                + MR::Math::pow2(observed / sig2) * (1.0 - ratio_on_x - MR::Math::pow2(ratio));
+                    
+                    return rician_log_prob(expected, observed, sig2, Math::Bessel::log_i0_scaled(bessel_x));
+                    
                 }
                 
+            protected:
+                
+                //! Evaluates the Bessel functions of all the encodings of a voxel in one batch (in chunks on the stack).
+                double signal_log_prob(const double* expected, const double* observed,
+                                       const Image::Index& index, double sig2) {
+                    
+                    bool full_b0 = b0_include == "full";
+                    
+                    size_t num_encodings = dw_mask.size();
+                    
+                    double encode_sigma2[SIGNAL_CHUNK_SIZE];
+                    double bessel_x[SIGNAL_CHUNK_SIZE];
+                    double log_bessel[SIGNAL_CHUNK_SIZE];
+                    
+                    double lprob = 0.0;
+                    
+                    for (size_t chunk_start = 0; chunk_start < num_encodings; chunk_start +=
+                            SIGNAL_CHUNK_SIZE) {
+                        
+                        size_t chunk_size = num_encodings - chunk_start;
+                        if (chunk_size > SIGNAL_CHUNK_SIZE)
+                            chunk_size = SIGNAL_CHUNK_SIZE;
+                        
+                        for (size_t encode_i = 0; encode_i < chunk_size; ++encode_i) {
+                            encode_sigma2[encode_i] = dw_mask[chunk_start + encode_i] ? sig2 : this->sigma2;
+                            bessel_x[encode_i] = expected[chunk_start + encode_i]
+                                    * observed[chunk_start + encode_i] / encode_sigma2[encode_i];
+                        }
+                        
+                        Math::Bessel::log_i0_scaled(bessel_x, log_bessel, chunk_size);
+                        
+                        for (size_t encode_i = 0; encode_i < chunk_size; ++encode_i)
+                            if (full_b0 || dw_mask[chunk_start + encode_i])
+                                lprob += rician_log_prob(expected[chunk_start + encode_i],
+                                        observed[chunk_start + encode_i], encode_sigma2[encode_i],
+                                        log_bessel[encode_i]);
+                        
+                    }
+                    
+                    return lprob;
+                    
+                }
+                
+                /*! log(o/sig2 * exp(-(o^2 + e^2)/(2 sig2)) * I0(e*o/sig2)), with the exp(e*o/sig2) growth of I0 cancelled
+                 *  against the Gaussian term so that neither underflows or overflows.
+                 */
+                static double rician_log_prob(double expected, double observed, double sig2,
+                                              double log_i0_scaled) {
+                    return MR::Math::log(observed / sig2)
+                           - MR::Math::pow2(observed - expected) / (2.0 * sig2) + log_i0_scaled;
+                }
+                
+                static const size_t SIGNAL_CHUNK_SIZE = 64;
+                
         };
     
     }
@@ -204,6 +204,7 @@
 #include "bts/fibre/strand/set.h"
 #include "bts/fibre/tractlet/set.h"
 #include "bts/mcmc/state.h"
+#include "bts/math/block_sparse.h"
 
 namespace FTS {
     
@@ -311,6 +312,18 @@ namespace FTS {
                     
                 }
                 
+                //! The change in the log probability when only the fibre at 'fibre_i' differs between the two sets, which
+                //! only requires the prior of that fibre to be evaluated.
+                template<typename T> double log_prob_delta(const T& current, const T& proposed,
+                                                           size_t fibre_i) {
+                    
+                    if (!scale)
+                        return 0.0;
+                    
+                    return log_prob(proposed[fibre_i]) - log_prob(current[fibre_i]);
+                    
+                }
+                
                 template<typename T> double log_prob(const T strand, T gradient,
                                                      typename T::Tensor hessian) {
                     throw Exception("Not implemented yet.");
@@ -327,6 +340,17 @@ namespace FTS {
                     throw Exception("Not implemented yet.");
                 }
                 
+                template<typename T> double log_prob_and_fisher(const T strand, T gradient,
+                                                                Math::BlockSparse& fisher) {
+                    throw Exception("Not implemented yet.");
+                }
+                
+                template<typename T> double log_prob_and_fisher(
+                        const T strand, T gradient, Math::BlockSparse& fisher,
+                        std::vector<Math::BlockSparse>& fisher_gradient) {
+                    throw Exception("Not implemented yet.");
+                }
+                
         };
     
     }
@@ -166,6 +166,41 @@ namespace FTS {
                 return log_prob_and_fisher(w, d_w, G);
                 
             }
+            
+            double BayesLogRegression::log_prob_and_fisher(const MR::Math::Vector<double>& w,
+                                                           MR::Math::Vector<double>& d_w,
+                                                           Math::BlockSparse& G) {
+                
+                MR::Math::Matrix<double> dense_G;
+                
+                double lprob = log_prob_and_fisher(w, d_w, dense_G);
+                
+                G.copy_from(dense_G);
+                
+                return lprob;
+                
+            }
+            
+            double BayesLogRegression::log_prob_and_fisher(const MR::Math::Vector<double>& w,
+                                                           MR::Math::Vector<double>& d_w,
+                                                           Math::BlockSparse& G,
+                                                           std::vector<Math::BlockSparse>& d_G) {
+                
+                MR::Math::Matrix<double> dense_G;
+                std::vector<MCMC::State::Tensor> dense_d_G;
+                
+                double lprob = log_prob_and_fisher(w, d_w, dense_G, dense_d_G);
+                
+                G.copy_from(dense_G);
+                
+                d_G.resize(dense_d_G.size());
+                
+                for (size_t d = 0; d < dense_d_G.size(); ++d)
+                    d_G[d].copy_from(dense_d_G[d]);
+                
+                return lprob;
+                
+            }
         
         }
     
@@ -31,6 +31,7 @@
 #include "math/math.h"
 
 #include "bts/mcmc/state.h"
+#include "bts/math/block_sparse.h"
 
 namespace FTS {
     
@@ -84,6 +85,14 @@ namespace FTS {
                                                MR::Math::Vector<double>& d_w,
                                                MR::Math::Matrix<double>& G,
                                                std::vector<MCMC::State::Tensor>& d_G);
+
+                    //! Block-sparse copies of the dense Fisher information (and gradients), for the Riemannian sampler.
+                    double log_prob_and_fisher(const MR::Math::Vector<double>& w,
+                                               MR::Math::Vector<double>& d_w, Math::BlockSparse& G);
+
+                    double log_prob_and_fisher(const MR::Math::Vector<double>& w,
+                                               MR::Math::Vector<double>& d_w, Math::BlockSparse& G,
+                                               std::vector<Math::BlockSparse>& d_G);
                     
             };
         
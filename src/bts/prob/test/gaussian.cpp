@@ -69,6 +69,39 @@ namespace FTS {
                 return log_prob(state, gradient, fisher);
                 
             }
+            
+            double Gaussian::log_prob_and_fisher(const MCMC::State& state, MCMC::State& gradient,
+                                                 Math::BlockSparse& fisher) {
+                
+                MCMC::State::Tensor dense_fisher(state);
+                
+                double lprob = log_prob_and_fisher(state, gradient, dense_fisher);
+                
+                fisher.copy_from(dense_fisher);
+                
+                return lprob;
+                
+            }
+            
+            double Gaussian::log_prob_and_fisher(const MCMC::State& state, MCMC::State& gradient,
+                                                 Math::BlockSparse& fisher,
+                                                 std::vector<Math::BlockSparse>& fisher_gradient) {
+                
+                MCMC::State::Tensor dense_fisher(state);
+                std::vector<MCMC::State::Tensor> dense_fisher_gradient;
+                
+                double lprob = log_prob_and_fisher(state, gradient, dense_fisher, dense_fisher_gradient);
+                
+                fisher.copy_from(dense_fisher);
+                
+                fisher_gradient.resize(dense_fisher_gradient.size());
+                
+                for (size_t i = 0; i < dense_fisher_gradient.size(); i++)
+                    fisher_gradient[i].copy_from(dense_fisher_gradient[i]);
+                
+                return lprob;
+                
+            }
         
         }
     
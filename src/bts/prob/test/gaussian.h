@@ -29,6 +29,7 @@
 //TODO: remove
 #include "bts/image/expected/buffer.h"
 #include "bts/mcmc/state.h"
+#include "bts/math/block_sparse.h"
 
 namespace FTS {
     
@@ -71,6 +72,14 @@ namespace FTS {
                                                MCMC::State::Tensor& fisher,
                                                std::vector<MCMC::State::Tensor>& fisher_gradient);
 
+                    //! Block-sparse copies of the dense Fisher information (and gradients), for the Riemannian sampler.
+                    double log_prob_and_fisher(const MCMC::State& test_state, MCMC::State& gradient,
+                                               Math::BlockSparse& fisher);
+
+                    double log_prob_and_fisher(const MCMC::State& test_state, MCMC::State& gradient,
+                                               Math::BlockSparse& fisher,
+                                               std::vector<Math::BlockSparse>& fisher_gradient);
+
                     void set_assumed_snr(double assumed_snr, const std::string& ref_b0,
                                          double ref_signal) {
                     }
@@ -29,6 +29,7 @@
 
 #include "bts/mcmc/state.h"
 #include "bts/mcmc/state/tensor.h"
+#include "bts/math/block_sparse.h"
 
 namespace FTS {
     
@@ -115,6 +116,21 @@ namespace FTS {
                     return 0.0;
                 }
                 
+                double log_prob_and_fisher(const MCMC::State& state, MCMC::State& gradient,
+                                           Math::BlockSparse& fisher) {
+                    gradient.zero();
+                    fisher.set_blocks(std::vector<size_t>(1, state.size()));
+                    return 0.0;
+                }
+                
+                double log_prob_and_fisher(const MCMC::State& state, MCMC::State& gradient,
+                                           Math::BlockSparse& fisher,
+                                           std::vector<Math::BlockSparse>& fisher_gradient) {
+                    log_prob_and_fisher(state, gradient, fisher);
+                    fisher_gradient.assign(state.size(), fisher);
+                    return 0.0;
+                }
+                
                 double component_log_prob(const std::string&, const FTS::Fibre::Strand& strand,
                                           FTS::Fibre::Strand& gradient) {
                     gradient.zero();
@@ -0,0 +1,130 @@
+/*
+ Copyright 2009 Brain Research Institute, Melbourne, Australia
+ 
+ Created by Tom Close on 13/03/09.
+ 
+ This file is part of Fourier Tract Sampling (FouTS).
+ 
+ FouTS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ FouTS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with FTS.  If not, see <http://www.gnu.org/licenses/>.
+ 
+ */
+
+#ifndef __bts_utilities_threads_h__
+#define __bts_utilities_threads_h__
+
+#include <vector>
+#include <string>
+#include <exception>
+#include <pthread.h>
+
+#include "bts/common.h"
+
+namespace FTS {
+    
+    namespace Utilities {
+        
+        // A job passed to a thread by 'run_in_threads', along with the messages of any exception it throws.
+        class ThreadCall {
+            
+            public:
+                
+                void* (*function)(void*);
+                void* job;
+                
+                bool failed;
+                std::vector<std::string> messages;
+                
+                ThreadCall()
+                        : function(0), job(0), failed(false) {
+                }
+                
+                static void* run(void* call_ptr) {
+                    
+                    ThreadCall& call = *(ThreadCall*) call_ptr;
+                    
+                    try {
+                        call.function(call.job);
+                    } catch (Exception& e) {
+                        call.failed = true;
+                        for (size_t msg_i = 0; msg_i < e.num(); ++msg_i)
+                            call.messages.push_back(e[msg_i]);
+                    } catch (const std::exception& e) {
+                        call.failed = true;
+                        call.messages.push_back(e.what());
+                    } catch (...) {
+                        call.failed = true;
+                    }
+                    
+                    return 0;
+                    
+                }
+        
+        };
+        
+        //! Runs 'function' on each of 'jobs', the first in the calling thread and the rest in threads of their own, and
+        //! returns once they have all finished. Exceptions thrown by the jobs are caught in their threads and the first
+        //! (in job order) is rethrown in the calling thread after all the threads have been joined. If a thread can't be
+        //! created, the threads that have already been started are joined before throwing. 'task' describes what the
+        //! jobs do in the error messages (e.g. "generate the expected image").
+        template<typename J> void run_in_threads(std::vector<J>& jobs, void* (*function)(void*),
+                                                 const std::string& task) {
+            
+            std::vector<ThreadCall> calls(jobs.size());
+            std::vector<pthread_t> threads(jobs.size());
+            
+            for (size_t job_i = 0; job_i < jobs.size(); ++job_i) {
+                calls[job_i].function = function;
+                calls[job_i].job = &jobs[job_i];
+            }
+            
+            size_t num_started = 1;
+            
+            for (; num_started < jobs.size(); ++num_started)
+                if (pthread_create(&threads[num_started], NULL, ThreadCall::run, &calls[num_started]))
+                    break;
+            
+            // The first job is only run if all the threads were started, as the jobs are abandoned otherwise.
+            if (jobs.size() && num_started == jobs.size())
+                ThreadCall::run(&calls[0]);
+            
+            for (size_t job_i = 1; job_i < num_started; ++job_i)
+                pthread_join(threads[job_i], NULL);
+            
+            if (num_started < jobs.size())
+                throw Exception("Could not create thread " + str(num_started) + " to " + task + ".");
+            
+            for (size_t job_i = 0; job_i < jobs.size(); ++job_i)
+                if (calls[job_i].failed) {
+                    
+                    const std::vector<std::string>& messages = calls[job_i].messages;
+                    
+                    if (!messages.size())
+                        throw Exception("Unknown error in thread " + str(job_i) + " while trying to " + task + ".");
+                    
+                    Exception e(messages[0]);
+                    
+                    for (size_t msg_i = 1; msg_i < messages.size(); ++msg_i)
+                        e = Exception(e, messages[msg_i]);
+                    
+                    throw e;
+                    
+                }
+            
+        }
+        
+    }
+
+}
+
+#endif /* __bts_utilities_threads_h__ */
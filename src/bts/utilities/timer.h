@@ -0,0 +1,47 @@
+/*
+ Copyright 2008 Brain Research Institute, Melbourne, Australia
+
+ Written by Thomas G Close, Aug 12, 2010.
+
+ This file is part of MRtrix.
+
+ MRtrix is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ MRtrix is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with MRtrix.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef __bts_utilities_timer_h__
+#define __bts_utilities_timer_h__
+
+#include <time.h>
+
+namespace FTS {
+    
+    namespace Utilities {
+        
+        //! Seconds on a monotonic clock, which isn't affected by changes to the system time, for timing intervals. Unlike
+        //! clock() it measures wall time rather than the processor time of all threads.
+        inline double monotonic_seconds() {
+            
+            timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            
+            return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+            
+        }
+    
+    }
+
+}
+
+#endif /* __bts_utilities_timer_h__ */